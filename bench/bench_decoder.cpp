@@ -0,0 +1,230 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * Microbenchmark for the UTF-8 decoder. This compares the table-driven DFA in utf8_dfa.h
+ * against the decoder we used before it, which branched on the IS_*_BYTES macros and then
+ * did a separate range check for each character length. The old decoder is kept below for
+ * reference.
+ *
+ * The corpora are the files in test/vcs_testcases/gen. Each file is repeated until it's
+ * about 4 MB, so that the timings aren't just noise. For every file we also check that
+ * the two decoders agree on whether it's valid. The one expected disagreement is the
+ * "surrogate" file, which the old decoder accepted.
+ *
+ * Both decoders look at every byte, including ASCII, so this measures only the decoding
+ * and not the SIMD skipping of ASCII runs that escape_block does.
+ *
+ * Since each file is just repeated, the branch predictor learns the pattern in the
+ * longer runs. The last corpus is more realistic: the characters from all the valid
+ * files, shuffled.
+ *
+ * Usage: bench_decoder path/to/test/vcs_testcases/gen
+ * This isn't part of the tests. Build it in release mode or the numbers are meaningless.
+ */
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/utf8_dfa.h"
+
+#define TWO_BYTE_MASK   0b11100000u
+#define TWO_BYTE_VAL    0b11000000u
+#define IS_TWO_BYTES(x) ((TWO_BYTE_MASK & x) == TWO_BYTE_VAL)
+
+#define THREE_BYTE_MASK 0b11110000u
+#define THREE_BYTE_VAL  0b11100000u
+#define IS_THREE_BYTES(x) ((THREE_BYTE_MASK & x) == THREE_BYTE_VAL)
+
+#define FOUR_BYTE_MASK  0b11111000u
+#define FOUR_BYTE_VAL   0b11110000u
+#define IS_FOUR_BYTES(x) ((FOUR_BYTE_MASK & x) == FOUR_BYTE_VAL)
+
+/**
+ * The result of decoding a buffer: whether it was valid, and the sum of all the decoded
+ * code points (which keeps the compiler from optimizing the decoding away, and lets us
+ * check that the two decoders decoded the same thing).
+ */
+struct DecodeResult {
+    bool valid;
+    std::uint_fast64_t checksum;
+};
+
+/**
+ * The old decoder, as it was in read_and_escape before the DFA was added.
+ */
+static DecodeResult decode_macros(const std::vector<unsigned char>& data) {
+    DecodeResult result = {true, 0};
+    std::size_t i = 0;
+    const std::size_t len = data.size();
+    while (i < len) {
+        unsigned char byte = data[i++];
+        if (byte <= 127) {
+            result.checksum += byte;
+            continue;
+        }
+        int numbytes;
+        unsigned char mask;
+        if (IS_TWO_BYTES(byte)) {
+            numbytes = 2;
+            mask = 0b00011111u;
+        } else if (IS_THREE_BYTES(byte)) {
+            numbytes = 3;
+            mask = 0b00001111u;
+        } else if (IS_FOUR_BYTES(byte)) {
+            numbytes = 4;
+            mask = 0b00000111u;
+        } else {
+            result.valid = false;
+            return result;
+        }
+        std::uint_fast32_t decoded_char = (byte & mask);
+        for (int j = 1; j < numbytes; ++j) {
+            if (i == len) {
+                result.valid = false;
+                return result;
+            }
+            byte = data[i++];
+            if ((byte & 0b11000000u) != 0b10000000u) {
+                result.valid = false;
+                return result;
+            }
+            decoded_char <<= 6u;
+            decoded_char |= static_cast<std::uint_fast32_t>(byte & 0b00111111u);
+        }
+        if ((numbytes == 2 && (decoded_char < 0x80u || decoded_char > 0x7FFu)) ||
+            (numbytes == 3 && (decoded_char < 0x800u || decoded_char > 0xFFFFu)) ||
+            (numbytes == 4 && (decoded_char < 0x10000u || decoded_char > 0x10FFFFu))) {
+            result.valid = false;
+            return result;
+        }
+        result.checksum += decoded_char;
+    }
+    return result;
+}
+
+/**
+ * The DFA decoder from utf8_dfa.h.
+ */
+static DecodeResult decode_dfa(const std::vector<unsigned char>& data) {
+    DecodeResult result = {true, 0};
+    std::uint_fast32_t state = UTF8_ACCEPT;
+    std::uint_fast32_t codepoint = 0;
+    for (unsigned char byte : data) {
+        // Like escape_block, ASCII at a character boundary doesn't go through the DFA.
+        if (byte < 0x80 && state == UTF8_ACCEPT) {
+            result.checksum += byte;
+            continue;
+        }
+        utf8_dfa_step(state, codepoint, byte);
+        if (state == UTF8_ACCEPT) {
+            result.checksum += codepoint;
+        } else if (state == UTF8_REJECT) {
+            result.valid = false;
+            return result;
+        }
+    }
+    result.valid = (state == UTF8_ACCEPT);
+    return result;
+}
+
+/**
+ * Runs decode repeatedly on data for roughly a quarter of a second and returns the
+ * throughput in MB/s. The result of the last run is stored in result.
+ */
+static double throughput(DecodeResult (*decode)(const std::vector<unsigned char>&),
+                         const std::vector<unsigned char>& data, DecodeResult& result) {
+    long runs = 0;
+    auto start = std::chrono::steady_clock::now();
+    double seconds = 0;
+    do {
+        result = decode(data);
+        ++runs;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (seconds < 0.25);
+    return static_cast<double>(data.size()) * static_cast<double>(runs) / seconds / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: bench_decoder path/to/test/vcs_testcases/gen" << std::endl;
+        return 5;
+    }
+    const std::string gen_dir(argv[1]);
+    const char *names[] = {
+        "control", "holamundo", "shortmix", "whitespace", "len6", "boundary_success",
+        "255", "bad4byte", "truncate", "boundary_fail_2byte", "boundary_fail_3byte",
+        "boundary_fail_4byte", "surrogate",
+    };
+    const std::size_t target_size = 4 * 1024 * 1024;
+
+    std::cout << std::left << std::setw(22) << "corpus" << std::right << std::setw(8) << "valid"
+              << std::setw(14) << "macros" << std::setw(14) << "DFA" << "\n";
+    std::vector<unsigned char> all_valid;
+    for (const char *name : names) {
+        std::ifstream file(gen_dir + "/" + name, std::ios_base::binary);
+        if (!file) {
+            std::cerr << "Failed to open " << gen_dir << "/" << name << std::endl;
+            return 1;
+        }
+        std::vector<unsigned char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        DecodeResult once = decode_dfa(contents);
+        // Valid files get repeated; invalid ones are timed as-is, since both decoders stop early anyway.
+        std::vector<unsigned char> data;
+        if (once.valid && !contents.empty()) {
+            while (data.size() < target_size) {
+                data.insert(data.end(), contents.begin(), contents.end());
+            }
+            all_valid.insert(all_valid.end(), contents.begin(), contents.end());
+        } else {
+            data = contents;
+        }
+
+        DecodeResult old_result, new_result;
+        double old_mbps = throughput(decode_macros, data, old_result);
+        double new_mbps = throughput(decode_dfa, data, new_result);
+        std::cout << std::left << std::setw(22) << name << std::right << std::setw(8)
+                  << (new_result.valid ? "yes" : "no") << std::fixed << std::setprecision(0)
+                  << std::setw(9) << old_mbps << " MB/s" << std::setw(9) << new_mbps << " MB/s";
+        if (old_result.valid != new_result.valid) {
+            std::cout << "  (old decoder says " << (old_result.valid ? "valid" : "invalid") << ")";
+        } else if (new_result.valid && old_result.checksum != new_result.checksum) {
+            std::cerr << "\nThe decoders disagree on the contents of " << name << std::endl;
+            return 1;
+        }
+        std::cout << "\n";
+    }
+
+    // Finally, the characters from all of the valid files shuffled together. This is the
+    // hardest case for branch prediction, since the length of the next character is random.
+    std::vector<std::vector<unsigned char>> chars;
+    std::uint_fast32_t state = UTF8_ACCEPT;
+    std::uint_fast32_t codepoint = 0;
+    for (unsigned char byte : all_valid) {
+        if (state == UTF8_ACCEPT) {
+            chars.emplace_back();
+        }
+        chars.back().push_back(byte);
+        utf8_dfa_step(state, codepoint, byte);
+    }
+    std::mt19937 rng(12345);
+    std::vector<unsigned char> mixed;
+    while (mixed.size() < target_size) {
+        const std::vector<unsigned char>& c = chars[rng() % chars.size()];
+        mixed.insert(mixed.end(), c.begin(), c.end());
+    }
+    DecodeResult old_result, new_result;
+    double old_mbps = throughput(decode_macros, mixed, old_result);
+    double new_mbps = throughput(decode_dfa, mixed, new_result);
+    std::cout << std::left << std::setw(22) << "all valid, shuffled" << std::right << std::setw(8) << "yes"
+              << std::fixed << std::setprecision(0) << std::setw(9) << old_mbps << " MB/s"
+              << std::setw(9) << new_mbps << " MB/s\n";
+    return 0;
+}
@@ -0,0 +1,127 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * Microbenchmark for construct_escape_string. This compares the current table-driven
+ * implementation against the old std::stringstream implementation, which is kept below
+ * for reference. It prints the average time per escaped character for a few different
+ * kinds of characters.
+ *
+ * Usage: bench_escape_string [ITERATIONS]
+ * This isn't part of the tests. Build it in release mode or the numbers are meaningless.
+ */
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <ios>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "../src/escape_kernel.h"
+
+/**
+ * This is construct_escape_string as it was before the lookup tables were added.
+ */
+static std::size_t construct_escape_string_stringstream(unsigned char *buf, std::uint_fast32_t codepoint) {
+    std::stringstream stream;
+    if (codepoint < 0x1000u) { // If number is less than 4 chars, pad it
+        stream << std::setfill('0') << std::setw(4);
+    }
+    stream << std::hex << std::uppercase << codepoint;
+    stream.read(reinterpret_cast<char *>(buf + 3), 6);
+    auto num_chars_read = stream.gcount();
+    assert(num_chars_read >= 4 && num_chars_read <= 6);
+    std::size_t idx_of_ending_singlequote = static_cast<std::size_t>(num_chars_read + 3);
+    buf[idx_of_ending_singlequote] = '\'';
+    return idx_of_ending_singlequote + 1;
+}
+
+typedef std::size_t (*EscapeFn)(unsigned char *, std::uint_fast32_t);
+
+// Where time_per_char stores its total, so that the compiler can't throw the calls away.
+static volatile std::size_t sink;
+
+/**
+ * Escapes every code point in codepoints, iterations times over, and returns the
+ * average number of nanoseconds per escaped character.
+ */
+static double time_per_char(EscapeFn fn, const std::vector<std::uint_fast32_t>& codepoints, long iterations) {
+    unsigned char buf[10] = {'\\', 'u', '\''};
+    // Accumulate the lengths (and a byte of each output), and store them in sink at the end.
+    std::size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long it = 0; it < iterations; ++it) {
+        for (std::uint_fast32_t codepoint : codepoints) {
+            total += fn(buf, codepoint);
+            total += buf[3];
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    sink = total;
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    return ns / (static_cast<double>(codepoints.size()) * static_cast<double>(iterations));
+}
+
+/**
+ * Returns n code points spread evenly over [low, high).
+ */
+static std::vector<std::uint_fast32_t> spread(std::uint_fast32_t low, std::uint_fast32_t high, std::size_t n) {
+    std::vector<std::uint_fast32_t> codepoints;
+    for (std::size_t i = 0; i < n; ++i) {
+        codepoints.push_back(low + static_cast<std::uint_fast32_t>((high - low) * i / n));
+    }
+    return codepoints;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = 200;
+    if (argc > 1) {
+        iterations = std::atol(argv[1]);
+        if (iterations <= 0) {
+            std::cerr << "ITERATIONS must be a positive number." << std::endl;
+            return 5;
+        }
+    }
+
+    // Before timing anything, check that the two implementations agree everywhere.
+    for (std::uint_fast32_t codepoint = 0; codepoint <= 0x10FFFFu; codepoint += 7) {
+        unsigned char expected[10] = {'\\', 'u', '\''};
+        unsigned char actual[10] = {'\\', 'u', '\''};
+        std::size_t expected_len = construct_escape_string_stringstream(expected, codepoint);
+        std::size_t actual_len = construct_escape_string(actual, codepoint);
+        if (expected_len != actual_len || std::memcmp(expected, actual, actual_len) != 0) {
+            std::cerr << "Mismatch for code point 0x" << std::hex << codepoint << std::endl;
+            return 1;
+        }
+    }
+
+    struct Case {
+        const char *name;
+        std::vector<std::uint_fast32_t> codepoints;
+    };
+    const Case cases[] = {
+        {"control (8 bytes)", spread(0x0, 0x20, 1000)},
+        {"Latin-1 (8 bytes)", spread(0x80, 0x100, 1000)},
+        {"CJK (8 bytes)", spread(0x4E00, 0xA000, 1000)},
+        {"emoji (9 bytes)", spread(0x1F300, 0x1FAFF, 1000)},
+        {"plane 16 (10 bytes)", spread(0x100000, 0x110000, 1000)},
+    };
+
+    std::cout << std::left << std::setw(22) << "characters" << std::right
+              << std::setw(16) << "stringstream" << std::setw(16) << "tables" << std::setw(10) << "speedup" << "\n";
+    for (const Case& c : cases) {
+        // The old implementation is so slow that we give it fewer iterations.
+        long old_iterations = iterations / 20 > 0 ? iterations / 20 : 1;
+        double old_ns = time_per_char(construct_escape_string_stringstream, c.codepoints, old_iterations);
+        double new_ns = time_per_char(construct_escape_string, c.codepoints, iterations);
+        std::cout << std::left << std::setw(22) << c.name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(13) << old_ns << " ns" << std::setw(13) << new_ns << " ns"
+                  << std::setw(9) << (old_ns / new_ns) << "x\n";
+    }
+    return 0;
+}
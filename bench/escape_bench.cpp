@@ -0,0 +1,459 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * Benchmark suite for the escaping engines. Unlike the microbenchmarks in this directory,
+ * which time one function in isolation, this runs each of the ways the escape program can
+ * escape a whole input, on synthetic corpora of any size, and reports the throughput.
+ * Run it before and after a change to catch performance regressions.
+ *
+ * Corpora (each is generated in memory, from a fixed seed, so runs are comparable):
+ *   ascii        Printable ASCII text with line breaks. Nothing needs escaping.
+ *   latin1       Mostly ASCII, with about 1 character in 6 from the Latin-1 Supplement
+ *                (U+00A0 to U+00FF), like Western European text.
+ *   cjk          CJK Unified Ideographs (3 bytes each), with some ASCII punctuation.
+ *   emoji        Emoji (4 bytes each) separated by spaces.
+ *   control      Half ASCII control characters, which each become 8 bytes of output.
+ *   alternating  "a" followed by U+00E9, over and over. This is the worst case for the
+ *                SIMD scanning, since no run of pass-through bytes is longer than 1.
+ *   mix          A weighted mix of the above, chosen per character. See --mix.
+ *
+ * Engines:
+ *   kernel           escape_block on 64 KB blocks, with no I/O at all. This is the upper bound.
+ *   read_and_escape  read_and_escape reading from a string source (the path for stdin and pipes).
+ *   mapped           read_and_escape reading from a memory-mapped file (the path for input
+ *                    files), writing to a sink without a file descriptor.
+ *   zero_copy        The same, but writing to /dev/null through a file descriptor, which
+ *                    is the zero-copy path on Linux.
+ *   io_uring         read_and_escape reading from a file descriptor with io_uring.
+ *   parallel         parallel_read_and_escape (--threads), with --threads threads. Given a
+ *                    list of thread counts, such as --threads 1,2,4,8,16,32, it runs once
+ *                    for each, and reports each as parallel:N.
+ * The engines that need a file write the corpus to a temporary file in the current
+ * directory first. Output goes to a sink that throws it away, or to /dev/null.
+ *
+ * --kernel picks the version of the scanning code to use (see ascii_scan.h), like the escape
+ * program's --kernel; by default it's the fastest one this CPU can run. Run once per tier to
+ * compare them.
+ *
+ * With --stats, every engine but kernel counts what --stats reports (see stats.h) as it goes.
+ * Compare the numbers with and without it to see what the counting costs.
+ *
+ * Reported numbers are for the fastest of --repeat runs: GB/s and ns per input byte, and
+ * CPU cycles per input byte (counted in user and kernel mode, across all threads) if
+ * perf_event_open is available. It usually isn't in containers and VMs, or when
+ * /proc/sys/kernel/perf_event_paranoid is above 2.
+ *
+ * Thread scaling: escape_bench --corpus mix --engine parallel --threads 1,2,4,8,16,32
+ * measures how --threads scales. On the single-core VM we have, 64 MB of mix (GB/s, best
+ * of 5):
+ *   threads   1     2     4     8     16    32
+ *   GB/s      0.17  0.17  0.18  0.16  0.15  0.15
+ * which is flat, as it has to be with one core, and only shows that the extra threads cost
+ * little. Run it on a machine with more cores for the real scaling.
+ *
+ * Usage: escape_bench [--size MB] [--corpus NAME,...] [--engine NAME,...] [--mix NAME:WEIGHT,...]
+ *                     [--repeat N] [--threads N,...] [--kernel TIER] [--stats] [--csv]
+ * This isn't part of the tests. Build it in release mode or the numbers are meaningless.
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio> // std::remove
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/BlockIO.h"
+#include "../src/MappedFile.h"
+#include "../src/StreamPair.h"
+#include "../src/ascii_scan.h"
+#include "../src/business_logic.h"
+#include "../src/escape_kernel.h"
+#include "../src/parallel_escape.h"
+#include "../src/stats.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const char *const TEMP_FILE = "escape_bench_corpus.tmp";
+
+/**
+ * Appends the UTF-8 encoding of codepoint to out.
+ */
+static void append_utf8(std::string& out, std::uint_fast32_t codepoint) {
+    if (codepoint < 0x80) {
+        out += static_cast<char>(codepoint);
+    } else if (codepoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codepoint >> 6));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else if (codepoint < 0x10000) {
+        out += static_cast<char>(0xE0 | (codepoint >> 12));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (codepoint >> 18));
+        out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+}
+
+/**
+ * Appends one character of the named corpus to out. column is the number of characters
+ * since the last line break, which the text-like corpora use to add line breaks.
+ */
+static bool append_char(const std::string& corpus, std::mt19937& rng, std::string& out, int& column) {
+    ++column;
+    if ((corpus == "ascii" || corpus == "latin1" || corpus == "cjk") && column >= 80) {
+        out += '\n';
+        column = 0;
+        return true;
+    }
+    if (corpus == "ascii") {
+        append_utf8(out, 32 + rng() % 95);
+    } else if (corpus == "latin1") {
+        append_utf8(out, (rng() % 6 == 0) ? 0xA0 + rng() % 0x60 : 32 + rng() % 95);
+    } else if (corpus == "cjk") {
+        append_utf8(out, (rng() % 10 == 0) ? static_cast<std::uint_fast32_t>(". ,"[rng() % 3]) : 0x4E00 + rng() % 0x5200);
+    } else if (corpus == "emoji") {
+        append_utf8(out, (rng() % 2 == 0) ? 0x20 : 0x1F300 + rng() % 0x700);
+    } else if (corpus == "control") {
+        std::uint_fast32_t c = (rng() % 2 == 0) ? rng() % 32 : 32 + rng() % 95;
+        append_utf8(out, (c == 9 || c == 10 || c == 13) ? 0x7F : c);
+    } else if (corpus == "alternating") {
+        append_utf8(out, (out.size() % 3 == 0) ? 'a' : 0xE9);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Generates about size bytes of a corpus. For "mix", weights gives the corpus to use for
+ * each character, chosen at random in proportion to the weights.
+ * @return False if the corpus name isn't known.
+ */
+static bool generate(const std::string& corpus, std::size_t size,
+                     const std::vector<std::pair<std::string, unsigned>>& weights, std::string& out) {
+    std::mt19937 rng(20261017);
+    out.clear();
+    out.reserve(size + 4);
+    int column = 0;
+    unsigned total_weight = 0;
+    for (const auto& w : weights) {
+        total_weight += w.second;
+    }
+    while (out.size() < size) {
+        std::string name = corpus;
+        if (corpus == "mix") {
+            if (total_weight == 0) {
+                return false;
+            }
+            unsigned pick = rng() % total_weight;
+            for (const auto& w : weights) {
+                if (pick < w.second) {
+                    name = w.first;
+                    break;
+                }
+                pick -= w.second;
+            }
+        }
+        if (!append_char(name, rng, out, column)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Counts CPU cycles with perf_event_open, for this thread and any threads it starts.
+ */
+class CycleCounter {
+public:
+    CycleCounter() : fd(-1) {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        attr.disabled = 1;
+        attr.inherit = 1; // Also count the worker and I/O threads.
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd == -1) {
+            attr.exclude_kernel = 1; // perf_event_paranoid == 2 only allows user mode.
+            fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    ~CycleCounter() {
+#ifdef __linux__
+        if (fd != -1) {
+            close(fd);
+        }
+#endif
+    }
+
+    bool available() const { return fd != -1; }
+
+    void start() {
+#ifdef __linux__
+        if (fd != -1) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // Returns the number of cycles since start(), or 0 if counting isn't available.
+    std::uint64_t stop() {
+        std::uint64_t count = 0;
+#ifdef __linux__
+        if (fd != -1) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+                count = 0;
+            }
+        }
+#endif
+        return count;
+    }
+
+private:
+    int fd;
+};
+
+/**
+ * Makes a StreamPair that reads from corpus and throws the output away (so that we measure
+ * the escaping and not the growth of a std::string), with no file descriptors, so
+ * read_and_escape uses the path for stdin and pipes.
+ */
+static StreamPair stream_pair(const std::string& corpus) {
+    return StreamPair(ByteSource::from_string(corpus), ByteSink::discard());
+}
+
+/**
+ * Runs the named engine once on corpus.
+ * @return The exit code from the engine (0 for valid input), or -1 if the engine isn't known
+ * or isn't available on this system.
+ */
+static int run_engine(const std::string& engine, const std::string& corpus, unsigned threads, EscapeStats *stats) {
+    if (engine == "kernel") {
+        static const std::size_t block = 65536;
+        std::vector<unsigned char> out(escape_output_bound(block));
+        EscapeState state;
+        const unsigned char *data = reinterpret_cast<const unsigned char *>(corpus.data());
+        for (std::size_t i = 0; i < corpus.size() && !state.invalid; i += block) {
+            std::size_t len = std::min(block, corpus.size() - i);
+            escape_block(state, data + i, len, out.data());
+        }
+        return (state.invalid || !state.at_boundary()) ? 2 : 0;
+    } else if (engine == "read_and_escape") {
+        StreamPair streams = stream_pair(corpus);
+        return read_and_escape(streams, EscapeSettings(), false, stats);
+    } else if (engine == "parallel") {
+        StreamPair streams = stream_pair(corpus);
+        return parallel_read_and_escape(streams, threads, EscapeSettings(), stats);
+    } else if (engine == "mapped") {
+        StreamPair streams = stream_pair("");
+        streams.mapped = MappedFile::open(TEMP_FILE);
+        return streams.mapped ? read_and_escape(streams, EscapeSettings(), false, stats) : -1;
+    }
+#ifdef __linux__
+    if (engine == "zero_copy") {
+        StreamPair streams(ByteSource::from_string(""), ByteSink::open_file("/dev/null"));
+        streams.mapped = MappedFile::open(TEMP_FILE);
+        return streams.mapped ? read_and_escape(streams, EscapeSettings(), false, stats) : -1;
+    } else if (engine == "io_uring") {
+        int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        int in_fd = open(TEMP_FILE, O_RDONLY | O_CLOEXEC);
+        std::unique_ptr<BlockIO> io = make_uring_io(in_fd, null_fd, 65536);
+        int retval = -1;
+        if (io) {
+            // This is what read_and_escape does once it has picked io_uring.
+            int escape_with_block_io(BlockIO& io, const EscapeSettings& settings, EscapeStats *stats);
+            retval = escape_with_block_io(*io, EscapeSettings(), stats);
+        }
+        io.reset();
+        close(in_fd);
+        close(null_fd);
+        return retval;
+    }
+#endif
+    return -1;
+}
+
+/**
+ * Splits a comma-separated list.
+ */
+static std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> result;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            result.push_back(item);
+        }
+    }
+    return result;
+}
+
+static int usage() {
+    std::cerr << "Usage: escape_bench [--size MB] [--corpus NAME,...] [--engine NAME,...] [--mix NAME:WEIGHT,...]\n"
+                 "                    [--repeat N] [--threads N,...] [--kernel TIER] [--stats] [--csv]\n"
+                 "Corpora: ascii latin1 cjk emoji control alternating mix\n"
+                 "Engines: kernel read_and_escape mapped zero_copy io_uring parallel\n"
+                 "Kernel tiers: scalar swar sse2 sse4.2 avx2 avx512" << std::endl;
+    return 5;
+}
+
+int main(int argc, char *argv[]) {
+    std::size_t size_mb = 64;
+    std::vector<std::string> corpora = split("ascii,latin1,cjk,emoji,control,alternating,mix");
+    std::vector<std::string> engines = split("kernel,read_and_escape,mapped,zero_copy,io_uring,parallel");
+    std::vector<std::pair<std::string, unsigned>> weights = {{"ascii", 70}, {"latin1", 10}, {"cjk", 10}, {"emoji", 5}, {"control", 5}};
+    int repeat = 5;
+    std::vector<unsigned> thread_counts = {0}; // One per core
+    bool csv = false;
+    bool with_stats = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool has_value = (i + 1 < argc);
+        if (arg == "--csv") {
+            csv = true;
+        } else if (arg == "--stats") {
+            with_stats = true;
+        } else if (arg == "--size" && has_value) {
+            size_mb = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--corpus" && has_value) {
+            corpora = split(argv[++i]);
+        } else if (arg == "--engine" && has_value) {
+            engines = split(argv[++i]);
+        } else if (arg == "--repeat" && has_value) {
+            repeat = std::atoi(argv[++i]);
+        } else if (arg == "--threads" && has_value) {
+            thread_counts.clear();
+            for (const std::string& item : split(argv[++i])) {
+                thread_counts.push_back(static_cast<unsigned>(std::strtoul(item.c_str(), nullptr, 10)));
+            }
+        } else if (arg == "--kernel" && has_value) {
+            KernelTier tier;
+            if (!parse_kernel_tier(argv[++i], tier) || !set_kernel_tier(tier)) {
+                std::cerr << "Unknown kernel tier, or one this CPU can't run: " << argv[i] << std::endl;
+                return usage();
+            }
+        } else if (arg == "--mix" && has_value) {
+            weights.clear();
+            for (const std::string& item : split(argv[++i])) {
+                std::size_t colon = item.find(':');
+                if (colon == std::string::npos) {
+                    return usage();
+                }
+                weights.emplace_back(item.substr(0, colon), static_cast<unsigned>(std::strtoul(item.c_str() + colon + 1, nullptr, 10)));
+            }
+        } else {
+            return usage();
+        }
+    }
+    if (size_mb == 0 || repeat <= 0 || thread_counts.empty()) {
+        return usage();
+    }
+
+    CycleCounter cycles;
+    if (csv) {
+        std::cout << "corpus,engine,bytes,gb_per_s,ns_per_byte,cycles_per_byte\n";
+    } else {
+        std::cout << std::left << std::setw(13) << "corpus" << std::setw(17) << "engine" << std::right
+                  << std::setw(10) << "GB/s" << std::setw(10) << "ns/byte" << std::setw(14) << "cycles/byte" << "\n";
+    }
+
+    std::string corpus;
+    for (const std::string& name : corpora) {
+        if (!generate(name, size_mb * 1024 * 1024, weights, corpus)) {
+            std::cerr << "Unknown corpus (or an unknown corpus in --mix): " << name << std::endl;
+            return usage();
+        }
+        {
+            std::ofstream file(TEMP_FILE, std::ios_base::binary);
+            file.write(corpus.data(), static_cast<std::streamsize>(corpus.size()));
+        }
+        // Each engine, and the parallel one once for each thread count.
+        std::vector<std::pair<std::string, unsigned>> runs;
+        for (const std::string& engine : engines) {
+            if (engine == "parallel" && thread_counts.size() > 1) {
+                for (unsigned threads : thread_counts) {
+                    runs.emplace_back(engine, threads);
+                }
+            } else {
+                runs.emplace_back(engine, thread_counts[0]);
+            }
+        }
+        for (const auto& run : runs) {
+            const std::string& engine = run.first;
+            const unsigned threads = run.second;
+            const std::string label = (engine == "parallel" && thread_counts.size() > 1)
+                                      ? engine + ":" + std::to_string(threads) : engine;
+            double best_seconds = 0;
+            std::uint64_t best_cycles = 0;
+            bool ok = true;
+            for (int r = 0; r < repeat && ok; ++r) {
+                std::unique_ptr<EscapeStats> stats(with_stats ? new EscapeStats() : nullptr);
+                cycles.start();
+                auto start = std::chrono::steady_clock::now();
+                int retval = run_engine(engine, corpus, threads, stats.get());
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                std::uint64_t count = cycles.stop();
+                if (retval != 0) {
+                    ok = false; // Unknown or unavailable engine
+                } else if (r == 0 || seconds < best_seconds) {
+                    best_seconds = seconds;
+                    best_cycles = count;
+                }
+            }
+            double bytes = static_cast<double>(corpus.size());
+            if (csv) {
+                std::cout << name << "," << label << "," << corpus.size() << ",";
+                if (ok) {
+                    std::cout << bytes / best_seconds / 1e9 << "," << best_seconds * 1e9 / bytes << ",";
+                    if (cycles.available()) {
+                        std::cout << static_cast<double>(best_cycles) / bytes;
+                    }
+                } else {
+                    std::cout << ",,";
+                }
+                std::cout << "\n";
+            } else {
+                std::cout << std::left << std::setw(13) << name << std::setw(17) << label << std::right << std::fixed;
+                if (ok) {
+                    std::cout << std::setprecision(2) << std::setw(10) << bytes / best_seconds / 1e9
+                              << std::setprecision(3) << std::setw(10) << best_seconds * 1e9 / bytes;
+                    if (cycles.available()) {
+                        std::cout << std::setprecision(2) << std::setw(14) << static_cast<double>(best_cycles) / bytes;
+                    } else {
+                        std::cout << std::setw(14) << "n/a";
+                    }
+                } else {
+                    std::cout << std::setw(34) << "not available";
+                }
+                std::cout << std::endl;
+            }
+        }
+    }
+    std::remove(TEMP_FILE);
+    return 0;
+}
@@ -0,0 +1,198 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * Load generator for escape --serve (see src/serve.h). It opens --clients connections to a
+ * running server, each on its own thread, and has each one send --requests requests of
+ * --size bytes, keeping up to --pipeline of them in flight at a time. Then it reports the
+ * throughput and the latency percentiles, where a request's latency is the time from just
+ * before it's sent until its whole response has arrived.
+ *
+ * The input is a mix of ASCII text and other characters (about 1 in 8), from a fixed seed,
+ * and the same for every request. Every response has to have status 0, or this stops with
+ * exit code 1.
+ *
+ * Usage: serve_load SOCKET [--clients N] [--requests N] [--size BYTES] [--pipeline N]
+ * The defaults are 4 clients, 10000 requests each, 200 bytes and a pipeline of 1. Start the
+ * server first, for example with "escape --serve /tmp/escape.sock". This isn't part of the
+ * tests; build it in release mode or the numbers are meaningless.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/serve.h"
+#include "../src/serve_client.h"
+
+#ifdef __linux__
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Appends the UTF-8 encoding of codepoint to out.
+ */
+static void append_utf8(std::string& out, std::uint_fast32_t codepoint) {
+    if (codepoint < 0x80) {
+        out += static_cast<char>(codepoint);
+    } else if (codepoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codepoint >> 6));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else {
+        out += static_cast<char>(0xE0 | (codepoint >> 12));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+}
+
+/**
+ * Makes the input: size bytes, give or take a character.
+ */
+static std::string make_payload(std::size_t size) {
+    std::mt19937 rng(12345);
+    std::string payload;
+    while (payload.size() < size) {
+        if (rng() % 8 == 0) {
+            append_utf8(payload, (rng() % 2 == 0) ? 0xA0 + rng() % 0x60 : 0x4E00 + rng() % 0x5200);
+        } else {
+            append_utf8(payload, 32 + rng() % 95);
+        }
+    }
+    return payload;
+}
+
+/**
+ * What one client did: the latency of each request, in nanoseconds.
+ */
+struct ClientResult {
+    std::vector<std::int64_t> latencies;
+    bool ok;
+};
+
+/**
+ * Runs one client to completion.
+ */
+static void run_client(const std::string& path, const std::string& payload, unsigned long requests, unsigned long pipeline,
+                       ClientResult& result) {
+    result.ok = false;
+    result.latencies.reserve(requests);
+    std::unique_ptr<ServeClient> client = ServeClient::connect(path);
+    if (!client) {
+        std::cerr << "Failed to connect to \"" << path << "\"." << std::endl;
+        return;
+    }
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(payload.data());
+    std::deque<Clock::time_point> in_flight;
+    std::string output;
+    unsigned long sent = 0;
+    while (result.latencies.size() < requests) {
+        while (sent < requests && in_flight.size() < pipeline) {
+            in_flight.push_back(Clock::now());
+            if (!client->send_request(data, payload.size())) {
+                std::cerr << "Lost the connection to the server." << std::endl;
+                return;
+            }
+            ++sent;
+        }
+        int status;
+        if (!client->receive_response(status, output)) {
+            std::cerr << "Lost the connection to the server." << std::endl;
+            return;
+        }
+        result.latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - in_flight.front()).count());
+        in_flight.pop_front();
+        if (status != SERVE_OK) {
+            std::cerr << "The server sent back status " << status << "." << std::endl;
+            return;
+        }
+    }
+    result.ok = true;
+}
+
+static int usage() {
+    std::cerr << "Usage: serve_load SOCKET [--clients N] [--requests N] [--size BYTES] [--pipeline N]" << std::endl;
+    return 5;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        return usage();
+    }
+    const std::string path(argv[1]);
+    unsigned long clients = 4;
+    unsigned long requests = 10000;
+    unsigned long size = 200;
+    unsigned long pipeline = 1;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (i + 1 == argc) {
+            return usage();
+        }
+        unsigned long value = std::strtoul(argv[++i], nullptr, 10);
+        if (arg == "--clients") {
+            clients = value;
+        } else if (arg == "--requests") {
+            requests = value;
+        } else if (arg == "--size") {
+            size = value;
+        } else if (arg == "--pipeline") {
+            pipeline = value;
+        } else {
+            return usage();
+        }
+    }
+    if (clients == 0 || requests == 0 || pipeline == 0 || size > SERVE_MAX_REQUEST) {
+        return usage();
+    }
+
+    const std::string payload = make_payload(size);
+    std::vector<ClientResult> results(clients);
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (unsigned long c = 0; c < clients; ++c) {
+        threads.emplace_back(run_client, std::cref(path), std::cref(payload), requests, pipeline, std::ref(results[c]));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<std::int64_t> latencies;
+    for (const ClientResult& result : results) {
+        if (!result.ok) {
+            return 1;
+        }
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    const double total = static_cast<double>(latencies.size());
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << latencies.size() << " requests of " << payload.size() << " bytes in " << seconds << " s: "
+              << total / seconds << " requests/s, " << total * static_cast<double>(payload.size()) / seconds / 1e6 << " MB/s\n";
+    std::cout << "latency (us):";
+    const double percentiles[] = {50, 90, 99, 99.9};
+    for (double p : percentiles) {
+        std::size_t index = static_cast<std::size_t>(p / 100 * (total - 1));
+        std::cout << "  p" << std::setprecision(p == 99.9 ? 1 : 0) << p << " " << std::setprecision(1)
+                  << static_cast<double>(latencies[index]) / 1000;
+    }
+    std::cout << "  max " << static_cast<double>(latencies.back()) / 1000 << std::endl;
+    return 0;
+}
+
+#else
+
+int main() {
+    std::cerr << "serve_load only works on Linux, like escape --serve." << std::endl;
+    return 5;
+}
+
+#endif
@@ -121,6 +121,11 @@ class BusinessLogic {
                     System.err.println(MALFORMED);
                     return 2;
                 }
+                // UTF-16 surrogates (U+D800 through U+DFFF) can't be encoded in UTF-8.
+                if (numbytes == 3 && (0xD800 <= decodedChar && decodedChar <= 0xDFFF)) {
+                    System.err.println(MALFORMED);
+                    return 2;
+                }
                 if (numbytes == 4 && (decodedChar < 0x10000 || decodedChar > 0x10FFFF)) {
                     System.err.println(MALFORMED);
                     return 2;
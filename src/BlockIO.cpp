@@ -0,0 +1,488 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <algorithm> // std::min
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility> // std::move
+
+#include "BlockIO.h"
+
+#ifdef ESCAPE_HAVE_IO_URING
+#include <cerrno>
+#include <cstring> // std::memcpy, std::memset
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/*
+ * ThreadIO
+ *   The reader thread and the writer thread each wait for a request, do one blocking call
+ *   on the source or the sink, and hand back the result. Only the reader touches the
+ *   source and only the writer touches the sink, so they don't have to be thread-safe.
+ *
+ *   The one awkward case is destroying a ThreadIO while the reader is in the middle of a
+ *   read. That happens when the input turns out to be invalid and there's more input
+ *   behind it, and the read could block for a long time (on a terminal, until the user
+ *   types more). We don't want to wait for it, so the reader is detached, and everything
+ *   it uses is kept in a shared_ptr that it holds on to. That's why the source is moved
+ *   in there, out of the StreamPair. The process exits soon after.
+ *
+ *   The writer can't outlive the ThreadIO, so it just uses the StreamPair's sink. Each
+ *   block of output is written straight from the caller's buffer (write_unbuffered),
+ *   since copying it into the sink's buffer wouldn't save anything.
+ */
+
+struct ThreadShared {
+    explicit ThreadShared(ByteSource&& in) : in(std::move(in)) {}
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    ByteSource in;
+    ByteSink *out;
+    std::unique_ptr<unsigned char[]> buffers[2];
+    std::size_t block_size;
+
+    // The buffer to read into next, or null if no read has been requested.
+    unsigned char *read_buffer;
+    bool reading; // Between start_read() and the end of wait_read()
+    bool read_done;
+    long read_result;
+
+    // The data to write next, or null if no write has been requested.
+    const unsigned char *write_data;
+    std::size_t write_len;
+    bool write_done;
+    bool write_result;
+
+    bool stopping;
+};
+
+void reader_thread(std::shared_ptr<ThreadShared> shared) {
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    while (true) {
+        shared->cv.wait(lock, [&shared] { return shared->read_buffer != nullptr || shared->stopping; });
+        if (shared->stopping) {
+            return;
+        }
+        unsigned char *buffer = shared->read_buffer;
+        shared->read_buffer = nullptr;
+        lock.unlock();
+
+        // A short read is only an error once we've used up the bytes it did get.
+        long result = static_cast<long>(shared->in.read(buffer, shared->block_size));
+        if (result == 0 && shared->in.error()) {
+            result = -1;
+        }
+
+        lock.lock();
+        shared->read_result = result;
+        shared->read_done = true;
+        shared->cv.notify_all();
+    }
+}
+
+void writer_thread(std::shared_ptr<ThreadShared> shared) {
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    while (true) {
+        shared->cv.wait(lock, [&shared] { return shared->write_data != nullptr || shared->stopping; });
+        if (shared->write_data == nullptr) {
+            return; // We only stop once there's nothing left to write.
+        }
+        const unsigned char *data = shared->write_data;
+        std::size_t len = shared->write_len;
+        shared->write_data = nullptr;
+        lock.unlock();
+
+        bool result = shared->out->write_unbuffered(data, len);
+
+        lock.lock();
+        shared->write_result = result;
+        shared->write_done = true;
+        shared->cv.notify_all();
+    }
+}
+
+class ThreadIO : public BlockIO {
+public:
+    ThreadIO(StreamPair& streams, std::size_t block_size) : BlockIO(block_size), shared(new ThreadShared(std::move(streams.in))) {
+        shared->out = &streams.out;
+        shared->buffers[0].reset(new unsigned char[block_size]);
+        shared->buffers[1].reset(new unsigned char[block_size]);
+        shared->block_size = block_size;
+        shared->read_buffer = nullptr;
+        shared->reading = false;
+        shared->read_done = false;
+        shared->read_result = 0;
+        shared->write_data = nullptr;
+        shared->write_len = 0;
+        shared->write_done = false;
+        shared->write_result = true;
+        shared->stopping = false;
+        reader = std::thread(reader_thread, shared);
+        writer = std::thread(writer_thread, shared);
+    }
+
+    ~ThreadIO() override {
+        bool detach;
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->stopping = true;
+            detach = shared->reading;
+        }
+        shared->cv.notify_all();
+        writer.join();
+        if (detach) {
+            reader.detach(); // See the comment at the top of this file.
+        } else {
+            reader.join();
+        }
+    }
+
+    unsigned char *buffer(std::size_t i) override {
+        return shared->buffers[i].get();
+    }
+
+    void start_read(std::size_t i) override {
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->read_buffer = shared->buffers[i].get();
+            shared->reading = true;
+            shared->read_done = false;
+        }
+        shared->cv.notify_all();
+    }
+
+    long wait_read() override {
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->cv.wait(lock, [this] { return shared->read_done; });
+        shared->reading = false;
+        return shared->read_result;
+    }
+
+    void start_write(const unsigned char *data, std::size_t len) override {
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->write_data = data;
+            shared->write_len = len;
+            shared->write_done = false;
+        }
+        shared->cv.notify_all();
+    }
+
+    bool wait_write() override {
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->cv.wait(lock, [this] { return shared->write_done; });
+        return shared->write_result;
+    }
+
+private:
+    std::shared_ptr<ThreadShared> shared;
+    std::thread reader;
+    std::thread writer;
+};
+
+#ifdef ESCAPE_HAVE_IO_URING
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup)
+#define ESCAPE_USE_IO_URING 1
+
+/*
+ * UringIO
+ *   This talks to io_uring with the raw system calls, since liburing isn't installed
+ *   everywhere and we only need a tiny part of it: one read and one write in flight, on
+ *   a ring with room for a few more. The ring setup and the memory ordering follow the
+ *   io_uring(7) man page and "Efficient IO with io_uring":
+ *   https://man7.org/linux/man-pages/man7/io_uring.7.html
+ *   https://kernel.dk/io_uring.pdf
+ *
+ *   The reads and writes use offset -1, which means "at the file's current position,
+ *   and move it along", just like read() and write(). That's what makes this work for
+ *   pipes and terminals as well as files. It needs Linux 5.6 (IORING_FEAT_RW_CUR_POS);
+ *   on anything older, make_uring_io returns null and we use threads instead.
+ *
+ *   The ByteSource might have read the first few bytes of the input already, to see if it's
+ *   compressed (see compression.h). Those are the prefix, which the first read returns
+ *   without going to the kernel at all.
+ */
+
+const __u64 READ_TAG = 1;
+const __u64 WRITE_TAG = 2;
+
+class UringIO : public BlockIO {
+public:
+    UringIO(std::size_t block_size) : BlockIO(block_size), ring_fd(-1), sq_ring(MAP_FAILED), cq_ring(MAP_FAILED),
+                                      sqes(static_cast<io_uring_sqe *>(MAP_FAILED)), sq_ring_len(0), cq_ring_len(0),
+                                      sqes_len(0), read_in_flight(false), read_buffer(nullptr), read_done(false),
+                                      read_result(0), write_data(nullptr), write_left(0), write_done(false),
+                                      write_result(0) {
+        buffers[0].reset(new unsigned char[block_size]);
+        buffers[1].reset(new unsigned char[block_size]);
+    }
+
+    /**
+     * Sets up the ring. Returns false if io_uring isn't usable, in which case the
+     * destructor cleans up whatever did get set up.
+     */
+    bool setup() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, 4, &params));
+        if (ring_fd < 0) {
+            return false; // ENOSYS on old kernels, EPERM if it's turned off (kernel.io_uring_disabled)
+        }
+        if (!(params.features & IORING_FEAT_RW_CUR_POS) || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+            return false;
+        }
+        // With IORING_FEAT_SINGLE_MMAP, the submission and completion rings share one mapping.
+        sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(__u32);
+        cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (cq_ring_len > sq_ring_len) {
+            sq_ring_len = cq_ring_len;
+        }
+        sq_ring = mmap(nullptr, sq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED) {
+            return false;
+        }
+        cq_ring = sq_ring;
+        sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes_map = mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (sqes_map == MAP_FAILED) {
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe *>(sqes_map);
+
+        unsigned char *sq = static_cast<unsigned char *>(sq_ring);
+        sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        unsigned char *cq = static_cast<unsigned char *>(cq_ring);
+        cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    ~UringIO() override {
+        if (read_in_flight) {
+            // The kernel might still write into the buffer after we close the ring (a
+            // blocked read is finished by a kernel worker thread), and the process is about
+            // to exit anyway, so we leave the buffers allocated.
+            buffers[0].release();
+            buffers[1].release();
+        }
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqes_len);
+        }
+        if (sq_ring != MAP_FAILED) {
+            munmap(sq_ring, sq_ring_len);
+        }
+        if (ring_fd >= 0) {
+            close(ring_fd);
+        }
+    }
+
+    void set_fds(int in, int out) {
+        in_fd = in;
+        out_fd = out;
+    }
+
+    void set_prefix(const unsigned char *data, std::size_t len) {
+        prefix.assign(reinterpret_cast<const char *>(data), len);
+    }
+
+    unsigned char *buffer(std::size_t i) override {
+        return buffers[i].get();
+    }
+
+    void start_read(std::size_t i) override {
+        read_buffer = buffers[i].get();
+        read_done = false;
+        if (!prefix.empty()) {
+            std::size_t len = std::min(prefix.size(), block_size());
+            std::memcpy(read_buffer, prefix.data(), len);
+            prefix.erase(0, len);
+            complete(READ_TAG, static_cast<long>(len));
+            return;
+        }
+        read_in_flight = true;
+        submit(IORING_OP_READ, in_fd, read_buffer, block_size(), READ_TAG);
+    }
+
+    long wait_read() override {
+        while (true) {
+            while (!read_done) {
+                reap();
+            }
+            if (read_result == -EINTR || read_result == -EAGAIN) {
+                read_done = false;
+                submit(IORING_OP_READ, in_fd, read_buffer, block_size(), READ_TAG);
+                continue;
+            }
+            read_in_flight = false;
+            return read_result < 0 ? -1 : read_result;
+        }
+    }
+
+    void start_write(const unsigned char *data, std::size_t len) override {
+        write_data = data;
+        write_left = len;
+        write_done = false;
+        submit(IORING_OP_WRITE, out_fd, write_data, write_left, WRITE_TAG);
+    }
+
+    bool wait_write() override {
+        while (true) {
+            while (!write_done) {
+                reap();
+            }
+            if (write_result == -EINTR || write_result == -EAGAIN) {
+                write_result = 0; // Try again from the same place
+            } else if (write_result < 0) {
+                return false;
+            }
+            // A write to a pipe or socket can be short, so we keep going until it's all written.
+            write_data += write_result;
+            write_left -= static_cast<std::size_t>(write_result);
+            if (write_left == 0) {
+                return true;
+            }
+            write_done = false;
+            submit(IORING_OP_WRITE, out_fd, write_data, write_left, WRITE_TAG);
+        }
+    }
+
+private:
+    /**
+     * Puts one request on the submission ring and tells the kernel about it. If that
+     * fails, the request is completed with the error right away.
+     */
+    void submit(__u8 opcode, int fd, const void *addr, std::size_t len, __u64 tag) {
+        unsigned tail = *sq_tail; // We're the only one who writes the tail.
+        unsigned index = tail & sq_mask;
+        io_uring_sqe *sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<__u64>(addr);
+        sqe->len = static_cast<__u32>(len);
+        sqe->off = static_cast<__u64>(-1);
+        sqe->user_data = tag;
+        sq_array[index] = index;
+        // The kernel must see the filled-in entry before it sees the new tail.
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        long result;
+        do {
+            result = syscall(__NR_io_uring_enter, ring_fd, 1, 0, 0, nullptr, 0);
+        } while (result < 0 && errno == EINTR);
+        if (result < 0) {
+            complete(tag, -errno);
+        }
+    }
+
+    /**
+     * Waits for at least one completion and records it.
+     */
+    void reap() {
+        unsigned head = *cq_head; // We're the only one who writes the head.
+        while (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            long result = syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (result < 0 && errno != EINTR) {
+                // Something is badly wrong with the ring. Fail whatever we're waiting for.
+                complete(READ_TAG, -errno);
+                complete(WRITE_TAG, -errno);
+                return;
+            }
+        }
+        const io_uring_cqe& cqe = cqes[head & cq_mask];
+        complete(cqe.user_data, cqe.res);
+        __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    }
+
+    void complete(__u64 tag, long result) {
+        if (tag == READ_TAG) {
+            read_result = result;
+            read_done = true;
+        } else {
+            write_result = result;
+            write_done = true;
+        }
+    }
+
+    int ring_fd;
+    int in_fd;
+    int out_fd;
+    void *sq_ring;
+    void *cq_ring;
+    io_uring_sqe *sqes;
+    std::size_t sq_ring_len;
+    std::size_t cq_ring_len;
+    std::size_t sqes_len;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe *cqes;
+
+    std::unique_ptr<unsigned char[]> buffers[2];
+    std::string prefix; // See the note above.
+    bool read_in_flight;
+    unsigned char *read_buffer;
+    bool read_done;
+    long read_result;
+    const unsigned char *write_data;
+    std::size_t write_left;
+    bool write_done;
+    long write_result;
+};
+
+#endif
+#endif
+
+} // namespace
+
+std::unique_ptr<BlockIO> make_uring_io(int in_fd, int out_fd, std::size_t block_size, const unsigned char *prefix,
+                                       std::size_t prefix_len) {
+#ifdef ESCAPE_USE_IO_URING
+    std::unique_ptr<UringIO> io(new UringIO(block_size));
+    if (!io->setup()) {
+        return nullptr;
+    }
+    io->set_fds(in_fd, out_fd);
+    io->set_prefix(prefix, prefix_len);
+    return std::unique_ptr<BlockIO>(io.release());
+#else
+    (void)in_fd;
+    (void)out_fd;
+    (void)block_size;
+    (void)prefix;
+    (void)prefix_len;
+    return nullptr;
+#endif
+}
+
+std::unique_ptr<BlockIO> make_thread_io(StreamPair& streams, std::size_t block_size) {
+    return std::unique_ptr<BlockIO>(new ThreadIO(streams, block_size));
+}
+
+std::unique_ptr<BlockIO> make_block_io(StreamPair& streams, std::size_t block_size) {
+    if (streams.in.fd() != -1 && streams.out.fd() != -1) {
+        const unsigned char *prefix;
+        std::size_t prefix_len = streams.in.peek(prefix, 0); // Only what's been read already
+        std::unique_ptr<BlockIO> io = make_uring_io(streams.in.fd(), streams.out.fd(), block_size, prefix, prefix_len);
+        if (io) {
+            return io;
+        }
+    }
+    return make_thread_io(streams, block_size);
+}
@@ -0,0 +1,106 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_BLOCKIO_H
+#define ESCAPE_UTF8_BLOCKIO_H
+
+#include <cstddef> // std::size_t
+#include <memory>
+
+#include "StreamPair.h"
+
+/**
+ * This is the asynchronous I/O layer that read_and_escape uses when the input isn't
+ * memory-mapped. It lets the next block of input be read and the previous block of output
+ * be written while the current block is being escaped, so that the total time gets close to
+ * the slowest of the three instead of their sum.
+ *
+ * Usage:
+ *   At most one read and one write can be in flight at a time. start_read(i) starts
+ *   reading the next block of input into buffer(i), and wait_read() waits for it to finish.
+ *   Likewise for start_write() and wait_write(). Every start has to be followed by a wait
+ *   before the next start of the same kind, except that it's fine to destroy a BlockIO
+ *   with a read still in flight (for example, once we know the input is invalid).
+ *
+ *   The input buffers belong to the BlockIO, because a read can outlive the function that
+ *   started it (see ThreadIO in BlockIO.cpp). The output buffers belong to the caller, and
+ *   must stay alive until wait_write() returns.
+ *
+ * There are two implementations, both made by make_block_io():
+ *   - On Linux, io_uring, if the kernel supports it and we have file descriptors for
+ *     both the input and the output.
+ *   - Everywhere else, a reader thread and a writer thread that do blocking I/O on the
+ *     source and the sink.
+ */
+class BlockIO {
+public:
+    virtual ~BlockIO() {}
+
+    /**
+     * Returns input buffer i, where i is 0 or 1. It holds block_size() bytes.
+     */
+    virtual unsigned char *buffer(std::size_t i) = 0;
+
+    /**
+     * Starts reading up to block_size() bytes of input into buffer(i).
+     */
+    virtual void start_read(std::size_t i) = 0;
+
+    /**
+     * Waits for the read started by start_read().
+     * @return The number of bytes read, which is 0 at the end of the input and may be less than
+     * block_size() before that, or -1 if there was an error.
+     */
+    virtual long wait_read() = 0;
+
+    /**
+     * Starts writing data[0..len) to the output.
+     */
+    virtual void start_write(const unsigned char *data, std::size_t len) = 0;
+
+    /**
+     * Waits for the write started by start_write().
+     * @return False if there was an error, true if all of the data was written.
+     */
+    virtual bool wait_write() = 0;
+
+    /**
+     * Returns the size of the input buffers.
+     */
+    std::size_t block_size() const { return size; }
+
+protected:
+    explicit BlockIO(std::size_t block_size) : size(block_size) {}
+
+private:
+    std::size_t size;
+};
+
+/**
+ * Makes the best BlockIO that works for the given streams (see above).
+ * @param streams The input and output. Nothing may have been read from or written to them
+ * yet. The input might be moved into the BlockIO (see make_thread_io), so don't use it
+ * afterwards. The output has to stay alive until the BlockIO is destroyed.
+ * @param block_size The size of each input buffer.
+ */
+std::unique_ptr<BlockIO> make_block_io(StreamPair& streams, std::size_t block_size);
+
+/**
+ * Makes a BlockIO that uses io_uring on the given file descriptors, or returns null if
+ * io_uring isn't available (not on Linux, the kernel is too old or has it turned off,
+ * or this was built against headers without it). The descriptors aren't closed.
+ * @param prefix, prefix_len Input that has already been read from in_fd (by
+ * ByteSource::peek), which the first reads return before anything more is read.
+ */
+std::unique_ptr<BlockIO> make_uring_io(int in_fd, int out_fd, std::size_t block_size, const unsigned char *prefix = nullptr,
+                                       std::size_t prefix_len = 0);
+
+/**
+ * Makes a BlockIO that uses a reader thread and a writer thread. This always works.
+ * streams.in is moved into the BlockIO, and streams.out has to stay alive until the
+ * BlockIO is destroyed.
+ */
+std::unique_ptr<BlockIO> make_thread_io(StreamPair& streams, std::size_t block_size);
+
+#endif //ESCAPE_UTF8_BLOCKIO_H
@@ -0,0 +1,490 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <algorithm> // std::min, std::max
+#include <cstdint> // std::uintptr_t
+#include <cstring> // std::memcpy
+
+#include "ByteStream.h"
+
+#ifdef _WIN32
+#include <cstdio> // _fileno
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/stat.h>
+#endif
+
+/*
+ * IMPLEMENTATION NOTES
+ * System calls:
+ *   The rest of the file only calls the little functions below, which hide the differences
+ *   between POSIX and Windows. On Windows the descriptors are the C runtime's (_open,
+ *   _read and so on), and stdin and stdout are already in binary mode by the time we get
+ *   here (see parse() in parseargs.cpp).
+ *
+ *   A read or write can be cut short by a signal (EINTR), in which case we just try again.
+ *   A write can also write only part of the data, for example to a pipe; then we write the
+ *   rest. A read that returns less than we asked for is fine, since the callers keep
+ *   reading until they have what they need.
+ *
+ * Readahead:
+ *   When the input is a regular file, we tell the kernel that we're going to read it from
+ *   start to end (POSIX_FADV_SEQUENTIAL), which makes it read further ahead than usual.
+ *   With the big buffer, the disk is kept busy while we escape what we've already got.
+ *
+ * Stages:
+ *   A ByteSource or ByteSink with a stage doesn't do any I/O of its own. Where it would read
+ *   into its buffer, it swaps the buffer for a full one from the stage, and where it would
+ *   write its buffer out, it swaps it for an empty one. The stage is on another thread, so
+ *   data that belongs to the caller (see write_unbuffered) has to be copied into one of our
+ *   buffers before it's handed over; everything else just changes hands.
+ */
+
+namespace {
+
+// What the buffers are aligned to: the page size, on every platform we build on.
+const std::size_t ALIGNMENT = 4096;
+
+// The most we read or write in one call. Windows can't do more than INT_MAX bytes at once.
+const std::size_t MAX_IO = 1 << 30;
+
+#ifdef _WIN32
+
+int open_for_reading(const std::string& path) {
+    int fd = -1;
+    _sopen_s(&fd, path.c_str(), _O_RDONLY | _O_BINARY, _SH_DENYNO, 0);
+    return fd;
+}
+
+int open_for_writing(const std::string& path, bool append) {
+    int fd = -1;
+    _sopen_s(&fd, path.c_str(), _O_WRONLY | _O_CREAT | (append ? _O_APPEND : _O_TRUNC) | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE);
+    return fd;
+}
+
+long read_some(int fd, unsigned char *data, std::size_t len) {
+    return _read(fd, data, static_cast<unsigned int>(std::min(len, MAX_IO)));
+}
+
+long write_some(int fd, const unsigned char *data, std::size_t len) {
+    return _write(fd, data, static_cast<unsigned int>(std::min(len, MAX_IO)));
+}
+
+int close_fd(int fd) {
+    return _close(fd);
+}
+
+int stdin_fd() {
+    return _fileno(stdin);
+}
+
+int stdout_fd() {
+    return _fileno(stdout);
+}
+
+#else
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+int open_for_reading(const std::string& path) {
+    return open(path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+int open_for_writing(const std::string& path, bool append) {
+    return open(path.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC) | O_CLOEXEC, 0666);
+}
+
+long read_some(int fd, unsigned char *data, std::size_t len) {
+    ssize_t n;
+    do {
+        n = ::read(fd, data, std::min(len, MAX_IO));
+    } while (n < 0 && errno == EINTR);
+    return static_cast<long>(n);
+}
+
+long write_some(int fd, const unsigned char *data, std::size_t len) {
+    ssize_t n;
+    do {
+        n = ::write(fd, data, std::min(len, MAX_IO));
+    } while (n < 0 && errno == EINTR);
+    return static_cast<long>(n);
+}
+
+int close_fd(int fd) {
+    return ::close(fd);
+}
+
+int stdin_fd() {
+    return STDIN_FILENO;
+}
+
+int stdout_fd() {
+    return STDOUT_FILENO;
+}
+
+#endif
+
+} // namespace
+
+void AlignedBuffer::allocate(std::size_t capacity) {
+    if (capacity <= size) {
+        return;
+    }
+    storage.reset(new unsigned char[capacity + ALIGNMENT - 1]);
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(storage.get());
+    aligned = storage.get() + (ALIGNMENT - address % ALIGNMENT) % ALIGNMENT;
+    size = capacity;
+}
+
+ByteSource::ByteSource(Kind kind, int descriptor) : kind(kind), descriptor(descriptor), begin(0), end(0), at_eof(false),
+                                                    failed(kind == Kind::Closed) {
+#ifdef __linux__
+    struct stat info;
+    if (descriptor != -1 && fstat(descriptor, &info) == 0 && S_ISREG(info.st_mode)) {
+        posix_fadvise(descriptor, 0, 0, POSIX_FADV_SEQUENTIAL); // See the note at the top of this file.
+    }
+#endif
+}
+
+ByteSource ByteSource::open_file(const std::string& path) {
+    int fd = open_for_reading(path);
+    return (fd == -1) ? ByteSource(Kind::Closed, -1) : ByteSource(Kind::File, fd);
+}
+
+ByteSource ByteSource::standard_input() {
+    return ByteSource(Kind::Standard, stdin_fd());
+}
+
+ByteSource ByteSource::from_string(const std::string& contents) {
+    ByteSource source(Kind::String, -1);
+    source.contents = contents;
+    source.end = contents.size();
+    return source;
+}
+
+ByteSource ByteSource::from_stage(std::unique_ptr<SourceStage> stage) {
+    ByteSource source(Kind::Stage, -1);
+    source.stage = std::move(stage);
+    return source;
+}
+
+ByteSource::ByteSource(ByteSource&& other) noexcept : kind(other.kind), descriptor(other.descriptor),
+        buffer(std::move(other.buffer)), contents(std::move(other.contents)), stage(std::move(other.stage)),
+        begin(other.begin), end(other.end), at_eof(other.at_eof), failed(other.failed) {
+    other.kind = Kind::Closed;
+    other.descriptor = -1;
+    other.begin = other.end = 0;
+    other.failed = true;
+}
+
+ByteSource& ByteSource::operator=(ByteSource&& other) noexcept {
+    if (this != &other) {
+        if (kind == Kind::File) {
+            close_fd(descriptor);
+        }
+        kind = other.kind;
+        descriptor = other.descriptor;
+        buffer = std::move(other.buffer);
+        contents = std::move(other.contents);
+        stage = std::move(other.stage);
+        begin = other.begin;
+        end = other.end;
+        at_eof = other.at_eof;
+        failed = other.failed;
+        other.kind = Kind::Closed;
+        other.descriptor = -1;
+        other.begin = other.end = 0;
+        other.failed = true;
+    }
+    return *this;
+}
+
+ByteSource::~ByteSource() {
+    if (kind == Kind::File) {
+        close_fd(descriptor);
+    }
+}
+
+void ByteSource::fill() {
+    begin = 0;
+    if (kind == Kind::Stage) {
+        end = stage->exchange(buffer);
+        if (end == 0) {
+            (stage->error() ? failed : at_eof) = true;
+        }
+        return;
+    }
+    buffer.allocate(BYTE_STREAM_BUFFER_SIZE);
+    long n = read_some(descriptor, buffer.data(), buffer.capacity());
+    end = (n > 0) ? static_cast<std::size_t>(n) : 0;
+    if (n == 0) {
+        at_eof = true;
+    } else if (n < 0) {
+        failed = true;
+    }
+}
+
+std::size_t ByteSource::peek(const unsigned char *& data, std::size_t len) {
+    if (end - begin < len && !at_eof && !failed) {
+        if (begin == end && kind != Kind::String) {
+            if (kind == Kind::Stage) {
+                fill(); // We can only get the stage's input a whole buffer at a time.
+            } else {
+                buffer.allocate(BYTE_STREAM_BUFFER_SIZE);
+                begin = end = 0;
+            }
+        }
+        if (kind == Kind::File || kind == Kind::Standard) {
+            // Only the missing bytes are read, so that when we're only peeking at the first
+            // few bytes, we don't read much further than whoever uses the descriptor next.
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+            long n = read_some(descriptor, buffer.data() + end, std::min(len, buffer.capacity()) - end);
+            if (n == 0) {
+                at_eof = true;
+            } else if (n < 0) {
+                failed = true;
+            } else {
+                end += static_cast<std::size_t>(n);
+            }
+        }
+    }
+    data = ((kind == Kind::String) ? reinterpret_cast<const unsigned char *>(contents.data()) : buffer.data()) + begin;
+    return end - begin;
+}
+
+std::size_t ByteSource::pull(const unsigned char *& data, std::size_t max_len) {
+    if (begin == end) {
+        if (at_eof || failed) {
+            return 0;
+        }
+        if (kind == Kind::String) {
+            at_eof = true;
+            return 0;
+        }
+        fill();
+        if (begin == end) {
+            return 0;
+        }
+    }
+    const unsigned char *base = (kind == Kind::String) ? reinterpret_cast<const unsigned char *>(contents.data()) : buffer.data();
+    std::size_t len = std::min(max_len, end - begin);
+    data = base + begin;
+    begin += len;
+    return len;
+}
+
+std::size_t ByteSource::read(unsigned char *dest, std::size_t len) {
+    std::size_t copied = 0;
+    while (copied < len) {
+        if (begin == end && (kind == Kind::File || kind == Kind::Standard) && !at_eof && !failed &&
+            len - copied >= BYTE_STREAM_BUFFER_SIZE) {
+            // There's nothing in our buffer, and this would fill all of it, so we might as
+            // well read straight into dest.
+            long n = read_some(descriptor, dest + copied, len - copied);
+            if (n == 0) {
+                at_eof = true;
+                break;
+            } else if (n < 0) {
+                failed = true;
+                break;
+            }
+            copied += static_cast<std::size_t>(n);
+            continue;
+        }
+        const unsigned char *data;
+        std::size_t n = pull(data, len - copied);
+        if (n == 0) {
+            break;
+        }
+        std::memcpy(dest + copied, data, n);
+        copied += n;
+    }
+    return copied;
+}
+
+ByteSink::ByteSink(Kind kind, int descriptor) : kind(kind), descriptor(descriptor), used(0), failed(kind == Kind::Closed) {}
+
+ByteSink ByteSink::open_file(const std::string& path, bool append) {
+    int fd = open_for_writing(path, append);
+    return (fd == -1) ? ByteSink(Kind::Closed, -1) : ByteSink(Kind::File, fd);
+}
+
+ByteSink ByteSink::from_descriptor(int fd) {
+    return (fd == -1) ? ByteSink(Kind::Closed, -1) : ByteSink(Kind::File, fd);
+}
+
+ByteSink ByteSink::standard_output() {
+    return ByteSink(Kind::Standard, stdout_fd());
+}
+
+ByteSink ByteSink::to_string() {
+    return ByteSink(Kind::String, -1);
+}
+
+ByteSink ByteSink::discard() {
+    return ByteSink(Kind::Discard, -1);
+}
+
+ByteSink ByteSink::to_stage(std::unique_ptr<SinkStage> stage) {
+    ByteSink sink(Kind::Stage, -1);
+    sink.stage = std::move(stage);
+    return sink;
+}
+
+ByteSink::ByteSink(ByteSink&& other) noexcept : kind(other.kind), descriptor(other.descriptor),
+        buffer(std::move(other.buffer)), used(other.used), flushed(std::move(other.flushed)),
+        stage(std::move(other.stage)), failed(other.failed) {
+    other.kind = Kind::Closed;
+    other.descriptor = -1;
+    other.used = 0;
+    other.failed = true;
+}
+
+ByteSink& ByteSink::operator=(ByteSink&& other) noexcept {
+    if (this != &other) {
+        close();
+        kind = other.kind;
+        descriptor = other.descriptor;
+        buffer = std::move(other.buffer);
+        used = other.used;
+        flushed = std::move(other.flushed);
+        stage = std::move(other.stage);
+        failed = other.failed;
+        other.kind = Kind::Closed;
+        other.descriptor = -1;
+        other.used = 0;
+        other.failed = true;
+    }
+    return *this;
+}
+
+ByteSink::~ByteSink() {
+    close();
+}
+
+bool ByteSink::close() {
+    if (kind == Kind::Closed) {
+        return false;
+    }
+    bool ok = flush_buffer();
+    if (kind == Kind::Stage) {
+        ok = stage->finish() && ok;
+        stage.reset();
+    } else if (kind == Kind::File) {
+        ok = close_fd(descriptor) == 0 && ok;
+    }
+    kind = Kind::Closed;
+    descriptor = -1;
+    failed = true;
+    return ok;
+}
+
+bool ByteSink::write_out(const unsigned char *data, std::size_t len) {
+    if (kind == Kind::String) {
+        flushed.append(reinterpret_cast<const char *>(data), len);
+        return true;
+    } else if (kind == Kind::Discard) {
+        return true;
+    } else if (kind == Kind::Stage) {
+        // The data belongs to the caller, so it goes through our buffers. See the note at the top of this file.
+        while (len > 0) {
+            buffer.allocate(BYTE_STREAM_BUFFER_SIZE);
+            std::size_t n = std::min(len, buffer.capacity() - used);
+            std::memcpy(buffer.data() + used, data, n);
+            used += n;
+            data += n;
+            len -= n;
+            if (used == buffer.capacity() && !flush_buffer()) {
+                return false;
+            }
+        }
+        return true;
+    }
+    while (len > 0) {
+        long n = write_some(descriptor, data, len);
+        if (n <= 0) {
+            failed = true;
+            return false;
+        }
+        data += n;
+        len -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool ByteSink::flush_buffer() {
+    if (failed) {
+        return false;
+    }
+    if (used == 0) {
+        return true;
+    }
+    std::size_t len = used;
+    used = 0;
+    if (kind == Kind::Stage) {
+        failed = !stage->exchange(buffer, len);
+        return !failed;
+    }
+    return write_out(buffer.data(), len);
+}
+
+bool ByteSink::flush() {
+    if (!flush_buffer()) {
+        return false;
+    }
+    if (kind == Kind::Stage) {
+        failed = !stage->flush();
+    }
+    return !failed;
+}
+
+bool ByteSink::write(const unsigned char *data, std::size_t len) {
+    if (failed) {
+        return false;
+    }
+    buffer.allocate(BYTE_STREAM_BUFFER_SIZE);
+    if (len > buffer.capacity() - used) {
+        if (!flush_buffer()) {
+            return false;
+        }
+        buffer.allocate(BYTE_STREAM_BUFFER_SIZE); // A stage might have handed back one that isn't allocated.
+        if (len >= buffer.capacity()) {
+            return write_out(data, len); // It would only fill the buffer, so skip the copy.
+        }
+    }
+    std::memcpy(buffer.data() + used, data, len);
+    used += len;
+    return true;
+}
+
+bool ByteSink::write_unbuffered(const unsigned char *data, std::size_t len) {
+    return flush_buffer() && write_out(data, len);
+}
+
+unsigned char *ByteSink::reserve(std::size_t len) {
+    if (failed) {
+        return nullptr;
+    }
+    buffer.allocate(BYTE_STREAM_BUFFER_SIZE);
+    if (len > buffer.capacity() - used) {
+        if (!flush_buffer()) {
+            return nullptr;
+        }
+        buffer.allocate(std::max(len, BYTE_STREAM_BUFFER_SIZE)); // Only does anything if it's still too small.
+    }
+    return buffer.data() + used;
+}
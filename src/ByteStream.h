@@ -0,0 +1,418 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_BYTESTREAM_H
+#define ESCAPE_UTF8_BYTESTREAM_H
+
+#include <cstddef> // std::size_t
+#include <memory>
+#include <string>
+#include <utility> // std::move
+
+/*
+ * ByteSource and ByteSink are the program's input and output: a file descriptor with one
+ * big buffer in front of it, and nothing else. They replace std::istream and std::ostream,
+ * which cost a virtual call (or two) for every read and write and copy everything through
+ * a small buffer of their own.
+ *
+ * Each one is made with one of its factory functions, which picks where the bytes come
+ * from or go to:
+ *   - open_file: a file, opened (and for a sink, created or truncated) with open().
+ *   - from_descriptor (sink only): a file that's already open.
+ *   - standard_input / standard_output: stdin or stdout, which aren't closed afterwards.
+ *   - from_string / to_string: a string, with no system calls at all. This is for the
+ *     tests, and for programs that use the library on text they already have in memory.
+ *   - discard: nowhere, for the benchmarks.
+ *   - from_stage / to_stage: a thread of its own that makes the input or takes the output,
+ *     like a decompressor or a compressor (see compression.h). Whole buffers are handed
+ *     back and forth, so nothing is copied on the way.
+ *
+ * They're move-only, like the file descriptors they hold: whoever has the object is the
+ * only one reading from (or writing to) it, and the descriptor is closed exactly once.
+ * Neither one is thread-safe, but either can be moved to another thread and used there.
+ *
+ * A program that opens lots of small files one after another (like batch mode) can hand
+ * each new source and sink the buffer that the last one had, with adopt_buffer and
+ * release_buffer, instead of allocating a new one for every file.
+ */
+
+// The size of the buffer in each ByteSource and ByteSink. A read() or write() this big
+// costs about the same as a small one, so this is what makes the system calls rare.
+const std::size_t BYTE_STREAM_BUFFER_SIZE = 1024 * 1024;
+
+/**
+ * A buffer that's aligned to a page, so that reads and writes start at a page boundary,
+ * and that isn't zeroed out when it's allocated. It's allocated the first time it's needed.
+ */
+class AlignedBuffer {
+public:
+    AlignedBuffer() : aligned(nullptr), size(0) {}
+    AlignedBuffer(AlignedBuffer&& other) noexcept : storage(std::move(other.storage)), aligned(other.aligned), size(other.size) {
+        other.aligned = nullptr;
+        other.size = 0;
+    }
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept {
+        storage = std::move(other.storage);
+        aligned = other.aligned;
+        size = other.size;
+        other.aligned = nullptr;
+        other.size = 0;
+        return *this;
+    }
+
+    /**
+     * Makes sure the buffer holds at least capacity bytes. The old contents are lost.
+     */
+    void allocate(std::size_t capacity);
+
+    unsigned char *data() const { return aligned; }
+    std::size_t capacity() const { return size; }
+
+private:
+    std::unique_ptr<unsigned char[]> storage;
+    unsigned char *aligned;
+    std::size_t size;
+};
+
+/**
+ * The other end of a ByteSource made with from_stage: something that fills buffers with
+ * input on a thread of its own.
+ */
+class SourceStage {
+public:
+    virtual ~SourceStage() {}
+
+    /**
+     * Takes back buffer, which the ByteSource is done with, and replaces it with the next
+     * full one, waiting for it if need be.
+     * @return The number of bytes of input at the start of the new buffer. This is 0 only at
+     * the end of the input or after an error.
+     */
+    virtual std::size_t exchange(AlignedBuffer& buffer) = 0;
+
+    /**
+     * Returns true if the input stopped because of an error.
+     */
+    virtual bool error() const = 0;
+};
+
+/**
+ * The input. There are two ways to read from it, which can be mixed:
+ *   - pull() hands back the next piece of the input where it already is (in the buffer, or
+ *     in the string), so it can be escaped without being copied first.
+ *   - read() copies the next len bytes into a buffer of the caller's. A big read goes
+ *     straight into that buffer, without going through ours.
+ *
+ * Both keep going until they get some input, or reach the end of it, or fail. After a
+ * failure, eof() is false and error() is true, and nothing more is read.
+ */
+class ByteSource {
+public:
+    /**
+     * Opens the file at path for reading.
+     * @return The source, which isn't open (see is_open) if the file couldn't be opened.
+     */
+    static ByteSource open_file(const std::string& path);
+
+    /**
+     * Reads from stdin.
+     */
+    static ByteSource standard_input();
+
+    /**
+     * Reads from a copy of contents.
+     */
+    static ByteSource from_string(const std::string& contents);
+
+    /**
+     * Reads the buffers that stage fills.
+     */
+    static ByteSource from_stage(std::unique_ptr<SourceStage> stage);
+
+    ByteSource(ByteSource&& other) noexcept;
+    ByteSource& operator=(ByteSource&& other) noexcept;
+    ByteSource(const ByteSource&) = delete;
+    ByteSource& operator=(const ByteSource&) = delete;
+    ~ByteSource();
+
+    /**
+     * Returns false if the file couldn't be opened, or this has been moved from.
+     */
+    bool is_open() const { return kind != Kind::Closed; }
+
+    /**
+     * Returns the file descriptor, or -1 if there isn't one (a string or a stage, or not
+     * open). Only use it if nothing has been read through this object yet, except by peek().
+     */
+    int fd() const { return descriptor; }
+
+    /**
+     * Returns true if the input comes from a stage, which already reads ahead on a thread
+     * of its own.
+     */
+    bool has_stage() const { return kind == Kind::Stage; }
+
+    /**
+     * Gives this source a buffer to use instead of allocating its own, such as one that
+     * release_buffer took from an earlier source. Call it before reading anything.
+     */
+    void adopt_buffer(AlignedBuffer spare) { buffer = std::move(spare); }
+
+    /**
+     * Takes the buffer away, so that another source can use it. Anything that has been
+     * read ahead into it is lost, so only call this once you're done reading.
+     */
+    AlignedBuffer release_buffer() {
+        begin = end = 0;
+        return std::move(buffer);
+    }
+
+    /**
+     * Looks at the next bytes of the input without using them up: they're still there for
+     * the next pull() or read(). If fewer than len bytes have been read ahead, this reads
+     * once more, for at most the bytes that are missing.
+     * @param data This is a return value: where the bytes are. It stays valid until the next
+     * call to anything else.
+     * @return The number of bytes that have been read ahead, which can be less than len.
+     */
+    std::size_t peek(const unsigned char *& data, std::size_t len);
+
+    /**
+     * Returns the next piece of the input, without copying it.
+     * @param data This is a return value: where the piece is. It stays valid until the next
+     * call to pull() or read().
+     * @param max_len The longest piece to return.
+     * @return The length of the piece, which is 0 only at the end of the input or after an
+     * error.
+     */
+    std::size_t pull(const unsigned char *& data, std::size_t max_len);
+
+    /**
+     * Copies the next len bytes of input into dest.
+     * @return The number of bytes copied, which is less than len only at the end of the
+     * input or after an error.
+     */
+    std::size_t read(unsigned char *dest, std::size_t len);
+
+    /**
+     * Returns true once the end of the input has been reached.
+     */
+    bool eof() const { return at_eof; }
+
+    /**
+     * Returns true if a read failed (or the source isn't open).
+     */
+    bool error() const { return failed; }
+
+private:
+    enum class Kind { Closed, File, Standard, String, Stage };
+
+    ByteSource(Kind kind, int descriptor);
+
+    /**
+     * Reads once into the buffer (or gets the next one from the stage), which must be
+     * empty. Sets at_eof or failed if it gets nothing.
+     */
+    void fill();
+
+    Kind kind;
+    int descriptor;
+    AlignedBuffer buffer;
+    std::string contents; // For a string source
+    std::unique_ptr<SourceStage> stage; // For a stage source
+    // The bytes that have been read but not handed out yet are [begin, end) of the buffer
+    // (or of contents).
+    std::size_t begin;
+    std::size_t end;
+    bool at_eof;
+    bool failed;
+};
+
+/**
+ * The other end of a ByteSink made with to_stage: something that takes full buffers of
+ * output and deals with them on a thread of its own.
+ */
+class SinkStage {
+public:
+    virtual ~SinkStage() {}
+
+    /**
+     * Takes buffer, whose first len bytes are output, and replaces it with an empty one,
+     * which may not have been allocated yet. Waits if the stage is too far behind.
+     * @return False if there was an error (now or earlier).
+     */
+    virtual bool exchange(AlignedBuffer& buffer, std::size_t len) = 0;
+
+    /**
+     * Waits until the stage has dealt with everything it's been given so far.
+     * @return False if there was an error (now or earlier).
+     */
+    virtual bool flush() = 0;
+
+    /**
+     * Ends the output, and waits until it's all done. Nothing may be handed over afterwards.
+     * @return False if there was an error (now or earlier).
+     */
+    virtual bool finish() = 0;
+};
+
+/**
+ * The output. There are three ways to write to it, which can be mixed:
+ *   - write() copies the data into the buffer. The buffer is written out with a single
+ *     write() when it's full, and by flush().
+ *   - reserve() and commit() let the caller put the data straight into the buffer, for
+ *     example by escaping into it.
+ *   - write_unbuffered() writes the data out right away, without copying it, for data
+ *     that's already in a big buffer of its own.
+ *
+ * Nothing is written out until the buffer is full or flush() is called, so whoever
+ * writes the last of the output has to call flush() and check the result. The destructor
+ * does flush, but it has no way to report an error. A stage can hold on to some of the
+ * output even after flush() (a compressor does), so for a sink that might have one, call
+ * close() at the very end too.
+ *
+ * After a write fails, every later call fails too (and doesn't write anything).
+ */
+class ByteSink {
+public:
+    /**
+     * Opens the file at path for writing. It's created if it doesn't exist and truncated
+     * if it does, unless append is true, in which case the output goes after what's there.
+     * @return The sink, which isn't open (see is_open) if the file couldn't be opened.
+     */
+    static ByteSink open_file(const std::string& path, bool append = false);
+
+    /**
+     * Writes to fd, a file that's already open for writing, like one made by mkstemp. The
+     * sink owns it from now on, and closes it.
+     */
+    static ByteSink from_descriptor(int fd);
+
+    /**
+     * Writes to stdout.
+     */
+    static ByteSink standard_output();
+
+    /**
+     * Writes to a string, which is available from contents().
+     */
+    static ByteSink to_string();
+
+    /**
+     * Throws the output away, like /dev/null but without the system calls.
+     */
+    static ByteSink discard();
+
+    /**
+     * Hands the buffers of output over to stage.
+     */
+    static ByteSink to_stage(std::unique_ptr<SinkStage> stage);
+
+    ByteSink(ByteSink&& other) noexcept;
+    ByteSink& operator=(ByteSink&& other) noexcept;
+    ByteSink(const ByteSink&) = delete;
+    ByteSink& operator=(const ByteSink&) = delete;
+    ~ByteSink();
+
+    /**
+     * Returns false if the file couldn't be opened, or this has been moved from.
+     */
+    bool is_open() const { return kind != Kind::Closed; }
+
+    /**
+     * Returns the file descriptor, or -1 if there isn't one (a string, a stage or nowhere, or
+     * not open). Only use it if nothing has been written through this object yet, or it has
+     * been flushed.
+     */
+    int fd() const { return descriptor; }
+
+    /**
+     * Gives this sink a buffer to use instead of allocating its own, such as one that
+     * release_buffer took from an earlier sink. Call it before writing anything.
+     */
+    void adopt_buffer(AlignedBuffer spare) { buffer = std::move(spare); }
+
+    /**
+     * Takes the buffer away, so that another sink can use it. Call it after close().
+     */
+    AlignedBuffer release_buffer() {
+        used = 0;
+        return std::move(buffer);
+    }
+
+    /**
+     * Writes data[0..len) to the output, through the buffer.
+     * @return False if there was an error.
+     */
+    bool write(const unsigned char *data, std::size_t len);
+
+    /**
+     * Writes out whatever is in the buffer, and then data[0..len), without copying it. (Except
+     * into a stage, which works on another thread, and so gets a copy in our buffers.)
+     * @return False if there was an error.
+     */
+    bool write_unbuffered(const unsigned char *data, std::size_t len);
+
+    /**
+     * Returns room in the buffer for len bytes of output, writing out the buffer first if
+     * there isn't enough room left (and making it bigger if it's too small). Put the output
+     * there, then call commit() with its actual length, before any other call.
+     * @return The room, or null if there was an error.
+     */
+    unsigned char *reserve(std::size_t len);
+
+    /**
+     * Adds the first len bytes of the room from reserve() to the output.
+     */
+    void commit(std::size_t len) { used += len; }
+
+    /**
+     * Writes out whatever is in the buffer.
+     * @return False if there was an error (now or earlier).
+     */
+    bool flush();
+
+    /**
+     * Flushes, ends the output (for a stage, that's when a compressor writes out the end of
+     * the compressed data) and closes the file. Afterwards the sink isn't open. The
+     * destructor does this too, without the error.
+     * @return False if there was an error (now or earlier).
+     */
+    bool close();
+
+    /**
+     * Returns true if a write failed (or the sink isn't open).
+     */
+    bool error() const { return failed; }
+
+    /**
+     * For a string sink, returns everything that's been flushed to it.
+     */
+    const std::string& contents() const { return flushed; }
+
+private:
+    enum class Kind { Closed, File, Standard, String, Discard, Stage };
+
+    ByteSink(Kind kind, int descriptor);
+
+    /**
+     * Writes out whatever is in the buffer (or hands it to the stage).
+     */
+    bool flush_buffer();
+
+    /**
+     * Writes data[0..len) out, bypassing the buffer (except for a stage).
+     */
+    bool write_out(const unsigned char *data, std::size_t len);
+
+    Kind kind;
+    int descriptor;
+    AlignedBuffer buffer;
+    std::size_t used; // The first used bytes of the buffer are waiting to be written out.
+    std::string flushed; // For a string sink
+    std::unique_ptr<SinkStage> stage; // For a stage sink
+    bool failed;
+};
+
+#endif //ESCAPE_UTF8_BYTESTREAM_H
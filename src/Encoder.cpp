@@ -0,0 +1,33 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include "Encoder.h"
+
+int Encoder::feed(const unsigned char *in, std::size_t len, unsigned char *out, std::size_t& written) {
+    if (state.invalid) {
+        written = 0;
+        return 2;
+    }
+    written = escape_block(state, in, len, out);
+    return state.invalid ? 2 : 0;
+}
+
+int Encoder::feed(const unsigned char *in, std::size_t len, std::string& out) {
+    // We grow the string to the worst-case size, let escape_block write straight into it,
+    // and then shrink it back down. Since C++11, std::string's storage is contiguous.
+    std::size_t old_size = out.size();
+    out.resize(old_size + escape_output_bound(len));
+    std::size_t written;
+    int retval = feed(in, len, reinterpret_cast<unsigned char *>(&out[old_size]), written);
+    out.resize(old_size + written);
+    return retval;
+}
+
+int Encoder::finish() const {
+    return (state.invalid || !state.at_boundary()) ? 2 : 0;
+}
+
+void Encoder::reset() {
+    state = EscapeState();
+}
@@ -0,0 +1,78 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_ENCODER_H
+#define ESCAPE_UTF8_ENCODER_H
+
+#include <cstddef> // std::size_t
+#include <cstdint> // uint_fast64_t
+#include <string>
+
+#include "escape_kernel.h"
+
+/**
+ * This is a resumable encoder for using the escaping logic in-process, without going
+ * through the escape executable. It's a thin wrapper around escape_block and EscapeState.
+ *
+ * Usage:
+ *   Construct an Encoder, call feed() for each piece of input in order, and then call
+ *   finish() once there's no more input. The pieces can be split anywhere, including in
+ *   the middle of a multi-byte character; the output is the same as if all the input
+ *   had been passed to feed() in one piece.
+ *
+ *   The Encoder doesn't allocate anything. The caller owns the output buffers, so a
+ *   caller that reuses its buffers escapes without any allocations at all.
+ *
+ *   feed() and finish() return the same codes that the escape program uses as its exit
+ *   status (see main.cpp): 0 on success and 2 if the input is not valid UTF-8. Once an
+ *   Encoder has returned 2, every later call to feed() or finish() also returns 2 until
+ *   reset() is called.
+ *
+ *   See libescape.h for the C version of this interface.
+ */
+class Encoder {
+public:
+    Encoder() = default;
+
+    /**
+     * Escapes the next piece of input.
+     * @param in Pointer to the input. May be null if len is 0.
+     * @param len Number of bytes of input.
+     * @param out The output buffer. Must have room for at least escape_output_bound(len) bytes.
+     * @param written This is a return value: the number of bytes written to out. If the
+     * input is invalid, this is everything up to the first invalid character.
+     * @return 0 if everything so far is valid UTF-8 (though it might end in the middle of a
+     * character), or 2 if it isn't.
+     */
+    int feed(const unsigned char *in, std::size_t len, unsigned char *out, std::size_t& written);
+
+    /**
+     * Same as above, but appends the escaped output to a std::string. This only allocates
+     * if the string doesn't already have enough capacity.
+     */
+    int feed(const unsigned char *in, std::size_t len, std::string& out);
+
+    /**
+     * Signals the end of the input.
+     * @return 0 if the whole input was valid UTF-8, or 2 if it wasn't (including the case
+     * where the input ended in the middle of a multi-byte character).
+     */
+    int finish() const;
+
+    /**
+     * Puts the Encoder back in its initial state so it can be used for a new input.
+     */
+    void reset();
+
+    /**
+     * Returns the number of input bytes the Encoder has looked at. If the input was
+     * invalid, this is the 1-based position of the byte that made it invalid.
+     */
+    std::uint_fast64_t bytes_read() const { return state.num_bytes_read; }
+
+private:
+    EscapeState state;
+};
+
+#endif //ESCAPE_UTF8_ENCODER_H
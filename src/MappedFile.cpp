@@ -0,0 +1,100 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include "MappedFile.h"
+
+// mmap is POSIX. __unix__ covers Linux and the BSDs; macOS defines __APPLE__ instead.
+// https://sourceforge.net/p/predef/wiki/OperatingSystems/
+#if defined(__unix__) || defined(__APPLE__)
+#define ESCAPE_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef ESCAPE_HAVE_MMAP
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path, std::size_t window_size) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat info;
+    // Pipes, FIFOs and character devices (like /dev/stdin) can't be mapped, or at least
+    // not in a way that tells us where the input ends.
+    if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL // macOS doesn't have posix_fadvise
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL); // This is only a hint, so we ignore errors.
+#endif
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size > 0) {
+        std::size_t page = static_cast<std::size_t>(page_size);
+        window_size = (window_size + page - 1) / page * page;
+    }
+    // The constructor is private, so we can't use std::make_shared.
+    return std::shared_ptr<MappedFile>(new MappedFile(fd, static_cast<std::uint_fast64_t>(info.st_size), window_size));
+}
+
+MappedFile::MappedFile(int fd, std::uint_fast64_t file_size, std::size_t window_size) :
+    fd(fd), file_size(file_size), window_size(window_size), position(0), window(nullptr), window_len(0) {}
+
+MappedFile::~MappedFile() {
+    unmap();
+    close(fd);
+}
+
+void MappedFile::unmap() {
+    if (window != nullptr) {
+        munmap(window, window_len);
+        window = nullptr;
+        window_len = 0;
+    }
+}
+
+bool MappedFile::next_window(const unsigned char *&data, std::size_t& len) {
+    unmap();
+    if (position >= file_size) {
+        // mmap fails on a length of 0, so the end of the file (and an empty file) is
+        // handled without it.
+        data = nullptr;
+        len = 0;
+        return true;
+    }
+    std::uint_fast64_t remaining = file_size - position;
+    std::size_t to_map = (remaining < window_size) ? static_cast<std::size_t>(remaining) : window_size;
+    void *addr = mmap(nullptr, to_map, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(position));
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    madvise(addr, to_map, MADV_SEQUENTIAL);
+    window = addr;
+    window_len = to_map;
+    position += to_map;
+    data = static_cast<const unsigned char *>(addr);
+    len = to_map;
+    return true;
+}
+
+#else // No mmap, so every file goes through the streaming path.
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string&, std::size_t) {
+    return nullptr;
+}
+
+MappedFile::MappedFile(int fd, std::uint_fast64_t file_size, std::size_t window_size) :
+    fd(fd), file_size(file_size), window_size(window_size), position(0), window(nullptr), window_len(0) {}
+
+MappedFile::~MappedFile() {}
+
+void MappedFile::unmap() {}
+
+bool MappedFile::next_window(const unsigned char *&, std::size_t&) {
+    return false;
+}
+
+#endif
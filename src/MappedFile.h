@@ -0,0 +1,102 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_MAPPEDFILE_H
+#define ESCAPE_UTF8_MAPPEDFILE_H
+
+#include <cstddef> // std::size_t
+#include <cstdint> // uint_fast64_t
+#include <memory>
+#include <string>
+
+/**
+ * This is a read-only memory mapping of a regular file, so that the input can be escaped
+ * straight out of the page cache instead of being copied through an ifstream first.
+ *
+ * Usage:
+ *   Call MappedFile::open(). If it returns null, the file can't be mapped and you should
+ *   read it as a stream instead. Otherwise call next_window() repeatedly; each call returns
+ *   the next piece of the file, in order, until it returns a length of 0 at the end.
+ *
+ *   Only one window is mapped at a time, and calling next_window() unmaps the previous
+ *   one. That way a file of any size can be read without needing that much address space,
+ *   which matters for multi-GB files in 32-bit builds.
+ *
+ * Implementation notes:
+ *   This is only implemented for POSIX systems (Linux, macOS, the BSDs). On other systems
+ *   open() always returns null, so they always use the streaming path.
+ *
+ *   We tell the kernel that we'll read the file sequentially, with posix_fadvise for the
+ *   whole file and madvise for each window, so that it reads ahead aggressively and can
+ *   drop the pages behind us.
+ *
+ *   The size of the file is taken once, when it's opened. If another process truncates the
+ *   file while we're reading it, touching the missing pages raises SIGBUS, which kills the
+ *   program. The streaming path would just see a shorter file instead, but that's a race
+ *   that the streaming path can't handle correctly either.
+ */
+class MappedFile {
+public:
+    // The default amount of the file that is mapped at once. It's a multiple of every page size we know of.
+    static const std::size_t DEFAULT_WINDOW_SIZE = 64 * 1024 * 1024;
+
+    /**
+     * Opens and maps the given file.
+     * @param path Path to the file.
+     * @param window_size The most to map at once. This is rounded up to a multiple of the
+     * page size. It's only a parameter so the tests can use small windows.
+     * @return The mapping, or null if the file isn't a regular file or can't be opened or
+     * mapped for any other reason.
+     */
+    static std::shared_ptr<MappedFile> open(const std::string& path, std::size_t window_size = DEFAULT_WINDOW_SIZE);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    /**
+     * Maps the next piece of the file and unmaps the previous one.
+     * @param data This is a return value: a pointer to the start of the window. It's only
+     * valid until the next call to next_window().
+     * @param len This is a return value: the length of the window. It's 0 once the whole
+     * file has been returned.
+     * @return False if mapping the window failed (in which case data and len are not set),
+     * true otherwise.
+     */
+    bool next_window(const unsigned char *&data, std::size_t& len);
+
+    /**
+     * Unmaps the current window, so that the next call to next_window() starts again from
+     * the beginning of the file.
+     */
+    void rewind() {
+        unmap();
+        position = 0;
+    }
+
+    /**
+     * Returns the size of the file.
+     */
+    std::uint_fast64_t size() const { return file_size; }
+
+    /**
+     * Returns the file descriptor of the file, for system calls that copy from it directly.
+     * The MappedFile still owns it.
+     */
+    int descriptor() const { return fd; }
+
+private:
+    MappedFile(int fd, std::uint_fast64_t file_size, std::size_t window_size);
+    void unmap();
+
+    int fd;
+    std::uint_fast64_t file_size;
+    std::size_t window_size;
+    // The offset in the file of the next window.
+    std::uint_fast64_t position;
+    void *window;
+    std::size_t window_len;
+};
+
+#endif //ESCAPE_UTF8_MAPPEDFILE_H
@@ -2,83 +2,82 @@
 // Created by Vicram on 8/31/2019.
 //
 
-#include <fstream>
 #include <iostream>
-#include <ios> // for ios_base::binary
 
 #include "StreamPair.h"
 
 /*
  * IMPLEMENTATION NOTES
- * Shared Pointer Constructors:
- *   For the cases where the filename is given, I'm using shared_ptr constructor 3:
- *   https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
- *   This will do 'delete ptr' on the object, which is the desired behavior.
- * 
- *   For the cases where no filename is given, we don't want to do 'delete ptr'
- *   because std::cin and std::cout are global variables. So I instead use constructor 4
- *   and pass in a dummy deleter which doesn't do anything. I think that the way I created
- *   and passed the deleter is valid, because one of the examples in that ref page declares
- *   the deleter like this:
- *     [](auto p) {std::cout << "Call delete from lambda...\n"; delete p;}
- * 
  * Error Handling:
- *   This reference page documents all the ways that I/O functions can fail:
- *   https://en.cppreference.com/w/cpp/io/ios_base/iostate
- *   It looks like constructing ifstream/ofstream can only fail if the file cannot
- *   be opened. If that happens, then the failbit is set; see here (we're using constructor 4):
- *   https://en.cppreference.com/w/cpp/io/basic_ifstream/basic_ifstream
+ *   Opening a file can only fail in one way that matters to us: we don't get a descriptor.
+ *   ByteSource::open_file and ByteSink::open_file return an object that isn't open in that
+ *   case, and we turn that into the error message and the FileError.
  *
- * Binary Mode:
- *   By default, it seems that ifstream/ofstream are opened in text mode. Details for
- *   text mode are here: https://en.cppreference.com/w/cpp/io/c/FILE#Binary_and_text_modes
- *   This doesn't matter for POSIX systems but it does for Windows. On Windows, CRLF
- *   will be converted to LF on input and vice versa for output.
- *   The docs for the constructors for basic_ifstream and basic_ofstream discuss how
- *   to add the mode arg. There is also some relevant documentation from Microsoft:
- *   https://docs.microsoft.com/en-us/cpp/standard-library/binary-output-files?view=msvc-160
+ *   Both files are opened before either one is checked, so (just like before) the output
+ *   file is created even if the input file can't be opened.
  *
- *   NOTE: std::cin and std::cout are opened in text mode! And according to SO, there
- *   is not a platform-independent way to change that: https://stackoverflow.com/a/7587701
- *   In other words, on Windows this program does not function 100% correctly unless
- *   the user gives a filename for both input and output.
+ * Binary Mode:
+ *   The files are opened in binary mode on Windows (see ByteStream.cpp), so that CRLF isn't
+ *   converted to LF on input or vice versa for output. stdin and stdout are switched to
+ *   binary mode in parse(), before the StreamPair is made.
  */
 
-auto deleter = [](auto){}; // parameter name omitted to silence "unused parameter" warnings
-
 void StreamPair::check_in(const std::string& inputfile) {
-    if (in->fail()) {
+    if (!in.is_open()) {
         std::cerr << "Failed to open input file \"" << inputfile << "\". Exiting now." << std::endl;
         throw FileError();
     }
 }
 
 void StreamPair::check_out(const std::string &outputfile) {
-    if (out->fail()) {
+    if (!out.is_open()) {
         std::cerr << "Failed to open output file \"" << outputfile << "\". Exiting now." << std::endl;
         throw FileError();
     }
 }
 
-StreamPair::StreamPair(const std::string &inputfile, const std::string &outputfile) : 
-    in(new std::ifstream(inputfile, std::ios_base::binary)),
-    out(new std::ofstream(outputfile, std::ios_base::binary)) {
+void StreamPair::open_in(const std::string& inputfile) {
+    mapped = MappedFile::open(inputfile);
+}
+
+StreamPair::StreamPair(const std::string &inputfile, const std::string &outputfile, bool append_output) :
+    in(ByteSource::open_file(inputfile)),
+    out(ByteSink::open_file(outputfile, append_output)) {
         check_in(inputfile);
         check_out(outputfile);
+        open_in(inputfile);
 }
 
-StreamPair::StreamPair(const std::string &inputfile, bool) : 
-    in(new std::ifstream(inputfile, std::ios_base::binary)),
-    out(&std::cout, deleter) {
+StreamPair::StreamPair(const std::string &inputfile, bool) :
+    in(ByteSource::open_file(inputfile)),
+    out(ByteSink::standard_output()) {
         check_in(inputfile);
+        open_in(inputfile);
 }
 
 StreamPair::StreamPair(bool, const std::string &outputfile) :
-    in(&std::cin, deleter),
-    out(new std::ofstream(outputfile, std::ios_base::binary)) {
+    in(ByteSource::standard_input()),
+    out(ByteSink::open_file(outputfile)) {
         check_out(outputfile);
 }
 
 StreamPair::StreamPair(bool, bool) :
-    in(&std::cin, deleter),
-    out(&std::cout, deleter) {}
+    in(ByteSource::standard_input()),
+    out(ByteSink::standard_output()) {}
+
+void StreamPair::decompress_input() {
+    Compression format = detect_compression(in);
+    if (format == Compression::None) {
+        return;
+    }
+    if (!compression_available(format)) {
+        std::cerr << "The input is compressed with " << compression_name(format) << ", which this build of escape can't read. Exiting now." << std::endl;
+        throw FileError();
+    }
+    mapped.reset();
+    in = decompress_source(std::move(in), format);
+}
+
+void StreamPair::compress_output(Compression format) {
+    out = compress_sink(std::move(out), format);
+}
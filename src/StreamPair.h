@@ -5,28 +5,31 @@
 #ifndef ESCAPE_UTF8_STREAMPAIR_H
 #define ESCAPE_UTF8_STREAMPAIR_H
 
-#include <istream>
-#include <ostream>
 #include <exception>
 #include <string>
 #include <memory>
 
+#include "ByteStream.h"
+#include "MappedFile.h"
+#include "compression.h"
+
 class FileError : public std::exception {};
 
 /**
- * This is a class that encapsulates the input & output streams
+ * This is a class that encapsulates the input & output
  * used throughout the program.
  *
  * Usage:
  *   All resources are managed internally. The user doesn't need to worry about
  *   deallocating anything.
  *
- *   There are 4 constructors, and all are used the same way. The first positional
+ *   There are 4 main constructors, and all are used the same way. The first positional
  *   argument is the name of the input file or, if we're reading from stdin, a
  *   bool. The second positional argument is analogous for the output file.
  *   For the bools, it doesn't matter whether you pass true or false; the parameter is just a
  *   tag to differentiate the cases where you're either only passing the inputfile
- *   or only passing the outputfile.
+ *   or only passing the outputfile. (The fifth one is for a source and sink made some
+ *   other way.)
  *
  *   THE CONSTRUCTORS CAN THROW. Well, the constructors taking at least one string
  *   as input can throw. If a file cannot be opened for reading/writing, then the
@@ -39,41 +42,73 @@ class FileError : public std::exception {};
  *   best practice: https://isocpp.org/wiki/faq/exceptions#ctors-can-throw
  *
  *
- *   I'm using shared_ptrs to hold the streams largely because unique_ptr isn't
- *   copy-constructible or copy-assignable. I need to be able to construct the
- *   StreamPair in one function and then pass it to another function. The best
- *   solution would probably be to do a move, but in all honesty I don't quite
- *   trust myself to write correct code with moves. 
- *   This also rules out storing the value of the object itself, as opposed to a pointer.
- *   That wouldn't work because copy assignment is not allowed for streams; it doesn't 
- *   make sense to copy them. It also wouldn't work because I want polymorphism; I need to
- *   be able to store a pointer to the parent class (std::istream and std::ostream).
+ *   The input and output used to be std::istream and std::ostream, held in shared_ptrs
+ *   so that a StreamPair could be copied from one function to another without any moves.
+ *   Now they're a ByteSource and a ByteSink (see ByteStream.h), which read and write the
+ *   file descriptors directly, and hand out whole buffers of input instead of one read()
+ *   call's worth at a time. They're move-only, and so is StreamPair: parse() makes one and
+ *   moves it out to main(), and everything after that takes it by reference.
+ *
+ *
+ *   When the input is a regular file, we also try to memory-map it (see MappedFile.h),
+ *   and if that works, read_and_escape reads from the mapping instead of from the source.
+ *   The source is still opened either way, since that's how we find out whether the file
+ *   can be opened at all, and it keeps the error messages the same as before.
  *
+ *   The zero-copy path (see zero_copy.h), io_uring (see BlockIO.h) and the streaming mode
+ *   (see streaming.h) use the file descriptors of the source and the sink directly, on
+ *   Linux. Whichever path runs is the only one that uses them.
  *
- *   There's one other issue: std::istream and std::ostream use signed char in the
- *   type parameter by default. This is annoying, because I use unsigned chars everywhere,
- *   but it's necessary because std::cin and std::cout are parameterized on signed chars.
- *   This just means we have to cast in business_logic.cpp.
+ *
+ *   decompress_input and compress_output put a decompressor or a compressor in front of the
+ *   source or the sink (see compression.h). Neither of those has a file descriptor, so the
+ *   paths above don't get used then.
  */
 class StreamPair {
 public:
-    std::shared_ptr<std::istream> in;
-    std::shared_ptr<std::ostream> out;
+    ByteSource in;
+    ByteSink out;
+    // The mapping of the input file, or null if the input is stdin or couldn't be mapped.
+    std::shared_ptr<MappedFile> mapped;
     StreamPair() = delete;
+    StreamPair(StreamPair&&) = default;
+    StreamPair& operator=(StreamPair&&) = default;
 
     /*
      * In these constructors, the bool parameter serves only as a tag to
      * differentiate between different constructors that would otherwise
      * have the same signature; that is, the constructors that take 1 string.
      * It is not used, so I have omitted the parameter name.
+     * append_output opens the output file for appending instead of truncating it.
      */
-    StreamPair(const std::string& inputfile, const std::string& outputfile);
+    StreamPair(const std::string& inputfile, const std::string& outputfile, bool append_output = false);
     StreamPair(const std::string& inputfile, bool);
     StreamPair(bool, const std::string& outputfile);
     StreamPair(bool, bool);
+
+    /*
+     * This one takes a source and a sink that are already open, such as strings for the
+     * tests. It doesn't throw.
+     */
+    StreamPair(ByteSource in, ByteSink out) : in(std::move(in)), out(std::move(out)) {}
+
+    /**
+     * If the input is compressed, puts a decompressor in front of it, and drops the mapping,
+     * since the bytes in the file aren't the ones to escape.
+     * This can throw FileError (after printing an error message), if the input is compressed
+     * in a format that this build of escape can't read.
+     */
+    void decompress_input();
+
+    /**
+     * Puts a compressor in front of the output, which compresses it in the given format. The
+     * format has to be available (see compression_available).
+     */
+    void compress_output(Compression format);
 private:
     void check_in(const std::string& inputfile);
     void check_out(const std::string& outputfile);
+    void open_in(const std::string& inputfile);
 };
 
 
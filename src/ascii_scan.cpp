@@ -0,0 +1,219 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <atomic>
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint64_t
+#include <cstdlib> // std::getenv
+#include <cstring> // std::memcpy
+
+#include "ascii_scan.h"
+#include "ascii_scan_kernels.h"
+
+/*
+ * IMPLEMENTATION NOTES
+ * Choosing a tier:
+ *   One binary has to run on every x86-64 CPU (and we can't build with -march=native), so
+ *   every tier is compiled in and we pick one at runtime; see cpu_features.h. The SIMD tiers
+ *   are in ascii_scan_x86.cpp. The tier in use is a pointer to a table of functions, so
+ *   each scan costs one indirect call more than calling the code directly. A scan is at
+ *   least one run of pass-through bytes, so that's noise next to the escaping around it.
+ *   The pointer starts out null and is filled in the first time it's needed, from the
+ *   environment variable ESCAPE_UTF8_KERNEL or from cpuid. Doing it then, rather than in
+ *   a static initializer, means that it works from the library too, and that --kernel
+ *   (set_kernel_tier) can get in first so we don't even look at the environment variable.
+ *
+ * SWAR ("SIMD within a register"):
+ *   This is 8 bytes at a time in a 64-bit integer, using only integer arithmetic, for CPUs
+ *   without any SIMD instructions that we know about. The trick is to do the comparisons
+ *   with additions that carry into the top bit of each byte. First we set aside the top
+ *   bits (the non-ASCII bytes), so every byte y is at most 127. Then y + (128 - lo) has its
+ *   top bit set if and only if y >= lo, and it's at most 255, so it never carries into the
+ *   next byte. Likewise y + (127 - hi) has its top bit set if and only if y > hi. The three
+ *   whitespace characters are checked for with the usual exact test for a zero byte in
+ *   x ^ (the character). Once a word has a byte that isn't passed through, we go through
+ *   its bytes one at a time to find which, which doesn't depend on the byte order.
+ *   Reference: https://graphics.stanford.edu/~seander/bithacks.html#ZeroInWord
+ */
+
+std::size_t scalar_prefix_len(const unsigned char *data, std::size_t len) {
+    for (std::size_t i = 0; i < len; ++i) {
+        if (!is_passthrough(data[i])) {
+            return i;
+        }
+    }
+    return len;
+}
+
+std::size_t scalar_prefix_len_in_set(const unsigned char *data, std::size_t len, const PreserveSet& set) {
+    for (std::size_t i = 0; i < len; ++i) {
+        if (!set.contains(data[i])) {
+            return i;
+        }
+    }
+    return len;
+}
+
+static const std::uint64_t ONES = 0x0101010101010101u;
+static const std::uint64_t HIGHS = 0x8080808080808080u;
+
+/**
+ * Loads 8 bytes (in whatever order this CPU uses). memcpy is how to do an unaligned load
+ * without breaking the aliasing rules; compilers turn it into a single load.
+ */
+static inline std::uint64_t load_word(const unsigned char *data) {
+    std::uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+/**
+ * Returns a word with the top bit of each byte set if that byte of x is 0, and every
+ * other bit clear.
+ */
+static inline std::uint64_t zero_bytes(std::uint64_t x) {
+    return ~(((x & ~HIGHS) + ~HIGHS) | x) & HIGHS;
+}
+
+static std::size_t swar_prefix_len(const unsigned char *data, std::size_t len) {
+    std::size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        std::uint64_t x = load_word(data + i);
+        std::uint64_t y = x & ~HIGHS;
+        std::uint64_t at_least_32 = y + 0x60 * ONES;
+        std::uint64_t is_127 = y + ONES;
+        std::uint64_t ok = (at_least_32 & ~is_127 & ~x) | zero_bytes(x ^ (9 * ONES)) |
+                           zero_bytes(x ^ (10 * ONES)) | zero_bytes(x ^ (13 * ONES));
+        if ((ok & HIGHS) != HIGHS) {
+            return i + scalar_prefix_len(data + i, 8);
+        }
+    }
+    return i + scalar_prefix_len(data + i, len - i);
+}
+
+static std::size_t swar_prefix_len_in_set(const unsigned char *data, std::size_t len, const PreserveSet& set) {
+    std::size_t i = 0;
+    if (set.fits_in_ranges()) {
+        const std::size_t num_ranges = set.num_ranges();
+        std::uint64_t to_low[PreserveSet::MAX_RANGES]; // 128 - lo in every byte
+        std::uint64_t past_high[PreserveSet::MAX_RANGES]; // 127 - hi in every byte
+        for (std::size_t k = 0; k < num_ranges; ++k) {
+            to_low[k] = (0x80u - set.range_lows()[k]) * ONES;
+            past_high[k] = (0x7Fu - set.range_highs()[k]) * ONES;
+        }
+        for (; i + 8 <= len; i += 8) {
+            std::uint64_t x = load_word(data + i);
+            std::uint64_t y = x & ~HIGHS;
+            std::uint64_t ok = 0;
+            for (std::size_t k = 0; k < num_ranges; ++k) {
+                ok |= (y + to_low[k]) & ~(y + past_high[k]);
+            }
+            if ((ok & ~x & HIGHS) != HIGHS) {
+                return i + scalar_prefix_len_in_set(data + i, 8, set);
+            }
+        }
+    }
+    return i + scalar_prefix_len_in_set(data + i, len - i, set);
+}
+
+static const ScanKernels SCALAR_KERNELS = {KernelTier::Scalar, scalar_prefix_len, scalar_prefix_len_in_set, scalar_utf8_valid,
+                                           scalar_escaped_length};
+static const ScanKernels SWAR_KERNELS = {KernelTier::Swar, swar_prefix_len, swar_prefix_len_in_set, swar_utf8_valid,
+                                         scalar_escaped_length};
+
+const ScanKernels *scalar_scan_kernels() {
+    return &SCALAR_KERNELS;
+}
+
+const ScanKernels *swar_scan_kernels() {
+    return &SWAR_KERNELS;
+}
+
+/**
+ * Returns the kernels for the given tier, or null if it wasn't compiled in.
+ */
+static const ScanKernels *compiled_kernels(KernelTier tier) {
+    switch (tier) {
+        case KernelTier::Scalar:
+            return scalar_scan_kernels();
+        case KernelTier::Swar:
+            return swar_scan_kernels();
+        case KernelTier::Sse2:
+            return sse2_scan_kernels();
+        case KernelTier::Sse42:
+            return sse42_scan_kernels();
+        case KernelTier::Avx2:
+            return avx2_scan_kernels();
+        case KernelTier::Avx512:
+            return avx512_scan_kernels();
+    }
+    return nullptr;
+}
+
+bool kernel_tier_available(KernelTier tier) {
+    return compiled_kernels(tier) != nullptr && cpu_supports(tier);
+}
+
+// The kernels in use, or null if they haven't been chosen yet.
+static std::atomic<const ScanKernels *> active_kernels(nullptr);
+
+/**
+ * Chooses the kernels to use, if that hasn't been done yet, and returns the ones in use.
+ * This is the slow path of kernels(), below.
+ */
+static const ScanKernels *choose_kernels() {
+    const ScanKernels *chosen = nullptr;
+    const char *forced = std::getenv("ESCAPE_UTF8_KERNEL");
+    KernelTier tier;
+    if (forced != nullptr && parse_kernel_tier(forced, tier) && kernel_tier_available(tier)) {
+        chosen = compiled_kernels(tier);
+    }
+    for (int k = NUM_KERNEL_TIERS - 1; chosen == nullptr; --k) {
+        // This stops at the scalar tier at the latest, since that's always available.
+        if (kernel_tier_available(static_cast<KernelTier>(k))) {
+            chosen = compiled_kernels(static_cast<KernelTier>(k));
+        }
+    }
+    // If another thread got in first (or --kernel did), use what it chose instead.
+    const ScanKernels *expected = nullptr;
+    if (!active_kernels.compare_exchange_strong(expected, chosen)) {
+        return expected;
+    }
+    return chosen;
+}
+
+/**
+ * Returns the kernels in use.
+ */
+static inline const ScanKernels *kernels() {
+    const ScanKernels *active = active_kernels.load(std::memory_order_acquire);
+    return (active != nullptr) ? active : choose_kernels();
+}
+
+const ScanKernels *active_scan_kernels() {
+    return kernels();
+}
+
+KernelTier active_kernel_tier() {
+    return kernels()->tier;
+}
+
+bool set_kernel_tier(KernelTier tier) {
+    if (!kernel_tier_available(tier)) {
+        return false;
+    }
+    active_kernels.store(compiled_kernels(tier));
+    return true;
+}
+
+std::size_t passthrough_prefix_len(const unsigned char *data, std::size_t len) {
+    return kernels()->prefix_len(data, len);
+}
+
+std::size_t passthrough_prefix_len(const unsigned char *data, std::size_t len, const PreserveSet& set) {
+    if (set.is_default()) {
+        return passthrough_prefix_len(data, len);
+    }
+    return kernels()->prefix_len_in_set(data, len, set);
+}
@@ -0,0 +1,78 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_ASCII_SCAN_H
+#define ESCAPE_UTF8_ASCII_SCAN_H
+
+#include <cstddef> // std::size_t
+
+#include "cpu_features.h" // KernelTier
+#include "preserve_set.h"
+
+/**
+ * Returns whether the given byte is passed through to the output unchanged.
+ * This is the set of printable US-ASCII characters [32, 126] plus tab (9),
+ * line feed (10) and carriage return (13). Every other byte either gets escaped
+ * or is part of a multi-byte UTF-8 character.
+ */
+inline bool is_passthrough(unsigned char byte) {
+    return (32 <= byte && byte <= 126) || byte == 9 || byte == 10 || byte == 13;
+}
+
+/**
+ * Returns the length of the longest prefix of the given buffer that consists
+ * only of pass-through bytes (see is_passthrough). In other words, this returns
+ * the index of the first byte that needs any work done to it, or len if there
+ * is no such byte.
+ *
+ * This is the hot loop for mostly-ASCII text, so there are several versions of it that
+ * look at 8 to 64 bytes at a time, and the fastest one that this CPU supports is used.
+ * See active_kernel_tier below.
+ * @param data Pointer to the first byte of the buffer. May be null if len is 0.
+ * @param len Number of bytes in the buffer.
+ * @return A number in [0, len].
+ */
+std::size_t passthrough_prefix_len(const unsigned char *data, std::size_t len);
+
+/**
+ * This is passthrough_prefix_len for any set of pass-through bytes (--preserve). It returns
+ * the index of the first byte that isn't in the given set, or len if there is no such byte.
+ *
+ * From SSE4.2 up, every set costs about the same: each byte is looked up in the set's
+ * nibble tables, or compared against all of its ranges in one instruction. The tiers below
+ * that check the set one range at a time, and a set with more than PreserveSet::MAX_RANGES
+ * ranges one byte at a time. The default set is handed off to the version above.
+ * @param data Pointer to the first byte of the buffer. May be null if len is 0.
+ * @param len Number of bytes in the buffer.
+ * @param set The bytes that are passed through.
+ * @return A number in [0, len].
+ */
+std::size_t passthrough_prefix_len(const unsigned char *data, std::size_t len, const PreserveSet& set);
+
+/**
+ * Returns the tier of the scanning code that the two functions above use, and so do
+ * utf8_valid and validate_block (see utf8_validate.h). Unless set_kernel_tier is called
+ * first, this is chosen the first time any of them is called (or this is): the tier named by
+ * the environment variable ESCAPE_UTF8_KERNEL, if that's one of the names from
+ * kernel_tier_name and it's available, and otherwise the best tier that's available.
+ */
+KernelTier active_kernel_tier();
+
+/**
+ * Returns whether the given tier was compiled into this program and this CPU supports it.
+ * The scalar and SWAR tiers are always available.
+ */
+bool kernel_tier_available(KernelTier tier);
+
+/**
+ * Makes the functions above use the given tier from now on (--kernel). This isn't meant to
+ * be called while another thread is scanning, though that would only mean that the other
+ * thread might keep using the old tier for a while.
+ * @param tier The tier to use.
+ * @return True if the tier is available (see kernel_tier_available), false otherwise, in
+ * which case nothing is changed.
+ */
+bool set_kernel_tier(KernelTier tier);
+
+#endif //ESCAPE_UTF8_ASCII_SCAN_H
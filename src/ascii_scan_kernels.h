@@ -0,0 +1,110 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_ASCII_SCAN_KERNELS_H
+#define ESCAPE_UTF8_ASCII_SCAN_KERNELS_H
+
+#include <cstddef> // std::size_t
+#include <cstdint> // uint_fast64_t
+
+#include "cpu_features.h"
+#include "escape_kernel.h" // EscapeFormat
+#include "preserve_set.h"
+
+/*
+ * This header is only for the files that have the tiers in them: ascii_scan.cpp,
+ * ascii_scan_x86.cpp, utf8_validate.cpp and measure.cpp. Everything else should use
+ * ascii_scan.h, utf8_validate.h and measure.h, which pick one of these for the CPU we're
+ * running on.
+ */
+
+/*
+ * The x86 tiers are compiled into every x86 build, whatever -m flags it has, with each
+ * function told which instruction set it may use by ESCAPE_UTF8_TARGET. See the top of
+ * ascii_scan_x86.cpp for why.
+ */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#if defined(__GNUC__) // Clang defines this too
+#define ESCAPE_UTF8_X86_KERNELS
+#define ESCAPE_UTF8_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_MSC_VER)
+#define ESCAPE_UTF8_X86_KERNELS
+#define ESCAPE_UTF8_TARGET(isa)
+#endif
+#endif
+
+#ifdef ESCAPE_UTF8_X86_KERNELS
+// AVX-512 intrinsics need VS 2017 15.3 or later, and we need 64-bit bit scans for its masks.
+#if !defined(_MSC_VER) || (_MSC_VER >= 1911 && defined(_M_X64))
+#define ESCAPE_UTF8_AVX512_KERNELS
+#endif
+#endif
+
+/**
+ * One version of the two scanning functions in ascii_scan.h, of utf8_valid (see
+ * utf8_validate.h) and of escaped_length (see measure.h). prefix_len is for the default set,
+ * and prefix_len_in_set is for any other set (it's never given the default one).
+ * escaped_length takes null for the default set.
+ */
+struct ScanKernels {
+    KernelTier tier;
+    std::size_t (*prefix_len)(const unsigned char *data, std::size_t len);
+    std::size_t (*prefix_len_in_set)(const unsigned char *data, std::size_t len, const PreserveSet& set);
+    bool (*utf8_valid)(const unsigned char *data, std::size_t len);
+    std::uint_fast64_t (*escaped_length)(const unsigned char *data, std::size_t len, EscapeFormat format,
+                                         const PreserveSet *set);
+};
+
+/**
+ * These return the kernels for each tier, or null if that tier wasn't compiled in (the
+ * x86 ones on other CPUs, or with a compiler we don't know how to ask for them). They don't
+ * check whether this CPU supports the tier; see cpu_supports.
+ */
+const ScanKernels *scalar_scan_kernels();
+const ScanKernels *swar_scan_kernels();
+const ScanKernels *sse2_scan_kernels();
+const ScanKernels *sse42_scan_kernels();
+const ScanKernels *avx2_scan_kernels();
+const ScanKernels *avx512_scan_kernels();
+
+/**
+ * The byte-at-a-time scans, for the tails of the buffers that the other tiers leave over.
+ */
+std::size_t scalar_prefix_len(const unsigned char *data, std::size_t len);
+std::size_t scalar_prefix_len_in_set(const unsigned char *data, std::size_t len, const PreserveSet& set);
+
+/**
+ * Returns the kernels in use. This is what active_kernel_tier (see ascii_scan.h) reports.
+ */
+const ScanKernels *active_scan_kernels();
+
+/**
+ * The versions of utf8_valid, in utf8_validate.cpp. The x86 ones are only there if the x86
+ * tiers are compiled in. The SSE4.2 tier uses the SSSE3 version, and the AVX-512 tier uses
+ * the AVX2 one.
+ */
+bool scalar_utf8_valid(const unsigned char *data, std::size_t len);
+bool swar_utf8_valid(const unsigned char *data, std::size_t len);
+#ifdef ESCAPE_UTF8_X86_KERNELS
+bool sse2_utf8_valid(const unsigned char *data, std::size_t len);
+bool ssse3_utf8_valid(const unsigned char *data, std::size_t len);
+bool avx2_utf8_valid(const unsigned char *data, std::size_t len);
+#endif
+
+/**
+ * The versions of escaped_length, in measure.cpp. The SWAR tier uses the scalar version, the
+ * SSE4.2 tier the SSSE3 one, and the AVX-512 tier the AVX2 one.
+ */
+std::uint_fast64_t scalar_escaped_length(const unsigned char *data, std::size_t len, EscapeFormat format,
+                                         const PreserveSet *set);
+#ifdef ESCAPE_UTF8_X86_KERNELS
+std::uint_fast64_t sse2_escaped_length(const unsigned char *data, std::size_t len, EscapeFormat format,
+                                       const PreserveSet *set);
+std::uint_fast64_t ssse3_escaped_length(const unsigned char *data, std::size_t len, EscapeFormat format,
+                                        const PreserveSet *set);
+std::uint_fast64_t avx2_escaped_length(const unsigned char *data, std::size_t len, EscapeFormat format,
+                                       const PreserveSet *set);
+#endif
+
+#endif //ESCAPE_UTF8_ASCII_SCAN_KERNELS_H
@@ -0,0 +1,409 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint32_t, std::uint64_t
+
+#include "ascii_scan_kernels.h"
+
+/*
+ * IMPLEMENTATION NOTES
+ * This file has the SIMD tiers of the scanning code for x86: SSE2, SSE4.2, AVX2 and
+ * AVX-512. Which one is used is decided at runtime (see ascii_scan.cpp), so all of them
+ * have to be compiled into every build, whatever -m flags the build has.
+ *
+ * Compiling code for instruction sets the build isn't targeting:
+ *   GCC and Clang only let us use an instruction set's intrinsics in a function that has
+ *   been told it can use it, which is what the target attribute (ESCAPE_UTF8_TARGET, in
+ *   ascii_scan_kernels.h) does. The usual alternative is to compile a whole file with e.g. -mavx2, but then any
+ *   inline function from a header that gets compiled in that file (std::vector's, say)
+ *   might be compiled with AVX2 too, and the linker is free to keep that copy for the
+ *   whole program, which then crashes on CPUs without AVX2. With the attribute, only the
+ *   functions here are affected. MSVC lets any function use any intrinsic, so there it
+ *   expands to nothing. We don't know how to do this with any other compiler, so with
+ *   those (and on other CPUs) we only have the portable tiers.
+ *   Each tier only uses full blocks, and hands the rest of the buffer to the tier below,
+ *   which the CPU is guaranteed to support too.
+ *
+ * Short runs:
+ *   In text with a lot of non-ASCII characters, most scans stop within a few bytes, and
+ *   then the cost of a scan is mostly the cost of getting started. For AVX2 and AVX-512
+ *   that's more than for SSE2: the wider constants have to be set up, and the upper halves
+ *   of the registers cleared on the way out. So those two tiers look at the first 16 bytes
+ *   with SSE2 (or SSSE3) first, and only go wide if all of them are passed through. On a
+ *   run of 6 bytes, that made the AVX2 and AVX-512 scans 25-30% faster, and it made no
+ *   difference we could measure from about 24 bytes up.
+ *
+ * Classifying a block:
+ *   SSE2 only has signed byte comparisons. That works out nicely here: if we treat each
+ *   byte as a signed char, all the bytes >= 128 become negative, so the single range
+ *   check (31 < x < 127) rejects them along with the control characters and DEL.
+ *   Then we OR in the three whitespace characters that are also passed through.
+ *   _mm_movemask_epi8 turns the result into a bitmask with 1 bit per byte; the first
+ *   0 bit is the first byte that isn't pass-through. AVX2 is the same with 32 bytes, and
+ *   AVX-512 is the same with 64 bytes, except that its comparisons give us the bitmask
+ *   directly.
+ *   SSE4.2 instead has PCMPESTRI, which compares each of 16 bytes against a list of up to
+ *   8 ranges and returns the index of the first byte that isn't in any of them. The default
+ *   set is the 3 ranges [9, 10], [13, 13] and [32, 126].
+ *
+ * Classifying a block against a custom set (--preserve):
+ *   With SSSE3 (which every SSE4.2 CPU has), PSHUFB looks up 16 bytes at once in a 16-byte
+ *   table. We look up each byte's low nibble in one table and its high nibble in another,
+ *   and AND the results; see PreserveSet::low_nibble_masks. That's the same number of
+ *   instructions as the hard-coded check above, whatever the set is. AVX2 and AVX-512 do
+ *   the same on 32 and 64 bytes. The SSE4.2 tier uses PCMPESTRI with the set's ranges if
+ *   there are few enough of them, and PSHUFB otherwise.
+ *   SSE2 doesn't have PSHUFB, so there we check the set one range of bytes at a time.
+ *   Like above, as signed chars the non-ASCII bytes are negative, so the check
+ *   (lo - 1 < x) rejects them for every range, and the check (x > hi) is never true for a
+ *   range that goes up to 127, so we don't have to worry about overflowing hi + 1.
+ */
+#ifdef ESCAPE_UTF8_X86_KERNELS
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h> // _BitScanForward
+#endif
+
+/**
+ * Returns the number of trailing zero bits in x, i.e. the index of the lowest set bit.
+ * x must not be 0.
+ */
+static inline unsigned int count_trailing_zeros(std::uint32_t x) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, x);
+    return static_cast<unsigned int>(idx);
+#else
+    return static_cast<unsigned int>(__builtin_ctz(x));
+#endif
+}
+
+/*
+ * SSE2
+ */
+
+/**
+ * Returns a mask with bit k set if byte k of the 16 bytes at data is passed through.
+ */
+ESCAPE_UTF8_TARGET("sse2")
+static inline std::uint32_t sse2_passthrough_mask(const unsigned char *data) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(31)), _mm_cmplt_epi8(x, _mm_set1_epi8(127)));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(x, _mm_set1_epi8(9)));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(x, _mm_set1_epi8(10)));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(x, _mm_set1_epi8(13)));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(ok));
+}
+
+ESCAPE_UTF8_TARGET("sse2")
+static std::size_t sse2_prefix_len(const unsigned char *data, std::size_t len) {
+    std::size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        std::uint32_t mask = sse2_passthrough_mask(data + i);
+        if (mask != 0xFFFFu) {
+            return i + count_trailing_zeros(~mask);
+        }
+    }
+    return i + scalar_prefix_len(data + i, len - i);
+}
+
+ESCAPE_UTF8_TARGET("sse2")
+static std::size_t sse2_prefix_len_in_set(const unsigned char *data, std::size_t len, const PreserveSet& set) {
+    std::size_t i = 0;
+    if (set.fits_in_ranges()) {
+        const std::size_t num_ranges = set.num_ranges();
+        const __m128i *below = reinterpret_cast<const __m128i *>(set.range_vectors()); // lo - 1 for each range
+        const __m128i *highs = below + PreserveSet::MAX_RANGES;
+        for (; i + 16 <= len; i += 16) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            __m128i ok = _mm_setzero_si128();
+            for (std::size_t k = 0; k < num_ranges; ++k) {
+                __m128i above_low = _mm_cmpgt_epi8(x, _mm_loadu_si128(below + k));
+                ok = _mm_or_si128(ok, _mm_andnot_si128(_mm_cmpgt_epi8(x, _mm_loadu_si128(highs + k)), above_low));
+            }
+            std::uint32_t mask = static_cast<std::uint32_t>(_mm_movemask_epi8(ok));
+            if (mask != 0xFFFFu) {
+                return i + count_trailing_zeros(~mask);
+            }
+        }
+    }
+    return i + scalar_prefix_len_in_set(data + i, len - i, set);
+}
+
+/*
+ * SSE4.2
+ */
+
+// The mode for PCMPESTRI: is each byte of the data in any of the ranges? The index we get
+// back is that of the first byte that isn't (because of the negative polarity), or 16 if
+// every byte is.
+static const int RANGES_MODE = _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT;
+
+/**
+ * Scans with PCMPESTRI for a byte that isn't in any of the ranges.
+ * @param ranges The ranges, as pairs of the lowest and highest byte in each; see
+ * PreserveSet::range_pairs.
+ * @param ranges_len The number of bytes of ranges that are used: twice the number of ranges.
+ */
+ESCAPE_UTF8_TARGET("sse4.2")
+static std::size_t sse42_prefix_len_in_ranges(const unsigned char *data, std::size_t len, __m128i ranges, int ranges_len,
+                                              std::size_t& i) {
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        int idx = _mm_cmpestri(ranges, ranges_len, x, 16, RANGES_MODE);
+        if (idx < 16) {
+            return i + static_cast<std::size_t>(idx);
+        }
+    }
+    return len;
+}
+
+ESCAPE_UTF8_TARGET("sse4.2")
+static std::size_t sse42_prefix_len(const unsigned char *data, std::size_t len) {
+    const __m128i ranges = _mm_setr_epi8(9, 10, 13, 13, 32, 126, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    std::size_t i = 0;
+    std::size_t found = sse42_prefix_len_in_ranges(data, len, ranges, 6, i);
+    return (found < len) ? found : i + scalar_prefix_len(data + i, len - i);
+}
+
+/**
+ * Returns a mask with bit k set if byte k of the 16 bytes at data is NOT in the set, using
+ * the PSHUFB lookups.
+ */
+ESCAPE_UTF8_TARGET("ssse3")
+static inline std::uint32_t ssse3_not_in_set_mask(const unsigned char *data, const PreserveSet& set) {
+    const __m128i low_masks = _mm_loadu_si128(reinterpret_cast<const __m128i *>(set.low_nibble_masks()));
+    const __m128i high_bits = _mm_loadu_si128(reinterpret_cast<const __m128i *>(set.high_nibble_bits()));
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    __m128i low = _mm_shuffle_epi8(low_masks, _mm_and_si128(x, nibble));
+    __m128i high = _mm_shuffle_epi8(high_bits, _mm_and_si128(_mm_srli_epi16(x, 4), nibble));
+    // 0xFF for every byte that is NOT in the set.
+    __m128i bad = _mm_cmpeq_epi8(_mm_and_si128(low, high), _mm_setzero_si128());
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(bad));
+}
+
+/**
+ * The PSHUFB scan on 16 bytes at a time, for a set with too many ranges for PCMPESTRI.
+ */
+ESCAPE_UTF8_TARGET("sse4.2")
+static std::size_t ssse3_prefix_len_in_set(const unsigned char *data, std::size_t len, const PreserveSet& set,
+                                           std::size_t& i) {
+    for (; i + 16 <= len; i += 16) {
+        std::uint32_t mask = ssse3_not_in_set_mask(data + i, set);
+        if (mask != 0) {
+            return i + count_trailing_zeros(mask);
+        }
+    }
+    return len;
+}
+
+ESCAPE_UTF8_TARGET("sse4.2")
+static std::size_t sse42_prefix_len_in_set(const unsigned char *data, std::size_t len, const PreserveSet& set) {
+    std::size_t i = 0;
+    std::size_t found;
+    if (set.fits_in_ranges()) {
+        const __m128i ranges = _mm_loadu_si128(reinterpret_cast<const __m128i *>(set.range_pairs()));
+        found = sse42_prefix_len_in_ranges(data, len, ranges, static_cast<int>(2 * set.num_ranges()), i);
+    } else {
+        found = ssse3_prefix_len_in_set(data, len, set, i);
+    }
+    return (found < len) ? found : i + scalar_prefix_len_in_set(data + i, len - i, set);
+}
+
+/*
+ * AVX2
+ */
+
+ESCAPE_UTF8_TARGET("avx2")
+static std::size_t avx2_prefix_len(const unsigned char *data, std::size_t len) {
+    const __m256i low = _mm256_set1_epi8(31);
+    const __m256i high = _mm256_set1_epi8(127);
+    const __m256i tab = _mm256_set1_epi8(9);
+    const __m256i lf = _mm256_set1_epi8(10);
+    const __m256i cr = _mm256_set1_epi8(13);
+    std::size_t i = 0;
+    if (len >= 16) {
+        std::uint32_t first = sse2_passthrough_mask(data);
+        if (first != 0xFFFFu) {
+            return count_trailing_zeros(~first);
+        }
+        i = 16;
+    }
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(x, low), _mm256_cmpgt_epi8(high, x));
+        ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(x, tab));
+        ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(x, lf));
+        ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(x, cr));
+        std::uint32_t mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(ok));
+        if (mask != 0xFFFFFFFFu) {
+            return i + count_trailing_zeros(~mask);
+        }
+    }
+    return i + sse42_prefix_len(data + i, len - i);
+}
+
+ESCAPE_UTF8_TARGET("avx2")
+static std::size_t avx2_prefix_len_in_set(const unsigned char *data, std::size_t len, const PreserveSet& set) {
+    // PSHUFB only shuffles within each 16-byte half, so both halves get a copy of the table.
+    const __m256i low_masks = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(set.low_nibble_masks())));
+    const __m256i high_bits = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(set.high_nibble_bits())));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+    std::size_t i = 0;
+    if (len >= 16) {
+        std::uint32_t first = ssse3_not_in_set_mask(data, set);
+        if (first != 0) {
+            return count_trailing_zeros(first);
+        }
+        i = 16;
+    }
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i low = _mm256_shuffle_epi8(low_masks, _mm256_and_si256(x, nibble));
+        __m256i high = _mm256_shuffle_epi8(high_bits, _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble));
+        __m256i bad = _mm256_cmpeq_epi8(_mm256_and_si256(low, high), zero);
+        std::uint32_t mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(bad));
+        if (mask != 0) {
+            return i + count_trailing_zeros(mask);
+        }
+    }
+    return i + sse42_prefix_len_in_set(data + i, len - i, set);
+}
+
+/*
+ * AVX-512
+ */
+
+#ifdef ESCAPE_UTF8_AVX512_KERNELS
+
+/**
+ * count_trailing_zeros for the 64-bit masks. x must not be 0.
+ */
+static inline unsigned int count_trailing_zeros64(std::uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, x);
+    return static_cast<unsigned int>(idx);
+#else
+    return static_cast<unsigned int>(__builtin_ctzll(x));
+#endif
+}
+
+ESCAPE_UTF8_TARGET("avx512f,avx512bw")
+static std::size_t avx512_prefix_len(const unsigned char *data, std::size_t len) {
+    const __m512i low = _mm512_set1_epi8(31);
+    const __m512i high = _mm512_set1_epi8(127);
+    const __m512i tab = _mm512_set1_epi8(9);
+    const __m512i lf = _mm512_set1_epi8(10);
+    const __m512i cr = _mm512_set1_epi8(13);
+    std::size_t i = 0;
+    if (len >= 16) {
+        std::uint32_t first = sse2_passthrough_mask(data);
+        if (first != 0xFFFFu) {
+            return count_trailing_zeros(~first);
+        }
+        i = 16;
+    }
+    for (; i + 64 <= len; i += 64) {
+        __m512i x = _mm512_loadu_si512(data + i);
+        __mmask64 ok = _mm512_cmpgt_epi8_mask(x, low) & _mm512_cmplt_epi8_mask(x, high);
+        ok |= _mm512_cmpeq_epi8_mask(x, tab) | _mm512_cmpeq_epi8_mask(x, lf) | _mm512_cmpeq_epi8_mask(x, cr);
+        std::uint64_t bad = ~static_cast<std::uint64_t>(ok);
+        if (bad != 0) {
+            return i + count_trailing_zeros64(bad);
+        }
+    }
+    return i + avx2_prefix_len(data + i, len - i);
+}
+
+ESCAPE_UTF8_TARGET("avx512f,avx512bw")
+static std::size_t avx512_prefix_len_in_set(const unsigned char *data, std::size_t len, const PreserveSet& set) {
+    // Like with AVX2, PSHUFB works within each 16-byte quarter, so each gets a copy. (The
+    // zero-masking version of the broadcast, with nothing masked, is the same thing, but
+    // some versions of GCC warn about the plain one.)
+    const __m512i low_masks = _mm512_maskz_broadcast_i32x4(0xFFFF,
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(set.low_nibble_masks())));
+    const __m512i high_bits = _mm512_maskz_broadcast_i32x4(0xFFFF,
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(set.high_nibble_bits())));
+    const __m512i nibble = _mm512_set1_epi8(0x0F);
+    std::size_t i = 0;
+    if (len >= 16) {
+        std::uint32_t first = ssse3_not_in_set_mask(data, set);
+        if (first != 0) {
+            return count_trailing_zeros(first);
+        }
+        i = 16;
+    }
+    for (; i + 64 <= len; i += 64) {
+        __m512i x = _mm512_loadu_si512(data + i);
+        __m512i low = _mm512_shuffle_epi8(low_masks, _mm512_and_si512(x, nibble));
+        __m512i high = _mm512_shuffle_epi8(high_bits, _mm512_and_si512(_mm512_srli_epi16(x, 4), nibble));
+        // A 1 bit for every byte whose two lookups have a bit in common, i.e. that's in the set.
+        std::uint64_t bad = ~static_cast<std::uint64_t>(_mm512_test_epi8_mask(low, high));
+        if (bad != 0) {
+            return i + count_trailing_zeros64(bad);
+        }
+    }
+    return i + avx2_prefix_len_in_set(data + i, len - i, set);
+}
+
+#endif // ESCAPE_UTF8_AVX512_KERNELS
+
+static const ScanKernels SSE2_KERNELS = {KernelTier::Sse2, sse2_prefix_len, sse2_prefix_len_in_set, sse2_utf8_valid,
+                                         sse2_escaped_length};
+static const ScanKernels SSE42_KERNELS = {KernelTier::Sse42, sse42_prefix_len, sse42_prefix_len_in_set,
+                                          ssse3_utf8_valid, ssse3_escaped_length};
+static const ScanKernels AVX2_KERNELS = {KernelTier::Avx2, avx2_prefix_len, avx2_prefix_len_in_set, avx2_utf8_valid,
+                                         avx2_escaped_length};
+
+const ScanKernels *sse2_scan_kernels() {
+    return &SSE2_KERNELS;
+}
+
+const ScanKernels *sse42_scan_kernels() {
+    return &SSE42_KERNELS;
+}
+
+const ScanKernels *avx2_scan_kernels() {
+    return &AVX2_KERNELS;
+}
+
+#ifdef ESCAPE_UTF8_AVX512_KERNELS
+static const ScanKernels AVX512_KERNELS = {KernelTier::Avx512, avx512_prefix_len, avx512_prefix_len_in_set,
+                                           avx2_utf8_valid, avx2_escaped_length};
+
+const ScanKernels *avx512_scan_kernels() {
+    return &AVX512_KERNELS;
+}
+#else
+const ScanKernels *avx512_scan_kernels() {
+    return nullptr;
+}
+#endif
+
+#else // ESCAPE_UTF8_X86_KERNELS
+
+const ScanKernels *sse2_scan_kernels() {
+    return nullptr;
+}
+
+const ScanKernels *sse42_scan_kernels() {
+    return nullptr;
+}
+
+const ScanKernels *avx2_scan_kernels() {
+    return nullptr;
+}
+
+const ScanKernels *avx512_scan_kernels() {
+    return nullptr;
+}
+
+#endif // ESCAPE_UTF8_X86_KERNELS
@@ -0,0 +1,404 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <algorithm> // std::sort
+#include <cstdlib> // realpath, free
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+#include "batch.h"
+#include "business_logic.h" // ESCAPE_BLOCK_SIZE
+#include "escape_kernel.h"
+#include "in_place.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ESCAPE_UTF8_HAVE_DIRENT
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#elif defined(_WIN32)
+#include <direct.h> // _mkdir
+#endif
+
+/*
+ * How batch mode works
+ *   First the whole list of files is worked out on the main thread (collect_batch_files), so
+ *   that every file has an index, and each worker thread gets a contiguous range of the
+ *   indices to start with. Files next to each other in the list are usually in the same
+ *   directory, so that keeps each thread mostly in one place. But the files can be of very
+ *   different sizes, so a thread that runs out of work steals from the other end of another
+ *   thread's range: that's the work-stealing part. Nothing is ever added to the queues, so
+ *   once every queue is empty, all of the work has been handed out.
+ *
+ *   Each thread has its own input and output buffers (BatchBuffers), which it lends to the
+ *   ByteSource and ByteSink of every file and takes back afterwards, so escaping lots of
+ *   small files doesn't mean lots of allocations. Each block is escaped from the source's
+ *   buffer straight into the sink's, so nothing is copied on the way either.
+ *
+ *   The exit status of each file goes into its own slot in a vector, so the threads never
+ *   write to the same place. The status lines are only printed at the end, after all the
+ *   threads are done, so that they come out in the order the files were listed no matter
+ *   which thread finished first.
+ */
+
+/**
+ * Returns the path of the output file for the given input, when the outputs go under
+ * output_dir. The input path is put under output_dir as-is, except that a leading "/" and
+ * any "." and ".." parts are left out, so that the output can't end up outside output_dir.
+ */
+static std::string output_path_under(const std::string& output_dir, const std::string& input) {
+    std::string result = output_dir;
+    std::size_t start = 0;
+    while (start <= input.size()) {
+        std::size_t end = input.find_first_of("/\\", start);
+        if (end == std::string::npos) {
+            end = input.size();
+        }
+        std::string part = input.substr(start, end - start);
+        if (!part.empty() && part != "." && part != "..") {
+            if (!result.empty() && result.back() != '/') {
+                result += '/';
+            }
+            result += part;
+        }
+        start = end + 1;
+    }
+    return result;
+}
+
+/**
+ * Returns the absolute path of the file at path, with every symbolic link followed, or just
+ * path if that can't be worked out (for example, because the file doesn't exist).
+ */
+static std::string resolved_path(const std::string& path) {
+#ifdef ESCAPE_UTF8_HAVE_DIRENT
+    char *resolved = realpath(path.c_str(), nullptr);
+    if (resolved != nullptr) {
+        std::string result(resolved);
+        free(resolved);
+        return result;
+    }
+#endif
+    return path;
+}
+
+/**
+ * Returns whether str ends with suffix.
+ */
+static bool ends_with(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/**
+ * Adds path to paths. If recursive is true and path is a directory, the files in it (and in
+ * its subdirectories, in sorted order) are added instead. Symbolic links to files are
+ * followed, but symbolic links to directories aren't, so that a link loop can't make this
+ * go on forever. Files whose names end with skip_suffix are skipped, since those are the
+ * outputs of an earlier run with --suffix.
+ */
+static void add_input(const std::string& path, bool recursive, const std::string& skip_suffix, std::vector<std::string>& paths) {
+#ifdef ESCAPE_UTF8_HAVE_DIRENT
+    struct stat info;
+    if (recursive && stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+        DIR *dir = opendir(path.c_str());
+        if (dir) {
+            std::vector<std::string> names;
+            while (struct dirent *entry = readdir(dir)) {
+                std::string name(entry->d_name);
+                if (name != "." && name != "..") {
+                    names.push_back(name);
+                }
+            }
+            closedir(dir);
+            std::sort(names.begin(), names.end());
+            std::string prefix = (path.back() == '/') ? path : path + "/";
+            for (const std::string& name : names) {
+                std::string child = prefix + name;
+                struct stat child_info;
+                if (lstat(child.c_str(), &child_info) != 0) {
+                    paths.push_back(child); // Let escape_file report it.
+                } else if (S_ISDIR(child_info.st_mode)) {
+                    add_input(child, recursive, skip_suffix, paths);
+                } else if (S_ISREG(child_info.st_mode) ||
+                           (S_ISLNK(child_info.st_mode) && stat(child.c_str(), &child_info) == 0 && S_ISREG(child_info.st_mode))) {
+                    if (skip_suffix.empty() || !ends_with(name, skip_suffix)) {
+                        paths.push_back(child);
+                    }
+                }
+                // Anything else (sockets, devices, links to directories) is skipped.
+            }
+            return;
+        }
+    }
+#else
+    (void)recursive; // We can't list directories here, so escape_file will fail to open them.
+    (void)skip_suffix;
+#endif
+    paths.push_back(path);
+}
+
+int collect_batch_files(const Options& options, std::istream& list_stream, std::vector<BatchFile>& files) {
+    std::vector<std::string> paths;
+    for (const std::string& input : options.inputs) {
+        add_input(input, options.recursive, options.suffix, paths);
+    }
+    if (!options.files_from.empty()) {
+        std::ifstream list_file;
+        std::istream *list = &list_stream;
+        if (options.files_from != "-") {
+            list_file.open(options.files_from, std::ios_base::binary);
+            if (list_file.fail()) {
+                std::cerr << "Failed to open input file \"" << options.files_from << "\". Exiting now." << std::endl;
+                return 1;
+            }
+            list = &list_file;
+        }
+        std::string line;
+        while (std::getline(*list, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back(); // The list was written on Windows.
+            }
+            if (!line.empty()) {
+                add_input(line, options.recursive, options.suffix, paths);
+            }
+        }
+        if (list->bad()) {
+            std::cerr << "Failed when trying to read the list of files \"" << options.files_from << "\" due to unknown error." << std::endl;
+            return 3;
+        }
+    }
+
+    std::unordered_set<std::string> outputs;
+    for (const std::string& path : paths) {
+        BatchFile file;
+        file.input = path;
+        if (options.in_place) {
+            // Escaping a file in place twice would escape the backslashes of the first time
+            // (with --preserve), so two paths to the same file count as the same output.
+            file.output = resolved_path(path);
+        } else {
+            file.output = options.output_dir.empty() ? path + options.suffix : output_path_under(options.output_dir, path);
+        }
+        if (!outputs.insert(file.output).second) {
+            // Two inputs would be escaped to the same output, e.g. "a" and "../a", or the
+            // same file was listed twice. Only the first one gets escaped.
+            std::cerr << "Skipping \"" << path << "\" because another file already has the output file \"" << file.output << "\"." << std::endl;
+            continue;
+        }
+        files.push_back(file);
+    }
+    return 0;
+}
+
+/**
+ * Creates the directories that the file at path will be in, if they don't exist yet.
+ */
+static void make_parent_dirs(const std::string& path) {
+    for (std::size_t pos = path.find_first_of("/\\", 1); pos != std::string::npos; pos = path.find_first_of("/\\", pos + 1)) {
+        std::string dir = path.substr(0, pos);
+#ifdef ESCAPE_UTF8_HAVE_DIRENT
+        mkdir(dir.c_str(), 0777); // If it already exists, that's fine.
+#elif defined(_WIN32)
+        _mkdir(dir.c_str());
+#endif
+    }
+}
+
+int escape_file(const BatchFile& file, BatchBuffers& buffers, const EscapeSettings& settings, Compression compress) {
+#ifdef ESCAPE_UTF8_HAVE_DIRENT
+    // open() will happily open a directory, and then fail to read it. We want to treat
+    // that as a file that can't be opened, like a missing file.
+    struct stat info;
+    if (stat(file.input.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+        return 1;
+    }
+#endif
+    ByteSource in = ByteSource::open_file(file.input);
+    if (!in.is_open()) {
+        return 1;
+    }
+    in.adopt_buffer(std::move(buffers.in));
+    Compression format = detect_compression(in);
+    if (format != Compression::None) {
+        if (!compression_available(format)) {
+            buffers.in = in.release_buffer();
+            return 1; // As in StreamPair::decompress_input
+        }
+        in = decompress_source(std::move(in), format);
+    }
+    ByteSink out = ByteSink::open_file(file.output);
+    if (!out.is_open()) {
+        // Most likely the directory for it doesn't exist yet.
+        make_parent_dirs(file.output);
+        out = ByteSink::open_file(file.output);
+        if (!out.is_open()) {
+            buffers.in = in.release_buffer();
+            return 1;
+        }
+    }
+    if (compress != Compression::None) {
+        out = compress_sink(std::move(out), compress);
+    }
+    out.adopt_buffer(std::move(buffers.out));
+
+    EscapeState state;
+    const std::size_t bound = escape_output_bound(ESCAPE_BLOCK_SIZE, settings.format);
+    int retval = 0;
+    while (true) {
+        const unsigned char *data;
+        std::size_t len = in.pull(data, ESCAPE_BLOCK_SIZE);
+        if (len == 0) {
+            if (in.error()) {
+                retval = 3;
+            } else if (!state.at_boundary()) {
+                retval = 2;
+            }
+            break;
+        }
+        unsigned char *outbuf = out.reserve(bound);
+        if (outbuf == nullptr) {
+            break; // Reported below
+        }
+        out.commit(escape_block(state, data, len, outbuf, settings));
+        if (state.invalid) {
+            retval = 2;
+            break;
+        }
+    }
+    bool closed = out.close();
+    // If the input or the output went through a stage, these are the stage's buffers
+    // rather than the ones we lent, but they're just as good for the next file.
+    buffers.in = in.release_buffer();
+    buffers.out = out.release_buffer();
+    return closed ? retval : 4;
+}
+
+namespace {
+
+/**
+ * The work-stealing queues of file indices (see the top of this file). Each worker takes
+ * files from the front of its own queue, and when that's empty, from the back of the others'.
+ */
+class WorkQueues {
+public:
+    WorkQueues(std::size_t num_files, unsigned int num_workers) : queues(num_workers) {
+        for (unsigned int w = 0; w < num_workers; ++w) {
+            std::size_t begin = num_files * w / num_workers;
+            std::size_t end = num_files * (w + 1) / num_workers;
+            for (std::size_t i = begin; i < end; ++i) {
+                queues[w].files.push_back(i);
+            }
+        }
+    }
+
+    /**
+     * Gets the next file for the given worker to escape.
+     * @return False if there are no files left anywhere.
+     */
+    bool next(unsigned int worker, std::size_t& file) {
+        for (std::size_t k = 0; k < queues.size(); ++k) {
+            Queue& queue = queues[(worker + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.files.empty()) {
+                continue;
+            }
+            if (k == 0) {
+                file = queue.files.front();
+                queue.files.pop_front();
+            } else {
+                // Stealing from the other end means we don't compete with the owner for
+                // the same files, and we take the ones it would have gotten to last.
+                file = queue.files.back();
+                queue.files.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::size_t> files;
+    };
+    std::vector<Queue> queues;
+};
+
+} // namespace
+
+int batch_escape(const Options& options, StreamPair& streams) {
+    std::vector<BatchFile> files;
+    std::istringstream list_stream;
+    if (options.files_from == "-") {
+        // The list is read all at once, since it's small next to the files in it.
+        std::string list;
+        const unsigned char *data;
+        std::size_t len;
+        while ((len = streams.in.pull(data, BYTE_STREAM_BUFFER_SIZE)) > 0) {
+            list.append(reinterpret_cast<const char *>(data), len);
+        }
+        if (streams.in.error()) {
+            std::cerr << "Failed when trying to read the list of files \"-\" due to unknown error." << std::endl;
+            return 3;
+        }
+        list_stream.str(list);
+    }
+    int retval = collect_batch_files(options, list_stream, files);
+    if (retval != 0) {
+        return retval;
+    }
+
+    unsigned int num_threads = options.threads;
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+        if (num_threads == 0) { // The number of cores isn't known.
+            num_threads = 1;
+        }
+    }
+    if (num_threads > files.size()) {
+        num_threads = files.empty() ? 1 : static_cast<unsigned int>(files.size());
+    }
+
+    std::vector<int> statuses(files.size(), 0);
+    WorkQueues queues(files.size(), num_threads);
+    const EscapeSettings settings(options.format, options.preserve);
+    const Compression compress = options.compress;
+    const bool in_place = options.in_place;
+    auto work = [&files, &statuses, &queues, &settings, compress, in_place](unsigned int worker) {
+        BatchBuffers buffers;
+        std::size_t i;
+        while (queues.next(worker, i)) {
+            if (in_place) {
+                statuses[i] = escape_in_place(files[i].output, settings);
+            } else {
+                statuses[i] = escape_file(files[i], buffers, settings, compress);
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int w = 1; w < num_threads; ++w) {
+        threads.emplace_back(work, w);
+    }
+    work(0); // The main thread is worker 0.
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    std::string line;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        line = std::to_string(statuses[i]) + '\t' + files[i].input + '\n';
+        streams.out.write(reinterpret_cast<const unsigned char *>(line.data()), line.size());
+        if (retval == 0) {
+            retval = statuses[i];
+        }
+    }
+    streams.out.flush();
+    return retval;
+}
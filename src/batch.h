@@ -0,0 +1,73 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_BATCH_H
+#define ESCAPE_UTF8_BATCH_H
+
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "StreamPair.h"
+#include "parseargs.h"
+
+/**
+ * One file for batch mode to escape.
+ */
+struct BatchFile {
+    // The path of the input file.
+    std::string input;
+    // The path of the output file. With --in-place, this is the input again, with every
+    // symbolic link followed.
+    std::string output;
+};
+
+/**
+ * The buffers that escape_file lends to the input and output of each file, so that a thread
+ * that escapes many files only allocates them once. They start out empty.
+ */
+struct BatchBuffers {
+    AlignedBuffer in;
+    AlignedBuffer out;
+};
+
+/**
+ * Works out the list of files to escape in batch mode, from the inputs on the command line,
+ * the --files-from list and (with --recursive) the contents of directories, in that order.
+ * Files in a directory are listed in sorted order, so the list is the same every time.
+ * @param options The options from parse(). options.batch must be true.
+ * @param list_stream The stream to read the list from if options.files_from is "-".
+ * @param files This is a return value. The files are appended to it.
+ * @return 0 on success, or 1 if the --files-from list couldn't be opened, or 3 if there was
+ * an error reading it. The error message has already been printed.
+ */
+int collect_batch_files(const Options& options, std::istream& list_stream, std::vector<BatchFile>& files);
+
+/**
+ * Escapes one file to another, the same way read_and_escape would. Nothing is printed; the
+ * result is only in the return value. A compressed input is decompressed first, just like
+ * in parse(), and the output is compressed if compress isn't Compression::None.
+ * @param file The input and output paths.
+ * @param buffers The buffers for the input and output, which are reused from one call to
+ * the next.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * @return The exit code read_and_escape would have given (see main.cpp).
+ */
+int escape_file(const BatchFile& file, BatchBuffers& buffers, const EscapeSettings& settings = EscapeSettings(),
+                Compression compress = Compression::None);
+
+/**
+ * This is the whole of batch mode: it escapes every file (with escape_file, or with
+ * escape_in_place for --in-place), spread over options.threads threads (0 means one per CPU
+ * core), and then prints a line with the exit status and
+ * the input path of each file, in the order they were listed.
+ * @param options The options from parse(). options.batch must be true.
+ * @param streams stdin (for --files-from -) and stdout (for the status lines).
+ * @return The exit status of the first file that failed, in the order they were listed,
+ * or 0 if all of them succeeded. If there was a problem with --files-from, the exit status
+ * from collect_batch_files.
+ */
+int batch_escape(const Options& options, StreamPair& streams);
+
+#endif //ESCAPE_UTF8_BATCH_H
@@ -2,35 +2,24 @@
 // Created by Vicram on 9/3/2019.
 //
 
-#include <string>
-#include <cassert>
-#include <cstdint> // uint_fast32_t, uint_fast64_t
+#include <algorithm> // std::min
+#include <cstdint> // uint_fast64_t
 #include <iostream>
-#include <sstream>
-#include <iomanip>
-#include <ios>
+#include <string>
+#include <vector>
 
 #include "business_logic.h"
+#include "decode_kernel.h"
+#include "escape_kernel.h"
+#include "measure.h"
+#include "utf8_validate.h"
+#include "zero_copy.h"
+#include "BlockIO.h"
 
-// Note: binary literals were only added in C++14 so this means that support for C++14 is required.
-
-/*
- * These are used to check the top few bits of the first byte of a multi-byte UTF-8 character,
- * in order to figure out how many bytes are in it.
- * Usage: the character has X bytes iff IS_X_BYTES(byte) evaluates to true.
- */
-#define TWO_BYTE_MASK   0b11100000u
-#define TWO_BYTE_VAL    0b11000000u
-#define IS_TWO_BYTES(x) ((TWO_BYTE_MASK & x) == TWO_BYTE_VAL)
-
-#define THREE_BYTE_MASK 0b11110000u
-#define THREE_BYTE_VAL  0b11100000u
-#define IS_THREE_BYTES(x) ((THREE_BYTE_MASK & x) == THREE_BYTE_VAL)
-
-#define FOUR_BYTE_MASK  0b11111000u
-#define FOUR_BYTE_VAL   0b11110000u
-#define IS_FOUR_BYTES(x) ((FOUR_BYTE_MASK & x) == FOUR_BYTE_VAL)
-
+// The number of bytes that read_and_check validates at once. There's no output buffer, so
+// this can be much bigger than ESCAPE_BLOCK_SIZE, which means fewer reads. When a block is
+// invalid it gets validated a second time to find the bad byte, so it shouldn't be huge either.
+static const std::size_t CHECK_BLOCK_SIZE = 1024 * 1024;
 
 /*
  * NOTE ON CASTING
@@ -43,249 +32,376 @@
  * That's the one that starts with "Any object pointer type T1* can be converted to another object pointer type cv T2*."
  */
 
-
 /**
- * Given a buffer and a Unicode code point, this function constructs the escape
- * string for that code point. The first three bytes of the buffer should be "\u'"
- * because those will be the same for every escape string. Note that in this docstring
- * (and elsewhere in the codebase), when describing a sequence of characters, the outer
- * quotes are external delimiters and SHOULD NOT be interpreted as being part of the
- * sequence.
- *
- * For example, given the code point 1000 (hex value 0x3E8) this function would write to the
- * buffer "\u'03E8'". All letters will be uppercase except the "u" at the beginning.
- *
- * Any number whose hex representation would fit in less than 4 hex digits (like 0x3E8)
- * will be padded by leading zeros to reach 4 characters. No padding is done for larger
- * values.
- * @param buf A buffer of length 10 bytes, where the first three bytes are "\u'".
- * @param codepoint Int representing a Unicode code point; must be a number in [0, 2^21).
- * @return The number of characters in the escape string. Will be 8, 9, or 10.
+ * This is read_and_escape for a memory-mapped input file. Since the input is already in
+ * memory, escape_block reads straight from the mapping; the only copy is into the output
+ * buffer, which we'd need anyway. Characters that are split between two windows are
+ * handled by the EscapeState, just like characters that are split between two blocks.
+ * The return values and error messages are the same as read_and_escape's.
  */
-std::size_t construct_escape_string(unsigned char *buf, std::uint_fast32_t codepoint) {
-    /*
-     * Using a solution modified from here: https://stackoverflow.com/a/5100745
-     * Note that std::stringstream uses signed chars by default. We just have to deal
-     * with it because there's no implementation for char_traits<unsigned char>.
-     * See here: https://en.cppreference.com/w/cpp/string/char_traits
-     */
-    std::stringstream stream;
-    if (codepoint < 0x1000u) { // If number is less than 4 chars, pad it
-        stream << std::setfill('0') << std::setw(4);
-    }
-    stream << std::hex << std::uppercase << codepoint; // For the ordering of hex/uppercase see this example: https://en.cppreference.com/w/cpp/io/manip/uppercase
-    // We can use the read method (basic_istream::read) to write the chars directly to buf
-    stream.read(reinterpret_cast<char *>(buf + 3), 6); // This tries to read 6 chars but will stop at EOF
-    auto num_chars_read = stream.gcount();
-    assert(num_chars_read >= 4 && num_chars_read <= 6);
-    std::size_t idx_of_ending_singlequote = static_cast<std::size_t>(num_chars_read + 3);
-    buf[idx_of_ending_singlequote] = '\'';
-    return idx_of_ending_singlequote + 1;
-}
-
-int read_and_escape(const StreamPair& streams) {
-    /*
-     * Error Handling
-     * We're using 3 I/O functions here: basic_istring::get, basic_ostring::put, and
-     * basic_ostring::write. This page contains information on all the ways these functions
-     * (and many others) can fail: https://en.cppreference.com/w/cpp/io/ios_base/iostate
-     * In short, here's what we need to be able to handle:
-     *   basic_istring::get can fail to extract any characters, in which case eofbit and
-     *   failbit (but not badbit) will be set.
-     *
-     *   basic_ostring::put and basic_ostring::write can both fail, and upon any failure,
-     *   badbit will be set.
-     *   In addition, the basic_ostream::sentry constructor, which is executed at the beginning
-     *   of every output function, may fail "under implementation-defined conditions", in which
-     *   case the failbit will be set.
-     *   Presumably, these two rules, taken together, mean that for basic_ostream, badbit will be
-     *   set iff failbit is set, but I don't think we really need to care.
-     *
-     * The above link also contains a really useful table that specifies how the outputs of
-     * functions like good(), fail(), and bad() correspond to badbit, failbit, and eofbit.
-     */
-
+static int escape_mapped(MappedFile& file, ByteSink& out, const EscapeSettings& settings, EscapeStats *stats) {
+    EscapeState state;
+    StatsScope stats_scope(stats, state);
+    const std::size_t bound = escape_output_bound(ESCAPE_BLOCK_SIZE, settings.format);
 
-    // This will keep track of the number of bytes successfully read. With a 64-bit unsigned int,
-    // there is no risk of overflow; 2^64-1 should be significantly larger than the max file size on any
-    // system. The nasty type name is just a platform-independent way of saying uint64: https://en.cppreference.com/w/cpp/types/integer
-    std::uint_fast64_t num_bytes_read = 0;
-
-    // This buffer will hold the 8-10 character strings for the escaped non-ASCII (or non-printable) chars.
-    unsigned char buf[10];
-    buf[0] = '\\';
-    buf[1] = 'u';
-    buf[2] = '\'';
-    assert(buf[0] == 92);
-    assert(buf[1] == 117);
-    assert(buf[2] == 39);
-
-    unsigned char byte;
-    for (streams.in->get(reinterpret_cast<char &>(byte)); streams.in->good() && streams.out->good(); streams.in->get(reinterpret_cast<char &>(byte))) {
-        // We use the form 'in->get(byte)' rather than 'byte = in->get()' because it is more
-        // type-safe. See reference: https://en.cppreference.com/w/cpp/io/basic_istream/get
-        // Because the stream are parameterized on SIGNED chars, we have to do some casting.
-        // The correct cast is reinterpret_cast<char &>(byte). Specifically, we're doing
-        // the 6th kind of conversion listed here: https://en.cppreference.com/w/cpp/language/reinterpret_cast
-        // Here is the text of that conversion:
-        //   "An lvalue expression of type T1 can be converted to reference to another type T2. The result is an
-        //    lvalue or xvalue referring to the same object as the original lvalue, but with a different type. No
-        //    temporary is created, no copy is made, no constructors or conversion functions are called. The resulting
-        //    reference can only be accessed safely if allowed by the type aliasing rules"
-        // The type aliasing rules are listed below on the same page, and one of them SPECIFICALLY refers
-        // to converting to char or unsigned char, stating "this permits examination of the object representation
-        // of any object as an array of bytes." So that's the correct way to do this.
+    const unsigned char *window;
+    std::size_t window_len;
+    while (file.next_window(window, window_len) && window_len > 0) {
+        stats_lap(stats, Phase::Read);
+        // The window can be far bigger than the output buffer, so we still escape it one
+        // block at a time, straight into the sink's buffer.
+        for (std::size_t offset = 0; offset < window_len; offset += ESCAPE_BLOCK_SIZE) {
+            unsigned char *outbuf = out.reserve(bound); // This writes out the buffer once it's full.
+            stats_lap(stats, Phase::Write);
+            if (outbuf == nullptr) {
+                break;
+            }
+            std::size_t len = std::min(ESCAPE_BLOCK_SIZE, window_len - offset);
+            std::size_t outlen = escape_block(state, window + offset, len, outbuf, settings);
+            out.commit(outlen);
+            stats_output(stats, outlen);
+            stats_lap(stats, Phase::Escape);
+            if (state.invalid) {
+                out.flush();
+                std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+                return 2;
+            }
+        }
+        if (out.error()) {
+            break;
+        }
+    }
+    out.flush();
+    stats_lap(stats, Phase::Write);
 
-        // As a side note, it looks like static_cast wouldn't work. I read the 10 conversion types here,
-        // and it looks like only the first one applies to this case:
-        // https://en.cppreference.com/w/cpp/language/static_cast
-        // This case would involve an "implicit conversion sequence" from unsigned char to char.
-        // (I didn't really consider converting to char &.)
-        // Of the implicit conversions, the only one that would apply here is Integral Promotion,
-        // and there is no promotion from unsigned char to signed char (or vice versa). This
-        // makes sense, because assuming that both are stored in 8 bits, a conversion either
-        // way would involve data loss.
+    if (out.error()) {
+        std::cerr << "There was a fatal error when trying to write to the output. Exiting now." << std::endl;
+        return 4;
+    }
+    if (state.num_bytes_read != file.size()) {
+        // next_window failed before we got to the end of the file.
+        std::cerr << "Failed when trying to read byte " << (state.num_bytes_read + 1) << " due to unknown error." << std::endl;
+        return 3;
+    }
+    if (!state.at_boundary()) {
+        std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+        return 2;
+    }
+    return 0;
+}
 
-        ++num_bytes_read; // Mark the byte as read (we have to check good() first)
+/**
+ * This is read_and_escape for an input that isn't memory-mapped. The I/O goes through a
+ * BlockIO (see BlockIO.h), so that reading the next block and writing the previous one
+ * overlap with escaping the current one:
+ *
+ *   main thread:  escape 0 | escape 1 | escape 2 | ...
+ *   input:        read 1   | read 2   | read 3   | ...
+ *   output:                | write 0  | write 1  | ...
+ *
+ * There are two input buffers and two output buffers. Block i is read into input buffer
+ * i % 2 and escaped into output buffer i % 2; by the time we escape block i + 2 into the
+ * same buffers, the read of block i + 2 and the write of block i are both finished.
+ *
+ * A multi-byte character that is split between two blocks is kept in the EscapeState
+ * until the next block finishes it. The output and the return values are the same as if
+ * the blocks were read, escaped and written one after another.
+ * @param io The I/O layer. No reads or writes may have been started on it.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * @param stats Where to count things for --stats, or null.
+ * @return The same exit codes as read_and_escape.
+ */
+int escape_with_block_io(BlockIO& io, const EscapeSettings& settings, EscapeStats *stats) {
+    // This keeps track of the decoder state between blocks, and also counts the number of
+    // bytes successfully read.
+    EscapeState state;
+    StatsScope stats_scope(stats, state);
+    std::vector<unsigned char> outbufs[2];
+    outbufs[0].resize(escape_output_bound(io.block_size(), settings.format));
+    outbufs[1].resize(escape_output_bound(io.block_size(), settings.format));
 
-        // First, we'll check if the character is printable. This includes 33-126
-        // (all normal graphical characters) plus 9 (tab), 10 (line feed),
-        // 13 (carriage return), and 32 (space).
-        // These numbers are all in decimal.
-        if ((32 <= byte && byte <= 126) || byte == 9 || byte == 10 || byte == 13) {
-            streams.out->put(byte);
-            continue;
+    bool read_error = false;
+    bool write_error = false;
+    bool write_pending = false;
+    std::size_t current = 0;
+    io.start_read(0);
+    while (true) {
+        long len = io.wait_read();
+        if (len <= 0) {
+            // 0 is the end of the input, and -1 is an error; either way, we're done reading.
+            read_error = (len < 0);
+            break;
         }
-        if (byte == 127) { // DEL, U+007F
-            streams.out->write("\\u'007F'", 8);
-            continue;
+        io.start_read(1 - current);
+        stats_lap(stats, Phase::Read);
+
+        unsigned char *outbuf = outbufs[current].data();
+        std::size_t outlen = escape_block(state, io.buffer(current), static_cast<std::size_t>(len), outbuf, settings);
+        stats_lap(stats, Phase::Escape);
+        if (write_pending && !io.wait_write()) {
+            write_error = true;
+            break;
         }
-        if (byte <= 31) { // US-ASCII control character. We must escape this.
-            std::size_t buflen = construct_escape_string(buf, byte);
-            streams.out->write(reinterpret_cast<char *>(buf), buflen);
-            continue;
+        // Even if the block turned out to be invalid, we write out everything before the bad character.
+        io.start_write(outbuf, outlen);
+        stats_output(stats, outlen);
+        write_pending = true;
+        stats_lap(stats, Phase::Write);
+        if (state.invalid) {
+            if (!io.wait_write()) {
+                write_error = true;
+                break;
+            }
+            // The output already shows where the input went wrong, so unlike --check (see
+            // report_invalid), we don't say which byte it was.
+            std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+            return 2;
         }
-        // Otherwise we're dealing with a multi-byte character.
-        assert(byte > 127);
-
-        // This will store the decoded character's actual numerical value. We need an int
-        // that's at least 21 bits wide.
-        std::uint_fast32_t decoded_char = 0;
+        current = 1 - current;
+    }
+    if (!write_error && write_pending && !io.wait_write()) {
+        write_error = true;
+    }
+    stats_lap(stats, Phase::Write);
 
-        // The first byte tells us how many bytes the character is.
-        int numbytes;
-        unsigned char mask; // Used to read only the relevant low-order bits from the first byte.
-        if (IS_TWO_BYTES(byte)) {
-            numbytes = 2;
-            mask = 0b00011111u;
-        } else if (IS_THREE_BYTES(byte)) {
-            numbytes = 3;
-            mask = 0b00001111u;
-        } else if (IS_FOUR_BYTES(byte)) {
-            numbytes = 4;
-            mask = 0b00000111u;
-        } else {
+    if (write_error) {
+        std::cerr << "There was a fatal error when trying to write to the output. Exiting now." << std::endl;
+        return 4;
+    }
+    if (!read_error) {
+        // We've reached EOF. This is the success case, as long as the input didn't end
+        // in the middle of a multi-byte character.
+        if (!state.at_boundary()) {
             std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
-            // TODO: I've commented out several error messages because I didn't want to write tests for them. Might do that at some point.
-//            std::cerr << "Byte " << num_bytes_read << " is invalid: 0x" << std::hex << ((unsigned int)byte) <<
-//            " is not valid as the first character in a UTF-8 character." << std::endl;
             return 2;
         }
-        // First we grab the 5, 4, or 3 relevant bits from the first byte and get them into position in decoded_char.
-        decoded_char = (byte & mask);
-        // Next, read the rest of the bytes, check that the first two bits are '10', and grab the last 6 bits.
-        for (int i = 1; i < numbytes; ++i) { // we start at 1 because we've already read the first byte.
-            streams.in->get(reinterpret_cast<char &>(byte));
-            if (!streams.in->good()) {
-                // As mentioned above, the only valid combination of state flags is
-                // eofbit, failbit, and not badbit.
-                if (streams.in->eof() && streams.in->fail() && (!streams.in->bad())) {
-                    std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
-//                    std::cerr << "Reached EOF after reading " << num_bytes_read <<
-//                    " byte(s). The given text is NOT valid UTF-8 text because it stopped in the middle of a multi-byte UTF-8 character."
-//                    << std::endl;
-                    return 2;
-                } else {
-                    std::cerr << "Failed when trying to read byte " << (num_bytes_read + 1) << " due to unknown error." << std::endl;
-                    return 3;
-                }
+        return 0;
+    } else {
+        std::cerr << "Failed when trying to read byte " << (state.num_bytes_read + 1) << " due to unknown error." << std::endl;
+        return 3;
+    }
+}
 
+static int escape_pulled(StreamPair& streams, const EscapeSettings& settings, EscapeStats *stats);
+
+int read_and_escape(StreamPair& streams, const EscapeSettings& settings, bool preallocate, EscapeStats *stats) {
+    if (streams.in.has_stage()) {
+        return escape_pulled(streams, settings, stats);
+    }
+    if (streams.mapped) {
+#ifdef __linux__
+        if (streams.out.fd() != -1) {
+            return escape_mapped_zero_copy(*streams.mapped, streams.out.fd(), settings, preallocate, stats);
+        }
+#else
+        (void)preallocate;
+#endif
+        return escape_mapped(*streams.mapped, streams.out, settings, stats);
+    }
+    std::unique_ptr<BlockIO> io = make_block_io(streams, ESCAPE_BLOCK_SIZE);
+    return escape_with_block_io(*io, settings, stats);
+}
+
+/**
+ * Feeds the whole input to process, one block at a time, in order. This is the input side of
+ * the modes that don't need read_and_escape's overlapped I/O, because they either have no
+ * output (--check) or don't spend much time on each byte (--decode). A memory-mapped input
+ * is read straight from the mapping, and any other input straight from the source's buffer.
+ * @param streams The input.
+ * @param block_size The most bytes to pass to process at once.
+ * @param process Called as process(data, len) with each block. It returns false to stop early.
+ * @return 0 if the whole input was read or process stopped early, or 3 if there was a read
+ * error, in which case the error message has already been printed.
+ */
+template <typename Process>
+static int for_each_block(StreamPair& streams, std::size_t block_size, Process process) {
+    std::uint_fast64_t num_bytes_read = 0;
+    if (streams.mapped) {
+        MappedFile& file = *streams.mapped;
+        const unsigned char *window;
+        std::size_t window_len;
+        while (file.next_window(window, window_len) && window_len > 0) {
+            for (std::size_t offset = 0; offset < window_len; offset += block_size) {
+                std::size_t len = std::min(block_size, window_len - offset);
+                num_bytes_read += len;
+                if (!process(window + offset, len)) {
+                    return 0;
+                }
             }
-            ++num_bytes_read;
-            if ((byte & 0b11000000u) != 0b10000000u) {
-                // The first two bits aren't '10' so the file is not valid UTF-8
-                std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
-//                std::string ordinal;
-//                if (i == 1) {
-//                    ordinal = "second";
-//                } else if (i == 2) {
-//                    ordinal = "third";
-//                } else {
-//                    assert(i == 3);
-//                    ordinal = "fourth";
-//                }
-//                std::cerr << "The given text is not valid UTF-8 text. Byte " << num_bytes_read <<
-//                " was supposed to be the " << ordinal << " byte in a multi-byte UTF-8 character but it is not in the valid range."
-//                << std::endl;
-                return 2;
-            }
-            decoded_char <<= 6u;
-            decoded_char |= static_cast<uint_fast32_t>(byte & 0b00111111u);
         }
-        // We've now constructed an int with the numeric value of the Unicode character.
-        // However, we still need to check that the value is within the appropriate range for
-        // a 2- or 3- or 4-byte UTF-8 character. See page 5 of RFC 3629, where they discuss "a naive implementation":
-        // https://tools.ietf.org/html/rfc3629
-        if (numbytes == 2 && (decoded_char < 0x80u || decoded_char > 0x7FFu)) {
-            std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
-//            std::cerr << "The given text is not valid UTF-8 text. "
-//            << "Bytes " << (numbytes-1) << " and " << numbytes << " form a 2-byte UTF-8 character with value 0x"
-//            << std::hex << decoded_char << "which is outside the valid range of [0x80, 0x7FF]." << std::endl;
-            return 2;
+        if (num_bytes_read == file.size()) {
+            return 0;
         }
-        if (numbytes == 3 && (decoded_char < 0x800u || decoded_char > 0xFFFFu)) {
-            std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
-//            std::cerr << "The given text is not valid UTF-8 text. "
-//            << "Bytes " << (numbytes-2) << ", " << (numbytes-1) << ", and " << numbytes << " form a 3-byte UTF-8 character with value 0x"
-//            << std::hex << decoded_char << "which is outside the valid range of [0x800, 0xFFFF]." << std::endl;
-            return 2;
+        // Otherwise next_window failed before we got to the end of the file.
+    } else {
+        ByteSource& in = streams.in;
+        const unsigned char *data;
+        std::size_t len;
+        while ((len = in.pull(data, block_size)) > 0) {
+            num_bytes_read += len;
+            if (!process(data, len)) {
+                return 0;
+            }
         }
-        if (numbytes == 4 && (decoded_char < 0x10000u || decoded_char > 0x10FFFFu)) {
-            std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
-//            std::cerr << "The given text is not valid UTF-8 text. "
-//            << "Bytes " << (numbytes-3) << " through " << numbytes << " form a 4-byte UTF-8 character with value 0x"
-//            << std::hex << decoded_char << "which is outside the valid range of [0x10000, 0x10FFFF]." << std::endl;
-            return 2;
+        if (!in.error()) {
+            return 0;
         }
-
-        // Finally, we can print out the escaped character and move on.
-        std::size_t buflen = construct_escape_string(buf, decoded_char);
-        streams.out->write(reinterpret_cast<char *>(buf), buflen);
-        // We're only printing out ASCII chars so interpreting them as signed should be fine,
-        // because all ASCII values are representable by a signed 8-bit int.
     }
-    // Here we need to check whether we exited the loop due to EOF or something else.
-    // There are no break statements, so if we got here, that implies we failed the
-    // check at the beginning of every loop. Additionally, every single possible path
-    // through the loop which doesn't result in a return statement ends with both a
-    // write operation (from streams.out->put or streams.out->write) and a read operation
-    // (from the streams.in->get in the for statement).
-    // The upshot of this is that we need to check the status of both streams.
+    std::cerr << "Failed when trying to read byte " << (num_bytes_read + 1) << " due to unknown error." << std::endl;
+    return 3;
+}
+
+/**
+ * This is read_and_escape for an input that comes from a stage, like a decompressor (see
+ * compression.h). The stage already works on a thread of its own, so a BlockIO wouldn't
+ * add anything but a copy: instead we escape straight from the stage's buffers into the
+ * sink's, like escape_mapped does from the mapping.
+ * The return values and error messages are the same as read_and_escape's.
+ */
+static int escape_pulled(StreamPair& streams, const EscapeSettings& settings, EscapeStats *stats) {
+    EscapeState state;
+    StatsScope stats_scope(stats, state);
+    ByteSink& out = streams.out;
+    const std::size_t bound = escape_output_bound(ESCAPE_BLOCK_SIZE, settings.format);
+    int retval = for_each_block(streams, ESCAPE_BLOCK_SIZE, [&](const unsigned char *data, std::size_t len) {
+        stats_lap(stats, Phase::Read);
+        unsigned char *outbuf = out.reserve(bound);
+        stats_lap(stats, Phase::Write);
+        if (outbuf == nullptr) {
+            return false;
+        }
+        std::size_t outlen = escape_block(state, data, len, outbuf, settings);
+        out.commit(outlen);
+        stats_output(stats, outlen);
+        stats_lap(stats, Phase::Escape);
+        return !state.invalid;
+    });
+    out.flush();
+    stats_lap(stats, Phase::Write);
 
-    if (streams.out->fail()) {
-        // I don't bother also checking streams.in here because the only reason to would be
-        // to print a slightly different error message saying "there was an error in both
-        // reading and writing."
+    if (state.invalid) {
+        std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+        return 2;
+    }
+    if (out.error()) {
         std::cerr << "There was a fatal error when trying to write to the output. Exiting now." << std::endl;
         return 4;
     }
-    if (streams.in->eof() && streams.in->fail() && (!streams.in->bad())) {
-        // This is the success case: exited because we reached EOF, and it wasn't
-        // in the middle of a character.
-        return 0;
+    if (retval != 0) {
+        return retval;
+    }
+    if (!state.at_boundary()) {
+        std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+        return 2;
+    }
+    return 0;
+}
+
+/**
+ * Prints the error message for invalid input in --check and --measure mode. Unlike read_and_escape,
+ * which can point at where the output stopped, --check has no output, so we say where
+ * the input went wrong.
+ * @return 2, the exit code for invalid input.
+ */
+static int report_invalid(const EscapeState& state) {
+    std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+    if (state.invalid) {
+        std::cerr << "Byte " << state.num_bytes_read << " is invalid." << std::endl;
     } else {
-        std::cerr << "Failed when trying to read byte " << (num_bytes_read + 1) << " due to unknown error." << std::endl;
-        return 3;
+        std::cerr << "Reached EOF after reading " << state.num_bytes_read <<
+        " byte(s). The given text is NOT valid UTF-8 text because it stopped in the middle of a multi-byte UTF-8 character."
+        << std::endl;
+    }
+    return 2;
+}
+
+int read_and_check(StreamPair& streams) {
+    EscapeState state;
+    int retval = for_each_block(streams, CHECK_BLOCK_SIZE, [&state](const unsigned char *data, std::size_t len) {
+        validate_block(state, data, len);
+        return !state.invalid;
+    });
+    if (state.invalid) {
+        return report_invalid(state);
     }
+    if (retval != 0) {
+        return retval;
+    }
+    if (!state.at_boundary()) {
+        return report_invalid(state);
+    }
+    return 0;
+}
 
+int read_and_measure(StreamPair& streams, const EscapeSettings& settings) {
+    EscapeState state;
+    std::uint_fast64_t total = 0;
+    int retval = for_each_block(streams, CHECK_BLOCK_SIZE, [&state, &total, &settings](const unsigned char *data, std::size_t len) {
+        // We validate and count one ESCAPE_BLOCK_SIZE piece at a time, so that the counting pass
+        // finds the piece still in the cache from the validating pass.
+        for (std::size_t offset = 0; offset < len; offset += ESCAPE_BLOCK_SIZE) {
+            std::size_t piece = std::min(ESCAPE_BLOCK_SIZE, len - offset);
+            validate_block(state, data + offset, piece);
+            if (state.invalid) {
+                return false;
+            }
+            total += escaped_length(data + offset, piece, settings);
+        }
+        return true;
+    });
+    if (state.invalid) {
+        return report_invalid(state);
+    }
+    if (retval != 0) {
+        return retval;
+    }
+    if (!state.at_boundary()) {
+        return report_invalid(state);
+    }
+    const std::string line = std::to_string(total) + '\n';
+    if (!streams.out.write(reinterpret_cast<const unsigned char *>(line.data()), line.size()) || !streams.out.flush()) {
+        std::cerr << "There was a fatal error when trying to write to the output. Exiting now." << std::endl;
+        return 4;
+    }
+    return 0;
+}
+
+int read_and_decode(StreamPair& streams) {
+    DecodeState state;
+    ByteSink& out = streams.out;
+    const std::size_t bound = decode_output_bound(ESCAPE_BLOCK_SIZE);
+    int retval = for_each_block(streams, ESCAPE_BLOCK_SIZE, [&](const unsigned char *data, std::size_t len) {
+        unsigned char *outbuf = out.reserve(bound);
+        if (outbuf == nullptr) {
+            return false;
+        }
+        out.commit(decode_block(state, data, len, outbuf));
+        return !state.invalid;
+    });
+    bool finished = false;
+    if (retval == 0 && !state.invalid && !out.error()) {
+        unsigned char *outbuf = out.reserve(bound);
+        if (outbuf != nullptr) {
+            out.commit(decode_finish(state, outbuf));
+        }
+        finished = true;
+    }
+
+    if (!out.flush()) {
+        std::cerr << "There was a fatal error when trying to write to the output. Exiting now." << std::endl;
+        return 4;
+    }
+    if (state.invalid) {
+        if (state.bad_escape) {
+            std::cerr << "The given text contains an invalid escape sequence. Exiting now." << std::endl;
+        } else {
+            std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+        }
+        if (!finished) {
+            // If the input ended too soon, there's no particular byte to point at.
+            std::cerr << "Byte " << state.num_bytes_read << " is invalid." << std::endl;
+        }
+        return 2;
+    }
+    return retval;
 }
@@ -6,6 +6,14 @@
 #define ESCAPE_UTF8_BUSINESS_LOGIC_H
 
 #include "StreamPair.h"
+#include "escape_kernel.h" // EscapeSettings
+#include "stats.h"
+
+// The number of bytes that read_and_escape tries to read and escape at once. The output
+// buffer has to be escape_output_bound(ESCAPE_BLOCK_SIZE) bytes, i.e. about 8 times larger.
+// The other ways of escaping (batch mode, --in-place, --line-buffered and --follow) use the
+// same size.
+const std::size_t ESCAPE_BLOCK_SIZE = 65536;
 
 /**
  * This is the central function of the whole program. This function reads the
@@ -14,8 +22,46 @@
  * write out an error message to stderr and return a nonzero value. Otherwise
  * it will return 0.
  * @param streams A StreamPair
+ * @param settings The format of the escape strings (--format) and the bytes that are passed
+ * through (--preserve).
+ * @param preallocate Whether to reserve the disk space for the output first (--preallocate).
+ * This only happens on Linux, when the input is memory-mapped and the output is a regular file.
+ * @param stats Where to count the bytes, characters and time for --stats (see stats.h), or
+ * null to not count them. If given, it's finished whether or not this succeeds.
  * @return int which should be used as the exit status for the whole program.
  */
-int read_and_escape(const StreamPair& streams);
+int read_and_escape(StreamPair& streams, const EscapeSettings& settings = EscapeSettings(), bool preallocate = false,
+                    EscapeStats *stats = nullptr);
+
+/**
+ * This is read_and_escape for --check: it reads the input and checks that it's valid
+ * UTF-8, but doesn't write anything to the output. If the input is invalid, the error
+ * message also gives the position of the first invalid byte.
+ * @param streams A StreamPair. Only the input is used.
+ * @return The same exit codes as read_and_escape, except that 4 (write error) can't happen.
+ */
+int read_and_check(StreamPair& streams);
+
+/**
+ * This is read_and_escape for --decode: it reads escaped text and writes the original UTF-8
+ * text, turning every escape string back into the character it stands for. See decode_block
+ * in decode_kernel.h for exactly what is accepted. If the input is invalid, everything before
+ * the problem is written out, and the error message gives the position of the bad byte.
+ * @param streams A StreamPair
+ * @return The same exit codes as read_and_escape. Invalid escape strings count as invalid input (2).
+ */
+int read_and_decode(StreamPair& streams);
+
+/**
+ * This is read_and_escape for --measure: it works out exactly how many bytes read_and_escape
+ * would write for the input, and writes that number (in decimal, followed by a newline)
+ * instead of the escaped text. The input is checked like with --check, and the error messages
+ * are the same, since there is no escaped length for invalid input.
+ * @param streams A StreamPair
+ * @param settings The format that the escaped output would be in, and the bytes that it would
+ * pass through.
+ * @return The same exit codes as read_and_escape.
+ */
+int read_and_measure(StreamPair& streams, const EscapeSettings& settings = EscapeSettings());
 
 #endif //ESCAPE_UTF8_BUSINESS_LOGIC_H
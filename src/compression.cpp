@@ -0,0 +1,659 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <algorithm> // std::min
+#include <cassert>
+#include <climits> // UINT_MAX
+#include <condition_variable>
+#include <cstring> // std::memcmp, std::memset
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility> // std::move
+#include <vector>
+
+#include "compression.h"
+
+#ifdef ESCAPE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef ESCAPE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/*
+ * IMPLEMENTATION NOTES
+ * Codecs:
+ *   Each format has a decompressor and a compressor with the same little interface (Codec),
+ *   which wraps the streaming API of zlib or libzstd: take some input, produce some output,
+ *   and say how far it got. The stages below don't know which format they're running.
+ *
+ *   A gzip file can be several gzip files one after another (that's what "cat a.gz b.gz"
+ *   makes, and gzip -d reads it as one file), and likewise for zstd frames. zstd handles
+ *   that by itself; for gzip we start over with inflateReset whenever there's more input
+ *   after the end of a member.
+ *
+ * The decompressing stage:
+ *   The thread pulls spans of compressed input from the inner ByteSource (straight from its
+ *   buffer) and decompresses them into a buffer of its own. When that buffer is full, it goes
+ *   on a queue, and ByteSource::pull hands out pieces of it until it's used up, and then
+ *   gives it back to be filled again. So the only time the data is written is by the
+ *   decompressor itself. The thread stays at most MAX_QUEUED buffers ahead.
+ *
+ *   As with the reader thread in BlockIO.cpp, the thread might be stuck in a read that
+ *   won't finish any time soon when the stage is destroyed (say the input is invalid UTF-8,
+ *   and it's coming from a terminal). So if it's in the middle of something, it's detached
+ *   instead of joined, and everything it uses is in a shared_ptr that it holds on to.
+ *
+ * The compressing stage:
+ *   The other way around: ByteSink hands over its buffer whenever it would write it out, and
+ *   the thread compresses it straight into the inner ByteSink's buffer (with reserve and
+ *   commit). The buffer then goes back to the ByteSink for more output. The thread always
+ *   finishes, since it's only ever writing, so it's joined.
+ */
+
+namespace {
+
+const unsigned char GZIP_MAGIC[] = {0x1F, 0x8B};
+const unsigned char ZSTD_MAGIC[] = {0x28, 0xB5, 0x2F, 0xFD};
+
+// The most full buffers that can be waiting to be handed over, in either direction. Two is
+// enough to keep both threads busy; more would only use more memory.
+const std::size_t MAX_QUEUED = 2;
+
+// How much room the compressor asks the inner sink for at a time.
+const std::size_t COMPRESS_CHUNK = 128 * 1024;
+
+// The default levels of the gzip and zstd command-line tools.
+const int GZIP_LEVEL = 6;
+const int ZSTD_LEVEL = 3;
+
+const char *const COMPRESSION_NAMES[] = {"none", "gzip", "zstd"};
+
+/**
+ * One direction of one format. See the note at the top of this file.
+ */
+class Codec {
+public:
+    virtual ~Codec() {}
+
+    /**
+     * Turns as much of in[0..in_len) into out[0..out_len) as it can. in and out are moved
+     * past what was used, and in_len and out_len are reduced to match.
+     * @param finish For a compressor: there's no more input, so end the compressed data.
+     * This has to be called with finish (and no input) until at_end() is true.
+     * @return False if the input is corrupt (or the library failed).
+     */
+    virtual bool run(const unsigned char *& in, std::size_t& in_len, unsigned char *& out, std::size_t& out_len,
+                     bool finish) = 0;
+
+    /**
+     * For a decompressor, returns true if the input so far ends at the end of a gzip member
+     * or a zstd frame. For a compressor, returns true once it has written out the end.
+     */
+    virtual bool at_end() const = 0;
+};
+
+#ifdef ESCAPE_HAVE_ZLIB
+
+/**
+ * Moves the pointers and lengths past what zlib used.
+ */
+void advance(const z_stream& stream, const unsigned char *& in, std::size_t& in_len, unsigned char *& out,
+             std::size_t& out_len) {
+    std::size_t used = static_cast<std::size_t>(stream.next_in - in);
+    std::size_t produced = static_cast<std::size_t>(stream.next_out - out);
+    in += used;
+    in_len -= used;
+    out += produced;
+    out_len -= produced;
+}
+
+/**
+ * Points the z_stream at the buffers. zlib's lengths are only 32 bits, so we give it at
+ * most 4 GB at a time; the stages call run() again for the rest.
+ */
+void point_at(z_stream& stream, const unsigned char *in, std::size_t in_len, unsigned char *out, std::size_t out_len) {
+    stream.next_in = const_cast<Bytef *>(in); // zlib doesn't write to it
+    stream.avail_in = static_cast<uInt>(std::min<std::size_t>(in_len, UINT_MAX));
+    stream.next_out = out;
+    stream.avail_out = static_cast<uInt>(std::min<std::size_t>(out_len, UINT_MAX));
+}
+
+class GzipDecompressor : public Codec {
+public:
+    GzipDecompressor() : ended(false) {
+        std::memset(&stream, 0, sizeof(stream));
+        ok = inflateInit2(&stream, 16 + MAX_WBITS) == Z_OK; // 16 means gzip (not zlib) headers
+    }
+
+    ~GzipDecompressor() override {
+        if (ok) {
+            inflateEnd(&stream);
+        }
+    }
+
+    bool run(const unsigned char *& in, std::size_t& in_len, unsigned char *& out, std::size_t& out_len, bool) override {
+        if (!ok) {
+            return false;
+        }
+        if (ended && in_len > 0) {
+            // Another member follows. See the note at the top of this file.
+            if (inflateReset(&stream) != Z_OK) {
+                return false;
+            }
+            ended = false;
+        }
+        point_at(stream, in, in_len, out, out_len);
+        int result = inflate(&stream, Z_NO_FLUSH);
+        advance(stream, in, in_len, out, out_len);
+        if (result == Z_STREAM_END) {
+            ended = true;
+        }
+        // Z_BUF_ERROR only means that it couldn't get anywhere without more input or more room.
+        return result == Z_OK || result == Z_STREAM_END || result == Z_BUF_ERROR;
+    }
+
+    bool at_end() const override {
+        return ended;
+    }
+
+private:
+    z_stream stream;
+    bool ok;
+    bool ended;
+};
+
+class GzipCompressor : public Codec {
+public:
+    GzipCompressor() : ended(false) {
+        std::memset(&stream, 0, sizeof(stream));
+        ok = deflateInit2(&stream, GZIP_LEVEL, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+
+    ~GzipCompressor() override {
+        if (ok) {
+            deflateEnd(&stream);
+        }
+    }
+
+    bool run(const unsigned char *& in, std::size_t& in_len, unsigned char *& out, std::size_t& out_len,
+             bool finish) override {
+        if (!ok) {
+            return false;
+        }
+        point_at(stream, in, in_len, out, out_len);
+        int result = deflate(&stream, finish ? Z_FINISH : Z_NO_FLUSH);
+        advance(stream, in, in_len, out, out_len);
+        if (result == Z_STREAM_END) {
+            ended = true;
+        }
+        return result == Z_OK || result == Z_STREAM_END || result == Z_BUF_ERROR;
+    }
+
+    bool at_end() const override {
+        return ended;
+    }
+
+private:
+    z_stream stream;
+    bool ok;
+    bool ended;
+};
+
+#endif
+
+#ifdef ESCAPE_HAVE_ZSTD
+
+class ZstdDecompressor : public Codec {
+public:
+    ZstdDecompressor() : context(ZSTD_createDCtx()), ended(false) {}
+
+    ~ZstdDecompressor() override {
+        ZSTD_freeDCtx(context);
+    }
+
+    bool run(const unsigned char *& in, std::size_t& in_len, unsigned char *& out, std::size_t& out_len, bool) override {
+        if (context == nullptr) {
+            return false;
+        }
+        ZSTD_inBuffer input = {in, in_len, 0};
+        ZSTD_outBuffer output = {out, out_len, 0};
+        std::size_t result = ZSTD_decompressStream(context, &output, &input);
+        if (ZSTD_isError(result)) {
+            return false;
+        }
+        if (input.pos > 0 || output.pos > 0) {
+            // 0 means that a frame has just been finished. When there's nothing to do, the
+            // result is about the next frame, which might never come, so we ignore it.
+            ended = (result == 0);
+        }
+        in += input.pos;
+        in_len -= input.pos;
+        out += output.pos;
+        out_len -= output.pos;
+        return true;
+    }
+
+    bool at_end() const override {
+        return ended;
+    }
+
+private:
+    ZSTD_DCtx *context;
+    bool ended;
+};
+
+class ZstdCompressor : public Codec {
+public:
+    ZstdCompressor() : context(ZSTD_createCCtx()), ended(false) {
+        if (context != nullptr) {
+            ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, ZSTD_LEVEL);
+        }
+    }
+
+    ~ZstdCompressor() override {
+        ZSTD_freeCCtx(context);
+    }
+
+    bool run(const unsigned char *& in, std::size_t& in_len, unsigned char *& out, std::size_t& out_len,
+             bool finish) override {
+        if (context == nullptr) {
+            return false;
+        }
+        ZSTD_inBuffer input = {in, in_len, 0};
+        ZSTD_outBuffer output = {out, out_len, 0};
+        std::size_t result = ZSTD_compressStream2(context, &output, &input, finish ? ZSTD_e_end : ZSTD_e_continue);
+        if (ZSTD_isError(result)) {
+            return false;
+        }
+        if (finish && result == 0) {
+            ended = true; // Everything has been written out.
+        }
+        in += input.pos;
+        in_len -= input.pos;
+        out += output.pos;
+        out_len -= output.pos;
+        return true;
+    }
+
+    bool at_end() const override {
+        return ended;
+    }
+
+private:
+    ZSTD_CCtx *context;
+    bool ended;
+};
+
+#endif
+
+/**
+ * Makes the decompressor (or, if compressing is true, the compressor) for format, which
+ * has to be available.
+ */
+std::unique_ptr<Codec> make_codec(Compression format, bool compressing) {
+    switch (format) {
+#ifdef ESCAPE_HAVE_ZLIB
+        case Compression::Gzip:
+            return compressing ? std::unique_ptr<Codec>(new GzipCompressor()) : std::unique_ptr<Codec>(new GzipDecompressor());
+#endif
+#ifdef ESCAPE_HAVE_ZSTD
+        case Compression::Zstd:
+            return compressing ? std::unique_ptr<Codec>(new ZstdCompressor()) : std::unique_ptr<Codec>(new ZstdDecompressor());
+#endif
+        default:
+            assert(false);
+            return nullptr;
+    }
+}
+
+/**
+ * A buffer on its way from one thread to the other, and how many bytes of it are data.
+ */
+struct Filled {
+    AlignedBuffer buffer;
+    std::size_t len;
+};
+
+struct DecompressShared {
+    DecompressShared(ByteSource&& in, Compression format) : in(std::move(in)), format(format),
+            codec(make_codec(format, false)), working(false), done(false), failed(false), stopping(false) {}
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    ByteSource in;
+    Compression format;
+    std::unique_ptr<Codec> codec;
+    std::deque<Filled> full; // Waiting for the ByteSource
+    std::vector<AlignedBuffer> empty; // Given back by the ByteSource
+    bool working; // The thread is filling a buffer
+    bool done; // The thread has handed over its last buffer
+    bool failed;
+    bool stopping; // The stage has been destroyed
+};
+
+/**
+ * Fills one buffer with decompressed input.
+ * @param in_data, in_len, in_done Where the thread is in the compressed input, kept between calls.
+ * @param finished This is a return value: true once there's no more input to come (either
+ * because it's all been decompressed or because of an error).
+ * @return False if there was an error.
+ */
+bool fill_buffer(DecompressShared& shared, AlignedBuffer& buffer, const unsigned char *& in_data, std::size_t& in_len,
+                 bool& in_done, std::size_t& len, bool& finished) {
+    buffer.allocate(BYTE_STREAM_BUFFER_SIZE);
+    unsigned char *out = buffer.data();
+    std::size_t out_len = buffer.capacity();
+    bool ok = true;
+    while (out_len > 0) {
+        if (in_len == 0 && !in_done) {
+            in_len = shared.in.pull(in_data, BYTE_STREAM_BUFFER_SIZE);
+            in_done = (in_len == 0);
+        }
+        std::size_t before = in_len + out_len;
+        if (!shared.codec->run(in_data, in_len, out, out_len, false)) {
+            ok = false;
+            finished = true;
+            break;
+        }
+        if (in_done && in_len + out_len == before) {
+            // There's no more input, and nothing more came out of the decompressor either.
+            // That's the end, as long as it isn't in the middle of a member or frame.
+            ok = !shared.in.error() && shared.codec->at_end();
+            finished = true;
+            break;
+        }
+    }
+    len = buffer.capacity() - out_len;
+    if (!ok && !shared.in.error()) {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        if (!shared.stopping) {
+            std::cerr << "The input is not valid " << compression_name(shared.format) << " data. Either it's corrupt or it's cut off." << std::endl;
+        }
+    }
+    return ok;
+}
+
+void decompress_thread(std::shared_ptr<DecompressShared> shared) {
+    const unsigned char *in_data = nullptr;
+    std::size_t in_len = 0;
+    bool in_done = false;
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    while (true) {
+        shared->cv.wait(lock, [&shared] { return shared->full.size() < MAX_QUEUED || shared->stopping; });
+        if (shared->stopping) {
+            return;
+        }
+        AlignedBuffer buffer;
+        if (!shared->empty.empty()) {
+            buffer = std::move(shared->empty.back());
+            shared->empty.pop_back();
+        }
+        shared->working = true;
+        lock.unlock();
+
+        std::size_t len = 0;
+        bool finished = false;
+        bool ok = fill_buffer(*shared, buffer, in_data, in_len, in_done, len, finished);
+
+        lock.lock();
+        shared->working = false;
+        if (len > 0) {
+            shared->full.push_back(Filled{std::move(buffer), len});
+        }
+        shared->done = finished;
+        shared->failed = !ok;
+        shared->cv.notify_all();
+        if (finished) {
+            return;
+        }
+    }
+}
+
+class DecompressStage : public SourceStage {
+public:
+    DecompressStage(ByteSource in, Compression format) : shared(std::make_shared<DecompressShared>(std::move(in), format)) {
+        thread = std::thread(decompress_thread, shared);
+    }
+
+    ~DecompressStage() override {
+        bool detach;
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->stopping = true;
+            detach = shared->working;
+        }
+        shared->cv.notify_all();
+        if (detach) {
+            thread.detach(); // See the note at the top of this file.
+        } else {
+            thread.join();
+        }
+    }
+
+    std::size_t exchange(AlignedBuffer& buffer) override {
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        if (buffer.capacity() > 0) {
+            shared->empty.push_back(std::move(buffer));
+            shared->cv.notify_all();
+        }
+        shared->cv.wait(lock, [this] { return !shared->full.empty() || shared->done; });
+        if (shared->full.empty()) {
+            return 0;
+        }
+        Filled& next = shared->full.front();
+        buffer = std::move(next.buffer);
+        std::size_t len = next.len;
+        shared->full.pop_front();
+        shared->cv.notify_all();
+        return len;
+    }
+
+    bool error() const override {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        return shared->failed;
+    }
+
+private:
+    std::shared_ptr<DecompressShared> shared;
+    std::thread thread;
+};
+
+struct CompressShared {
+    CompressShared(ByteSink&& out, Compression format) : out(std::move(out)), codec(make_codec(format, true)),
+            busy(false), finishing(false), failed(false) {}
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    ByteSink out;
+    std::unique_ptr<Codec> codec;
+    std::deque<Filled> queue; // Waiting to be compressed
+    std::vector<AlignedBuffer> empty; // Compressed, and ready to be handed back
+    bool busy; // The thread is compressing a buffer
+    bool finishing; // No more buffers are coming
+    bool failed;
+};
+
+/**
+ * Compresses data[0..len) into shared.out. If last is true, this ends the compressed data
+ * and closes shared.out.
+ * @return False if there was an error.
+ */
+bool compress_buffer(CompressShared& shared, const unsigned char *data, std::size_t len, bool last) {
+    while (len > 0 || (last && !shared.codec->at_end())) {
+        unsigned char *room = shared.out.reserve(COMPRESS_CHUNK);
+        if (room == nullptr) {
+            return false;
+        }
+        unsigned char *out = room;
+        std::size_t out_len = COMPRESS_CHUNK;
+        if (!shared.codec->run(data, len, out, out_len, last)) {
+            return false;
+        }
+        shared.out.commit(COMPRESS_CHUNK - out_len);
+    }
+    return !last || shared.out.close();
+}
+
+void compress_thread(CompressShared& shared) {
+    std::unique_lock<std::mutex> lock(shared.mutex);
+    while (true) {
+        shared.cv.wait(lock, [&shared] { return !shared.queue.empty() || shared.finishing; });
+        // The buffers that were handed over before finish() still have to be compressed first.
+        bool last = shared.queue.empty();
+        Filled item{AlignedBuffer(), 0};
+        if (!last) {
+            item = std::move(shared.queue.front());
+            shared.queue.pop_front();
+        }
+        bool failed = shared.failed;
+        shared.busy = true;
+        lock.unlock();
+
+        if (!failed) {
+            failed = !compress_buffer(shared, item.buffer.data(), item.len, last);
+        }
+        if (last) {
+            shared.out.close(); // Even after an error, so that the file is closed.
+        }
+
+        lock.lock();
+        shared.busy = false;
+        shared.failed = shared.failed || failed;
+        if (item.buffer.capacity() > 0 && shared.empty.size() < MAX_QUEUED) {
+            shared.empty.push_back(std::move(item.buffer));
+        }
+        shared.cv.notify_all();
+        if (last) {
+            return;
+        }
+    }
+}
+
+class CompressStage : public SinkStage {
+public:
+    CompressStage(ByteSink out, Compression format) : shared(new CompressShared(std::move(out), format)), finished(false) {
+        thread = std::thread(compress_thread, std::ref(*shared));
+    }
+
+    ~CompressStage() override {
+        finish();
+    }
+
+    bool exchange(AlignedBuffer& buffer, std::size_t len) override {
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->cv.wait(lock, [this] { return shared->queue.size() < MAX_QUEUED; });
+        shared->queue.push_back(Filled{std::move(buffer), len});
+        if (!shared->empty.empty()) {
+            buffer = std::move(shared->empty.back());
+            shared->empty.pop_back();
+        }
+        shared->cv.notify_all();
+        return !shared->failed;
+    }
+
+    bool flush() override {
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->cv.wait(lock, [this] { return shared->queue.empty() && !shared->busy; });
+        return !shared->failed;
+    }
+
+    bool finish() override {
+        if (!finished) {
+            {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                shared->finishing = true;
+            }
+            shared->cv.notify_all();
+            thread.join();
+            finished = true;
+        }
+        return !shared->failed;
+    }
+
+private:
+    std::unique_ptr<CompressShared> shared;
+    std::thread thread;
+    bool finished;
+};
+
+/**
+ * Returns true if data[0..len) starts with magic[0..magic_len).
+ */
+bool starts_with(const unsigned char *data, std::size_t len, const unsigned char *magic, std::size_t magic_len) {
+    return len >= magic_len && std::memcmp(data, magic, magic_len) == 0;
+}
+
+/**
+ * Returns true if data[0..len) is too short to tell, but could be the start of magic.
+ */
+bool could_start(const unsigned char *data, std::size_t len, const unsigned char *magic, std::size_t magic_len) {
+    return len < magic_len && std::memcmp(data, magic, len) == 0;
+}
+
+} // namespace
+
+const char *compression_name(Compression format) {
+    return COMPRESSION_NAMES[static_cast<int>(format)];
+}
+
+bool parse_compression(const std::string& name, Compression& format) {
+    if (name == "gzip") {
+        format = Compression::Gzip;
+    } else if (name == "zstd") {
+        format = Compression::Zstd;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool compression_available(Compression format) {
+    switch (format) {
+#ifdef ESCAPE_HAVE_ZLIB
+        case Compression::Gzip:
+            return true;
+#endif
+#ifdef ESCAPE_HAVE_ZSTD
+        case Compression::Zstd:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+Compression detect_compression(ByteSource& in) {
+    const unsigned char *data;
+    std::size_t len = in.peek(data, sizeof(ZSTD_MAGIC));
+    while (true) {
+        if (starts_with(data, len, GZIP_MAGIC, sizeof(GZIP_MAGIC))) {
+            return Compression::Gzip;
+        } else if (starts_with(data, len, ZSTD_MAGIC, sizeof(ZSTD_MAGIC))) {
+            return Compression::Zstd;
+        }
+        // A pipe can give us the input a byte at a time. We only wait for more if it could
+        // still be compressed, so that a live stream of text isn't held up.
+        if (!could_start(data, len, GZIP_MAGIC, sizeof(GZIP_MAGIC)) && !could_start(data, len, ZSTD_MAGIC, sizeof(ZSTD_MAGIC))) {
+            return Compression::None;
+        }
+        std::size_t more = in.peek(data, sizeof(ZSTD_MAGIC));
+        if (more == len) {
+            return Compression::None; // The input ended (or failed) first.
+        }
+        len = more;
+    }
+}
+
+ByteSource decompress_source(ByteSource in, Compression format) {
+    assert(compression_available(format));
+    return ByteSource::from_stage(std::unique_ptr<SourceStage>(new DecompressStage(std::move(in), format)));
+}
+
+ByteSink compress_sink(ByteSink out, Compression format) {
+    assert(compression_available(format));
+    return ByteSink::to_stage(std::unique_ptr<SinkStage>(new CompressStage(std::move(out), format)));
+}
@@ -0,0 +1,74 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_COMPRESSION_H
+#define ESCAPE_UTF8_COMPRESSION_H
+
+#include <cstddef> // std::size_t
+#include <string>
+
+#include "ByteStream.h"
+
+/*
+ * Compressed input and output, so that "zcat log.gz | escape | gzip" can be just
+ * "escape log.gz --compress gzip".
+ *
+ * The input is decompressed if it starts with the magic bytes of a format we know. That
+ * can't change what happens to any input that we'd escape otherwise: both magic numbers
+ * have a UTF-8 continuation byte in the wrong place (0x8B and 0xB5), so an input that
+ * starts with one is invalid UTF-8 anyway.
+ *
+ * The decompressor and the compressor each run on a thread of their own, as a stage of a
+ * ByteSource or ByteSink (see ByteStream.h), so decompressing the next buffer of input and
+ * compressing the last buffer of output happen at the same time as escaping. The buffers
+ * are handed between the threads, never copied.
+ *
+ * Each format is only available if the library for it was found when escape was built:
+ * zlib for gzip and libzstd for zstd.
+ */
+
+enum class Compression { None, Gzip, Zstd };
+
+/**
+ * Returns the name of the format, as given to --compress: "gzip" or "zstd" (or "none").
+ */
+const char *compression_name(Compression format);
+
+/**
+ * Parses the name of a format (see compression_name), other than "none".
+ * @param name The name.
+ * @param format This is a return value. It's only modified if the parse succeeds.
+ * @return True if name is the name of a format, false otherwise.
+ */
+bool parse_compression(const std::string& name, Compression& format);
+
+/**
+ * Returns whether this build of escape can compress and decompress the given format.
+ */
+bool compression_available(Compression format);
+
+/**
+ * Works out whether the input is compressed from its first few bytes, which are still
+ * there to be read afterwards (see ByteSource::peek).
+ * @return The format, or Compression::None if it isn't compressed (or is empty).
+ */
+Compression detect_compression(ByteSource& in);
+
+/**
+ * Returns a source that reads in and decompresses it, on a thread of its own. If the data
+ * turns out to be corrupt or cut off, an error message is printed and the source fails
+ * with a read error.
+ * @param format A format that's available.
+ */
+ByteSource decompress_source(ByteSource in, Compression format);
+
+/**
+ * Returns a sink that compresses its output, on a thread of its own, and writes it to out.
+ * The compressed data is only complete once the sink has been closed (see ByteSink::close).
+ * The compression level is the default of the command-line tool: 6 for gzip and 3 for zstd.
+ * @param format A format that's available.
+ */
+ByteSink compress_sink(ByteSink out, Compression format);
+
+#endif //ESCAPE_UTF8_COMPRESSION_H
@@ -0,0 +1,132 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include "cpu_features.h"
+
+/*
+ * IMPLEMENTATION NOTES
+ * What we look for (the bit numbers are from the Intel manual, volume 2A, under CPUID):
+ *   SSE2:    leaf 1, EDX bit 26.
+ *   SSE4.2:  leaf 1, ECX bit 20, plus SSSE3 (ECX bit 9). Every CPU with SSE4.2 has SSSE3,
+ *            but it costs nothing to check.
+ *   AVX2:    leaf 7, EBX bit 5, plus AVX itself (leaf 1, ECX bit 28). Real CPUs with AVX2
+ *            always have AVX, but some hypervisors hide AVX and still report AVX2. Before
+ *            using the 32-byte registers we also need the operating system to save them on
+ *            a context switch: leaf 1, ECX bit 27 (OSXSAVE) says we can ask with XGETBV, and
+ *            XCR0 bits 1 and 2 say it saves the SSE and AVX state.
+ *   AVX-512: leaf 7, EBX bits 16 (F) and 30 (BW), and XCR0 bits 5, 6 and 7 for the mask
+ *            registers and the upper halves of the 64-byte registers.
+ *   On anything that isn't x86, only the portable tiers are supported.
+ *
+ * References:
+ * https://www.intel.com/content/www/us/en/developer/articles/technical/intel-sdm.html
+ * https://docs.microsoft.com/en-us/cpp/intrinsics/cpuid-cpuidex
+ */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ESCAPE_UTF8_X86
+#ifdef _MSC_VER
+#include <intrin.h> // __cpuid, __cpuidex
+#include <immintrin.h> // _xgetbv
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+static const char *const TIER_NAMES[NUM_KERNEL_TIERS] = {"scalar", "swar", "sse2", "sse4.2", "avx2", "avx512"};
+
+const char *kernel_tier_name(KernelTier tier) {
+    return TIER_NAMES[static_cast<int>(tier)];
+}
+
+bool parse_kernel_tier(const std::string& name, KernelTier& tier) {
+    for (int k = 0; k < NUM_KERNEL_TIERS; ++k) {
+        if (name == TIER_NAMES[k]) {
+            tier = static_cast<KernelTier>(k);
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef ESCAPE_UTF8_X86
+
+/**
+ * Runs cpuid for the given leaf (and subleaf 0), and stores EAX, EBX, ECX and EDX in regs.
+ * If the CPU doesn't have that leaf, they're all 0.
+ */
+static void cpuid(unsigned int leaf, unsigned int (&regs)[4]) {
+    regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (static_cast<unsigned int>(info[0]) < leaf) {
+        return;
+    }
+    __cpuidex(info, static_cast<int>(leaf), 0);
+    for (int k = 0; k < 4; ++k) {
+        regs[k] = static_cast<unsigned int>(info[k]);
+    }
+#else
+    if (__get_cpuid_max(0, nullptr) < leaf) {
+        return;
+    }
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/**
+ * Returns the low 32 bits of XCR0, the register that says which kinds of register state
+ * the operating system saves. Only call this if OSXSAVE is set.
+ */
+static unsigned int xcr0() {
+#ifdef _MSC_VER
+    return static_cast<unsigned int>(_xgetbv(0));
+#else
+    // The _xgetbv intrinsic needs -mxsave, so we use the instruction directly.
+    unsigned int eax;
+    unsigned int edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return eax;
+#endif
+}
+
+/**
+ * Returns the best tier that this CPU supports.
+ */
+static KernelTier detect_best_tier() {
+    unsigned int leaf1[4];
+    unsigned int leaf7[4];
+    cpuid(1, leaf1);
+    cpuid(7, leaf7);
+    const unsigned int ecx1 = leaf1[2];
+    const unsigned int edx1 = leaf1[3];
+    const unsigned int ebx7 = leaf7[1];
+    if (!(edx1 & (1u << 26))) {
+        return KernelTier::Swar; // No SSE2, so this is a very old 32-bit CPU.
+    }
+    if (!(ecx1 & (1u << 20)) || !(ecx1 & (1u << 9))) {
+        return KernelTier::Sse2;
+    }
+    const unsigned int xcr = (ecx1 & (1u << 27)) ? xcr0() : 0;
+    if (!(ecx1 & (1u << 28)) || !(ebx7 & (1u << 5)) || (xcr & 0x6u) != 0x6u) {
+        return KernelTier::Sse42;
+    }
+    if (!(ebx7 & (1u << 16)) || !(ebx7 & (1u << 30)) || (xcr & 0xE6u) != 0xE6u) {
+        return KernelTier::Avx2;
+    }
+    return KernelTier::Avx512;
+}
+
+#else
+
+static KernelTier detect_best_tier() {
+    return KernelTier::Swar;
+}
+
+#endif
+
+bool cpu_supports(KernelTier tier) {
+    static const KernelTier best = detect_best_tier();
+    return static_cast<int>(tier) <= static_cast<int>(best);
+}
@@ -0,0 +1,55 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_CPU_FEATURES_H
+#define ESCAPE_UTF8_CPU_FEATURES_H
+
+#include <string>
+
+/**
+ * The versions of the scanning code that the escape kernel can run with, from the slowest
+ * to the fastest. Each one needs the instruction sets of the ones before it (except that
+ * the x86 ones don't need SWAR, which is portable), so a CPU that supports a tier supports
+ * every tier below it. See ascii_scan.cpp for what each one does.
+ */
+enum class KernelTier {
+    // One byte at a time. Works everywhere.
+    Scalar,
+    // 8 bytes at a time in a 64-bit integer ("SIMD within a register"). Works everywhere.
+    Swar,
+    // 16 bytes at a time with SSE2, which every x86-64 CPU has.
+    Sse2,
+    // 16 bytes at a time with SSE4.2's string instructions (and SSSE3's PSHUFB).
+    Sse42,
+    // 32 bytes at a time with AVX2.
+    Avx2,
+    // 64 bytes at a time with AVX-512 (the F and BW subsets).
+    Avx512
+};
+
+// The number of tiers, for looping over them.
+static const int NUM_KERNEL_TIERS = 6;
+
+/**
+ * Returns the name of the tier, as given to --kernel: "scalar", "swar", "sse2", "sse4.2",
+ * "avx2" or "avx512".
+ */
+const char *kernel_tier_name(KernelTier tier);
+
+/**
+ * Parses the name of a tier (see kernel_tier_name).
+ * @param name The name.
+ * @param tier This is a return value. It's only modified if the parse succeeds.
+ * @return True if name is the name of a tier, false otherwise.
+ */
+bool parse_kernel_tier(const std::string& name, KernelTier& tier);
+
+/**
+ * Returns whether this CPU (and the operating system, which has to save the bigger
+ * registers on a context switch) supports the instructions that the given tier needs.
+ * This asks the CPU with cpuid the first time it's called, and remembers the answer.
+ */
+bool cpu_supports(KernelTier tier);
+
+#endif //ESCAPE_UTF8_CPU_FEATURES_H
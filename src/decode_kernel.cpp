@@ -0,0 +1,215 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <cassert>
+#include <cstring> // std::memchr, std::memcpy
+
+#include "decode_kernel.h"
+#include "utf8_dfa.h"
+#include "utf8_validate.h"
+
+// The start of every escape string.
+static const unsigned char ESCAPE_START[3] = {'\\', 'u', '\''};
+
+// The most hex digits an escape string can have. 6 is enough for U+10FFFF.
+static const unsigned int MAX_DIGITS = 6;
+
+/**
+ * Returns the value of the given hex digit (either case), or -1 if it isn't one.
+ */
+static inline int hex_value(unsigned char byte) {
+    if ('0' <= byte && byte <= '9') {
+        return byte - '0';
+    }
+    unsigned char lower = static_cast<unsigned char>(byte | 0x20u); // 'A' -> 'a', and leaves 'a' alone
+    if ('a' <= lower && lower <= 'f') {
+        return lower - 'a' + 10;
+    }
+    return -1;
+}
+
+std::size_t encode_utf8(std::uint_fast32_t codepoint, unsigned char *out) {
+    if (codepoint < 0x80u) {
+        out[0] = static_cast<unsigned char>(codepoint);
+        return 1;
+    } else if (codepoint < 0x800u) {
+        out[0] = static_cast<unsigned char>(0xC0u | (codepoint >> 6u));
+        out[1] = static_cast<unsigned char>(0x80u | (codepoint & 0x3Fu));
+        return 2;
+    } else if (codepoint < 0x10000u) {
+        out[0] = static_cast<unsigned char>(0xE0u | (codepoint >> 12u));
+        out[1] = static_cast<unsigned char>(0x80u | ((codepoint >> 6u) & 0x3Fu));
+        out[2] = static_cast<unsigned char>(0x80u | (codepoint & 0x3Fu));
+        return 3;
+    } else {
+        out[0] = static_cast<unsigned char>(0xF0u | (codepoint >> 18u));
+        out[1] = static_cast<unsigned char>(0x80u | ((codepoint >> 12u) & 0x3Fu));
+        out[2] = static_cast<unsigned char>(0x80u | ((codepoint >> 6u) & 0x3Fu));
+        out[3] = static_cast<unsigned char>(0x80u | (codepoint & 0x3Fu));
+        return 4;
+    }
+}
+
+/**
+ * Given the byte after the hex digits of an escape string, returns whether that byte ends
+ * the escape string and the escape string stands for a Unicode scalar value.
+ */
+static inline bool is_valid_end(unsigned char byte, unsigned int num_digits, std::uint_fast32_t codepoint) {
+    return byte == '\'' && num_digits > 0 && codepoint <= 0x10FFFFu && !(0xD800u <= codepoint && codepoint <= 0xDFFFu);
+}
+
+/**
+ * Returns true if the text between two escape strings is short and ASCII, so that it doesn't
+ * need to go through validate_block. That's the common case in escaped text, and validate_block
+ * costs a fair bit more than this for a handful of bytes.
+ */
+static inline bool is_short_ascii(const DecodeState& state, const unsigned char *data, std::size_t len) {
+    if (len > 16 || !state.text.at_boundary()) {
+        return false;
+    }
+    unsigned char any = 0;
+    for (std::size_t k = 0; k < len; ++k) {
+        any |= data[k];
+    }
+    return any < 0x80;
+}
+
+/**
+ * Marks the state as invalid. pos is the 0-based position in the current block of the byte
+ * that made the input invalid.
+ */
+static void set_invalid(DecodeState& state, bool bad_escape, std::size_t pos) {
+    state.invalid = true;
+    state.bad_escape = bad_escape;
+    state.num_bytes_read += pos + 1;
+}
+
+std::size_t decode_block(DecodeState& state, const unsigned char *in, std::size_t len, unsigned char *out) {
+    assert(!state.invalid);
+    unsigned char *const out_begin = out;
+    std::size_t i = 0;
+
+    while (i < len) {
+        if (state.pending_len == 0) {
+            // We're between escape strings. Escaped text is mostly stretches of plain text,
+            // so we find the next backslash with memchr (which is vectorized in every C
+            // library that matters) and copy everything up to it at once. The stretch also
+            // has to be valid UTF-8, which validate_block checks at about the same speed.
+            const void *found = std::memchr(in + i, '\\', len - i);
+            std::size_t end = found ? static_cast<std::size_t>(static_cast<const unsigned char *>(found) - in) : len;
+            if (!is_short_ascii(state, in + i, end - i)) {
+                EscapeState before = state.text;
+                validate_block(state.text, in + i, end - i);
+                if (state.text.invalid) {
+                    // Like escape_block, we write out everything before the bad character. We get
+                    // the last character boundary before the bad byte by running the DFA again.
+                    std::size_t bad = i + static_cast<std::size_t>(state.text.num_bytes_read - before.num_bytes_read) - 1;
+                    std::uint_fast32_t dfa_state = before.dfa_state;
+                    std::size_t boundary = i;
+                    for (std::size_t j = i; j < bad; ++j) {
+                        dfa_state = UTF8_TRANSITIONS[dfa_state + UTF8_BYTE_CLASS[in[j]]];
+                        if (dfa_state == UTF8_ACCEPT) {
+                            boundary = j + 1;
+                        }
+                    }
+                    std::memcpy(out, in + i, boundary - i);
+                    out += boundary - i;
+                    set_invalid(state, false, bad);
+                    return static_cast<std::size_t>(out - out_begin);
+                }
+            }
+            std::memcpy(out, in + i, end - i);
+            out += end - i;
+            i = end;
+            if (i == len) {
+                break;
+            }
+            if (!state.text.at_boundary()) {
+                // A backslash in the middle of a multi-byte character
+                set_invalid(state, false, i);
+                return static_cast<std::size_t>(out - out_begin);
+            }
+            // The fast path: the whole escape string is in this block, so we don't need to go
+            // through the state machine below one byte at a time.
+            std::size_t j = i + sizeof(ESCAPE_START);
+            if (j <= len && in[i + 1] == ESCAPE_START[1] && in[i + 2] == ESCAPE_START[2]) {
+                std::uint_fast32_t codepoint = 0;
+                unsigned int num_digits = 0;
+                int digit;
+                while (j < len && num_digits < MAX_DIGITS && (digit = hex_value(in[j])) >= 0) {
+                    codepoint = (codepoint << 4u) | static_cast<std::uint_fast32_t>(digit);
+                    ++num_digits;
+                    ++j;
+                }
+                if (j < len) {
+                    if (!is_valid_end(in[j], num_digits, codepoint)) {
+                        set_invalid(state, true, j);
+                        return static_cast<std::size_t>(out - out_begin);
+                    }
+                    out += encode_utf8(codepoint, out);
+                    i = j + 1;
+                    continue;
+                }
+                // Otherwise the escape string continues in the next block.
+            }
+            state.pending_len = 1;
+            ++i;
+            continue;
+        }
+
+        unsigned char byte = in[i];
+        if (state.pending_len < sizeof(ESCAPE_START)) {
+            if (byte == ESCAPE_START[state.pending_len]) {
+                ++state.pending_len;
+                ++i;
+                if (state.pending_len == sizeof(ESCAPE_START)) {
+                    state.num_digits = 0;
+                    state.codepoint = 0;
+                }
+            } else {
+                // It's a backslash that doesn't start an escape string, so it stands for
+                // itself. The current byte hasn't been used yet; the next iteration handles it.
+                std::memcpy(out, ESCAPE_START, state.pending_len);
+                out += state.pending_len;
+                state.pending_len = 0;
+            }
+            continue;
+        }
+
+        // We're in the hex digits of an escape string.
+        int digit = hex_value(byte);
+        if (digit >= 0 && state.num_digits < MAX_DIGITS) {
+            state.codepoint = (state.codepoint << 4u) | static_cast<std::uint_fast32_t>(digit);
+            ++state.num_digits;
+            ++i;
+            continue;
+        }
+        if (!is_valid_end(byte, state.num_digits, state.codepoint)) {
+            set_invalid(state, true, i);
+            return static_cast<std::size_t>(out - out_begin);
+        }
+        out += encode_utf8(state.codepoint, out);
+        state.pending_len = 0;
+        ++i;
+    }
+    state.num_bytes_read += len;
+    return static_cast<std::size_t>(out - out_begin);
+}
+
+std::size_t decode_finish(DecodeState& state, unsigned char *out) {
+    assert(!state.invalid);
+    if (state.pending_len == sizeof(ESCAPE_START)) {
+        state.invalid = true; // The input stopped in the middle of an escape string.
+        state.bad_escape = true;
+        return 0;
+    }
+    // A "\" or "\u" at the very end stands for itself.
+    std::memcpy(out, ESCAPE_START, state.pending_len);
+    std::size_t outlen = state.pending_len;
+    state.pending_len = 0;
+    if (!state.text.at_boundary()) {
+        state.invalid = true; // The input stopped in the middle of a multi-byte character.
+    }
+    return outlen;
+}
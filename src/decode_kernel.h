@@ -0,0 +1,89 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_DECODE_KERNEL_H
+#define ESCAPE_UTF8_DECODE_KERNEL_H
+
+#include <cstddef> // std::size_t
+#include <cstdint> // uint_fast32_t, uint_fast64_t
+
+#include "escape_kernel.h" // EscapeState
+
+/**
+ * This is the state that decode_block carries from one block of input to the next, so that
+ * an escape string (or a multi-byte character that wasn't escaped) can be split between blocks.
+ *
+ * A freshly constructed DecodeState is the state at the beginning of the input.
+ */
+struct DecodeState {
+    // How much of the "\u'" at the start of an escape string we've seen (0 to 3 bytes), if
+    // the last escape string hasn't been finished yet.
+    std::size_t pending_len;
+    // After "\u'", the number of hex digits we've seen so far and their value.
+    unsigned int num_digits;
+    std::uint_fast32_t codepoint;
+    // The validator state for the text between the escape strings, which is copied as-is
+    // and so has to be valid UTF-8 by itself. See validate_block in utf8_validate.h.
+    EscapeState text;
+    // Set to true once decode_block sees invalid input. After that the state shouldn't be used again.
+    bool invalid;
+    // If invalid is true, this says whether it was a bad escape string (as opposed to
+    // invalid UTF-8 between the escape strings).
+    bool bad_escape;
+    // The number of input bytes that decode_block has looked at so far. If invalid is true,
+    // this includes the byte that made the input invalid, so it's the 1-based position of that byte.
+    std::uint_fast64_t num_bytes_read;
+
+    DecodeState() : pending_len(0), num_digits(0), codepoint(0), invalid(false), bad_escape(false), num_bytes_read(0) {}
+};
+
+/**
+ * Returns the maximum number of bytes that decode_block can write for an input block of
+ * len bytes. Decoding never makes the text longer, except at the start of the block: an escape
+ * string that started in the previous block can be finished by a single "'", which produces up
+ * to 4 bytes, or a "\u" that was held back can turn out not to start an escape string after all.
+ */
+inline std::size_t decode_output_bound(std::size_t len) {
+    return len + 4;
+}
+
+/**
+ * This is the reverse of escape_block: it turns the escape strings made by
+ * construct_escape_string back into UTF-8, and copies everything else as-is.
+ *
+ * An escape string is "\u'", then 1 to 6 hex digits (in either case), then "'", as in section
+ * 5.1 of RFC 5137. The value must be a Unicode scalar value, i.e. at most U+10FFFF and not a
+ * surrogate. A backslash that isn't followed by "u'" is copied as-is, since the escape program
+ * never escapes backslashes. Anything that starts with "\u'" but isn't a valid escape string
+ * makes the input invalid, and so does text between the escape strings that isn't valid UTF-8.
+ *
+ * Like escape_block, this stops at the byte that made the input invalid and sets
+ * state.invalid, and everything before that is written out.
+ * @param state The decoder state. Must not already be invalid.
+ * @param in Pointer to the input block. May be null if len is 0.
+ * @param len Number of bytes in the input block.
+ * @param out The output buffer. Must have room for at least decode_output_bound(len) bytes.
+ * @return The number of bytes written to out.
+ */
+std::size_t decode_block(DecodeState& state, const unsigned char *in, std::size_t len, unsigned char *out);
+
+/**
+ * Finishes decoding at the end of the input. A "\" or "\u" that was held back is written
+ * out; an unfinished escape string or an unfinished multi-byte character makes the input
+ * invalid, in which case state.invalid is set.
+ * @param state The decoder state. Must not already be invalid.
+ * @param out The output buffer. Must have room for at least 2 bytes.
+ * @return The number of bytes written to out.
+ */
+std::size_t decode_finish(DecodeState& state, unsigned char *out);
+
+/**
+ * Writes the UTF-8 encoding of the given code point to out.
+ * @param codepoint A Unicode scalar value.
+ * @param out A buffer with room for at least 4 bytes.
+ * @return The number of bytes written, from 1 to 4.
+ */
+std::size_t encode_utf8(std::uint_fast32_t codepoint, unsigned char *out);
+
+#endif //ESCAPE_UTF8_DECODE_KERNEL_H
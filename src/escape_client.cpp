@@ -0,0 +1,109 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * escape_client: a command-line client for escape --serve (see serve.h). It sends each FILE
+ * (or stdin, if there are none) to the server as one request, and writes the responses to
+ * stdout, one after another. It's for trying out a server and for scripts; a program that
+ * escapes a lot of text should use ServeClient (serve_client.h) and keep its connection.
+ *
+ * Usage: escape_client SOCKET [FILE...]
+ *
+ * The exit codes are those of the escape program:
+ * 0: success
+ * 1: couldn't connect to the server, or couldn't open a file
+ * 2: an input isn't valid UTF-8 (the output for it is everything before the bad character,
+ *    and nothing is sent after it)
+ * 3: error when reading a file, or the connection to the server was lost
+ * 4: error when writing to stdout
+ * 5: malformed command line, or an input was longer than the server accepts
+ */
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "serve.h"
+#include "serve_client.h"
+
+#ifdef __linux__
+
+/**
+ * Reads all of in into contents.
+ * @return False if there was a read error.
+ */
+static bool read_all(std::istream& in, std::string& contents) {
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    contents = buffer.str();
+    return !in.bad();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help") {
+        std::cerr << "Usage: escape_client SOCKET [FILE...]" << std::endl;
+        return (argc < 2) ? 5 : 0;
+    }
+    std::ios_base::sync_with_stdio(false);
+    std::unique_ptr<ServeClient> client = ServeClient::connect(argv[1]);
+    if (!client) {
+        std::cerr << "Failed to connect to \"" << argv[1] << "\". Exiting now." << std::endl;
+        return 1;
+    }
+    std::string input;
+    std::string output;
+    // With no files, the only input is stdin.
+    const int num_inputs = (argc == 2) ? 1 : argc - 2;
+    for (int k = 0; k < num_inputs; ++k) {
+        if (argc == 2) {
+            if (!read_all(std::cin, input)) {
+                std::cerr << "Failed when trying to read stdin. Exiting now." << std::endl;
+                return 3;
+            }
+        } else {
+            const char *name = argv[2 + k];
+            std::ifstream file(name, std::ios_base::binary);
+            if (!file.is_open()) {
+                std::cerr << "Failed to open input file \"" << name << "\". Exiting now." << std::endl;
+                return 1;
+            }
+            if (!read_all(file, input)) {
+                std::cerr << "Failed when trying to read \"" << name << "\". Exiting now." << std::endl;
+                return 3;
+            }
+        }
+        if (input.size() > SERVE_MAX_REQUEST) {
+            std::cerr << "The input is longer than the server accepts. Exiting now." << std::endl;
+            return 5;
+        }
+        int status;
+        if (!client->escape(input, status, output)) {
+            std::cerr << "Lost the connection to the server. Exiting now." << std::endl;
+            return 3;
+        }
+        std::cout.write(output.data(), static_cast<std::streamsize>(output.size()));
+        std::cout.flush();
+        if (!std::cout) {
+            std::cerr << "There was a fatal error when trying to write to the output. Exiting now." << std::endl;
+            return 4;
+        }
+        if (status != SERVE_OK) {
+            if (status == SERVE_INVALID_UTF8) {
+                std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+            }
+            return status;
+        }
+    }
+    return 0;
+}
+
+#else
+
+int main() {
+    std::cerr << "escape_client only works on Linux, like escape --serve." << std::endl;
+    return 5;
+}
+
+#endif
@@ -0,0 +1,297 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <cassert>
+#include <cstring> // std::memcpy
+#include <cstdint> // uint_fast32_t
+
+#include "escape_kernel.h"
+#include "ascii_scan.h"
+#include "hex_tables.h"
+#include "utf8_dfa.h"
+
+/**
+ * Given a buffer and a Unicode code point, this function constructs the escape
+ * string for that code point. The first three bytes of the buffer should be "\u'"
+ * because those will be the same for every escape string. Note that in this docstring
+ * (and elsewhere in the codebase), when describing a sequence of characters, the outer
+ * quotes are external delimiters and SHOULD NOT be interpreted as being part of the
+ * sequence.
+ *
+ * For example, given the code point 1000 (hex value 0x3E8) this function would write to the
+ * buffer "\u'03E8'". All letters will be uppercase except the "u" at the beginning.
+ *
+ * Any number whose hex representation would fit in less than 4 hex digits (like 0x3E8)
+ * will be padded by leading zeros to reach 4 characters. No padding is done for larger
+ * values.
+ * @param buf A buffer of length 10 bytes, where the first three bytes are "\u'".
+ * @param codepoint Int representing a Unicode code point; must be a number in [0, 2^21).
+ * @return The number of characters in the escape string. Will be 8, 9, or 10.
+ */
+std::size_t construct_escape_string(unsigned char *buf, std::uint_fast32_t codepoint) {
+    /*
+     * We used to format the number with a std::stringstream (setfill/setw/hex/uppercase),
+     * but that meant a heap allocation and a trip through the locale machinery for every
+     * single escaped character. Now we look up the hex digits two at a time in HEX_PAIRS.
+     *
+     * The number of hex digits is 4 for anything below 0x10000 (this includes the padding),
+     * 5 below 0x100000, and 6 otherwise. Since codepoint < 2^21, the top byte in the 6-digit
+     * case is at most 0x1F, which is still in the table.
+     */
+    assert(codepoint < (1u << 21u));
+    unsigned char *digits = buf + 3;
+    std::uint_fast32_t low = codepoint & 0xFFu;
+    std::uint_fast32_t mid = (codepoint >> 8u) & 0xFFu;
+    std::uint_fast32_t high = codepoint >> 16u;
+    if (high == 0) {
+        std::memcpy(digits, HEX_PAIRS + 2 * mid, 2);
+        std::memcpy(digits + 2, HEX_PAIRS + 2 * low, 2);
+        buf[7] = '\'';
+        return 8;
+    } else if (high < 0x10u) {
+        digits[0] = static_cast<unsigned char>(HEX_DIGITS[high]);
+        std::memcpy(digits + 1, HEX_PAIRS + 2 * mid, 2);
+        std::memcpy(digits + 3, HEX_PAIRS + 2 * low, 2);
+        buf[8] = '\'';
+        return 9;
+    } else {
+        std::memcpy(digits, HEX_PAIRS + 2 * high, 2);
+        std::memcpy(digits + 2, HEX_PAIRS + 2 * mid, 2);
+        std::memcpy(digits + 4, HEX_PAIRS + 2 * low, 2);
+        buf[9] = '\'';
+        return 10;
+    }
+}
+
+/*
+ * ESCAPE FORMATS
+ *   Each escape format (see EscapeFormat in escape_kernel.h) is a policy class with two
+ *   static functions, which write the escape string for a character to out and return its
+ *   length:
+ *     escape_ascii(out, byte) for an ASCII control character or DEL, and
+ *     escape(out, codepoint) for anything else that needs escaping.
+ *   escape_block_as is a template over the policy class, so each format gets its own copy
+ *   of the loop with the format's code inlined into it, and the only place that looks at
+ *   the format at run time is the switch in escape_block_in. That's once per block.
+ *
+ *   Three of the formats are a 3-byte prefix, the same 4 to 6 hex digits as RFC 5137, and a
+ *   1-byte suffix, so construct_escape_string does the work for all three of them.
+ */
+
+/**
+ * A format that is Prefix0 Prefix1 Prefix2, then the hex digits, then Suffix.
+ */
+template <unsigned char Prefix0, unsigned char Prefix1, unsigned char Prefix2, unsigned char Suffix>
+struct HexFormat {
+    static inline std::size_t escape(unsigned char *out, std::uint_fast32_t codepoint) {
+        out[0] = Prefix0;
+        out[1] = Prefix1;
+        out[2] = Prefix2;
+        std::size_t len = construct_escape_string(out, codepoint);
+        if (Suffix != '\'') { // This is known at compile time.
+            out[len - 1] = Suffix;
+        }
+        return len;
+    }
+
+    static inline std::size_t escape_ascii(unsigned char *out, unsigned char byte) {
+        return escape(out, byte);
+    }
+};
+
+/**
+ * \u'XXXX'. The escape strings for ASCII characters come straight out of a table.
+ */
+struct Rfc5137Format : HexFormat<'\\', 'u', '\'', '\''> {
+    static inline std::size_t escape_ascii(unsigned char *out, unsigned char byte) {
+        std::memcpy(out, ASCII_ESCAPES + 8 * byte, 8);
+        return 8;
+    }
+};
+
+/**
+ * \U{XXXX}
+ */
+typedef HexFormat<'\\', 'U', '{', '}'> BracesFormat;
+
+/**
+ * &#xXXXX;
+ */
+typedef HexFormat<'&', '#', 'x', ';'> HtmlFormat;
+
+/**
+ * \uXXXX, always with 4 hex digits. Characters above U+FFFF are written as their UTF-16
+ * surrogate pair, which is how JSON (RFC 8259, section 7) writes them.
+ */
+struct JsonFormat {
+    /**
+     * Writes \uXXXX for a single UTF-16 code unit.
+     */
+    static inline std::size_t escape_unit(unsigned char *out, std::uint_fast32_t unit) {
+        out[0] = '\\';
+        out[1] = 'u';
+        std::memcpy(out + 2, HEX_PAIRS + 2 * (unit >> 8u), 2);
+        std::memcpy(out + 4, HEX_PAIRS + 2 * (unit & 0xFFu), 2);
+        return 6;
+    }
+
+    static inline std::size_t escape(unsigned char *out, std::uint_fast32_t codepoint) {
+        if (codepoint < 0x10000u) {
+            return escape_unit(out, codepoint);
+        }
+        std::uint_fast32_t offset = codepoint - 0x10000u;
+        escape_unit(out, 0xD800u + (offset >> 10u));
+        escape_unit(out + 6, 0xDC00u + (offset & 0x3FFu));
+        return 12;
+    }
+
+    static inline std::size_t escape_ascii(unsigned char *out, unsigned char byte) {
+        return escape_unit(out, byte);
+    }
+};
+
+/*
+ * PRESERVE SETS
+ *   Which bytes are passed through is a second policy class, with static functions
+ *   prefix_len(data, len, set), which works like passthrough_prefix_len, and contains(byte, set).
+ *   The default set has its own hard-coded scanning code, and every other set uses the table
+ *   lookups in PreserveSet. Either way, a byte that the scan stops at and that's below 128 is
+ *   escaped.
+ */
+
+/**
+ * The default set (see is_passthrough). The PreserveSet is ignored.
+ */
+struct DefaultPreserve {
+    static inline std::size_t prefix_len(const unsigned char *data, std::size_t len, const PreserveSet&) {
+        return passthrough_prefix_len(data, len);
+    }
+
+    static inline bool contains(unsigned char byte, const PreserveSet&) {
+        return is_passthrough(byte);
+    }
+};
+
+/**
+ * Any other set.
+ */
+struct CustomPreserve {
+    static inline std::size_t prefix_len(const unsigned char *data, std::size_t len, const PreserveSet& set) {
+        return passthrough_prefix_len(data, len, set);
+    }
+
+    static inline bool contains(unsigned char byte, const PreserveSet& set) {
+        return set.contains(byte);
+    }
+};
+
+/**
+ * This is escape_block, for the format given by the policy class Format and the preserve
+ * set given by the policy class Preserve (see above).
+ */
+template <typename Format, typename Preserve>
+static std::size_t escape_block_as(EscapeState& state, const unsigned char *in, std::size_t len, unsigned char *out,
+                                   const PreserveSet& preserve) {
+    assert(!state.invalid);
+    unsigned char *const out_begin = out;
+    std::size_t i = 0;
+
+    while (i < len) {
+        if (state.dfa_state == UTF8_ACCEPT) {
+            // First, we'll check for a run of printable characters. By default this includes
+            // 33-126 (all normal graphical characters) plus 9 (tab), 10 (line feed),
+            // 13 (carriage return), and 32 (space). These are copied as-is. The scan is a
+            // call through a function pointer (see ascii_scan.cpp), so we only make it if
+            // there's a run at all; in text like CJK, most characters are followed by another.
+            unsigned char byte = in[i];
+            if (Preserve::contains(byte, preserve)) {
+                std::size_t run = Preserve::prefix_len(in + i, len - i, preserve);
+                std::memcpy(out, in + i, run);
+                out += run;
+                i += run;
+                continue;
+            }
+
+            if (byte <= 127) {
+                // US-ASCII control character or DEL (U+007F), or some other character that
+                // isn't in the preserve set. We must escape this.
+                out += Format::escape_ascii(out, byte);
+                ++state.num_escaped[0];
+                ++i;
+                continue;
+            }
+        }
+
+        // Otherwise we're dealing with a multi-byte character, or with the rest of a character
+        // that started in the previous block. We run the bytes through the DFA until it
+        // either accepts a whole character or rejects the input. States above UTF8_REJECT
+        // mean we're in the middle of a character.
+        std::uint_fast32_t dfa_state = state.dfa_state;
+        std::uint_fast32_t codepoint = state.codepoint;
+        do {
+            utf8_dfa_step(dfa_state, codepoint, in[i++]);
+        } while (dfa_state > UTF8_REJECT && i < len);
+
+        if (dfa_state == UTF8_REJECT) {
+            state.invalid = true;
+            state.num_bytes_read += i;
+            return static_cast<std::size_t>(out - out_begin);
+        }
+        state.dfa_state = dfa_state;
+        state.codepoint = codepoint;
+        if (dfa_state != UTF8_ACCEPT) {
+            break; // The character continues in the next block.
+        }
+
+        // Finally, we can write out the escaped character and move on. Its length in UTF-8
+        // only depends on the code point, since the DFA doesn't accept overlong encodings.
+        out += Format::escape(out, codepoint);
+        ++state.num_escaped[1 + (codepoint >= 0x800u) + (codepoint >= 0x10000u)];
+    }
+    state.num_bytes_read += len;
+    return static_cast<std::size_t>(out - out_begin);
+}
+
+/**
+ * Picks the copy of the loop for the given format, with the preserve set given by the policy
+ * class Preserve. This is the only place that looks at the format at run time.
+ */
+template <typename Preserve>
+static std::size_t escape_block_in(EscapeFormat format, EscapeState& state, const unsigned char *in, std::size_t len,
+                                   unsigned char *out, const PreserveSet& preserve) {
+    switch (format) {
+        case EscapeFormat::Json:
+            return escape_block_as<JsonFormat, Preserve>(state, in, len, out, preserve);
+        case EscapeFormat::Braces:
+            return escape_block_as<BracesFormat, Preserve>(state, in, len, out, preserve);
+        case EscapeFormat::Html:
+            return escape_block_as<HtmlFormat, Preserve>(state, in, len, out, preserve);
+        default:
+            return escape_block_as<Rfc5137Format, Preserve>(state, in, len, out, preserve);
+    }
+}
+
+/**
+ * Returns the default preserve set. It's built the first time this is called.
+ */
+static const PreserveSet& default_preserve_set() {
+    static const PreserveSet set;
+    return set;
+}
+
+std::size_t escape_block(EscapeState& state, const unsigned char *in, std::size_t len, unsigned char *out) {
+    return escape_block_as<Rfc5137Format, DefaultPreserve>(state, in, len, out, default_preserve_set());
+}
+
+std::size_t escape_block(EscapeState& state, const unsigned char *in, std::size_t len, unsigned char *out, EscapeFormat format) {
+    return escape_block_in<DefaultPreserve>(format, state, in, len, out, default_preserve_set());
+}
+
+std::size_t escape_block(EscapeState& state, const unsigned char *in, std::size_t len, unsigned char *out,
+                         const EscapeSettings& settings) {
+    if (settings.preserve.is_default()) {
+        return escape_block_in<DefaultPreserve>(settings.format, state, in, len, out, settings.preserve);
+    }
+    return escape_block_in<CustomPreserve>(settings.format, state, in, len, out, settings.preserve);
+}
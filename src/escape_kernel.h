@@ -0,0 +1,163 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_ESCAPE_KERNEL_H
+#define ESCAPE_UTF8_ESCAPE_KERNEL_H
+
+#include <cstddef> // std::size_t
+#include <cstdint> // uint_fast32_t, uint_fast64_t
+
+#include "preserve_set.h"
+
+/**
+ * This is the decoder state that escape_block carries from one block of input
+ * to the next. The point of it is that a multi-byte UTF-8 character is allowed
+ * to be split across two (or more) blocks: whatever part of the character was
+ * at the end of one block is remembered here and finished off at the start of
+ * the next one.
+ *
+ * A freshly constructed EscapeState is the state at the beginning of the input.
+ */
+struct EscapeState {
+    // The bits of the current multi-byte character that we've decoded so far.
+    std::uint_fast32_t codepoint;
+    // The state of the UTF-8 decoder; see utf8_dfa.h. 0 (UTF8_ACCEPT) means we're at a
+    // character boundary, anything else means we're in the middle of a character.
+    std::uint_fast32_t dfa_state;
+    // Set to true once escape_block sees invalid UTF-8. After that the state shouldn't be used again.
+    bool invalid;
+    // The number of input bytes that escape_block has looked at so far. If invalid is true,
+    // this includes the byte that made the input invalid, so it's the 1-based position of that byte.
+    std::uint_fast64_t num_bytes_read;
+    // The number of characters that escape_block has escaped (instead of passing them through),
+    // by their length in UTF-8: [0] is ASCII characters, and [1], [2] and [3] are 2-, 3- and
+    // 4-byte characters. A character is counted once it's complete. This is for --stats.
+    std::uint_fast64_t num_escaped[4];
+
+    EscapeState() : codepoint(0), dfa_state(0), invalid(false), num_bytes_read(0), num_escaped() {}
+
+    /**
+     * Returns true if the input seen so far ended at a character boundary,
+     * i.e. it would be valid for the input to end here.
+     */
+    bool at_boundary() const { return dfa_state == 0; }
+};
+
+/**
+ * The formats that escape_block can write escape strings in (--format). In the examples,
+ * the character is U+1F602.
+ */
+enum class EscapeFormat {
+    // \u'1F602', as in section 5.1 of RFC 5137. This is the default, and the only format
+    // that --decode understands.
+    Rfc5137,
+    // \uD83D\uDE02, as in JSON and JavaScript strings. Characters above U+FFFF are written
+    // as a UTF-16 surrogate pair.
+    Json,
+    // \U{1F602}
+    Braces,
+    // &#x1F602;, a hexadecimal character reference as in HTML and XML.
+    Html
+};
+
+/**
+ * Everything about how to escape other than the input itself: the format of the escape
+ * strings (--format) and the ASCII characters that are passed through (--preserve). These
+ * are set up once from the command line and then only read, so they can be shared between
+ * threads.
+ */
+struct EscapeSettings {
+    EscapeFormat format;
+    PreserveSet preserve;
+
+    EscapeSettings() : format(EscapeFormat::Rfc5137) {}
+    explicit EscapeSettings(EscapeFormat format) : format(format) {}
+    EscapeSettings(EscapeFormat format, const PreserveSet& preserve) : format(format), preserve(preserve) {}
+};
+
+/**
+ * Returns the maximum number of bytes that escape_block can write for an input block of
+ * len bytes. Every input byte produces at most 8 output bytes (a single control character
+ * becomes "\u'00XX'"), except that a character that started in a previous block can be
+ * finished off by a single byte, which produces up to 10 output bytes.
+ */
+inline std::size_t escape_output_bound(std::size_t len) {
+    return len * 8 + 2;
+}
+
+/**
+ * Returns the maximum number of bytes that escape_block can write for an input block of len
+ * bytes in the given format. It's the same as above, except that in the JSON format, a single
+ * byte that finishes off a character above U+FFFF produces a 12-byte surrogate pair.
+ */
+inline std::size_t escape_output_bound(std::size_t len, EscapeFormat format) {
+    return (format == EscapeFormat::Json) ? len * 8 + 4 : escape_output_bound(len);
+}
+
+/**
+ * This is the other way around from escape_output_bound: it returns the longest input block
+ * whose escaped output is sure to fit in capacity bytes, in the given format. It's 0 if not
+ * even a 1-byte block is sure to fit.
+ */
+inline std::size_t escape_input_bound(std::size_t capacity, EscapeFormat format = EscapeFormat::Rfc5137) {
+    // The bound is a fixed amount plus the same amount for each byte, so it can be turned
+    // around without knowing what those amounts are.
+    const std::size_t fixed = escape_output_bound(0, format);
+    const std::size_t per_byte = escape_output_bound(1, format) - fixed;
+    return (capacity < fixed) ? 0 : (capacity - fixed) / per_byte;
+}
+
+/**
+ * This is the core of the program: it escapes one block of input into an output buffer.
+ * It does not do any I/O, so it can be driven by anything that has the input in memory.
+ *
+ * Bytes that don't need escaping are copied as-is, and every other character is
+ * replaced with its escape string (see construct_escape_string). If the block ends in the
+ * middle of a multi-byte character then that character is kept in state and will be
+ * written out by the call that sees its last byte.
+ *
+ * If the input is not valid UTF-8, this function stops at the character that made it
+ * invalid and sets state.invalid. Everything before that character is written out, so the
+ * output is the same as if we had stopped reading right there.
+ * @param state The decoder state. Must not already be invalid.
+ * @param in Pointer to the input block. May be null if len is 0.
+ * @param len Number of bytes in the input block.
+ * @param out The output buffer. Must have room for at least escape_output_bound(len) bytes.
+ * @return The number of bytes written to out.
+ */
+std::size_t escape_block(EscapeState& state, const unsigned char *in, std::size_t len, unsigned char *out);
+
+/**
+ * This is escape_block for any of the escape formats. Each format has its own copy of the
+ * escaping loop, made at compile time (see escape_kernel.cpp), so the format is only looked
+ * at once per call and not once per character.
+ * @param out The output buffer. Must have room for at least escape_output_bound(len, format) bytes.
+ * @param format The format of the escape strings.
+ * The other parameters and the return value are the same as above.
+ */
+std::size_t escape_block(EscapeState& state, const unsigned char *in, std::size_t len, unsigned char *out, EscapeFormat format);
+
+/**
+ * This is escape_block with the given settings. The bytes in settings.preserve are copied
+ * as-is, and every other ASCII byte is escaped. A custom preserve set gets its own copies of
+ * the escaping loop, like the formats do, so the default set doesn't pay anything for it.
+ * @param out The output buffer. Must have room for at least
+ * escape_output_bound(len, settings.format) bytes.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * The other parameters and the return value are the same as above.
+ */
+std::size_t escape_block(EscapeState& state, const unsigned char *in, std::size_t len, unsigned char *out,
+                         const EscapeSettings& settings);
+
+/**
+ * Given a buffer and a Unicode code point, this function constructs the escape
+ * string for that code point. The first three bytes of the buffer should be "\u'".
+ * See escape_kernel.cpp for the details.
+ * @param buf A buffer of length 10 bytes, where the first three bytes are "\u'".
+ * @param codepoint Int representing a Unicode code point; must be a number in [0, 2^21).
+ * @return The number of characters in the escape string. Will be 8, 9, or 10.
+ */
+std::size_t construct_escape_string(unsigned char *buf, std::uint_fast32_t codepoint);
+
+#endif //ESCAPE_UTF8_ESCAPE_KERNEL_H
@@ -0,0 +1,411 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include "follow.h"
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint> // uint_fast64_t
+#include <cstdio> // std::rename
+#include <cstring> // std::memmove
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "business_logic.h" // ESCAPE_BLOCK_SIZE
+#include "stop_signal.h"
+
+/*
+ * IMPLEMENTATION NOTES
+ *   Each time around the main loop, we read what's been added to the file (up to
+ *   MAX_READ_AT_ONCE, so that a file that grows faster than we can escape it still gets its
+ *   checkpoints), escape it and flush the output; then look at whether the file was truncated
+ *   or the path now names another file; then write the checkpoint if it's due. If we got to
+ *   the end of the file, we wait for inotify (or the stop descriptor, or RECHECK_MS) before
+ *   going around again.
+ *
+ *   The bytes of an incomplete character at the end of a read are moved to the start of the
+ *   input buffer, and the next read goes after them. So each piece that's escaped starts and
+ *   ends at a character boundary, and escape_block starts with a fresh state every time.
+ *
+ *   The file is watched for changes to it (IN_MODIFY, and IN_MOVE_SELF and IN_DELETE_SELF
+ *   for when it's rotated), and its directory for new files (IN_CREATE and IN_MOVED_TO), so
+ *   that we find out when a new file takes its name. If inotify isn't available (we're out of
+ *   watches, say), we just look every RECHECK_MS.
+ *
+ *   SIGINT and SIGTERM write a byte to a pipe, like with --serve (see stop_signal.h), and that
+ *   pipe is the stop descriptor.
+ */
+
+namespace {
+
+// The longest UTF-8 character, which is the most that can be held back between reads.
+const std::size_t MAX_CHAR_LEN = 4;
+// The most we read before looking at the file and the checkpoint again.
+const std::uint_fast64_t MAX_READ_AT_ONCE = 64 * 1024 * 1024;
+// The longest we wait before looking at the file again, even without an inotify event.
+const int RECHECK_MS = 1000;
+// The shortest time between two checkpoints while the input is growing.
+const std::chrono::milliseconds CHECKPOINT_INTERVAL(1000);
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Returns the number of bytes at the end of data that are the start of a character that
+ * isn't complete yet. If the end of data is a complete character, or bytes that can't be
+ * part of one, this is 0, and escape_block will deal with them.
+ */
+std::size_t incomplete_tail(const unsigned char *data, std::size_t len) {
+    for (std::size_t i = len; i > 0 && len - i < MAX_CHAR_LEN - 1; ) {
+        --i;
+        unsigned char byte = data[i];
+        if ((byte & 0xC0u) == 0x80u) {
+            continue; // A continuation byte, so the character started before it.
+        }
+        std::size_t char_len = 1;
+        if (0xC2 <= byte && byte <= 0xDF) {
+            char_len = 2;
+        } else if (0xE0 <= byte && byte <= 0xEF) {
+            char_len = 3;
+        } else if (0xF0 <= byte && byte <= 0xF4) {
+            char_len = 4;
+        }
+        return (i + char_len > len) ? len - i : 0;
+    }
+    return 0;
+}
+
+/**
+ * Where we are in the input: the file (by device and inode), and how much of it has been
+ * escaped and written.
+ */
+struct Position {
+    std::uint_fast64_t device;
+    std::uint_fast64_t inode;
+    std::uint_fast64_t offset;
+};
+
+/**
+ * Reads the checkpoint file at path.
+ * @param found This is a return value: false if there's no checkpoint file yet.
+ * @return False if the file exists but couldn't be read or isn't a checkpoint, in which case
+ * an error message has been printed.
+ */
+bool read_checkpoint(const std::string& path, Position& position, bool& found) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 && errno == ENOENT) {
+        found = false;
+        return true;
+    }
+    std::ifstream file(path);
+    std::string rest;
+    if (!(file >> position.device >> position.inode >> position.offset) || (file >> rest)) {
+        std::cerr << "Failed to read the checkpoint file \"" << path << "\". Exiting now." << std::endl;
+        return false;
+    }
+    found = true;
+    return true;
+}
+
+/**
+ * Replaces the checkpoint file at path with one for the given position, atomically.
+ * @return False if there was an error, in which case an error message has been printed.
+ */
+bool write_checkpoint(const std::string& path, const Position& position) {
+    const std::string temp = path + ".tmp";
+    std::ofstream file(temp);
+    file << position.device << ' ' << position.inode << ' ' << position.offset << '\n';
+    file.close();
+    if (file.fail() || std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::cerr << "There was a fatal error when trying to write to the checkpoint file \"" << path << "\". Exiting now." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * The state of follow(), and each of the steps of its main loop. Each step returns an exit
+ * code, which is 0 if all is well.
+ */
+class Follower {
+public:
+    Follower(const std::string& path, ByteSink& out, const EscapeSettings& settings, const std::string& checkpoint) :
+            path(path), out(out), settings(settings), checkpoint(checkpoint), inbuf(MAX_CHAR_LEN + ESCAPE_BLOCK_SIZE),
+            fd(-1), carry_len(0), saved_offset(0), inotify_fd(-1), file_watch(-1) {
+        position.device = 0;
+        position.inode = 0;
+        position.offset = 0;
+        inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        if (inotify_fd >= 0) {
+            std::size_t slash = path.rfind('/');
+            const std::string dir = (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+            inotify_add_watch(inotify_fd, dir.c_str(), IN_CREATE | IN_MOVED_TO);
+        }
+    }
+    ~Follower() {
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (inotify_fd >= 0) {
+            close(inotify_fd);
+        }
+    }
+    Follower(const Follower&) = delete;
+    Follower& operator=(const Follower&) = delete;
+
+    /**
+     * Opens the input, and carries on from the checkpoint if there is one for it.
+     */
+    int start() {
+        Position saved;
+        bool found = false;
+        if (!checkpoint.empty() && !read_checkpoint(checkpoint, saved, found)) {
+            return 1;
+        }
+        int retval = open_input();
+        if (retval != 0) {
+            return retval;
+        }
+        struct stat info;
+        if (found && saved.device == position.device && saved.inode == position.inode && fstat(fd, &info) == 0 &&
+            static_cast<std::uint_fast64_t>(info.st_size) >= saved.offset &&
+            lseek(fd, static_cast<off_t>(saved.offset), SEEK_SET) >= 0) {
+            position.offset = saved.offset;
+        }
+        saved_offset = position.offset;
+        last_checkpoint = Clock::now();
+        return 0;
+    }
+
+    /**
+     * Reads, escapes and writes what's been added to the input, up to MAX_READ_AT_ONCE bytes.
+     * @param at_end This is a return value: whether we got to the end of the file.
+     */
+    int read_more(bool& at_end) {
+        at_end = false;
+        std::uint_fast64_t done = 0;
+        while (done < MAX_READ_AT_ONCE) {
+            ssize_t n = read(fd, inbuf.data() + carry_len, ESCAPE_BLOCK_SIZE);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Failed when trying to read byte " << (position.offset + done + carry_len + 1) << " due to unknown error." << std::endl;
+                return 3;
+            }
+            if (n == 0) {
+                at_end = true;
+                break;
+            }
+            std::size_t len = carry_len + static_cast<std::size_t>(n);
+            std::size_t complete = len - incomplete_tail(inbuf.data(), len);
+            unsigned char *room = out.reserve(escape_output_bound(complete, settings.format));
+            if (room == nullptr) {
+                return report_write_error();
+            }
+            EscapeState state;
+            out.commit(escape_block(state, inbuf.data(), complete, room, settings));
+            if (state.invalid) {
+                // Everything before the bad character still gets written.
+                if (!out.flush()) {
+                    return report_write_error();
+                }
+                std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+                return 2;
+            }
+            carry_len = len - complete;
+            std::memmove(inbuf.data(), inbuf.data() + complete, carry_len);
+            done += complete;
+        }
+        if (!out.flush()) {
+            return report_write_error();
+        }
+        position.offset += done;
+        return 0;
+    }
+
+    /**
+     * Deals with the input having been truncated or rotated (see follow.h).
+     */
+    int check_rotation() {
+        struct stat info;
+        if (fstat(fd, &info) == 0 && static_cast<std::uint_fast64_t>(info.st_size) < position.offset + carry_len) {
+            if (carry_len > 0) {
+                return report_invalid();
+            }
+            if (lseek(fd, 0, SEEK_SET) < 0) {
+                std::cerr << "Failed when trying to read byte 1 due to unknown error." << std::endl;
+                return 3;
+            }
+            position.offset = 0;
+            return save_checkpoint();
+        }
+        if (stat(path.c_str(), &info) != 0 ||
+            (static_cast<std::uint_fast64_t>(info.st_dev) == position.device && static_cast<std::uint_fast64_t>(info.st_ino) == position.inode)) {
+            return 0; // Either it's the same file, or there's no new one yet.
+        }
+        // Whatever was written to the old file before it was renamed comes first.
+        bool at_end = false;
+        while (!at_end) {
+            int retval = read_more(at_end);
+            if (retval != 0) {
+                return retval;
+            }
+        }
+        if (carry_len > 0) {
+            return report_invalid();
+        }
+        close(fd);
+        fd = -1;
+        int retval = open_input();
+        if (retval != 0) {
+            return retval;
+        }
+        return save_checkpoint();
+    }
+
+    /**
+     * Writes the checkpoint if there's been progress and it's been long enough since the last.
+     */
+    int maybe_save_checkpoint() {
+        if (position.offset == saved_offset || Clock::now() - last_checkpoint < CHECKPOINT_INTERVAL) {
+            return 0;
+        }
+        return save_checkpoint();
+    }
+
+    /**
+     * Writes the checkpoint now.
+     */
+    int save_checkpoint() {
+        if (checkpoint.empty()) {
+            return 0;
+        }
+        if (!write_checkpoint(checkpoint, position)) {
+            return 4;
+        }
+        saved_offset = position.offset;
+        last_checkpoint = Clock::now();
+        return 0;
+    }
+
+    /**
+     * Waits until the input might have changed, or it's time to stop.
+     * @return True if it's time to stop.
+     */
+    bool wait(int stop_fd) {
+        pollfd fds[2];
+        fds[0].fd = stop_fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = inotify_fd;
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        // A negative descriptor is left out by poll().
+        if (poll(fds, 2, RECHECK_MS) > 0) {
+            if (fds[1].revents & POLLIN) {
+                // We only needed to wake up. What happened gets worked out from the file itself.
+                char events[4096];
+                while (read(inotify_fd, events, sizeof(events)) > 0) {}
+            }
+            return (fds[0].revents & (POLLIN | POLLHUP)) != 0;
+        }
+        return false;
+    }
+
+private:
+    /**
+     * Opens the file at path from the start, and watches it.
+     */
+    int open_input() {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            std::cerr << "Failed to open input file \"" << path << "\". Exiting now." << std::endl;
+            return 1;
+        }
+        position.device = static_cast<std::uint_fast64_t>(info.st_dev);
+        position.inode = static_cast<std::uint_fast64_t>(info.st_ino);
+        position.offset = 0;
+        if (inotify_fd >= 0) {
+            if (file_watch >= 0) {
+                inotify_rm_watch(inotify_fd, file_watch);
+            }
+            file_watch = inotify_add_watch(inotify_fd, path.c_str(), IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+        }
+        return 0;
+    }
+
+    int report_write_error() {
+        std::cerr << "There was a fatal error when trying to write to the output. Exiting now." << std::endl;
+        return 4;
+    }
+
+    int report_invalid() {
+        std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+        return 2;
+    }
+
+    const std::string path;
+    ByteSink& out;
+    const EscapeSettings& settings;
+    const std::string checkpoint;
+    // The input, after the carry_len bytes of an incomplete character (see the top of this file).
+    std::vector<unsigned char> inbuf;
+    int fd;
+    std::size_t carry_len;
+    Position position;
+    // The offset in the last checkpoint we wrote, and when we wrote it.
+    std::uint_fast64_t saved_offset;
+    Clock::time_point last_checkpoint;
+    int inotify_fd;
+    int file_watch;
+};
+
+} // namespace
+
+int follow(const std::string& path, ByteSink& out, const EscapeSettings& settings, const std::string& checkpoint, int stop_fd) {
+    Follower follower(path, out, settings, checkpoint);
+    int retval = follower.start();
+    if (retval != 0) {
+        return retval;
+    }
+    while (true) {
+        bool at_end;
+        retval = follower.read_more(at_end);
+        if (retval == 0) {
+            retval = follower.check_rotation();
+        }
+        if (retval == 0) {
+            retval = follower.maybe_save_checkpoint();
+        }
+        if (retval != 0) {
+            return retval;
+        }
+        if (at_end && follower.wait(stop_fd)) {
+            // Anything added since we last looked is left for the next run to pick up.
+            return follower.save_checkpoint();
+        }
+    }
+}
+
+int follow_until_signalled(const std::string& path, ByteSink& out, const EscapeSettings& settings, const std::string& checkpoint) {
+    StopSignalPipe stop;
+    if (!stop.ok()) {
+        std::cerr << "Failed when trying to read byte 1 due to unknown error." << std::endl;
+        return 3;
+    }
+    int retval = follow(path, out, settings, checkpoint, stop.fd());
+    return retval;
+}
+
+#endif
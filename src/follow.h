@@ -0,0 +1,82 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_FOLLOW_H
+#define ESCAPE_UTF8_FOLLOW_H
+
+#include <string>
+
+#include "ByteStream.h"
+#include "escape_kernel.h" // EscapeSettings
+
+/*
+ * This is --follow: like "tail -F", for a log file that keeps growing. The file is escaped
+ * up to its end, and then we wait for more to be written to it (with inotify), and escape
+ * only what was added. This goes on until SIGINT or SIGTERM.
+ *
+ * The checkpoint:
+ *   With --checkpoint FILE, how far we've got in the input is kept in FILE, so that if escape
+ *   is stopped and started again, it carries on from there instead of escaping the whole log
+ *   again. FILE has one line: the device and inode numbers of the input file, and the number
+ *   of bytes of it whose escaped output has been written, in decimal, separated by spaces. It's
+ *   replaced atomically (with a rename), after the output it counts has been written, so after
+ *   a crash the worst that can happen is that some of the output is written twice: the part
+ *   from after the last checkpoint. It's written at most once a second while the input is
+ *   growing, and when the input is rotated, and when we stop.
+ *
+ *   When we start, the checkpoint only counts if it's for the same file (the same device and
+ *   inode) and the file is at least that long. Otherwise the file was rotated or truncated
+ *   while we were stopped, and it's escaped from the start.
+ *
+ * Characters split between writes:
+ *   A writer can add half of a multi-byte character now and the other half later. The bytes
+ *   of a character that isn't complete yet are held back until the rest of it arrives, just
+ *   like the characters at the end of each block in read_and_escape, so the checkpoint is
+ *   always at the start of a character.
+ *
+ * Rotation:
+ *   A log is usually rotated by renaming it (and then creating a new, empty file with the
+ *   same name), or by copying it and truncating it. Either way, we notice on the next wakeup:
+ *     - If the file is smaller than the part we've read, it was truncated, and it's escaped
+ *       from the start again.
+ *     - If the path now names a different file, the old one was renamed (or removed). The
+ *       rest of the old file is escaped first, since the program writing to it may not have
+ *       switched yet, and then we switch to the new one and escape it from the start. Until a
+ *       new file appears, we keep reading the old one.
+ *   The end of the old file has to be the end of a character, or it isn't valid UTF-8.
+ *
+ * inotify only wakes us up; what happened is always worked out from the file itself, so
+ * missed or merged events don't matter. We also look at least once a second anyway, for file
+ * systems that don't support inotify (like NFS).
+ *
+ * This is only implemented for Linux.
+ */
+
+#ifdef __linux__
+
+/**
+ * Follows the file at path until stop_fd becomes readable or hangs up.
+ * @param path The input file.
+ * @param out The output. Everything is flushed after each batch of input.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * @param checkpoint The checkpoint file (see above), or empty for none.
+ * @param stop_fd A file descriptor, such as the read end of a pipe, that becomes readable
+ * when it's time to stop. -1 means never.
+ * @return The same exit codes as read_and_escape, after an error message has been printed,
+ * or 0 once it's time to stop. 1 also means that the checkpoint file couldn't be read, and 4
+ * that it couldn't be written.
+ */
+int follow(const std::string& path, ByteSink& out, const EscapeSettings& settings, const std::string& checkpoint,
+           int stop_fd = -1);
+
+/**
+ * This is --follow: it runs follow() until SIGINT or SIGTERM.
+ * The parameters and the return value are the same as follow's.
+ */
+int follow_until_signalled(const std::string& path, ByteSink& out, const EscapeSettings& settings,
+                           const std::string& checkpoint);
+
+#endif
+
+#endif //ESCAPE_UTF8_FOLLOW_H
@@ -0,0 +1,60 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_HEX_TABLES_H
+#define ESCAPE_UTF8_HEX_TABLES_H
+
+/*
+ * Lookup tables used to format escape strings without going through iostreams.
+ * Everything in here is a string literal, so the tables are built entirely at
+ * compile time and cost nothing at startup.
+ *
+ * The tables are generated with the preprocessor rather than with constexpr
+ * functions, because MSVC 2015 (which we still build with on AppVeyor) doesn't
+ * support C++14's relaxed constexpr rules. Adjacent string literals are
+ * concatenated by the compiler, so e.g. HEX_PAIR_ROW("A") expands to
+ * "A0A1A2...AF".
+ */
+
+#define HEX_PAIR_ROW(h) \
+    h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7" \
+    h "8" h "9" h "A" h "B" h "C" h "D" h "E" h "F"
+
+/*
+ * HEX_PAIRS[2*b] and HEX_PAIRS[2*b + 1] are the two uppercase hex digits of the byte b.
+ * For example, the pair for 0xA7 starts at index 0x14E and is "A7".
+ */
+static constexpr char HEX_PAIRS[] =
+    HEX_PAIR_ROW("0") HEX_PAIR_ROW("1") HEX_PAIR_ROW("2") HEX_PAIR_ROW("3")
+    HEX_PAIR_ROW("4") HEX_PAIR_ROW("5") HEX_PAIR_ROW("6") HEX_PAIR_ROW("7")
+    HEX_PAIR_ROW("8") HEX_PAIR_ROW("9") HEX_PAIR_ROW("A") HEX_PAIR_ROW("B")
+    HEX_PAIR_ROW("C") HEX_PAIR_ROW("D") HEX_PAIR_ROW("E") HEX_PAIR_ROW("F");
+static_assert(sizeof(HEX_PAIRS) == 513, "HEX_PAIRS should have 256 pairs plus the null byte");
+
+/*
+ * HEX_DIGITS[x] is the uppercase hex digit for x, where x is in [0, 16).
+ */
+static constexpr char HEX_DIGITS[] = "0123456789ABCDEF";
+
+#define ASCII_ESCAPE_ROW(h) \
+    "\\u'00" h "0'" "\\u'00" h "1'" "\\u'00" h "2'" "\\u'00" h "3'" \
+    "\\u'00" h "4'" "\\u'00" h "5'" "\\u'00" h "6'" "\\u'00" h "7'" \
+    "\\u'00" h "8'" "\\u'00" h "9'" "\\u'00" h "A'" "\\u'00" h "B'" \
+    "\\u'00" h "C'" "\\u'00" h "D'" "\\u'00" h "E'" "\\u'00" h "F'"
+
+/*
+ * The complete 8-byte escape string for every US-ASCII character, one after another.
+ * The escape string for the byte b starts at ASCII_ESCAPES[8*b]; for example the one for
+ * 0x0B is "\u'000B'". By default only the control characters and DEL are escaped, but with
+ * --preserve (see PreserveSet) any ASCII byte can be, so all 128 entries are used.
+ */
+static constexpr char ASCII_ESCAPES[] =
+    ASCII_ESCAPE_ROW("0") ASCII_ESCAPE_ROW("1") ASCII_ESCAPE_ROW("2") ASCII_ESCAPE_ROW("3")
+    ASCII_ESCAPE_ROW("4") ASCII_ESCAPE_ROW("5") ASCII_ESCAPE_ROW("6") ASCII_ESCAPE_ROW("7");
+static_assert(sizeof(ASCII_ESCAPES) == 128 * 8 + 1, "ASCII_ESCAPES should have 128 escape strings plus the null byte");
+
+#undef HEX_PAIR_ROW
+#undef ASCII_ESCAPE_ROW
+
+#endif //ESCAPE_UTF8_HEX_TABLES_H
@@ -0,0 +1,257 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include "in_place.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <algorithm> // std::min
+#include <cstdint> // uint_fast64_t
+#include <cstdlib> // realpath, mkstemp, free
+#include <memory>
+#include <vector>
+
+#include <fcntl.h> // fallocate
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ByteStream.h"
+#include "MappedFile.h"
+#include "ascii_scan.h"
+#include "business_logic.h" // ESCAPE_BLOCK_SIZE
+#include "measure.h"
+#include "utf8_validate.h"
+
+/*
+ * IMPLEMENTATION NOTES
+ *   The file is read twice if it needs escaping: once by scan_file, and once while writing
+ *   the new file. Both go through the same MappedFile, so the second pass finds the file in
+ *   the page cache, and the first pass is all that a file that doesn't need escaping ever
+ *   gets. It stops being plain pass-through scanning at the first byte that needs escaping, and
+ *   from there on it validates and counts, one ESCAPE_BLOCK_SIZE piece at a time, the same
+ *   way read_and_measure does.
+ *
+ *   The new file is made with mkstemp, next to the original, since rename() only works
+ *   within one file system. Its name starts with a "." so that ls and the like don't show
+ *   it in the moment before the rename. If anything goes wrong, it's removed again.
+ *
+ *   The size from scan_file is reserved with fallocate (Linux only; elsewhere the file just
+ *   grows as it's written). If the file changed between the two passes, the escaped text is
+ *   whatever the second pass read, and it's checked again as it's escaped, so the worst that
+ *   can happen is that we reserved the wrong amount of space.
+ */
+
+namespace {
+
+/**
+ * Removes the file at path when it goes out of scope, unless it's been told not to.
+ */
+class TempFile {
+public:
+    explicit TempFile(const std::string& path) : path(path), keep(false) {}
+    ~TempFile() {
+        if (!keep) {
+            unlink(path.c_str());
+        }
+    }
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+
+    const std::string path;
+    bool keep;
+};
+
+/**
+ * Returns the absolute path of the file that path names, with every symbolic link followed,
+ * or the empty string if there isn't one.
+ */
+std::string resolve_path(const std::string& path) {
+    char *resolved = realpath(path.c_str(), nullptr);
+    if (resolved == nullptr) {
+        return std::string();
+    }
+    std::string result(resolved);
+    free(resolved);
+    return result;
+}
+
+/**
+ * The first pass (see the top of this file).
+ * @param file The file, which nothing has read yet.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * @param first_change This is a return value: the offset of the first byte that needs
+ * escaping, or the size of the file if there isn't one.
+ * @param escaped_size This is a return value: the size of the file once it's escaped.
+ * @return 0, or 2 if the file isn't valid UTF-8, or 3 if it couldn't be read. The return
+ * values are only set if this returns 0.
+ */
+int scan_file(MappedFile& file, const EscapeSettings& settings, std::uint_fast64_t& first_change, std::uint_fast64_t& escaped_size) {
+    bool changed = false;
+    std::uint_fast64_t position = 0;
+    std::uint_fast64_t total = 0;
+    EscapeState state;
+    const unsigned char *window;
+    std::size_t window_len;
+    while (true) {
+        if (!file.next_window(window, window_len)) {
+            return 3;
+        }
+        if (window_len == 0) {
+            break;
+        }
+        std::size_t offset = 0;
+        if (!changed) {
+            offset = passthrough_prefix_len(window, window_len, settings.preserve);
+            total += offset;
+            if (offset < window_len) {
+                changed = true;
+                first_change = position + offset;
+            }
+        }
+        while (offset < window_len) {
+            std::size_t piece = std::min(ESCAPE_BLOCK_SIZE, window_len - offset);
+            validate_block(state, window + offset, piece);
+            if (state.invalid) {
+                return 2;
+            }
+            total += escaped_length(window + offset, piece, settings);
+            offset += piece;
+        }
+        position += window_len;
+    }
+    if (position != file.size()) {
+        return 3;
+    }
+    if (!state.at_boundary()) {
+        return 2;
+    }
+    if (!changed) {
+        first_change = position;
+    }
+    escaped_size = total;
+    return 0;
+}
+
+/**
+ * The second pass: escapes the file into out.
+ * @param file The file, rewound to the beginning.
+ * @param first_change The offset from scan_file. Everything before it is written out as it is.
+ * @return The same exit codes as escape_in_place.
+ */
+int escape_into(MappedFile& file, ByteSink& out, const EscapeSettings& settings, std::uint_fast64_t first_change) {
+    std::uint_fast64_t position = 0;
+    EscapeState state;
+    const unsigned char *window;
+    std::size_t window_len;
+    while (true) {
+        if (!file.next_window(window, window_len)) {
+            return 3;
+        }
+        if (window_len == 0) {
+            break;
+        }
+        std::size_t offset = 0;
+        if (position < first_change) {
+            offset = static_cast<std::size_t>(std::min<std::uint_fast64_t>(window_len, first_change - position));
+            if (!out.write_unbuffered(window, offset)) {
+                return 4;
+            }
+            state.num_bytes_read += offset;
+        }
+        while (offset < window_len) {
+            std::size_t piece = std::min(ESCAPE_BLOCK_SIZE, window_len - offset);
+            unsigned char *room = out.reserve(escape_output_bound(piece, settings.format));
+            if (room == nullptr) {
+                return 4;
+            }
+            out.commit(escape_block(state, window + offset, piece, room, settings));
+            if (state.invalid) {
+                return 2;
+            }
+            offset += piece;
+        }
+        position += window_len;
+    }
+    if (position != file.size()) {
+        return 3;
+    }
+    if (!state.at_boundary()) {
+        return 2;
+    }
+    return out.flush() ? 0 : 4;
+}
+
+} // namespace
+
+int escape_in_place(const std::string& path, const EscapeSettings& settings) {
+    const std::string target = resolve_path(path);
+    if (target.empty()) {
+        return 1;
+    }
+    // MappedFile::open fails for anything that isn't a regular file, like a directory.
+    std::shared_ptr<MappedFile> file = MappedFile::open(target);
+    if (!file) {
+        return 1;
+    }
+    std::uint_fast64_t first_change;
+    std::uint_fast64_t escaped_size;
+    int retval = scan_file(*file, settings, first_change, escaped_size);
+    if (retval != 0) {
+        return retval;
+    }
+    if (first_change == file->size()) {
+        return 0; // Escaping wouldn't change anything.
+    }
+    struct stat info;
+    if (fstat(file->descriptor(), &info) != 0) {
+        return 3;
+    }
+    file->rewind();
+
+    std::size_t slash = target.rfind('/');
+    const std::string temp_template = target.substr(0, slash + 1) + "." + target.substr(slash + 1) + ".escape-XXXXXX";
+    std::vector<char> temp_path(temp_template.begin(), temp_template.end()); // mkstemp fills in the X's
+    temp_path.push_back('\0');
+    int fd = mkstemp(temp_path.data());
+    if (fd == -1) {
+        return 4; // Most likely we can't write to the directory.
+    }
+    TempFile temp(temp_path.data());
+    ByteSink out = ByteSink::from_descriptor(fd);
+    // mkstemp makes the file readable and writable only by us. It gets the original's
+    // permissions instead, and its owner if we're allowed to (that is, if we're root).
+    if (fchmod(fd, info.st_mode & 07777) != 0) {
+        return 4;
+    }
+    if (fchown(fd, info.st_uid, info.st_gid) != 0) {
+        // That's all right: the file is ours, like any other file we write.
+    }
+#ifdef __linux__
+    // This is only a hint, and if it fails (the file system doesn't support it, or the disk
+    // is full), the writes will find out whether it matters.
+    fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(escaped_size));
+#endif
+    retval = escape_into(*file, out, settings, first_change);
+    if (retval != 0) {
+        return retval;
+    }
+    // The new contents have to be on disk before the rename is, or a crash could leave an
+    // empty file under the original's name.
+    if (fsync(fd) != 0 || !out.close()) {
+        return 4;
+    }
+    if (rename(temp.path.c_str(), target.c_str()) != 0) {
+        return 4;
+    }
+    temp.keep = true;
+    return 0;
+}
+
+#else // No mkstemp or mmap. parse() doesn't allow --in-place here, so this is never called.
+
+int escape_in_place(const std::string&, const EscapeSettings&) {
+    return 1;
+}
+
+#endif
@@ -0,0 +1,50 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_IN_PLACE_H
+#define ESCAPE_UTF8_IN_PLACE_H
+
+#include <string>
+
+#include "escape_kernel.h" // EscapeSettings
+
+/*
+ * This is batch mode with --in-place: each file is replaced by its escaped version.
+ *
+ * Most files in a big tree are usually plain printable ASCII already, and escaping them
+ * gives back exactly the same bytes. So each file is scanned first, with the same code
+ * that looks for the next byte to escape, and if there's nothing to escape, that's it: the
+ * file isn't written, so its modification time stays the same and no disk space is used.
+ * The scan also checks the rest of the file from the first byte that does need escaping
+ * (see validate_block), so an invalid file is left alone without writing anything either,
+ * and works out how big the escaped file will be (see escaped_length).
+ *
+ * Otherwise, the escaped text is written to a new file in the same directory, and that's
+ * renamed over the original, which replaces it atomically: anything that opens the file
+ * sees either the old contents or the new, never half of each, even if we're killed
+ * halfway or the machine crashes (the new file is synced before the rename). The new file
+ * gets the disk space for all of it up front, which keeps it in one piece on disk, and the
+ * same permissions (and owner, if we're allowed to set it) as the original. The part before
+ * the first byte that needs escaping is written straight out of the mapping of the input.
+ *
+ * Replacing the file like this means it becomes a new file: other hard links to the old
+ * one still have the old contents. A symbolic link is followed, and the file it points to
+ * is replaced, so the link stays a link.
+ *
+ * This is only implemented for POSIX systems, which have mkstemp and mmap.
+ */
+
+/**
+ * Escapes the file at path in place. Nothing is printed; the result is only in the return
+ * value, like escape_file's (see batch.h).
+ * @param path The file.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * @return The exit code read_and_escape would have given (see main.cpp): 0 if the file was
+ * escaped or didn't need to be, 1 if it couldn't be opened (or isn't a regular file), 2 if
+ * it isn't valid UTF-8, 3 if it couldn't be read, or 4 if the new file couldn't be written
+ * or renamed. The file is only changed if the result is 0.
+ */
+int escape_in_place(const std::string& path, const EscapeSettings& settings = EscapeSettings());
+
+#endif //ESCAPE_UTF8_IN_PLACE_H
@@ -0,0 +1,58 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <new> // std::nothrow
+
+#include "libescape.h"
+#include "Encoder.h"
+
+/*
+ * The C handle is just an Encoder. It has to be a struct with this exact name so that
+ * it matches the forward declaration in libescape.h.
+ */
+struct escape_encoder {
+    Encoder encoder;
+};
+
+escape_encoder *escape_encoder_new(void) {
+    // C callers can't catch exceptions, so we return NULL instead of throwing std::bad_alloc.
+    return new (std::nothrow) escape_encoder();
+}
+
+void escape_encoder_free(escape_encoder *enc) {
+    delete enc;
+}
+
+void escape_encoder_reset(escape_encoder *enc) {
+    if (enc != nullptr) {
+        enc->encoder.reset();
+    }
+}
+
+size_t escape_output_size(size_t len) {
+    return escape_output_bound(len);
+}
+
+int escape_encoder_feed(escape_encoder *enc, const unsigned char *in, size_t len,
+                        unsigned char *out, size_t out_capacity, size_t *consumed, size_t *written) {
+    // This is the most input whose output is sure to fit.
+    std::size_t max_len = escape_input_bound(out_capacity);
+    if (enc == nullptr || consumed == nullptr || written == nullptr || (in == nullptr && len > 0) ||
+        out == nullptr || max_len == 0) {
+        return ESCAPE_BAD_ARGUMENT;
+    }
+    std::size_t chunk = len < max_len ? len : max_len;
+
+    std::uint_fast64_t before = enc->encoder.bytes_read();
+    int retval = enc->encoder.feed(in, chunk, out, *written);
+    *consumed = static_cast<std::size_t>(enc->encoder.bytes_read() - before);
+    return retval;
+}
+
+int escape_encoder_finish(const escape_encoder *enc) {
+    if (enc == nullptr) {
+        return ESCAPE_BAD_ARGUMENT;
+    }
+    return enc->encoder.finish();
+}
@@ -0,0 +1,83 @@
+/*
+ * Created by Vicram on 10/17/2026.
+ */
+
+#ifndef ESCAPE_UTF8_LIBESCAPE_H
+#define ESCAPE_UTF8_LIBESCAPE_H
+
+/*
+ * This is the C interface to libescape. It can be used from C or from anything that can
+ * call C functions. It's the same as the Encoder class (see Encoder.h), except that the
+ * output buffer doesn't have to be big enough for all of the input: escape_encoder_feed
+ * escapes as much of the input as fits and tells the caller how much that was.
+ *
+ * Example:
+ *   escape_encoder *enc = escape_encoder_new();
+ *   while (there is more input) {
+ *       size_t consumed, written;
+ *       if (escape_encoder_feed(enc, in, len, out, sizeof(out), &consumed, &written) != ESCAPE_OK) {
+ *           ... the input is not valid UTF-8; out[0..written) is everything before the bad character ...
+ *       }
+ *       ... use out[0..written), then feed in[consumed..len) again if consumed < len ...
+ *   }
+ *   int status = escape_encoder_finish(enc);
+ *   escape_encoder_free(enc);
+ *
+ * The return codes are the same as the exit codes of the escape program.
+ */
+
+#include <stddef.h> /* size_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESCAPE_OK 0
+#define ESCAPE_INVALID_UTF8 2
+#define ESCAPE_BAD_ARGUMENT 5
+
+typedef struct escape_encoder escape_encoder;
+
+/*
+ * Allocates a new encoder. Returns NULL if the allocation fails.
+ */
+escape_encoder *escape_encoder_new(void);
+
+/*
+ * Frees an encoder. enc may be NULL.
+ */
+void escape_encoder_free(escape_encoder *enc);
+
+/*
+ * Puts the encoder back in its initial state so it can be used for a new input.
+ */
+void escape_encoder_reset(escape_encoder *enc);
+
+/*
+ * Returns the size of an output buffer that is always big enough to escape len bytes of
+ * input in a single call to escape_encoder_feed.
+ */
+size_t escape_output_size(size_t len);
+
+/*
+ * Escapes as much of in[0..len) as fits into out[0..out_capacity).
+ * *consumed is set to the number of input bytes that were escaped, and *written to the
+ * number of bytes written to out. out_capacity must be at least 10, so that there is
+ * always room for at least one escaped character.
+ * Returns ESCAPE_OK, ESCAPE_INVALID_UTF8 if the input is not valid UTF-8, or
+ * ESCAPE_BAD_ARGUMENT if one of the arguments is unusable (in which case nothing is consumed).
+ */
+int escape_encoder_feed(escape_encoder *enc, const unsigned char *in, size_t len,
+                        unsigned char *out, size_t out_capacity, size_t *consumed, size_t *written);
+
+/*
+ * Signals the end of the input. Returns ESCAPE_OK if the whole input was valid UTF-8,
+ * or ESCAPE_INVALID_UTF8 otherwise (including when it ended in the middle of a character).
+ */
+int escape_encoder_finish(const escape_encoder *enc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ESCAPE_UTF8_LIBESCAPE_H */
@@ -1,11 +1,20 @@
 //
 // Created by Vicram on 8/22/2019.
 //
+#include <fstream>
 #include <iostream>
+#include <memory>
 
 #include "parseargs.h"
+#include "ascii_scan.h" // set_kernel_tier
 #include "StreamPair.h"
 #include "business_logic.h"
+#include "parallel_escape.h"
+#include "batch.h"
+#include "streaming.h"
+#include "serve.h"
+#include "follow.h"
+#include "stats.h"
 
 
 /*
@@ -22,8 +31,71 @@
 
 int main(int argc, char *argv[]) {
     try {
-        StreamPair streams = parse(argc, argv);
-        int retval = read_and_escape(streams);
+        Options options;
+        StreamPair streams = parse(argc, argv, options);
+        if (options.force_kernel) {
+            set_kernel_tier(options.kernel); // parse already checked that it's available
+        }
+        const EscapeSettings settings(options.format, options.preserve);
+        // The stats file is opened now, so that we find out it can't be before doing all the work.
+        std::ofstream stats_file;
+        if (!options.stats_file.empty()) {
+            stats_file.open(options.stats_file);
+            if (stats_file.fail()) {
+                std::cerr << "Failed to open stats file \"" << options.stats_file << "\". Exiting now." << std::endl;
+                return 1;
+            }
+        }
+        std::unique_ptr<EscapeStats> stats;
+        if (options.stats || stats_file.is_open()) {
+            stats.reset(new EscapeStats());
+        }
+        int retval;
+#ifdef __linux__
+        if (!options.serve_socket.empty()) {
+            return serve_until_signalled(options.serve_socket, settings); // parse only allows this on Linux
+        }
+        if (options.follow) {
+            // The output is flushed as it goes, so there's nothing left to do with it afterwards.
+            return follow_until_signalled(options.inputs[0], streams.out, settings, options.checkpoint);
+        }
+#endif
+        if (options.batch) {
+            retval = batch_escape(options, streams);
+        } else if (options.check) {
+            retval = read_and_check(streams);
+        } else if (options.measure) {
+            retval = read_and_measure(streams, settings);
+        } else if (options.decode) {
+            // Decoding is mostly memchr and memcpy, so it doesn't get any faster with --threads.
+            retval = read_and_decode(streams);
+        } else if (options.line_buffered || options.max_latency_ms >= 0) {
+            retval = read_and_stream(streams, settings, options.line_buffered, options.max_latency_ms, stats.get());
+        } else if (options.threads == 1) {
+            retval = read_and_escape(streams, settings, options.preallocate, stats.get());
+        } else {
+            retval = parallel_read_and_escape(streams, options.threads, settings, stats.get());
+        }
+        // With --compress, the end of the compressed output is only written now. Every mode
+        // has flushed its output and reported any error with it already.
+        if (!streams.out.close() && retval == 0) {
+            std::cerr << "There was a fatal error when trying to write to the output. Exiting now." << std::endl;
+            retval = 4;
+        }
+        if (stats) {
+            // The stats are reported even if the run failed, since that's when they're most interesting.
+            if (options.stats) {
+                stats->print(std::cerr);
+            }
+            if (stats_file.is_open()) {
+                stats->write_json(stats_file);
+                stats_file.close();
+                if (stats_file.fail() && retval == 0) {
+                    std::cerr << "There was a fatal error when trying to write to the stats file. Exiting now." << std::endl;
+                    retval = 4;
+                }
+            }
+        }
         return retval;
     } catch (const EarlyFinish&) {
         return 0;
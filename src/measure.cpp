@@ -0,0 +1,362 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <algorithm> // std::min
+#include <cstddef> // std::size_t
+#include <cstdint> // uint_fast64_t
+
+#include "measure.h"
+#include "ascii_scan.h"
+#include "ascii_scan_kernels.h"
+
+/*
+ * IMPLEMENTATION NOTES
+ * Instruction sets:
+ *   Like the scanning code in ascii_scan.cpp, every version is compiled in and the one for
+ *   the kernel tier in use is picked at runtime (see ScanKernels): 16 bytes at a time for
+ *   the SSE2 and SSE4.2 tiers, and 32 at a time for the AVX2 and AVX-512 tiers. The scalar
+ *   and SWAR tiers count one byte at a time. A custom preserve set (--preserve) is looked up
+ *   in its nibble tables with PSHUFB from the SSE4.2 tier up (whose CPUs all have SSSE3), and
+ *   otherwise checked one range at a time like in ascii_scan_x86.cpp.
+ *
+ *   The counting loops are templates, with a classifier class for each kind of set and
+ *   instruction set. They don't have a target attribute of their own, but they're always
+ *   inlined into the function for a tier, which does, so the compiler ends up with one copy
+ *   of the loop for each tier and classifier, with the classifier inlined into it.
+ *
+ * Counting:
+ *   For valid UTF-8, the cost of a character (see measure.h) only depends on its first byte:
+ *     - pass-through bytes (see is_passthrough, or the preserve set) cost 1;
+ *     - continuation bytes (80..BF) cost 0, since their character was counted at its first byte;
+ *     - F4 starts a character in U+100000..U+10FFFF, which costs 10;
+ *     - F0..F3 start a character in U+10000..U+FFFFF, which costs 9;
+ *     - everything else (the other ASCII bytes, and C2..EF) costs 8.
+ *   So the total is 8 * len - 7 * (pass-through bytes) - 8 * (continuation bytes)
+ *   + (bytes >= F0) + (bytes == F4), and all we have to do is count four kinds of byte.
+ *   The JSON format has different costs (6 instead of 8, and 12 for everything from F0
+ *   up), but it's the same four counts that go into them.
+ *
+ *   Each kind is counted with one comparison per vector, which gives 0xFF (-1) in every byte
+ *   that matches. Subtracting that from a vector of byte counters adds 1 to each counter.
+ *   A byte counter can only go up to 255, so after at most 255 vectors we add up the 16
+ *   counters with PSADBW (the sum of absolute differences against zero, which is just the
+ *   sum) and start again from zero.
+ */
+// The most vectors we can count before a byte counter could overflow.
+static const std::size_t MAX_VECTORS_PER_ROUND = 255;
+
+/**
+ * The counts of the four kinds of byte described at the top of this file.
+ */
+struct ByteCounts {
+    std::uint_fast64_t total;
+    std::uint_fast64_t passthrough;
+    std::uint_fast64_t continuation;
+    std::uint_fast64_t four_byte; // F0 and up
+    std::uint_fast64_t f4;
+
+    ByteCounts() : total(0), passthrough(0), continuation(0), four_byte(0), f4(0) {}
+
+    /**
+     * Counts one byte.
+     * @param byte The byte.
+     * @param preserved Whether the byte is passed through.
+     */
+    void add(unsigned char byte, bool preserved) {
+        ++total;
+        passthrough += preserved;
+        continuation += (0x80 <= byte && byte <= 0xBF);
+        four_byte += (byte >= 0xF0);
+        f4 += (byte == 0xF4);
+    }
+
+    /**
+     * Returns the length of the escaped output, as described at the top of this file.
+     */
+    std::uint_fast64_t escaped_length(EscapeFormat format) const {
+        if (format == EscapeFormat::Json) {
+            // Every byte that starts a character costs 6, except that pass-through bytes cost 1,
+            // and a character from F0 up costs 12.
+            return 6 * total - 5 * passthrough - 6 * continuation + 6 * four_byte;
+        }
+        return 8 * total - 7 * passthrough - 8 * continuation + four_byte + f4;
+    }
+};
+
+/**
+ * Counts the bytes of the buffer one at a time.
+ * @param set The bytes that are passed through, or null for the default set.
+ */
+static inline void count_one_at_a_time(const unsigned char *data, std::size_t len, const PreserveSet *set,
+                                       ByteCounts& counts) {
+    for (std::size_t i = 0; i < len; ++i) {
+        counts.add(data[i], (set == nullptr) ? is_passthrough(data[i]) : set->contains(data[i]));
+    }
+}
+
+std::uint_fast64_t scalar_escaped_length(const unsigned char *data, std::size_t len, EscapeFormat format,
+                                         const PreserveSet *set) {
+    ByteCounts counts;
+    count_one_at_a_time(data, len, set, counts);
+    return counts.escaped_length(format);
+}
+
+#ifdef ESCAPE_UTF8_X86_KERNELS
+
+#include <immintrin.h>
+
+#if defined(__GNUC__)
+#define ESCAPE_UTF8_ALWAYS_INLINE __attribute__((always_inline)) inline
+#else
+#define ESCAPE_UTF8_ALWAYS_INLINE __forceinline
+#endif
+
+/*
+ * The classes below say which bytes are passed through. Each one has passthrough(x), which
+ * gives 0xFF for every byte of x that is passed through and 0 for every other byte.
+ */
+
+/**
+ * The default set, with the same comparisons as passthrough_prefix_len.
+ */
+struct Sse2DefaultClassifier {
+    ESCAPE_UTF8_TARGET("sse2")
+    __m128i passthrough(__m128i x) const {
+        __m128i pass = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(31)), _mm_cmpgt_epi8(_mm_set1_epi8(127), x));
+        pass = _mm_or_si128(pass, _mm_cmpeq_epi8(x, _mm_set1_epi8(9)));
+        pass = _mm_or_si128(pass, _mm_cmpeq_epi8(x, _mm_set1_epi8(10)));
+        return _mm_or_si128(pass, _mm_cmpeq_epi8(x, _mm_set1_epi8(13)));
+    }
+};
+
+/**
+ * A custom set that fits in PreserveSet::MAX_RANGES ranges, checked one range at a time.
+ */
+class Sse2RangeClassifier {
+public:
+    ESCAPE_UTF8_TARGET("sse2")
+    explicit Sse2RangeClassifier(const PreserveSet& set) : num_ranges(set.num_ranges()) {
+        for (std::size_t k = 0; k < num_ranges; ++k) {
+            below[k] = _mm_set1_epi8(static_cast<char>(static_cast<int>(set.range_lows()[k]) - 1));
+            highs[k] = _mm_set1_epi8(static_cast<char>(set.range_highs()[k]));
+        }
+    }
+
+    ESCAPE_UTF8_TARGET("sse2")
+    __m128i passthrough(__m128i x) const {
+        __m128i pass = _mm_setzero_si128();
+        for (std::size_t k = 0; k < num_ranges; ++k) {
+            pass = _mm_or_si128(pass, _mm_andnot_si128(_mm_cmpgt_epi8(x, highs[k]), _mm_cmpgt_epi8(x, below[k])));
+        }
+        return pass;
+    }
+
+private:
+    std::size_t num_ranges;
+    __m128i below[PreserveSet::MAX_RANGES]; // lo - 1 for each range
+    __m128i highs[PreserveSet::MAX_RANGES];
+};
+
+/**
+ * Any custom set, looked up in its nibble tables. See PreserveSet and ascii_scan_x86.cpp.
+ */
+class Ssse3NibbleClassifier {
+public:
+    ESCAPE_UTF8_TARGET("ssse3")
+    explicit Ssse3NibbleClassifier(const PreserveSet& set)
+            : low_masks(_mm_loadu_si128(reinterpret_cast<const __m128i *>(set.low_nibble_masks()))),
+              high_bits(_mm_loadu_si128(reinterpret_cast<const __m128i *>(set.high_nibble_bits()))) {}
+
+    ESCAPE_UTF8_TARGET("ssse3")
+    __m128i passthrough(__m128i x) const {
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        __m128i low = _mm_shuffle_epi8(low_masks, _mm_and_si128(x, nibble));
+        __m128i high = _mm_shuffle_epi8(high_bits, _mm_and_si128(_mm_srli_epi16(x, 4), nibble));
+        __m128i not_pass = _mm_cmpeq_epi8(_mm_and_si128(low, high), _mm_setzero_si128());
+        return _mm_xor_si128(not_pass, _mm_set1_epi8(-1));
+    }
+
+private:
+    __m128i low_masks;
+    __m128i high_bits;
+};
+
+struct Avx2DefaultClassifier {
+    ESCAPE_UTF8_TARGET("avx2")
+    __m256i passthrough(__m256i x) const {
+        __m256i pass = _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8(31)), _mm256_cmpgt_epi8(_mm256_set1_epi8(127), x));
+        pass = _mm256_or_si256(pass, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(9)));
+        pass = _mm256_or_si256(pass, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(10)));
+        return _mm256_or_si256(pass, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(13)));
+    }
+};
+
+class Avx2NibbleClassifier {
+public:
+    ESCAPE_UTF8_TARGET("avx2")
+    explicit Avx2NibbleClassifier(const PreserveSet& set)
+            : low_masks(_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(set.low_nibble_masks())))),
+              high_bits(_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(set.high_nibble_bits())))) {}
+
+    ESCAPE_UTF8_TARGET("avx2")
+    __m256i passthrough(__m256i x) const {
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        __m256i low = _mm256_shuffle_epi8(low_masks, _mm256_and_si256(x, nibble));
+        __m256i high = _mm256_shuffle_epi8(high_bits, _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble));
+        __m256i not_pass = _mm256_cmpeq_epi8(_mm256_and_si256(low, high), _mm256_setzero_si256());
+        return _mm256_xor_si256(not_pass, _mm256_set1_epi8(-1));
+    }
+
+private:
+    __m256i low_masks;
+    __m256i high_bits;
+};
+
+/**
+ * Returns the sum of the 16 unsigned byte counters in x.
+ */
+ESCAPE_UTF8_TARGET("sse2")
+static inline std::uint_fast64_t sum_bytes(__m128i x) {
+    __m128i sums = _mm_sad_epu8(x, _mm_setzero_si128());
+    return static_cast<std::uint_fast64_t>(_mm_cvtsi128_si32(sums)) +
+           static_cast<std::uint_fast64_t>(_mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums)));
+}
+
+/**
+ * Returns the sum of the 32 unsigned byte counters in x.
+ */
+ESCAPE_UTF8_TARGET("avx2")
+static inline std::uint_fast64_t sum_bytes(__m256i x) {
+    __m256i sums = _mm256_sad_epu8(x, _mm256_setzero_si256());
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    return static_cast<std::uint_fast64_t>(_mm_cvtsi128_si32(half)) +
+           static_cast<std::uint_fast64_t>(_mm_cvtsi128_si32(_mm_unpackhi_epi64(half, half)));
+}
+
+/**
+ * Counts the bytes of the buffer 16 at a time, from data[i] up to the last whole vector, and
+ * moves i past them.
+ */
+template <typename Classifier>
+ESCAPE_UTF8_TARGET("sse2")
+ESCAPE_UTF8_ALWAYS_INLINE void count_vectors(const unsigned char *data, std::size_t len, std::size_t& i, ByteCounts& counts,
+                                             const Classifier& classifier) {
+    const __m128i lead = _mm_set1_epi8(static_cast<char>(0xC0));
+    const __m128i f0 = _mm_set1_epi8(static_cast<char>(0xF0));
+    const __m128i f4 = _mm_set1_epi8(static_cast<char>(0xF4));
+    while (i + 16 <= len) {
+        std::size_t round = std::min(MAX_VECTORS_PER_ROUND, (len - i) / 16);
+        __m128i pass_count = _mm_setzero_si128();
+        __m128i cont_count = _mm_setzero_si128();
+        __m128i f0_count = _mm_setzero_si128();
+        __m128i f4_count = _mm_setzero_si128();
+        for (std::size_t k = 0; k < round; ++k, i += 16) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            __m128i pass = classifier.passthrough(x);
+            // As signed chars, the continuation bytes 80..BF are exactly the ones below C0.
+            __m128i cont = _mm_cmpgt_epi8(lead, x);
+            // There's no unsigned comparison, but x >= F0 exactly when max(x, F0) == x.
+            __m128i four_byte = _mm_cmpeq_epi8(_mm_max_epu8(x, f0), x);
+            pass_count = _mm_sub_epi8(pass_count, pass);
+            cont_count = _mm_sub_epi8(cont_count, cont);
+            f0_count = _mm_sub_epi8(f0_count, four_byte);
+            f4_count = _mm_sub_epi8(f4_count, _mm_cmpeq_epi8(x, f4));
+        }
+        counts.total += round * 16;
+        counts.passthrough += sum_bytes(pass_count);
+        counts.continuation += sum_bytes(cont_count);
+        counts.four_byte += sum_bytes(f0_count);
+        counts.f4 += sum_bytes(f4_count);
+    }
+}
+
+/**
+ * This is count_vectors, 32 bytes at a time.
+ */
+template <typename Classifier>
+ESCAPE_UTF8_TARGET("avx2")
+ESCAPE_UTF8_ALWAYS_INLINE void count_vectors256(const unsigned char *data, std::size_t len, std::size_t& i, ByteCounts& counts,
+                                                const Classifier& classifier) {
+    const __m256i lead = _mm256_set1_epi8(static_cast<char>(0xC0));
+    const __m256i f0 = _mm256_set1_epi8(static_cast<char>(0xF0));
+    const __m256i f4 = _mm256_set1_epi8(static_cast<char>(0xF4));
+    while (i + 32 <= len) {
+        std::size_t round = std::min(MAX_VECTORS_PER_ROUND, (len - i) / 32);
+        __m256i pass_count = _mm256_setzero_si256();
+        __m256i cont_count = _mm256_setzero_si256();
+        __m256i f0_count = _mm256_setzero_si256();
+        __m256i f4_count = _mm256_setzero_si256();
+        for (std::size_t k = 0; k < round; ++k, i += 32) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+            __m256i pass = classifier.passthrough(x);
+            __m256i cont = _mm256_cmpgt_epi8(lead, x);
+            __m256i four_byte = _mm256_cmpeq_epi8(_mm256_max_epu8(x, f0), x);
+            pass_count = _mm256_sub_epi8(pass_count, pass);
+            cont_count = _mm256_sub_epi8(cont_count, cont);
+            f0_count = _mm256_sub_epi8(f0_count, four_byte);
+            f4_count = _mm256_sub_epi8(f4_count, _mm256_cmpeq_epi8(x, f4));
+        }
+        counts.total += round * 32;
+        counts.passthrough += sum_bytes(pass_count);
+        counts.continuation += sum_bytes(cont_count);
+        counts.four_byte += sum_bytes(f0_count);
+        counts.f4 += sum_bytes(f4_count);
+    }
+}
+
+ESCAPE_UTF8_TARGET("sse2")
+std::uint_fast64_t sse2_escaped_length(const unsigned char *data, std::size_t len, EscapeFormat format,
+                                       const PreserveSet *set) {
+    ByteCounts counts;
+    std::size_t i = 0;
+    if (set == nullptr) {
+        count_vectors(data, len, i, counts, Sse2DefaultClassifier());
+    } else if (set->fits_in_ranges()) {
+        count_vectors(data, len, i, counts, Sse2RangeClassifier(*set));
+    }
+    count_one_at_a_time(data + i, len - i, set, counts);
+    return counts.escaped_length(format);
+}
+
+ESCAPE_UTF8_TARGET("ssse3")
+std::uint_fast64_t ssse3_escaped_length(const unsigned char *data, std::size_t len, EscapeFormat format,
+                                        const PreserveSet *set) {
+    ByteCounts counts;
+    std::size_t i = 0;
+    if (set == nullptr) {
+        count_vectors(data, len, i, counts, Sse2DefaultClassifier());
+    } else {
+        count_vectors(data, len, i, counts, Ssse3NibbleClassifier(*set));
+    }
+    count_one_at_a_time(data + i, len - i, set, counts);
+    return counts.escaped_length(format);
+}
+
+ESCAPE_UTF8_TARGET("avx2")
+std::uint_fast64_t avx2_escaped_length(const unsigned char *data, std::size_t len, EscapeFormat format,
+                                       const PreserveSet *set) {
+    ByteCounts counts;
+    std::size_t i = 0;
+    // What's left after the 32-byte vectors can still have a 16-byte one in it.
+    if (set == nullptr) {
+        count_vectors256(data, len, i, counts, Avx2DefaultClassifier());
+        count_vectors(data, len, i, counts, Sse2DefaultClassifier());
+    } else {
+        count_vectors256(data, len, i, counts, Avx2NibbleClassifier(*set));
+        count_vectors(data, len, i, counts, Ssse3NibbleClassifier(*set));
+    }
+    count_one_at_a_time(data + i, len - i, set, counts);
+    return counts.escaped_length(format);
+}
+
+#endif // ESCAPE_UTF8_X86_KERNELS
+
+std::uint_fast64_t escaped_length(const unsigned char *data, std::size_t len, EscapeFormat format) {
+    return active_scan_kernels()->escaped_length(data, len, format, nullptr);
+}
+
+std::uint_fast64_t escaped_length(const unsigned char *data, std::size_t len, const EscapeSettings& settings) {
+    const PreserveSet *set = settings.preserve.is_default() ? nullptr : &settings.preserve;
+    return active_scan_kernels()->escaped_length(data, len, settings.format, set);
+}
@@ -0,0 +1,44 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_MEASURE_H
+#define ESCAPE_UTF8_MEASURE_H
+
+#include <cstddef> // std::size_t
+#include <cstdint> // uint_fast64_t
+
+#include "escape_kernel.h" // EscapeFormat, EscapeSettings
+
+/**
+ * Returns the number of bytes that escape_block would write for the given buffer, without
+ * writing them. Each character costs 1 byte if it's passed through, and otherwise the length
+ * of its escape string. For every format but JSON, that's the same as for the default format
+ * (see construct_escape_string): 8 for anything below U+10000, 9 below U+100000, and 10 above
+ * that. For JSON, it's 6 below U+10000 and 12 (a surrogate pair) above that.
+ *
+ * The whole cost of a character is counted at its first byte, and continuation bytes cost
+ * nothing, so a character can be split between two buffers and the sum of the two lengths
+ * is still right. This means the length can also be worked out for the pieces of the input
+ * in any order, or in parallel.
+ *
+ * The result is only meaningful if the input is valid UTF-8; this doesn't check that. Use
+ * validate_block (see utf8_validate.h) for that.
+ *
+ * This looks at 16 (SSE2 and SSE4.2 tiers) or 32 (AVX2 and AVX-512 tiers) bytes at a time,
+ * depending on the kernel tier in use (see active_kernel_tier in ascii_scan.h).
+ * @param data Pointer to the first byte of the buffer. May be null if len is 0.
+ * @param len Number of bytes in the buffer.
+ * @param format The format that the escape strings would be in.
+ */
+std::uint_fast64_t escaped_length(const unsigned char *data, std::size_t len, EscapeFormat format = EscapeFormat::Rfc5137);
+
+/**
+ * This is escaped_length with the given settings, so the bytes in settings.preserve (and only
+ * those) count as passed through.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * The other parameters and the return value are the same as above.
+ */
+std::uint_fast64_t escaped_length(const unsigned char *data, std::size_t len, const EscapeSettings& settings);
+
+#endif //ESCAPE_UTF8_MEASURE_H
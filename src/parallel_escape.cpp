@@ -0,0 +1,332 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <algorithm> // std::copy and std::min
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel_escape.h"
+#include "escape_kernel.h"
+
+/*
+ * How this works
+ *   The input is read in superblocks of up to num_threads * CHUNK_SIZE bytes. Each
+ *   superblock is cut into one chunk per thread, and every chunk is escaped by its own
+ *   worker with a fresh EscapeState. That's only correct if every chunk starts at a
+ *   character boundary, so the cuts are moved back over any UTF-8 continuation bytes
+ *   (10xxxxxx) until they land on the first byte of a character; see find_chunk_boundary.
+ *   The last character of a superblock (which might not be complete yet) is carried over
+ *   to the start of the next one.
+ *
+ *   The outputs are written in order by the main thread. Since we write to a stream, which
+ *   might be a pipe, we can't do positioned writes: instead each chunk records how many
+ *   bytes of output it produced and the main thread writes them one after another, which
+ *   puts every chunk at the offset given by the prefix sum of the earlier chunks' sizes.
+ *   Meanwhile the workers are already escaping the next superblock, so the input and
+ *   output buffers are double-buffered.
+ *
+ * Invalid input
+ *   On invalid input the cuts can end up in the middle of a character (a cut never moves
+ *   back more than 3 bytes, and a stray continuation byte has no first byte to move back
+ *   to). So while walking the chunks in order, the main thread also keeps the EscapeState
+ *   that read_and_escape would have had at the start of each chunk. If that state is in
+ *   the middle of a character, the worker's result is thrown away and the chunk is escaped
+ *   again on the main thread, starting from the right state. Otherwise the worker started
+ *   from the same state read_and_escape would have, so its output is the same. This way
+ *   we write exactly the same output as read_and_escape, up to the same first bad
+ *   character, and num_bytes_read is the same too.
+ */
+
+// The number of input bytes per chunk, i.e. per thread per superblock. The output
+// buffer for each chunk is about 8 times this, and there are two of them per thread.
+static const std::size_t CHUNK_SIZE = 256 * 1024;
+
+// The longest UTF-8 character is 4 bytes, so a character has at most 3 continuation bytes.
+static const std::size_t MAX_CHAR_LEN = 4;
+static const std::size_t MAX_CONTINUATION_BYTES = MAX_CHAR_LEN - 1;
+
+/**
+ * Returns the position of the start of the character that contains data[pos], which is
+ * pos moved back over any continuation bytes. It won't move back more than
+ * MAX_CONTINUATION_BYTES bytes, or to before min; if the input is valid UTF-8 neither limit
+ * matters.
+ * @param data The buffer.
+ * @param pos A position in [min, len], where len is the length of the buffer. If pos == len,
+ * data[pos] is not read and pos is returned as-is.
+ * @param len The length of the buffer.
+ * @param min The smallest value to return.
+ * @return A position in [max(min, pos - 3), pos].
+ */
+std::size_t find_chunk_boundary(const unsigned char *data, std::size_t pos, std::size_t len, std::size_t min) {
+    if (pos >= len) {
+        return len;
+    }
+    std::size_t limit = (pos - min > MAX_CONTINUATION_BYTES) ? pos - MAX_CONTINUATION_BYTES : min;
+    std::size_t i = pos;
+    while (i > limit && (data[i] & 0xC0u) == 0x80u) {
+        --i;
+    }
+    return i;
+}
+
+namespace {
+
+/**
+ * A piece of a superblock, and the result of escaping it.
+ */
+struct Chunk {
+    const unsigned char *in;
+    std::size_t len;
+    std::unique_ptr<unsigned char[]> out;
+    std::size_t outlen;
+    // The state after escaping the chunk, starting from a fresh EscapeState.
+    EscapeState state;
+};
+
+/**
+ * A fixed set of worker threads. Each call to start() hands chunk i to worker i (workers
+ * without a chunk just skip the round), and wait() blocks until every worker is done.
+ * We keep the threads around for the whole run rather than starting new ones for every
+ * superblock, since a superblock of ASCII only takes a fraction of a millisecond.
+ */
+class WorkerPool {
+public:
+    WorkerPool(unsigned int num_threads, const EscapeSettings& settings) :
+            settings(settings), chunks(nullptr), num_chunks(0), generation(0), remaining(0), stopping(false) {
+        for (unsigned int i = 0; i < num_threads; ++i) {
+            threads.emplace_back(&WorkerPool::work, this, i);
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Waits for the current round (if any) to finish and then stops the threads.
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        start_cv.notify_all();
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+    void start(Chunk *first, std::size_t count) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            chunks = first;
+            num_chunks = count;
+            remaining = threads.size();
+            ++generation;
+        }
+        start_cv.notify_all();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [this] { return remaining == 0; });
+    }
+
+private:
+    void work(unsigned int index) {
+        unsigned long seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            // A new round takes priority over stopping, so that the destructor never
+            // frees the buffers while a worker is still using them.
+            start_cv.wait(lock, [this, seen] { return generation != seen || stopping; });
+            if (generation == seen) {
+                return;
+            }
+            seen = generation;
+            Chunk *chunk = (index < num_chunks) ? chunks + index : nullptr;
+            lock.unlock();
+            if (chunk != nullptr) {
+                chunk->state = EscapeState();
+                chunk->outlen = escape_block(chunk->state, chunk->in, chunk->len, chunk->out.get(), settings);
+            }
+            lock.lock();
+            if (--remaining == 0) {
+                done_cv.notify_one();
+            }
+        }
+    }
+
+    const EscapeSettings& settings;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+    Chunk *chunks;
+    std::size_t num_chunks;
+    unsigned long generation;
+    std::size_t remaining;
+    bool stopping;
+};
+
+/**
+ * One half of the double buffer: a superblock of input and its chunks.
+ */
+struct Superblock {
+    std::unique_ptr<unsigned char[]> in;
+    std::vector<Chunk> chunks;
+    std::size_t num_chunks;
+};
+
+} // namespace
+
+int parallel_read_and_escape(StreamPair& streams, unsigned int num_threads, const EscapeSettings& settings, EscapeStats *stats) {
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+        if (num_threads == 0) { // The number of cores isn't known.
+            num_threads = 1;
+        }
+    }
+    const std::size_t read_size = num_threads * CHUNK_SIZE;
+    // A superblock is at most read_size bytes plus the carried-over character, so splitting
+    // it evenly gives at most CHUNK_SIZE + MAX_CHAR_LEN bytes per chunk, and moving the
+    // start of a chunk back can add up to MAX_CONTINUATION_BYTES more.
+    const std::size_t max_chunk = CHUNK_SIZE + MAX_CHAR_LEN + MAX_CONTINUATION_BYTES;
+
+    // The buffers are declared before the pool so that they're destroyed after it, and
+    // we don't use std::vector for them since there's no need to zero out ~8 MB per thread.
+    Superblock blocks[2];
+    for (Superblock& block : blocks) {
+        block.in.reset(new unsigned char[MAX_CHAR_LEN + read_size]);
+        block.chunks.resize(num_threads);
+        for (Chunk& chunk : block.chunks) {
+            chunk.out.reset(new unsigned char[escape_output_bound(max_chunk, settings.format)]);
+        }
+        block.num_chunks = 0;
+    }
+    WorkerPool pool(num_threads, settings);
+
+    // The bytes of the last character of the previous superblock.
+    unsigned char carry[MAX_CHAR_LEN];
+    std::size_t carry_len = 0;
+
+    /*
+     * Reads the next superblock into block and splits it into chunks. Like read_and_escape,
+     * we keep going until a read comes back short; the caller checks why afterwards.
+     */
+    auto fill = [&](Superblock& block) {
+        std::copy(carry, carry + carry_len, block.in.get());
+        std::size_t got = streams.in.read(block.in.get() + carry_len, read_size);
+        std::size_t len = carry_len + got;
+        bool last = got < read_size;
+
+        // If there's more input coming, the end of this superblock has to be a character
+        // boundary too. The last character (which might be incomplete) is carried over
+        // to the start of the next superblock.
+        std::size_t end = last ? len : find_chunk_boundary(block.in.get(), len - 1, len, 0);
+        carry_len = len - end;
+        std::copy(block.in.get() + end, block.in.get() + len, carry);
+
+        std::size_t per_chunk = (end + num_threads - 1) / num_threads;
+        std::size_t start = 0;
+        block.num_chunks = 0;
+        for (unsigned int i = 0; i < num_threads && start < end; ++i) {
+            std::size_t nominal = std::min(end, (i + 1) * per_chunk);
+            std::size_t stop = find_chunk_boundary(block.in.get(), nominal, end, start);
+            Chunk& chunk = block.chunks[i];
+            chunk.in = block.in.get() + start;
+            chunk.len = stop - start;
+            ++block.num_chunks;
+            start = stop;
+        }
+        return last;
+    };
+
+    // This is the state read_and_escape would have at the start of the next chunk.
+    EscapeState state;
+    StatsScope stats_scope(stats, state);
+    int retval = -1;
+
+    /*
+     * Writes out the chunks of block in order, escaping them again if needed (see the
+     * comment at the top of this file). Returns 2 if the input turned out to be invalid,
+     * and -1 otherwise. Like read_and_escape, we stop at the first chunk that fails to be
+     * written, even if a later one is invalid; the caller then sees the write error.
+     */
+    auto write_out = [&](Superblock& block) {
+        for (std::size_t i = 0; i < block.num_chunks; ++i) {
+            Chunk& chunk = block.chunks[i];
+            if (state.at_boundary() && !state.invalid) {
+                // The worker's counts start from zero, so the ones so far are added back on.
+                EscapeState before = state;
+                state = chunk.state;
+                state.num_bytes_read += before.num_bytes_read;
+                for (std::size_t k = 0; k < 4; ++k) {
+                    state.num_escaped[k] += before.num_escaped[k];
+                }
+            } else {
+                chunk.outlen = escape_block(state, chunk.in, chunk.len, chunk.out.get(), settings);
+            }
+            // The chunks are big, so they go straight out instead of through the sink's buffer.
+            streams.out.write_unbuffered(chunk.out.get(), chunk.outlen);
+            stats_output(stats, chunk.outlen);
+            if (streams.out.error()) {
+                return -1;
+            }
+            if (state.invalid) {
+                std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+                return 2;
+            }
+        }
+        return -1;
+    };
+
+    bool last = fill(blocks[0]);
+    pool.start(blocks[0].chunks.data(), blocks[0].num_chunks);
+    std::size_t current = 0;
+    while (true) {
+        Superblock& block = blocks[current];
+        Superblock& next = blocks[1 - current];
+        bool next_last = last;
+        // Read the next superblock while the workers escape this one. We stop reading
+        // once the output fails, the same as read_and_escape.
+        bool have_next = !last && !streams.out.error();
+        if (have_next) {
+            next_last = fill(next);
+        }
+        stats_lap(stats, Phase::Read);
+        pool.wait();
+        if (have_next) {
+            pool.start(next.chunks.data(), next.num_chunks);
+        }
+        stats_lap(stats, Phase::Escape);
+        retval = write_out(block);
+        stats_lap(stats, Phase::Write);
+        if (retval != -1 || !have_next || streams.out.error()) {
+            break;
+        }
+        last = next_last;
+        current = 1 - current;
+    }
+    if (retval != -1) {
+        return retval;
+    }
+
+    // Everything from here on is the same as the end of read_and_escape.
+    if (streams.out.error()) {
+        std::cerr << "There was a fatal error when trying to write to the output. Exiting now." << std::endl;
+        return 4;
+    }
+    if (!streams.in.error()) {
+        if (!state.at_boundary()) {
+            std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+            return 2;
+        }
+        return 0;
+    } else {
+        std::cerr << "Failed when trying to read byte " << (state.num_bytes_read + 1) << " due to unknown error." << std::endl;
+        return 3;
+    }
+}
@@ -0,0 +1,31 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_PARALLEL_ESCAPE_H
+#define ESCAPE_UTF8_PARALLEL_ESCAPE_H
+
+#include "StreamPair.h"
+#include "escape_kernel.h" // EscapeSettings
+#include "stats.h"
+
+/**
+ * This does the same thing as read_and_escape (see business_logic.h), but the escaping is
+ * spread over several worker threads. The output, the error messages and the return value
+ * are exactly the same as read_and_escape's for every input; only the speed is different.
+ *
+ * The main thread does all of the I/O. It reads the input in "superblocks" of one chunk
+ * per thread, cutting the chunks at UTF-8 character boundaries, and the workers escape
+ * the chunks while the main thread reads the next superblock and writes out the previous
+ * one in order.
+ * @param streams The input and output streams.
+ * @param num_threads The number of worker threads. 0 means one per CPU core.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * @param stats Where to count things for --stats, or null. The escape time is the time the
+ * main thread spends waiting for the workers.
+ * @return The same exit codes as read_and_escape.
+ */
+int parallel_read_and_escape(StreamPair& streams, unsigned int num_threads, const EscapeSettings& settings = EscapeSettings(),
+                             EscapeStats *stats = nullptr);
+
+#endif //ESCAPE_UTF8_PARALLEL_ESCAPE_H
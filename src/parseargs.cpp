@@ -6,8 +6,11 @@
 #include <bitset>
 #include <cassert>
 #include <cstring> // std::size_t and std::strncmp
+#include <vector>
 
 #include "parseargs.h"
+#include "ascii_scan.h" // is_passthrough, kernel_tier_available
+#include "streaming.h" // streams_by_descriptor
 #include "../version.h"
 
 // This macro is used to identify Windows. Sources:
@@ -34,13 +37,31 @@ static std::string const helpmsg(
 "\n"
 "\n"
 "Usage:\n"
-"  escape [INPUTFILE] [-o OUTPUTFILE]\n"
+"  escape [INPUTFILE] [-o OUTPUTFILE] [--format FORMAT] [--preserve SET]\n"
+"         [--threads N] [--preallocate] [--stats] [--stats-file FILE]\n"
+"         [--compress FORMAT]\n"
+"  escape [INPUTFILE] [-o OUTPUTFILE] [--format FORMAT] [--preserve SET]\n"
+"         [--line-buffered] [--max-latency-ms MS] [--stats]\n"
+"         [--stats-file FILE]\n"
+"  escape --check [INPUTFILE]\n"
+"  escape --decode [INPUTFILE] [-o OUTPUTFILE] [--compress FORMAT]\n"
+"  escape --measure [INPUTFILE] [-o OUTPUTFILE] [--format FORMAT]\n"
+"         [--preserve SET]\n"
+"  escape --batch (--output-dir DIR | --suffix SUFFIX) [--recursive]\n"
+"         [--files-from LISTFILE] [--format FORMAT] [--preserve SET]\n"
+"         [--threads N] [--compress FORMAT] [INPUT...]\n"
+"  escape --batch --in-place [--recursive] [--files-from LISTFILE]\n"
+"         [--format FORMAT] [--preserve SET] [--threads N] [INPUT...]\n"
+"  escape --serve SOCKET [--format FORMAT] [--preserve SET]\n"
+"  escape --follow INPUTFILE [-o OUTPUTFILE] [--checkpoint FILE]\n"
+"         [--format FORMAT] [--preserve SET]\n"
 "  escape -h | --help\n"
 "  escape -v | --version\n"
 "\n"
 "Argument:\n"
 "  INPUTFILE    Path to the input file. This argument may be omitted; if\n"
-"               so, input will be read from stdin.\n"
+"               so, input will be read from stdin. If the input is\n"
+"               compressed with gzip or zstd, it's decompressed first.\n"
 "\n"
 "Options:\n"
 "  -h, --help                          Show this help message.\n"
@@ -52,15 +73,151 @@ static std::string const helpmsg(
 "                                      then it will be created; if it\n"
 "                                      does exist, it will be\n"
 "                                      overwritten.\n"
+"  --format FORMAT                     The format of the escape strings,\n"
+"                                      shown here for U+1F602:\n"
+"                                        rfc5137  \\u'1F602' (default)\n"
+"                                        json     \\uD83D\\uDE02\n"
+"                                        braces   \\U{1F602}\n"
+"                                        html     &#x1F602;\n"
+"  --preserve SET                      The ASCII characters to pass\n"
+"                                      through without escaping. SET is\n"
+"                                      a comma-separated list, applied\n"
+"                                      in order to an empty set, of:\n"
+"                                        default  tab, LF, CR and the\n"
+"                                                 printable characters\n"
+"                                        ascii    all of ASCII\n"
+"                                        none     nothing\n"
+"                                        C        the character C\n"
+"                                        0xHH     the byte HH (hex)\n"
+"                                        0xHH-0xHH  a range of bytes\n"
+"                                      An item starting with - is taken\n"
+"                                      out of the set instead. For\n"
+"                                      example, default,0x0B,0x0C also\n"
+"                                      keeps \\v and \\f, and\n"
+"                                      default,-\\ escapes backslashes.\n"
+"  --threads N                         Escape using N threads. This is\n"
+"                                      only worth it for large inputs.\n"
+"                                      If N is 0, one thread is used per\n"
+"                                      CPU core. The default is 1.\n"
+"  --check                             Only check whether the input is\n"
+"                                      valid UTF-8, without writing any\n"
+"                                      output. The exit status is 0 if\n"
+"                                      it is and 2 if it isn't, in which\n"
+"                                      case the position of the first\n"
+"                                      invalid byte is printed.\n"
+"  --decode                            Do the reverse: turn escaped text\n"
+"                                      back into UTF-8. Exits with\n"
+"                                      status 2 if an escape sequence\n"
+"                                      is malformed or out of range.\n"
+"  --measure                           Print the exact number of bytes\n"
+"                                      the escaped output would have,\n"
+"                                      instead of the output itself.\n"
+"                                      The input is checked like with\n"
+"                                      --check.\n"
+"  --preallocate                       Reserve the disk space for\n"
+"                                      OUTPUTFILE before writing it, to\n"
+"                                      keep it in one piece on disk.\n"
+"                                      This takes an extra pass over\n"
+"                                      INPUTFILE, and only works on\n"
+"                                      Linux with one thread.\n"
+"  --line-buffered                     Write out each line as soon as\n"
+"                                      it has been escaped, instead of\n"
+"                                      waiting for a full buffer. For\n"
+"                                      input that comes in a little at\n"
+"                                      a time, like from tail -f.\n"
+"  --max-latency-ms MS                 Never hold back output for more\n"
+"                                      than MS milliseconds, even in\n"
+"                                      the middle of a line.\n"
+"  --stats                             When done, print to stderr how\n"
+"                                      many bytes went in and out, how\n"
+"                                      many characters of each kind\n"
+"                                      were escaped, and how long\n"
+"                                      reading, escaping and writing\n"
+"                                      took.\n"
+"  --stats-file FILE                   Write the same statistics to\n"
+"                                      FILE as JSON.\n"
+"  --compress FORMAT                   Compress the output with FORMAT,\n"
+"                                      which is gzip or zstd.\n"
+"                                      Compressing and decompressing are\n"
+"                                      only available for the formats\n"
+"                                      whose libraries escape was built\n"
+"                                      with.\n"
+"  --kernel TIER                       Scan the input with the given\n"
+"                                      version of the code instead of\n"
+"                                      the fastest one this CPU can\n"
+"                                      run, for testing and\n"
+"                                      benchmarking. Goes with any of\n"
+"                                      the usages above. TIER is one of\n"
+"                                      scalar, swar, sse2, sse4.2, avx2\n"
+"                                      and avx512. The environment\n"
+"                                      variable ESCAPE_UTF8_KERNEL does\n"
+"                                      the same.\n"
+"  --serve SOCKET                      Keep running and escape requests\n"
+"                                      from other programs, which\n"
+"                                      connect to the Unix domain\n"
+"                                      socket SOCKET. Stops on SIGINT\n"
+"                                      or SIGTERM. See the README for\n"
+"                                      the protocol. Linux only.\n"
+"  --follow                            Like tail -F: after escaping\n"
+"                                      INPUTFILE, keep escaping what's\n"
+"                                      added to it, even after it's\n"
+"                                      rotated, until SIGINT or\n"
+"                                      SIGTERM. Linux only.\n"
+"  --checkpoint FILE                   With --follow, keep how far\n"
+"                                      INPUTFILE has been escaped in\n"
+"                                      FILE, and carry on from there\n"
+"                                      next time. OUTPUTFILE is then\n"
+"                                      appended to, not overwritten.\n"
+"\n"
+"Batch mode:\n"
+"  --batch                             Escape every INPUT file, each to\n"
+"                                      its own output file. With\n"
+"                                      --threads, several files are\n"
+"                                      escaped at once. For each file,\n"
+"                                      a line with its exit status and\n"
+"                                      name is printed. The exit status\n"
+"                                      of the program is that of the\n"
+"                                      first file that failed, or 0.\n"
+"  --output-dir DIR                    Write the output for INPUT to\n"
+"                                      DIR/INPUT.\n"
+"  --suffix SUFFIX                     Write the output for INPUT to\n"
+"                                      INPUTSUFFIX.\n"
+"  --in-place                          Replace each INPUT with its\n"
+"                                      output. A file that wouldn't\n"
+"                                      change isn't written at all.\n"
+"                                      Otherwise it's replaced in one\n"
+"                                      step, with a rename. Not on\n"
+"                                      Windows.\n"
+"  --files-from LISTFILE               Also escape the files listed in\n"
+"                                      LISTFILE, one per line. If\n"
+"                                      LISTFILE is -, read the list\n"
+"                                      from stdin.\n"
+"  -r, --recursive                     Escape all the files in any\n"
+"                                      INPUT that is a directory, and\n"
+"                                      in its subdirectories.\n"
 );
 
+// The largest value we accept for --threads. Anything bigger is almost certainly a typo.
+static const unsigned int MAX_THREADS = 1024;
+// The largest value we accept for --max-latency-ms, which is an hour.
+static const unsigned int MAX_LATENCY_MS = 60 * 60 * 1000;
+
 
 std::bitset<3> parse_helper(int argc, char **argv, std::string& inputfile, std::string& outputfile);
 bool strlen_atleast(const char *str, std::size_t len);
 int check_output_option(const char *arg);
+bool extract_options(int argc, char **argv, Options& options, std::vector<char *>& remaining);
+int match_value_option(int argc, char **argv, int& i, const char *name, const char *& value);
+bool parse_count(const char *str, unsigned int max, unsigned int& count);
+bool parse_format(const char *str, EscapeFormat& format);
+bool parse_preserve(const char *str, PreserveSet& set);
+bool parse_preserve_item(const std::string& item, bool (&bytes)[128]);
+bool parse_hex_byte(const std::string& str, unsigned int& byte);
+std::bitset<3> batch_helper(int argc, char **argv, Options& options);
+StreamPair open_streams(const std::string& inputfile, const std::string& outputfile, bool append_output);
 
 
-StreamPair parse(int argc, char **argv) {
+StreamPair parse(int argc, char **argv, Options& options) {
     /*
      * There are 4 potential invocations of this program: help, version,
      * neither (which is valid), and invalid.
@@ -68,7 +225,20 @@ StreamPair parse(int argc, char **argv) {
 
     std::string inputfile; // If an arg is given, it's guaranteed to have length > 0, so the empty string serves as our "null" value.
     std::string outputfile;
-    std::bitset<3> bits = parse_helper(argc, argv, inputfile, outputfile);
+    // The options that only take a value (like --threads) are pulled out first, so that
+    // parse_helper only ever sees the input and output files and the help/version flags.
+    std::vector<char *> args;
+    std::bitset<3> bits;
+    if (!extract_options(argc, argv, options, args)) {
+        bits.set(0); // Return "help" and "invalid"
+    } else if (options.batch) {
+        bits = batch_helper(static_cast<int>(args.size()), args.data(), options);
+    } else if (!options.output_dir.empty() || !options.suffix.empty() || options.in_place || !options.files_from.empty() ||
+               options.recursive) {
+        bits.set(0); // The batch mode options don't mean anything without --batch.
+    } else {
+        bits = parse_helper(static_cast<int>(args.size()), args.data(), inputfile, outputfile);
+    }
     // Bit 0 is "help", bit 1 is "version", bit 2 is "valid"
     if (bits[1]) {
         assert(bits[2]);
@@ -85,6 +255,64 @@ StreamPair parse(int argc, char **argv) {
         }
     }
     assert(bits[2]);
+    int num_modes = options.check + options.decode + options.measure;
+    bool other_format = options.format != EscapeFormat::Rfc5137 || !options.preserve.is_default();
+    bool streaming = options.line_buffered || options.max_latency_ms >= 0;
+    bool stats = options.stats || !options.stats_file.empty();
+    bool serving = !options.serve_socket.empty();
+    bool compressing = options.compress != Compression::None;
+    bool following = options.follow || !options.checkpoint.empty();
+    if ((options.check && !outputfile.empty()) || num_modes > 1 || (options.preallocate && num_modes > 0) ||
+        (other_format && (options.check || options.decode)) ||
+        (streaming && (num_modes > 0 || options.preallocate || options.threads != 1)) || (stats && num_modes > 0) ||
+        (serving && (!inputfile.empty() || !outputfile.empty() || num_modes > 0 || options.preallocate || streaming ||
+                     stats || options.threads != 1)) ||
+        (compressing && (options.check || options.measure || options.preallocate || streaming || serving)) ||
+        (following && (!options.follow || inputfile.empty() || num_modes > 0 || options.preallocate || streaming ||
+                       stats || options.threads != 1 || serving || compressing))) {
+        // --check doesn't write any output, so an output file is almost certainly a mistake.
+        // Better to say so than to silently truncate the file. And --check, --decode and
+        // --measure each do something different with the input, so only one can be given.
+        // --preallocate reserves space for escaped output, so it only goes with escaping.
+        // --check doesn't write escape strings, and --decode only reads the default format, so
+        // --format and --preserve don't mean anything with either of them. And the streaming
+        // mode (see streaming.h) is its own way of escaping, with one thread and no preallocation.
+        // The statistics are about escaping, so --stats doesn't go with the other modes either.
+        // --serve gets its input from its clients and sends the output back to them, so it
+        // doesn't take files, and it only escapes, in its own way.
+        // --compress needs output to compress, and compressed output can't be read a line at
+        // a time, and takes up some size on disk other than the one --preallocate reserves.
+        // --follow watches a file, so it needs one, and it's its own way of escaping, like
+        // --serve. --checkpoint is only for --follow.
+        std::cerr << "The given input is not a valid usage of this program.\nUse 'escape --help' for usage information." << std::endl;
+        throw InvalidCmd();
+    }
+#ifndef __linux__
+    if (serving) {
+        std::cerr << "--serve is only available on Linux. Exiting now." << std::endl;
+        throw InvalidCmd();
+    }
+#endif
+#ifndef __linux__
+    if (options.follow) {
+        std::cerr << "--follow is only available on Linux. Exiting now." << std::endl;
+        throw InvalidCmd();
+    }
+#endif
+#if !defined(__unix__) && !defined(__APPLE__)
+    if (options.in_place) {
+        std::cerr << "--in-place isn't available on this system. Exiting now." << std::endl;
+        throw InvalidCmd();
+    }
+#endif
+    if (options.force_kernel && !kernel_tier_available(options.kernel)) {
+        std::cerr << "The " << kernel_tier_name(options.kernel) << " kernel can't be used on this CPU. Exiting now." << std::endl;
+        throw InvalidCmd();
+    }
+    if (compressing && !compression_available(options.compress)) {
+        std::cerr << "This build of escape can't compress with " << compression_name(options.compress) << ". Exiting now." << std::endl;
+        throw InvalidCmd();
+    }
     // The only remaining case is the one where we can continue with the rest of the program.
     // Before setting up the streams, we do some setup on stdin/stdout. We do this here
     // in order to make the modifications before creating StreamPair, but not if any
@@ -105,10 +333,40 @@ StreamPair parse(int argc, char **argv) {
     }
 #endif
 
-    // This line should improve I/O performance. But it makes this program not thread-safe.
-    // We're not using multi-threading, so that's all right.
+    // This line should improve I/O performance. But it makes the standard streams not
+    // thread-safe. That's all right: even with --threads, only the main thread does I/O.
     std::ios_base::sync_with_stdio(false);
 
+    if (options.batch) {
+        // The files are opened one at a time later on. stdin is only used for --files-from -,
+        // and stdout for the status lines.
+        return StreamPair(true, true);
+    }
+    // With a checkpoint, the output from before it is already in the output file.
+    StreamPair streams = open_streams(inputfile, outputfile, !options.checkpoint.empty());
+    if (options.follow) {
+        options.inputs.push_back(inputfile);
+    }
+    if (!serving && !options.follow && !(streaming && streams_by_descriptor(streams))) {
+        // --serve doesn't read stdin at all, and --follow reads the file by its name. The
+        // streaming mode reads the input's file descriptor just as it is (see streaming.h)
+        // when the input is a pipe or a terminal, but an input file is read like in the
+        // normal mode, so that can be decompressed.
+        streams.decompress_input();
+    }
+    if (compressing) {
+        streams.compress_output(options.compress);
+    }
+    return streams;
+}
+
+/**
+ * Opens the input and output files, or stdin and stdout for the ones that are empty.
+ * This can throw FileError, like the StreamPair constructors.
+ * @param append_output Whether to append to the output file instead of truncating it. This
+ * is only supported when there's an input file too.
+ */
+StreamPair open_streams(const std::string& inputfile, const std::string& outputfile, bool append_output) {
     if (inputfile.empty()) {
         if (outputfile.empty()) {
             return StreamPair(true, true);
@@ -119,7 +377,7 @@ StreamPair parse(int argc, char **argv) {
         if (outputfile.empty()) {
             return StreamPair(inputfile, true);
         } else {
-            return StreamPair(inputfile, outputfile);
+            return StreamPair(inputfile, outputfile, append_output);
         }
     }
 }
@@ -251,6 +509,354 @@ std::bitset<3> parse_helper(int argc, char **argv, std::string& inputfile, std::
     }
 }
 
+/**
+ * Removes the options other than -o/--output, -h/--help and -v/--version from the command
+ * line. Those are the flags --check, --decode, --measure, --preallocate, --line-buffered, --stats,
+ * --batch, -r/--recursive, --in-place and --follow, and the options that take a value: --threads,
+ * --max-latency-ms, --format, --preserve, --kernel, --stats-file, --serve, --compress, --checkpoint,
+ * --files-from, --output-dir and --suffix. The options that take a value can be given either as "--threads N" or as
+ * "--threads=N".
+ * @param argc The argc from main()
+ * @param argv The argv from main()
+ * @param options This is a return value. The values of the options are stored in it.
+ * @param remaining This is a return value; it must be empty when passed in. It's filled
+ * with the args that weren't removed (starting with argv[0]), in the same order.
+ * @return True if every option that was found had a valid value, false otherwise. If an
+ * option is given more than once, the last one wins.
+ */
+bool extract_options(int argc, char **argv, Options& options, std::vector<char *>& remaining) {
+    assert(remaining.empty());
+    if (argc > 0) {
+        remaining.push_back(argv[0]);
+    }
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        const char *value = nullptr;
+        int match;
+        if (arg == "--check") {
+            options.check = true;
+        } else if (arg == "--decode") {
+            options.decode = true;
+        } else if (arg == "--measure") {
+            options.measure = true;
+        } else if (arg == "--preallocate") {
+            options.preallocate = true;
+        } else if (arg == "--line-buffered") {
+            options.line_buffered = true;
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "--batch") {
+            options.batch = true;
+        } else if (arg == "-r" || arg == "--recursive") {
+            options.recursive = true;
+        } else if (arg == "--in-place") {
+            options.in_place = true;
+        } else if (arg == "--follow") {
+            options.follow = true;
+        } else if ((match = match_value_option(argc, argv, i, "--threads", value)) != 0) {
+            if (match < 0 || !parse_count(value, MAX_THREADS, options.threads)) {
+                return false;
+            }
+        } else if ((match = match_value_option(argc, argv, i, "--max-latency-ms", value)) != 0) {
+            unsigned int ms;
+            if (match < 0 || !parse_count(value, MAX_LATENCY_MS, ms)) {
+                return false;
+            }
+            options.max_latency_ms = static_cast<long>(ms);
+        } else if ((match = match_value_option(argc, argv, i, "--format", value)) != 0) {
+            if (match < 0 || !parse_format(value, options.format)) {
+                return false;
+            }
+        } else if ((match = match_value_option(argc, argv, i, "--preserve", value)) != 0) {
+            if (match < 0 || !parse_preserve(value, options.preserve)) {
+                return false;
+            }
+        } else if ((match = match_value_option(argc, argv, i, "--kernel", value)) != 0) {
+            if (match < 0 || !parse_kernel_tier(value, options.kernel)) {
+                return false;
+            }
+            options.force_kernel = true;
+        } else if ((match = match_value_option(argc, argv, i, "--stats-file", value)) != 0) {
+            if (match < 0 || *value == '\0') {
+                return false;
+            }
+            options.stats_file = value;
+        } else if ((match = match_value_option(argc, argv, i, "--serve", value)) != 0) {
+            if (match < 0 || *value == '\0') {
+                return false;
+            }
+            options.serve_socket = value;
+        } else if ((match = match_value_option(argc, argv, i, "--compress", value)) != 0) {
+            if (match < 0 || !parse_compression(value, options.compress)) {
+                return false;
+            }
+        } else if ((match = match_value_option(argc, argv, i, "--checkpoint", value)) != 0) {
+            if (match < 0 || *value == '\0') {
+                return false;
+            }
+            options.checkpoint = value;
+        } else if ((match = match_value_option(argc, argv, i, "--files-from", value)) != 0) {
+            if (match < 0 || *value == '\0') {
+                return false;
+            }
+            options.files_from = value;
+        } else if ((match = match_value_option(argc, argv, i, "--output-dir", value)) != 0) {
+            if (match < 0 || *value == '\0') {
+                return false;
+            }
+            options.output_dir = value;
+        } else if ((match = match_value_option(argc, argv, i, "--suffix", value)) != 0) {
+            if (match < 0 || *value == '\0') {
+                return false;
+            }
+            options.suffix = value;
+        } else {
+            remaining.push_back(argv[i]);
+        }
+    }
+    return true;
+}
+
+/**
+ * Checks whether argv[i] is the option called name, given either as "name VALUE" (two args)
+ * or as "name=VALUE" (one arg).
+ * @param argc The argc from main()
+ * @param argv The argv from main()
+ * @param i The index of the arg to look at. If it's "name VALUE", i is moved to VALUE, so
+ * that the caller's loop skips it.
+ * @param name The name of the option, e.g. "--threads".
+ * @param value This is a return value. If the option matches, it points to VALUE.
+ * @return 1 if argv[i] is the option and value has been set, 0 if argv[i] is something else,
+ * or -1 if argv[i] is the option but VALUE is missing (i.e. it's the last arg).
+ */
+int match_value_option(int argc, char **argv, int& i, const char *name, const char *& value) {
+    std::size_t name_len = std::strlen(name);
+    if (std::strncmp(argv[i], name, name_len) != 0) {
+        return 0;
+    }
+    if (argv[i][name_len] == '\0') {
+        if (i + 1 == argc) {
+            return -1;
+        }
+        value = argv[++i];
+        return 1;
+    } else if (argv[i][name_len] == '=') {
+        value = argv[i] + name_len + 1;
+        return 1;
+    }
+    return 0; // Some other option that starts with the same characters
+}
+
+/**
+ * This is parse_helper for batch mode. Every arg is an input, except for the help and
+ * version flags.
+ * @param argc The number of args, including the program name.
+ * @param argv The args that are left after extract_options.
+ * @param options The options from extract_options. The inputs are stored in options.inputs.
+ * @return A bitset with the same meaning as parse_helper's. The args are invalid if there are
+ * no inputs at all, if there isn't exactly one of --output-dir, --suffix and --in-place, if
+ * -o/--output or another unknown option is given, if --check, --decode, --measure,
+ * --preallocate, --line-buffered, --max-latency-ms, --stats, --stats-file, --serve, --follow or
+ * --checkpoint is given, or if --compress is given with --in-place.
+ */
+std::bitset<3> batch_helper(int argc, char **argv, Options& options) {
+    std::bitset<3> bits;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (arg == "-h" || arg == "--help") {
+            bits.set(0);
+            bits.set(2);
+            return bits;
+        } else if (arg == "-v" || arg == "--version") {
+            bits.set(1);
+            bits.set(2);
+            return bits;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            bits.set(0); // -o/--output, or an option we don't know
+            return bits;
+        }
+        options.inputs.push_back(arg);
+    }
+    bool has_inputs = !options.inputs.empty() || !options.files_from.empty();
+    int num_destinations = !options.output_dir.empty() + !options.suffix.empty() + options.in_place;
+    // A file that's escaped in place keeps its name, so it shouldn't turn into a compressed file.
+    if (!has_inputs || num_destinations != 1 || (options.in_place && options.compress != Compression::None) || options.check || options.decode || options.measure || options.preallocate ||
+        options.line_buffered || options.max_latency_ms >= 0 || options.stats || !options.stats_file.empty() ||
+        !options.serve_socket.empty() || options.follow || !options.checkpoint.empty()) {
+        bits.set(0);
+        return bits;
+    }
+    bits.set(2);
+    return bits;
+}
+
+/**
+ * Parses a non-negative decimal integer. Unlike std::stoul, this doesn't accept leading
+ * whitespace, a sign, or trailing garbage.
+ * @param str A null-terminated string.
+ * @param max The largest value to accept.
+ * @param count This is a return value. It's only modified if the parse succeeds.
+ * @return True if str is made up of only digits (and at least one of them) and its
+ * value is at most max, false otherwise.
+ */
+bool parse_count(const char *str, unsigned int max, unsigned int& count) {
+    if (*str == '\0') {
+        return false;
+    }
+    unsigned long value = 0;
+    for (; *str != '\0'; ++str) {
+        if (*str < '0' || *str > '9') {
+            return false;
+        }
+        value = value * 10 + static_cast<unsigned long>(*str - '0');
+        if (value > max) {
+            return false; // Checking as we go means this can't overflow.
+        }
+    }
+    count = static_cast<unsigned int>(value);
+    return true;
+}
+
+/**
+ * Parses the name of an escape format, as given to --format.
+ * @param str A null-terminated string.
+ * @param format This is a return value. It's only modified if the parse succeeds.
+ * @return True if str is the name of a format, false otherwise.
+ */
+bool parse_format(const char *str, EscapeFormat& format) {
+    std::string name(str);
+    if (name == "rfc5137") {
+        format = EscapeFormat::Rfc5137;
+    } else if (name == "json") {
+        format = EscapeFormat::Json;
+    } else if (name == "braces") {
+        format = EscapeFormat::Braces;
+    } else if (name == "html") {
+        format = EscapeFormat::Html;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Parses the set of characters given to --preserve: a comma-separated list of items, each of
+ * which is added to the set (or, if it starts with "-", taken out of it) in order, starting
+ * from the empty set. See parse_preserve_item for the items.
+ * @param str A null-terminated string.
+ * @param set This is a return value. It's only modified if the parse succeeds.
+ * @return True if every item is valid, false otherwise.
+ */
+bool parse_preserve(const char *str, PreserveSet& set) {
+    std::string spec(str);
+    bool preserved[128] = {};
+    std::size_t start = 0;
+    while (true) {
+        std::size_t end = spec.find(',', start);
+        if (end == std::string::npos) {
+            end = spec.size();
+        }
+        std::string item = spec.substr(start, end - start);
+        // A lone "-" is the character itself, not an empty item that's taken out.
+        bool remove = item.size() > 1 && item[0] == '-';
+        if (remove) {
+            item.erase(0, 1);
+        }
+        bool bytes[128] = {};
+        if (!parse_preserve_item(item, bytes)) {
+            return false;
+        }
+        for (unsigned int byte = 0; byte < 128; ++byte) {
+            if (bytes[byte]) {
+                preserved[byte] = !remove;
+            }
+        }
+        if (end == spec.size()) {
+            break;
+        }
+        start = end + 1;
+    }
+    set = PreserveSet(preserved);
+    return true;
+}
+
+/**
+ * Parses one item of the list given to --preserve (see parse_preserve). An item is one of:
+ *   "default", the set that's passed through without --preserve (see is_passthrough);
+ *   "ascii", every ASCII character;
+ *   "none", no characters;
+ *   a single printable ASCII character, which stands for itself;
+ *   "0xHH", a byte given as 1 or 2 hex digits, which must be at most 0x7F; or
+ *   "0xHH-0xHH", the bytes from the first one to the second one.
+ * A comma can't be given as itself, since it separates the items, but it can be given as 0x2C.
+ * @param item The item, without any leading "-".
+ * @param bytes This is a return value. bytes[b] is set to true for every byte b in the item.
+ * @return True if the item is valid, false otherwise.
+ */
+bool parse_preserve_item(const std::string& item, bool (&bytes)[128]) {
+    if (item == "default" || item == "ascii" || item == "none") {
+        for (unsigned int byte = 0; byte < 128; ++byte) {
+            bytes[byte] = (item == "ascii") || (item == "default" && is_passthrough(static_cast<unsigned char>(byte)));
+        }
+        return true;
+    }
+    if (item.size() == 1) {
+        unsigned char c = static_cast<unsigned char>(item[0]);
+        if (c < 32 || c > 126) {
+            return false;
+        }
+        bytes[c] = true;
+        return true;
+    }
+    std::size_t dash = item.find('-');
+    unsigned int low;
+    unsigned int high;
+    if (dash == std::string::npos) {
+        if (!parse_hex_byte(item, low)) {
+            return false;
+        }
+        high = low;
+    } else if (!parse_hex_byte(item.substr(0, dash), low) || !parse_hex_byte(item.substr(dash + 1), high) || low > high) {
+        return false;
+    }
+    for (unsigned int byte = low; byte <= high; ++byte) {
+        bytes[byte] = true;
+    }
+    return true;
+}
+
+/**
+ * Parses an ASCII byte given as "0x" followed by 1 or 2 hex digits (in either case).
+ * @param str The string to parse.
+ * @param byte This is a return value. It's only modified if the parse succeeds.
+ * @return True if str has that form and its value is at most 0x7F, false otherwise.
+ */
+bool parse_hex_byte(const std::string& str, unsigned int& byte) {
+    if (str.size() < 3 || str.size() > 4 || str[0] != '0' || (str[1] != 'x' && str[1] != 'X')) {
+        return false;
+    }
+    unsigned int value = 0;
+    for (std::size_t i = 2; i < str.size(); ++i) {
+        char c = str[i];
+        unsigned int digit;
+        if ('0' <= c && c <= '9') {
+            digit = static_cast<unsigned int>(c - '0');
+        } else if ('a' <= c && c <= 'f') {
+            digit = static_cast<unsigned int>(c - 'a' + 10);
+        } else if ('A' <= c && c <= 'F') {
+            digit = static_cast<unsigned int>(c - 'A' + 10);
+        } else {
+            return false;
+        }
+        value = value * 16 + digit;
+    }
+    if (value > 0x7F) {
+        return false;
+    }
+    byte = value;
+    return true;
+}
+
 /**
  * Checks whether the given string begins with either "-o" or "--output=",
  * and whether it contains at least 1 character beyond that.
@@ -8,8 +8,13 @@
 
 #include <memory>
 #include <exception>
+#include <string>
+#include <vector>
 
 #include "StreamPair.h"
+#include "cpu_features.h" // KernelTier
+#include "escape_kernel.h" // EscapeFormat
+#include "preserve_set.h"
 
 class EarlyFinish : public std::exception {};
 
@@ -17,6 +22,70 @@ class InvalidCmd : public std::exception {};
 
 class WindowsIOError : public std::exception {};
 
+/**
+ * This holds the settings given on the command line, other than the input and output
+ * files (those go into the StreamPair). A default-constructed Options is what you get
+ * when no options are given.
+ */
+struct Options {
+    // The number of threads to escape with (--threads). 1 means the normal single-threaded
+    // path, and 0 means one thread per CPU core.
+    unsigned int threads;
+    // Whether to only check that the input is valid UTF-8 (--check), without writing any output.
+    bool check;
+    // Whether to turn escaped text back into UTF-8 (--decode) instead of escaping it.
+    bool decode;
+    // Whether to only print the number of bytes the escaped output would have (--measure),
+    // instead of the output itself.
+    bool measure;
+    // The format of the escape strings (--format).
+    EscapeFormat format;
+    // The ASCII characters that are passed through without escaping (--preserve).
+    PreserveSet preserve;
+    // Whether to reserve the disk space for the output file before writing it (--preallocate).
+    // See zero_copy.cpp.
+    bool preallocate;
+    // Whether to write out each line as soon as we have it (--line-buffered). See streaming.h.
+    bool line_buffered;
+    // The longest time in milliseconds that output may be held back (--max-latency-ms), or -1
+    // if there's no limit. See streaming.h.
+    long max_latency_ms;
+    // Whether to print statistics about the run to stderr at the end (--stats). See stats.h.
+    bool stats;
+    // The file to write the statistics to as JSON (--stats-file), or empty if not given.
+    std::string stats_file;
+    // Whether to use the scanning code in kernel (--kernel) instead of the best one for this
+    // CPU. See ascii_scan.h.
+    bool force_kernel;
+    KernelTier kernel;
+    // The socket to serve requests on (--serve), or empty if not given. See serve.h.
+    std::string serve_socket;
+    // The format to compress the output with (--compress), or None. See compression.h.
+    Compression compress;
+    // Whether to keep escaping what's added to the input file (--follow), and the file to keep
+    // our place in it in (--checkpoint), or empty if not given. See follow.h.
+    bool follow;
+    std::string checkpoint;
+
+    // Batch mode (--batch): escape many files in one process. See batch.h.
+    bool batch;
+    // The input files (and, with --recursive, directories) given on the command line. With
+    // --follow, this is INPUTFILE, which is opened again by name whenever it's rotated.
+    std::vector<std::string> inputs;
+    // A file with more inputs, one per line (--files-from). "-" means stdin. Empty if not given.
+    std::string files_from;
+    // Whether directories in the inputs are searched for files (--recursive).
+    bool recursive;
+    // Where the outputs go: either under a directory (--output-dir), or next to each input
+    // with a suffix added to the name (--suffix), or over the input itself (--in-place).
+    // Exactly one of these is given in batch mode. See in_place.h for the last one.
+    std::string output_dir;
+    std::string suffix;
+    bool in_place;
+
+    Options() : threads(1), check(false), decode(false), measure(false), format(EscapeFormat::Rfc5137), preallocate(false), line_buffered(false), max_latency_ms(-1), stats(false), force_kernel(false), kernel(KernelTier::Scalar), compress(Compression::None), follow(false), batch(false), recursive(false), in_place(false) {}
+};
+
 /**
  * This is a high-level function that parses command-line arguments, checks
  * that the arguments are well-formed, does error handling, and opens any
@@ -33,11 +102,15 @@ class WindowsIOError : public std::exception {};
  * function will throw a WindowsIOError exception. This can only happen on Windows.
  *
  * Otherwise, this function will succeed and return the input and output streams
- * to be used in the rest of the program.
+ * to be used in the rest of the program, with a decompressor in front of the input if
+ * it's compressed and a compressor in front of the output with --compress. In batch mode, those are always stdin and stdout,
+ * and the files to escape are in options.inputs instead.
  * @param argc The argc value from main().
  * @param argv The argv value from main().
- * @return A pair of a std::istream and a std::ostream. The istream might be from
- * stdin or from a file; the ostream might be for stdout or for a file.
+ * @param options This is a return value. Any options given on the command line are stored
+ * in it; options that weren't given are left alone.
+ * @return A pair of a ByteSource and a ByteSink. The source might be from
+ * stdin or from a file; the sink might be for stdout or for a file.
  * The details of where the streams point to are not relevant for the
  * caller; the caller should just treat these as streams of bytes.
  * @throws As discussed above, this function can throw an EarlyFinish exception,
@@ -48,6 +121,6 @@ class WindowsIOError : public std::exception {};
  * For FileError, InvalidCmd, or WindowsIOError, the caller should clean up and
  * exit the program with nonzero exit status; this is considered an error.
  */
-StreamPair parse(int argc, char **argv);
+StreamPair parse(int argc, char **argv, Options& options);
 
 #endif //ESCAPE_UTF8_PARSEARGS_H
@@ -0,0 +1,62 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <cstring> // std::memset
+
+#include "preserve_set.h"
+#include "ascii_scan.h"
+
+PreserveSet::PreserveSet() {
+    for (unsigned int byte = 0; byte < 256; ++byte) {
+        table[byte] = is_passthrough(static_cast<unsigned char>(byte)) ? 1 : 0;
+    }
+    build();
+}
+
+PreserveSet::PreserveSet(const bool (&preserved)[128]) {
+    std::memset(table, 0, sizeof(table));
+    for (unsigned int byte = 0; byte < 128; ++byte) {
+        table[byte] = preserved[byte] ? 1 : 0;
+    }
+    build();
+}
+
+void PreserveSet::build() {
+    std::memset(low_masks, 0, sizeof(low_masks));
+    std::memset(high_bits, 0, sizeof(high_bits));
+    std::memset(pairs, 0, sizeof(pairs));
+    for (unsigned int high = 0; high < 8; ++high) {
+        high_bits[high] = static_cast<unsigned char>(1u << high);
+    }
+    default_set = true;
+    range_count = 0;
+    bool in_range = false;
+    for (unsigned int byte = 0; byte < 128; ++byte) {
+        bool preserved = table[byte] != 0;
+        if (preserved) {
+            low_masks[byte & 0xFu] = static_cast<unsigned char>(low_masks[byte & 0xFu] | (1u << (byte >> 4u)));
+        }
+        if (preserved != is_passthrough(static_cast<unsigned char>(byte))) {
+            default_set = false;
+        }
+        // A range starts at every preserved byte that comes after one that isn't. We keep
+        // counting past MAX_RANGES, but only store the first MAX_RANGES of them.
+        if (preserved && !in_range) {
+            if (range_count < MAX_RANGES) {
+                low_ends[range_count] = static_cast<unsigned char>(byte);
+            }
+            ++range_count;
+        }
+        if (preserved && range_count <= MAX_RANGES) {
+            high_ends[range_count - 1] = static_cast<unsigned char>(byte);
+        }
+        in_range = preserved;
+    }
+    for (std::size_t k = 0; k < MAX_RANGES && k < range_count; ++k) {
+        std::memset(vectors[k], low_ends[k] - 1, 16); // 0xFF (-1) if the range starts at 0
+        std::memset(vectors[k + MAX_RANGES], high_ends[k], 16);
+        pairs[2 * k] = low_ends[k];
+        pairs[2 * k + 1] = high_ends[k];
+    }
+}
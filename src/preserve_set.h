@@ -0,0 +1,100 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_PRESERVE_SET_H
+#define ESCAPE_UTF8_PRESERVE_SET_H
+
+#include <cstddef> // std::size_t
+
+/**
+ * The set of ASCII bytes that are passed through to the output unchanged (--preserve).
+ * Every other ASCII byte gets escaped. Bytes from 128 up are never in the set, since
+ * they're always part of a multi-byte UTF-8 character.
+ *
+ * A PreserveSet can't be changed after it's constructed. The constructor works out
+ * everything the SIMD code needs to classify bytes against the set (see preserve_set.cpp),
+ * so that only happens once, at startup, and a custom set is as cheap to scan for as the
+ * default one.
+ */
+class PreserveSet {
+public:
+    // The most ranges that the SSE2 code checks for one at a time; see ranges() below.
+    static const std::size_t MAX_RANGES = 8;
+
+    /**
+     * Constructs the default set: the printable characters [32, 126] plus tab (9),
+     * line feed (10) and carriage return (13). See is_passthrough in ascii_scan.h.
+     */
+    PreserveSet();
+
+    /**
+     * Constructs the set of the ASCII bytes b for which preserved[b] is true.
+     */
+    explicit PreserveSet(const bool (&preserved)[128]);
+
+    /**
+     * Returns whether the given byte is passed through unchanged.
+     */
+    bool contains(unsigned char byte) const { return table[byte] != 0; }
+
+    /**
+     * Returns whether this is the same set as the default one. The default set has its
+     * own hard-coded scanning code, which is a little faster than the general code.
+     */
+    bool is_default() const { return default_set; }
+
+    /**
+     * These two tables are for a lookup with PSHUFB. Split a byte b into its low nibble
+     * (b & 0xF) and its high nibble (b >> 4). Then b is in the set if and only if
+     *     low_nibble_masks()[b & 0xF] & high_nibble_bits()[b >> 4]
+     * is nonzero. Bit h of low_nibble_masks()[l] says whether the byte (h << 4) | l is in
+     * the set, and high_nibble_bits()[h] is 1 << h for h < 8 and 0 for the non-ASCII bytes.
+     */
+    const unsigned char *low_nibble_masks() const { return low_masks; }
+    const unsigned char *high_nibble_bits() const { return high_bits; }
+
+    /**
+     * The set as a list of ranges [range_lows()[k], range_highs()[k]] of consecutive bytes,
+     * in increasing order. This is for SSE2, which doesn't have PSHUFB but can check a range
+     * with two comparisons. Only valid if fits_in_ranges() is true, i.e. the set is made
+     * up of at most MAX_RANGES ranges.
+     */
+    bool fits_in_ranges() const { return range_count <= MAX_RANGES; }
+    std::size_t num_ranges() const { return range_count; }
+    const unsigned char *range_lows() const { return low_ends; }
+    const unsigned char *range_highs() const { return high_ends; }
+
+    /**
+     * The same ranges, ready to be loaded into SSE2 registers: row k of range_vectors() is
+     * 16 copies of range_lows()[k] - 1 (as a signed char), and row k + MAX_RANGES is 16
+     * copies of range_highs()[k]. Setting these up for every call would cost more than the
+     * comparisons themselves when the runs of pass-through bytes are short.
+     */
+    const unsigned char (*range_vectors() const)[16] { return vectors; }
+
+    /**
+     * The same ranges again, as the pairs range_lows()[0], range_highs()[0], range_lows()[1],
+     * ... in 16 bytes, with zeros after the last pair. This is how PCMPESTRI (SSE4.2) takes a
+     * list of ranges, so it can check a byte against all of them in one instruction.
+     */
+    const unsigned char *range_pairs() const { return pairs; }
+
+private:
+    /**
+     * Fills in everything other than table from table.
+     */
+    void build();
+
+    unsigned char table[256];
+    unsigned char low_masks[16];
+    unsigned char high_bits[16];
+    unsigned char low_ends[MAX_RANGES];
+    unsigned char high_ends[MAX_RANGES];
+    unsigned char vectors[2 * MAX_RANGES][16];
+    unsigned char pairs[2 * MAX_RANGES];
+    std::size_t range_count;
+    bool default_set;
+};
+
+#endif //ESCAPE_UTF8_PRESERVE_SET_H
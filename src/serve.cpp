@@ -0,0 +1,473 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include "serve.h"
+
+#ifdef __linux__
+
+#include <algorithm> // std::max
+#include <cerrno>
+#include <cstdint> // uint_fast32_t
+#include <cstring> // std::memcpy, std::memset
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "stop_signal.h"
+
+/*
+ * IMPLEMENTATION NOTES
+ * Connections:
+ *   Every socket is nonblocking and the epoll interest is level-triggered. Each time a
+ *   connection is readable we do one read of up to READ_SIZE bytes, so that one busy client
+ *   can't keep the others waiting, and then escape every complete request in the input
+ *   buffer straight into the output buffer, and send as much of the output as the socket
+ *   will take. Whatever it won't take is sent when epoll says the socket is writable again.
+ *
+ * Backpressure:
+ *   A client that sends requests and never reads the responses would make us buffer output
+ *   without limit. So once a connection has MAX_PENDING_OUTPUT bytes of output waiting, we
+ *   stop escaping its requests, and stop reading from it, until it has read some of it.
+ *
+ * Buffers:
+ *   Buffer is a simple byte queue that doesn't zero its memory when it grows (std::vector
+ *   would, and for a 64 KB read that's as much work as escaping it). A request is only
+ *   escaped once all of it is in the input buffer, which saves keeping an EscapeState per
+ *   connection, and a request can't be longer than SERVE_MAX_REQUEST anyway.
+ *   When a connection closes, its Connection goes into a pool with its buffers, so the next
+ *   connection doesn't have to allocate any. Buffers that grew past MAX_POOLED_CAPACITY for
+ *   a big request are freed instead, so one big request doesn't tie up memory forever.
+ *
+ * Stopping:
+ *   SIGINT and SIGTERM write a byte to a pipe (the "self-pipe trick"; see stop_signal.h), and
+ *   the read end of the pipe is in the epoll set like everything else. The tests use their own pipe.
+ *   Writes use send() with MSG_NOSIGNAL, so a client that goes away doesn't kill the server
+ *   with SIGPIPE.
+ */
+
+namespace {
+
+const std::size_t REQUEST_HEADER_SIZE = 4;
+const std::size_t RESPONSE_HEADER_SIZE = 5;
+// How much we read from a connection at a time.
+const std::size_t READ_SIZE = 65536;
+// See "Backpressure" above.
+const std::size_t MAX_PENDING_OUTPUT = 4 * 1024 * 1024;
+// See "Buffers" above.
+const std::size_t MAX_POOLED_CAPACITY = 1024 * 1024;
+const std::size_t MAX_POOLED_CONNECTIONS = 256;
+// The most events we handle per call to epoll_wait.
+const int MAX_EVENTS = 64;
+
+/**
+ * A queue of bytes: data is added at the end and taken from the front. See "Buffers" above.
+ */
+class Buffer {
+public:
+    Buffer() : capacity(0), begin(0), end(0) {}
+
+    unsigned char *data() { return bytes.get() + begin; }
+    std::size_t size() const { return end - begin; }
+    std::size_t allocated() const { return capacity; }
+
+    /**
+     * Makes room for at least n more bytes at the end.
+     * @return A pointer to the room. Call commit() with the number of bytes written there.
+     */
+    unsigned char *reserve(std::size_t n) {
+        if (capacity - end >= n) {
+            return bytes.get() + end;
+        }
+        const std::size_t len = size();
+        if (capacity - len >= n && len <= begin) {
+            // There's enough room if we move the data to the front, and that's cheap.
+            std::memcpy(bytes.get(), bytes.get() + begin, len);
+        } else {
+            std::size_t new_capacity = std::max(std::max(2 * capacity, len + n), static_cast<std::size_t>(4096));
+            std::unique_ptr<unsigned char[]> new_bytes(new unsigned char[new_capacity]);
+            if (len > 0) {
+                std::memcpy(new_bytes.get(), bytes.get() + begin, len);
+            }
+            bytes = std::move(new_bytes);
+            capacity = new_capacity;
+        }
+        begin = 0;
+        end = len;
+        return bytes.get() + end;
+    }
+
+    void commit(std::size_t n) { end += n; }
+
+    /**
+     * Takes n bytes off the front.
+     */
+    void consume(std::size_t n) {
+        begin += n;
+        if (begin == end) {
+            begin = end = 0;
+        }
+    }
+
+    void clear() { begin = end = 0; }
+
+    /**
+     * Frees the memory.
+     */
+    void release() {
+        bytes.reset();
+        capacity = begin = end = 0;
+    }
+
+private:
+    std::unique_ptr<unsigned char[]> bytes;
+    std::size_t capacity;
+    std::size_t begin;
+    std::size_t end;
+};
+
+struct Connection {
+    int fd;
+    Buffer in;
+    Buffer out;
+    // False once the client has finished sending, or once we've stopped listening to it
+    // because it sent a request that's too long.
+    bool reading;
+    // The events that epoll is watching for.
+    std::uint32_t events;
+};
+
+std::uint_fast32_t get_u32(const unsigned char *p) {
+    return (static_cast<std::uint_fast32_t>(p[0]) << 24) | (static_cast<std::uint_fast32_t>(p[1]) << 16) |
+           (static_cast<std::uint_fast32_t>(p[2]) << 8) | static_cast<std::uint_fast32_t>(p[3]);
+}
+
+void put_u32(unsigned char *p, std::uint_fast32_t value) {
+    p[0] = static_cast<unsigned char>(value >> 24);
+    p[1] = static_cast<unsigned char>(value >> 16);
+    p[2] = static_cast<unsigned char>(value >> 8);
+    p[3] = static_cast<unsigned char>(value);
+}
+
+class Server {
+public:
+    Server(int epoll_fd, const EscapeSettings& settings) : epoll_fd(epoll_fd), settings(settings) {}
+
+    ~Server() {
+        for (std::unique_ptr<Connection>& conn : connections) {
+            if (conn) {
+                close(conn->fd);
+            }
+        }
+    }
+
+    /**
+     * Accepts every connection that's waiting on listen_fd.
+     */
+    void accept_all(int listen_fd) {
+        while (true) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                return; // EAGAIN, or we're out of file descriptors and will try again later.
+            }
+            std::unique_ptr<Connection> conn;
+            if (!pool.empty()) {
+                conn = std::move(pool.back());
+                pool.pop_back();
+            } else {
+                conn.reset(new Connection());
+            }
+            conn->fd = fd;
+            conn->reading = true;
+            conn->events = EPOLLIN;
+            epoll_event event;
+            event.events = conn->events;
+            event.data.fd = fd;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+                close(fd);
+                continue;
+            }
+            if (connections.size() <= static_cast<std::size_t>(fd)) {
+                connections.resize(static_cast<std::size_t>(fd) + 1);
+            }
+            connections[static_cast<std::size_t>(fd)] = std::move(conn);
+        }
+    }
+
+    /**
+     * Does whatever there is to do on a connection that epoll says is ready.
+     */
+    void handle(int fd, std::uint32_t events) {
+        if (static_cast<std::size_t>(fd) >= connections.size() || !connections[static_cast<std::size_t>(fd)]) {
+            return;
+        }
+        Connection& conn = *connections[static_cast<std::size_t>(fd)];
+        if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && conn.reading && !read_some(conn)) {
+            drop(conn);
+            return;
+        }
+        while (true) {
+            escape_requests(conn);
+            if (!send_some(conn)) {
+                drop(conn);
+                return;
+            }
+            // If the output was held back and has all been sent now, there may be more
+            // requests waiting to be escaped.
+            if (conn.out.size() > 0 || !has_request(conn)) {
+                break;
+            }
+        }
+        if (!conn.reading && conn.out.size() == 0) {
+            drop(conn);
+            return;
+        }
+        std::uint32_t wanted = 0;
+        if (conn.reading && conn.out.size() < MAX_PENDING_OUTPUT) {
+            wanted |= EPOLLIN;
+        }
+        if (conn.out.size() > 0) {
+            wanted |= EPOLLOUT;
+        }
+        if (wanted != conn.events) {
+            epoll_event event;
+            event.events = wanted;
+            event.data.fd = conn.fd;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &event) != 0) {
+                drop(conn);
+                return;
+            }
+            conn.events = wanted;
+        }
+    }
+
+private:
+    /**
+     * Reads once from the connection.
+     * @return False if there was an error and the connection should be closed.
+     */
+    bool read_some(Connection& conn) {
+        unsigned char *room = conn.in.reserve(READ_SIZE);
+        ssize_t n = read(conn.fd, room, READ_SIZE);
+        if (n < 0) {
+            return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        if (n == 0) {
+            conn.reading = false; // Whatever is left of an unfinished request is thrown away.
+        }
+        conn.in.commit(static_cast<std::size_t>(n));
+        return true;
+    }
+
+    /**
+     * Returns whether there's a whole request (or a request that's too long) in the input buffer.
+     */
+    static bool has_request(Connection& conn) {
+        if (conn.in.size() < REQUEST_HEADER_SIZE) {
+            return false;
+        }
+        std::uint_fast32_t len = get_u32(conn.in.data());
+        return len > SERVE_MAX_REQUEST || conn.in.size() - REQUEST_HEADER_SIZE >= len;
+    }
+
+    /**
+     * Escapes the complete requests in the input buffer into the output buffer, until there's
+     * too much output waiting.
+     */
+    void escape_requests(Connection& conn) {
+        while (conn.out.size() < MAX_PENDING_OUTPUT && has_request(conn)) {
+            std::uint_fast32_t len = get_u32(conn.in.data());
+            if (len > SERVE_MAX_REQUEST) {
+                unsigned char *response = conn.out.reserve(RESPONSE_HEADER_SIZE);
+                response[0] = SERVE_TOO_LONG;
+                put_u32(response + 1, 0);
+                conn.out.commit(RESPONSE_HEADER_SIZE);
+                conn.in.clear();
+                conn.reading = false;
+                break;
+            }
+            unsigned char *response = conn.out.reserve(RESPONSE_HEADER_SIZE + escape_output_bound(len, settings.format));
+            EscapeState state;
+            std::size_t written = escape_block(state, conn.in.data() + REQUEST_HEADER_SIZE, len, response + RESPONSE_HEADER_SIZE,
+                                               settings);
+            response[0] = (state.invalid || !state.at_boundary()) ? SERVE_INVALID_UTF8 : SERVE_OK;
+            put_u32(response + 1, static_cast<std::uint_fast32_t>(written));
+            conn.out.commit(RESPONSE_HEADER_SIZE + written);
+            conn.in.consume(REQUEST_HEADER_SIZE + len);
+        }
+        if (conn.reading && conn.in.size() >= REQUEST_HEADER_SIZE) {
+            // Make room for the rest of the request now, so it doesn't have to be moved
+            // again every time part of it arrives.
+            std::size_t needed = REQUEST_HEADER_SIZE + get_u32(conn.in.data());
+            if (needed <= REQUEST_HEADER_SIZE + SERVE_MAX_REQUEST && needed > conn.in.size()) {
+                conn.in.reserve(needed - conn.in.size());
+            }
+        }
+    }
+
+    /**
+     * Sends as much of the output buffer as the socket will take.
+     * @return False if there was an error and the connection should be closed.
+     */
+    static bool send_some(Connection& conn) {
+        while (conn.out.size() > 0) {
+            ssize_t n = send(conn.fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            conn.out.consume(static_cast<std::size_t>(n));
+        }
+        return true;
+    }
+
+    /**
+     * Closes a connection and puts it in the pool.
+     */
+    void drop(Connection& conn) {
+        const std::size_t fd = static_cast<std::size_t>(conn.fd);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        close(conn.fd);
+        std::unique_ptr<Connection> released = std::move(connections[fd]);
+        if (pool.size() < MAX_POOLED_CONNECTIONS) {
+            released->in.clear();
+            released->out.clear();
+            if (released->in.allocated() > MAX_POOLED_CAPACITY) {
+                released->in.release();
+            }
+            if (released->out.allocated() > MAX_POOLED_CAPACITY) {
+                released->out.release();
+            }
+            pool.push_back(std::move(released));
+        }
+    }
+
+    int epoll_fd;
+    const EscapeSettings& settings;
+    // The open connections, by file descriptor.
+    std::vector<std::unique_ptr<Connection>> connections;
+    std::vector<std::unique_ptr<Connection>> pool;
+};
+
+} // namespace
+
+int open_serve_socket(const std::string& path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "The socket path \"" << path << "\" is too long. Exiting now." << std::endl;
+        return -1;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    const sockaddr *address = reinterpret_cast<const sockaddr *>(&addr);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "Failed to create the socket \"" << path << "\". Exiting now." << std::endl;
+        return -1;
+    }
+    int result = bind(fd, address, sizeof(addr));
+    if (result != 0 && errno == EADDRINUSE) {
+        // If it's a socket that nothing is listening on, it was left behind by a server that
+        // didn't get to clean up, and we can take its place.
+        struct stat info;
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe >= 0 && lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode) &&
+            connect(probe, address, sizeof(addr)) != 0 && errno == ECONNREFUSED) {
+            unlink(path.c_str());
+            result = bind(fd, address, sizeof(addr));
+        } else {
+            errno = EADDRINUSE;
+        }
+        if (probe >= 0) {
+            close(probe);
+        }
+    }
+    if (result != 0 || listen(fd, SOMAXCONN) != 0) {
+        if (errno == EADDRINUSE) {
+            std::cerr << "Something is already using \"" << path << "\". Exiting now." << std::endl;
+        } else {
+            std::cerr << "Failed to create the socket \"" << path << "\". Exiting now." << std::endl;
+        }
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve(int listen_fd, const EscapeSettings& settings, int stop_fd) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    bool ok = (epoll_fd >= 0);
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd;
+    ok = ok && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) == 0;
+    if (ok && stop_fd >= 0) {
+        event.data.fd = stop_fd;
+        ok = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &event) == 0;
+    }
+
+    bool stopping = false;
+    {
+        Server server(epoll_fd, settings);
+        epoll_event events[MAX_EVENTS];
+        while (ok && !stopping) {
+            int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+            if (n < 0) {
+                ok = (errno == EINTR);
+                continue;
+            }
+            for (int k = 0; k < n; ++k) {
+                int fd = events[k].data.fd;
+                if (fd == stop_fd) {
+                    stopping = true;
+                } else if (fd == listen_fd) {
+                    server.accept_all(listen_fd);
+                } else {
+                    server.handle(fd, events[k].events);
+                }
+            }
+        }
+    }
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+    }
+    close(listen_fd);
+    if (!ok) {
+        std::cerr << "There was a fatal error when waiting for connections. Exiting now." << std::endl;
+        return 3;
+    }
+    return 0;
+}
+
+int serve_until_signalled(const std::string& path, const EscapeSettings& settings) {
+    int listen_fd = open_serve_socket(path);
+    if (listen_fd < 0) {
+        return 1;
+    }
+    StopSignalPipe stop;
+    if (!stop.ok()) {
+        std::cerr << "There was a fatal error when waiting for connections. Exiting now." << std::endl;
+        close(listen_fd);
+        unlink(path.c_str());
+        return 3;
+    }
+    int retval = serve(listen_fd, settings, stop.fd());
+    unlink(path.c_str());
+    return retval;
+}
+
+#endif
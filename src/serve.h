@@ -0,0 +1,83 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_SERVE_H
+#define ESCAPE_UTF8_SERVE_H
+
+#include <cstddef> // std::size_t
+#include <string>
+
+#include "escape_kernel.h" // EscapeSettings
+
+/*
+ * This is --serve: a server that stays running and escapes text for other processes, over a
+ * Unix domain socket. For small inputs, starting the escape program costs far more than the
+ * escaping (loading it, setting up the streams, opening the files), so a program that needs
+ * to escape a lot of small pieces of text should keep one server running and send it each
+ * piece instead. See serve_client.h for the other end.
+ *
+ * The protocol:
+ *   A client connects to the socket and sends any number of requests, one after another,
+ *   without waiting for the responses if it likes. Each request is the length of the input
+ *   as a 4-byte big-endian number, followed by the input. The input is escaped with the
+ *   --format and --preserve that the server was started with.
+ *   For each request, in order, the server sends back a response: a 1-byte status, the
+ *   length of the output as a 4-byte big-endian number, and the output. The status is the
+ *   exit code that the escape program would have had for the same input:
+ *     0  The output is the escaped input.
+ *     2  The input isn't valid UTF-8. The output is everything before the first invalid
+ *        character, like the escape program writes.
+ *     5  The request is longer than SERVE_MAX_REQUEST bytes. There's no output, and the
+ *        server closes the connection after sending this, since it won't read the input.
+ *
+ * The server is one thread, which waits on all of the connections at once with epoll. Each
+ * connection has an input and an output buffer that are reused from one request to the
+ * next, and when it closes they go back into a pool for the next connection to use, so a
+ * request for a small input doesn't allocate any memory at all.
+ *
+ * This is only implemented for Linux.
+ */
+
+// The longest input that one request can have.
+const std::size_t SERVE_MAX_REQUEST = 16 * 1024 * 1024;
+
+// The statuses in the responses; see above.
+const unsigned char SERVE_OK = 0;
+const unsigned char SERVE_INVALID_UTF8 = 2;
+const unsigned char SERVE_TOO_LONG = 5;
+
+#ifdef __linux__
+
+/**
+ * Creates the server's socket and starts listening on it. If there's already a socket file at
+ * path that no server is listening on (because the last server was killed), it's replaced.
+ * @param path Where to create the socket.
+ * @return The socket's file descriptor, or -1 if it couldn't be created, in which case an
+ * error message has been printed.
+ */
+int open_serve_socket(const std::string& path);
+
+/**
+ * Runs the server until stop_fd becomes readable or hangs up. The listening socket is closed
+ * before this returns, but the socket file isn't removed; see serve_until_signalled.
+ * @param listen_fd A socket from open_serve_socket.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * @param stop_fd A file descriptor, such as the read end of a pipe, that becomes readable
+ * when it's time to stop. -1 means never.
+ * @return 0, or 3 if epoll failed, in which case an error message has been printed.
+ */
+int serve(int listen_fd, const EscapeSettings& settings, int stop_fd = -1);
+
+/**
+ * This is --serve: it creates the socket at path, runs the server until SIGINT or SIGTERM,
+ * and then removes the socket file.
+ * @param path Where to create the socket.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * @return 0 after a signal, 1 if the socket couldn't be created, or 3 if epoll failed.
+ */
+int serve_until_signalled(const std::string& path, const EscapeSettings& settings);
+
+#endif
+
+#endif //ESCAPE_UTF8_SERVE_H
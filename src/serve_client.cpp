@@ -0,0 +1,123 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include "serve_client.h"
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstdint> // uint_fast32_t
+#include <cstring> // std::memcpy, std::memset
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "serve.h" // SERVE_MAX_REQUEST
+
+std::unique_ptr<ServeClient> ServeClient::connect(const std::string& path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        return nullptr;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    return std::unique_ptr<ServeClient>(new ServeClient(fd));
+}
+
+ServeClient::~ServeClient() {
+    close(fd);
+}
+
+bool ServeClient::send_request(const unsigned char *data, std::size_t len) {
+    if (len > SERVE_MAX_REQUEST) {
+        // It would be refused anyway, and the length might not fit in the header.
+        return false;
+    }
+    unsigned char header[4];
+    header[0] = static_cast<unsigned char>(len >> 24);
+    header[1] = static_cast<unsigned char>(len >> 16);
+    header[2] = static_cast<unsigned char>(len >> 8);
+    header[3] = static_cast<unsigned char>(len);
+    // The header and the input go out together, in one call if the socket will take them.
+    iovec pieces[2];
+    pieces[0].iov_base = header;
+    pieces[0].iov_len = sizeof(header);
+    pieces[1].iov_base = const_cast<unsigned char *>(data);
+    pieces[1].iov_len = len;
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = pieces;
+    message.msg_iovlen = 2;
+    while (message.msg_iovlen > 0) {
+        ssize_t n = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        std::size_t sent = static_cast<std::size_t>(n);
+        while (message.msg_iovlen > 0 && sent >= message.msg_iov[0].iov_len) {
+            sent -= message.msg_iov[0].iov_len;
+            ++message.msg_iov;
+            --message.msg_iovlen;
+        }
+        if (message.msg_iovlen > 0) {
+            message.msg_iov[0].iov_base = static_cast<unsigned char *>(message.msg_iov[0].iov_base) + sent;
+            message.msg_iov[0].iov_len -= sent;
+        }
+    }
+    return true;
+}
+
+/**
+ * Reads exactly len bytes from fd.
+ * @return False if there was an error, or the connection was closed first.
+ */
+static bool read_exactly(int fd, unsigned char *data, std::size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool ServeClient::receive_response(int& status, std::string& output) {
+    unsigned char header[5];
+    if (!read_exactly(fd, header, sizeof(header))) {
+        return false;
+    }
+    status = header[0];
+    std::uint_fast32_t len = (static_cast<std::uint_fast32_t>(header[1]) << 24) |
+                             (static_cast<std::uint_fast32_t>(header[2]) << 16) |
+                             (static_cast<std::uint_fast32_t>(header[3]) << 8) | static_cast<std::uint_fast32_t>(header[4]);
+    output.resize(len);
+    // Writing through &output[0] is fine: a std::string's characters are contiguous since C++11.
+    return len == 0 || read_exactly(fd, reinterpret_cast<unsigned char *>(&output[0]), len);
+}
+
+bool ServeClient::escape(const std::string& input, int& status, std::string& output) {
+    return send_request(reinterpret_cast<const unsigned char *>(input.data()), input.size()) &&
+           receive_response(status, output);
+}
+
+#endif
@@ -0,0 +1,71 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_SERVE_CLIENT_H
+#define ESCAPE_UTF8_SERVE_CLIENT_H
+
+#include <cstddef> // std::size_t
+#include <memory>
+#include <string>
+
+#ifdef __linux__
+
+/**
+ * The client end of --serve (see serve.h for the protocol): one connection to a server,
+ * which can be used for any number of requests.
+ *
+ * Usage:
+ *   Call ServeClient::connect(). If it returns null, there's no server at that path.
+ *   Otherwise call escape() for each input. To have several requests in flight at once,
+ *   call send_request() for each of them and then receive_response() the same number of
+ *   times; the responses come back in the same order as the requests.
+ *
+ * The calls block until they're done. If one of them fails, the server has gone away (or
+ * closed the connection after a request that was too long), and the ServeClient can't be
+ * used any more.
+ */
+class ServeClient {
+public:
+    /**
+     * Connects to the server listening at path.
+     * @return The connection, or null if it couldn't be made.
+     */
+    static std::unique_ptr<ServeClient> connect(const std::string& path);
+
+    ~ServeClient();
+    ServeClient(const ServeClient&) = delete;
+    ServeClient& operator=(const ServeClient&) = delete;
+
+    /**
+     * Sends a request to escape data[0..len). len must be at most SERVE_MAX_REQUEST, or the
+     * server will refuse it.
+     * @return False if the request couldn't be sent.
+     */
+    bool send_request(const unsigned char *data, std::size_t len);
+
+    /**
+     * Waits for the response to the oldest request that hasn't had one yet.
+     * @param status This is a return value: the status, which is one of the exit codes of
+     * the escape program (see serve.h).
+     * @param output This is a return value: the escaped output. Its old contents are replaced.
+     * @return False if the response couldn't be read, in which case status and output are
+     * meaningless.
+     */
+    bool receive_response(int& status, std::string& output);
+
+    /**
+     * Sends one request and waits for its response.
+     * The parameters and the return value are those of send_request and receive_response.
+     */
+    bool escape(const std::string& input, int& status, std::string& output);
+
+private:
+    explicit ServeClient(int fd) : fd(fd) {}
+
+    int fd;
+};
+
+#endif
+
+#endif //ESCAPE_UTF8_SERVE_CLIENT_H
@@ -0,0 +1,77 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <iomanip>
+
+#include "stats.h"
+#include "ascii_scan.h" // active_kernel_tier
+
+EscapeStats::EscapeStats() :
+        bytes_in(0), bytes_out(0), passed_through(0), escaped(), phase_seconds(), total_seconds(0),
+        kernel(KernelTier::Scalar), start(Clock::now()), last(start) {}
+
+void EscapeStats::lap(Phase phase) {
+    Clock::time_point now = Clock::now();
+    phase_seconds[static_cast<int>(phase)] += std::chrono::duration<double>(now - last).count();
+    last = now;
+}
+
+void EscapeStats::finish(const EscapeState& state) {
+    total_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    bytes_in = state.num_bytes_read;
+    kernel = active_kernel_tier();
+    std::uint_fast64_t escaped_bytes = 0;
+    for (int k = 0; k < 4; ++k) {
+        escaped[k] = state.num_escaped[k];
+        escaped_bytes += (k + 1) * escaped[k];
+    }
+    // Every byte is either passed through or part of an escaped character. The only exceptions
+    // are a character that the input stopped in the middle of, and the byte that made the
+    // input invalid, and we don't bother with those.
+    passed_through = (bytes_in > escaped_bytes) ? bytes_in - escaped_bytes : 0;
+}
+
+/**
+ * Returns the throughput in MB (10^6 bytes) of input per second.
+ */
+static double megabytes_per_second(std::uint_fast64_t bytes, double seconds) {
+    return (seconds > 0) ? static_cast<double>(bytes) / 1e6 / seconds : 0;
+}
+
+void EscapeStats::print(std::ostream& out) const {
+    std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3)
+        << "Bytes in:              " << bytes_in << '\n'
+        << "Bytes out:             " << bytes_out << '\n'
+        << "ASCII passed through:  " << passed_through << '\n'
+        << "ASCII escaped:         " << escaped[0] << '\n'
+        << "2-byte characters:     " << escaped[1] << '\n'
+        << "3-byte characters:     " << escaped[2] << '\n'
+        << "4-byte characters:     " << escaped[3] << '\n'
+        << "Time:                  " << total_seconds << " s (read " << phase_seconds[0]
+        << " s, escape " << phase_seconds[1] << " s, write " << phase_seconds[2] << " s)\n"
+        << std::setprecision(1)
+        << "Throughput:            " << megabytes_per_second(bytes_in, total_seconds) << " MB/s\n"
+        << "Kernel:                " << kernel_tier_name(kernel) << std::endl;
+    out.flags(flags);
+}
+
+void EscapeStats::write_json(std::ostream& out) const {
+    std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(6)
+        << "{\"bytes_in\": " << bytes_in
+        << ", \"bytes_out\": " << bytes_out
+        << ", \"ascii_passed_through\": " << passed_through
+        << ", \"ascii_escaped\": " << escaped[0]
+        << ", \"two_byte_chars\": " << escaped[1]
+        << ", \"three_byte_chars\": " << escaped[2]
+        << ", \"four_byte_chars\": " << escaped[3]
+        << ", \"read_seconds\": " << phase_seconds[0]
+        << ", \"escape_seconds\": " << phase_seconds[1]
+        << ", \"write_seconds\": " << phase_seconds[2]
+        << ", \"total_seconds\": " << total_seconds
+        << ", \"mb_per_second\": " << megabytes_per_second(bytes_in, total_seconds)
+        << ", \"kernel\": \"" << kernel_tier_name(kernel) << "\"}\n";
+    out.flags(flags);
+}
@@ -0,0 +1,122 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_STATS_H
+#define ESCAPE_UTF8_STATS_H
+
+#include <chrono>
+#include <cstdint> // uint_fast64_t
+#include <ostream>
+
+#include "cpu_features.h" // KernelTier
+#include "escape_kernel.h" // EscapeState
+
+/*
+ * This is what --stats reports about a run: how many bytes went in and out, what kind of
+ * characters they were, and where the time went.
+ *
+ * The character counts come from the EscapeState, which escape_block keeps up to date
+ * anyway (see num_escaped), so counting costs one increment per escaped character. Everything
+ * else is counted once per block: the bytes written, and the time since the last block,
+ * which goes to whichever phase the caller says it was spent in. That's a clock read per
+ * phase per block, or a few for every 64 KB of input.
+ *
+ * The phases are the time that the thread doing the escaping spent in each one. With
+ * overlapped I/O (see BlockIO.h) the reads and writes mostly happen while we escape, so
+ * the read and write times are the time spent waiting for them, not how long they took.
+ * Likewise with --threads, the escape time is the time spent waiting for the workers.
+ */
+
+enum class Phase { Read, Escape, Write };
+
+class EscapeStats {
+public:
+    /**
+     * Starts the clock. Everything up to the first lap counts toward that lap's phase.
+     */
+    EscapeStats();
+
+    /**
+     * Adds the time since the last lap (or since the clock started) to the given phase.
+     */
+    void lap(Phase phase);
+
+    /**
+     * Counts len bytes of output.
+     */
+    void add_output(std::uint_fast64_t len) { bytes_out += len; }
+
+    /**
+     * Stops the clock, and takes the input size and the character counts from the state,
+     * and the kernel tier from active_kernel_tier().
+     * This is called at the end of a run; see StatsScope.
+     */
+    void finish(const EscapeState& state);
+
+    /**
+     * Writes the report for people, one value per line.
+     */
+    void print(std::ostream& out) const;
+
+    /**
+     * Writes the report as a single JSON object, followed by a newline.
+     */
+    void write_json(std::ostream& out) const;
+
+    // The totals, which are only meaningful after finish().
+    std::uint_fast64_t bytes_in;
+    std::uint_fast64_t bytes_out;
+    std::uint_fast64_t passed_through; // Bytes that were copied to the output as-is
+    std::uint_fast64_t escaped[4]; // Escaped characters, by their length in UTF-8; see EscapeState::num_escaped
+    double phase_seconds[3]; // Indexed by Phase
+    double total_seconds;
+    KernelTier kernel; // The scanning code that was used; see ascii_scan.h
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start;
+    Clock::time_point last;
+};
+
+/**
+ * Calls stats->lap(phase), if there is a stats.
+ */
+inline void stats_lap(EscapeStats *stats, Phase phase) {
+    if (stats != nullptr) {
+        stats->lap(phase);
+    }
+}
+
+/**
+ * Calls stats->add_output(len), if there is a stats.
+ */
+inline void stats_output(EscapeStats *stats, std::uint_fast64_t len) {
+    if (stats != nullptr) {
+        stats->add_output(len);
+    }
+}
+
+/**
+ * Calls stats->finish(state) when it goes out of scope, if there is a stats. This way every
+ * return from a run (including the ones for errors) finishes the stats.
+ */
+class StatsScope {
+public:
+    StatsScope(EscapeStats *stats, const EscapeState& state) : stats(stats), state(state) {}
+
+    StatsScope(const StatsScope&) = delete;
+    StatsScope& operator=(const StatsScope&) = delete;
+
+    ~StatsScope() {
+        if (stats != nullptr) {
+            stats->finish(state);
+        }
+    }
+
+private:
+    EscapeStats *stats;
+    const EscapeState& state;
+};
+
+#endif //ESCAPE_UTF8_STATS_H
@@ -0,0 +1,54 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include "stop_signal.h"
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstring> // std::memset
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// The write end of the pipe that the signal handler writes to.
+int signal_pipe_fd = -1;
+
+extern "C" void on_stop_signal(int) {
+    int saved_errno = errno;
+    const char byte = 0;
+    ssize_t ignored = write(signal_pipe_fd, &byte, 1);
+    (void)ignored;
+    errno = saved_errno;
+}
+
+} // namespace
+
+StopSignalPipe::StopSignalPipe() {
+    if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+        fds[0] = fds[1] = -1;
+        return;
+    }
+    signal_pipe_fd = fds[1];
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = on_stop_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, &old_int);
+    sigaction(SIGTERM, &action, &old_term);
+}
+
+StopSignalPipe::~StopSignalPipe() {
+    if (ok()) {
+        sigaction(SIGINT, &old_int, nullptr);
+        sigaction(SIGTERM, &old_term, nullptr);
+        signal_pipe_fd = -1;
+        close(fds[0]);
+        close(fds[1]);
+    }
+}
+
+#endif
@@ -0,0 +1,50 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_STOP_SIGNAL_H
+#define ESCAPE_UTF8_STOP_SIGNAL_H
+
+/*
+ * --serve and --follow both run until SIGINT or SIGTERM, and then stop cleanly. A signal
+ * handler can't do much safely, so it just writes a byte to a pipe (the "self-pipe trick"),
+ * and the main loop, which is already waiting on file descriptors with epoll or poll, waits
+ * on the read end of the pipe too.
+ *
+ * This is only implemented for Linux.
+ */
+
+#ifdef __linux__
+
+#include <csignal>
+
+/**
+ * Makes the pipe and installs the handler for SIGINT and SIGTERM for as long as it's in
+ * scope, and then puts back the handlers from before. Only one can exist at a time.
+ */
+class StopSignalPipe {
+public:
+    StopSignalPipe();
+    ~StopSignalPipe();
+    StopSignalPipe(const StopSignalPipe&) = delete;
+    StopSignalPipe& operator=(const StopSignalPipe&) = delete;
+
+    /**
+     * Returns false if the pipe couldn't be made, in which case no handler was installed.
+     */
+    bool ok() const { return fds[0] != -1; }
+
+    /**
+     * Returns the read end of the pipe, which becomes readable once a signal has come in.
+     */
+    int fd() const { return fds[0]; }
+
+private:
+    int fds[2];
+    struct sigaction old_int;
+    struct sigaction old_term;
+};
+
+#endif
+
+#endif //ESCAPE_UTF8_STOP_SIGNAL_H
@@ -0,0 +1,278 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include "streaming.h"
+#include "business_logic.h"
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <chrono>
+#include <cstring> // memrchr
+#include <iostream>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
+/*
+ * IMPLEMENTATION NOTES
+ * Reading:
+ *   We only call read() once poll() says the input is readable, and for a pipe, socket or
+ *   terminal, read() then returns whatever is there instead of waiting for the whole buffer.
+ *   So we get the effect of a nonblocking read without setting O_NONBLOCK on the input. That
+ *   matters because the input is usually our stdin, whose flags are shared with every other
+ *   process that has it open, like the shell we were started from; if we died without
+ *   setting it back, they would be left with a nonblocking stdin.
+ *   A read that comes back short means we've emptied the pipe, so that's when we decide
+ *   whether to write. A read that fills the buffer means there's probably more waiting, so we
+ *   keep going until there's FLUSH_SIZE bytes of output.
+ *
+ * Deadlines:
+ *   With --max-latency-ms, poll() gets a timeout that ends when the oldest byte of output we
+ *   haven't written yet has waited for the given time. When it times out, everything is written.
+ *
+ * Lines:
+ *   With --line-buffered, the output is written up to the end of the last line, and whatever
+ *   comes after that is held back until its line is finished (or the deadline comes). A line
+ *   feed is never part of a multi-byte character, so we can escape each read in two pieces,
+ *   up to and including the last line feed and then the rest, and the end of the first piece
+ *   in the output is where the last complete line ends.
+ */
+
+namespace {
+
+// Once we have this much output, we write it no matter what.
+const std::size_t FLUSH_SIZE = 256 * 1024;
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Writes all of data to fd, retrying after short writes and interrupted calls.
+ * @return False if there was a write error.
+ */
+bool write_all(int fd, const unsigned char *data, std::size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * The escaped output that we haven't written yet.
+ */
+class PendingOutput {
+public:
+    PendingOutput(int out_fd, const EscapeSettings& settings, EscapeStats *stats) :
+            out_fd(out_fd), settings(settings), stats(stats), line_end(0) {
+        data.reserve(FLUSH_SIZE + escape_output_bound(ESCAPE_BLOCK_SIZE, settings.format));
+    }
+
+    /**
+     * Escapes a piece of input onto the end of the output. If the input turns out to be
+     * invalid, the output stops before the bad character, and state.invalid is set.
+     * @param arrived When the input arrived, for the deadline.
+     */
+    void escape(EscapeState& state, const unsigned char *in, std::size_t len, bool line_buffered, Clock::time_point arrived) {
+        if (data.empty()) {
+            oldest = arrived;
+        }
+        std::size_t begin = data.size();
+        data.resize(begin + escape_output_bound(len, settings.format));
+        const void *newline = line_buffered ? memrchr(in, '\n', len) : nullptr;
+        std::size_t first = (newline != nullptr) ? static_cast<std::size_t>(static_cast<const unsigned char *>(newline) - in) + 1 : 0;
+        std::size_t end = begin + escape_block(state, in, first, data.data() + begin, settings);
+        if (newline != nullptr && !state.invalid) {
+            line_end = end;
+        }
+        if (!state.invalid) {
+            end += escape_block(state, in + first, len - first, data.data() + end, settings);
+        }
+        data.resize(end);
+    }
+
+    /**
+     * Writes the output up to the end of the last complete line, if there is one.
+     * @return False if there was a write error.
+     */
+    bool write_lines(Clock::time_point now) {
+        if (line_end == 0) {
+            return true;
+        }
+        bool ok = write_all(out_fd, data.data(), line_end);
+        stats_output(stats, line_end);
+        // The rest of the output is part of the last read, so that's when it arrived.
+        data.erase(data.begin(), data.begin() + static_cast<std::ptrdiff_t>(line_end));
+        line_end = 0;
+        oldest = now;
+        return ok;
+    }
+
+    /**
+     * Writes all of the output.
+     * @return False if there was a write error.
+     */
+    bool write_all_pending() {
+        bool ok = write_all(out_fd, data.data(), data.size());
+        stats_output(stats, data.size());
+        data.clear();
+        line_end = 0;
+        return ok;
+    }
+
+    std::size_t size() const { return data.size(); }
+
+    /**
+     * Returns how many milliseconds are left until the given deadline for the oldest byte
+     * of output (0 if it has passed), or -1 if there's no output.
+     */
+    int time_left(long max_latency_ms, Clock::time_point now) const {
+        if (data.empty()) {
+            return -1;
+        }
+        long waited = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(now - oldest).count());
+        return (waited >= max_latency_ms) ? 0 : static_cast<int>(max_latency_ms - waited);
+    }
+
+private:
+    int out_fd;
+    const EscapeSettings& settings;
+    EscapeStats *stats;
+    std::vector<unsigned char> data;
+    // The output up to here ends with a complete line, or 0 if there's no complete line.
+    std::size_t line_end;
+    // When the input for the start of the output arrived.
+    Clock::time_point oldest;
+};
+
+} // namespace
+
+int stream_escape(int in_fd, int out_fd, const EscapeSettings& settings, bool line_buffered, long max_latency_ms,
+                  EscapeStats *stats) {
+    EscapeState state;
+    StatsScope stats_scope(stats, state);
+    std::vector<unsigned char> inbuf(ESCAPE_BLOCK_SIZE);
+    PendingOutput pending(out_fd, settings, stats);
+    bool read_error = false;
+    bool write_error = false;
+
+    while (true) {
+        int timeout = -1;
+        if (max_latency_ms >= 0) {
+            timeout = pending.time_left(max_latency_ms, Clock::now());
+            if (timeout == 0) {
+                if (!pending.write_all_pending()) {
+                    write_error = true;
+                    break;
+                }
+                stats_lap(stats, Phase::Write);
+                timeout = -1;
+            }
+        }
+        pollfd fds;
+        fds.fd = in_fd;
+        fds.events = POLLIN;
+        fds.revents = 0;
+        int ready = poll(&fds, 1, timeout);
+        stats_lap(stats, Phase::Read); // Waiting for the input counts as reading it.
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            read_error = true;
+            break;
+        }
+        if (ready == 0) {
+            continue; // The deadline has come; the output is written at the top of the loop.
+        }
+
+        ssize_t len = read(in_fd, inbuf.data(), inbuf.size());
+        if (len < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            read_error = true;
+            break;
+        }
+        if (len == 0) {
+            break; // End of the input
+        }
+        stats_lap(stats, Phase::Read);
+        Clock::time_point now = Clock::now();
+        pending.escape(state, inbuf.data(), static_cast<std::size_t>(len), line_buffered, now);
+        stats_lap(stats, Phase::Escape);
+        if (state.invalid) {
+            // Everything before the bad character still gets written.
+            if (!pending.write_all_pending()) {
+                write_error = true;
+                break;
+            }
+            std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+            return 2;
+        }
+
+        bool drained = static_cast<std::size_t>(len) < inbuf.size();
+        bool ok = true;
+        if (pending.size() >= FLUSH_SIZE || (drained && max_latency_ms == 0)) {
+            ok = pending.write_all_pending();
+        } else if (drained && line_buffered) {
+            ok = pending.write_lines(now);
+        }
+        if (!ok) {
+            write_error = true;
+            break;
+        }
+        stats_lap(stats, Phase::Write);
+    }
+    if (!write_error && !pending.write_all_pending()) {
+        write_error = true;
+    }
+    stats_lap(stats, Phase::Write);
+
+    if (write_error) {
+        std::cerr << "There was a fatal error when trying to write to the output. Exiting now." << std::endl;
+        return 4;
+    }
+    if (read_error) {
+        std::cerr << "Failed when trying to read byte " << (state.num_bytes_read + 1) << " due to unknown error." << std::endl;
+        return 3;
+    }
+    if (!state.at_boundary()) {
+        std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+        return 2;
+    }
+    return 0;
+}
+
+#endif
+
+bool streams_by_descriptor(const StreamPair& streams) {
+#ifdef __linux__
+    return !streams.mapped && streams.in.fd() != -1 && streams.out.fd() != -1;
+#else
+    (void)streams;
+    return false;
+#endif
+}
+
+int read_and_stream(StreamPair& streams, const EscapeSettings& settings, bool line_buffered, long max_latency_ms,
+                    EscapeStats *stats) {
+#ifdef __linux__
+    if (streams_by_descriptor(streams)) {
+        return stream_escape(streams.in.fd(), streams.out.fd(), settings, line_buffered, max_latency_ms, stats);
+    }
+#else
+    (void)line_buffered;
+    (void)max_latency_ms;
+#endif
+    return read_and_escape(streams, settings, false, stats);
+}
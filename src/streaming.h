@@ -0,0 +1,68 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_STREAMING_H
+#define ESCAPE_UTF8_STREAMING_H
+
+#include "StreamPair.h"
+#include "escape_kernel.h" // EscapeSettings
+#include "stats.h"
+
+/*
+ * This is read_and_escape for --line-buffered and --max-latency-ms, for when the input is a
+ * live stream like the output of "tail -f" and whatever reads our output wants each line as
+ * soon as it can get it.
+ *
+ * The normal mode reads the input a whole block at a time, and writes a block of output
+ * whenever a block of input has been escaped. That's the fastest way to get through a big
+ * input, but on a quiet log a line can sit in our buffers until enough other lines have come
+ * along to fill a block, which can take minutes. Here we instead wait with poll() until
+ * there's something to read, read only what's there, and write out the output when the input
+ * runs dry: either the complete lines so far (--line-buffered), or everything once the oldest
+ * byte we're holding on to has waited for the given time (--max-latency-ms).
+ *
+ * When the input is coming in faster than we can escape it, every read fills the whole input
+ * buffer, and we keep reading and escaping until there's a good-sized block of output before
+ * writing anything. So a busy stream is written in blocks just like in the normal mode.
+ *
+ * Everything else (the output, the error messages and the return values) is the same as
+ * read_and_escape.
+ */
+
+#ifdef __linux__
+
+/**
+ * @param in_fd The input.
+ * @param out_fd The output. Nothing else may have written to it yet without flushing.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * @param line_buffered Whether to write out the complete lines as soon as the input runs dry.
+ * @param max_latency_ms The longest time, in milliseconds, that escaped output is held back
+ * before it's written, or -1 for no limit.
+ * @param stats Where to count things for --stats, or null. The time spent waiting for input
+ * counts as reading.
+ * @return The same exit codes as read_and_escape.
+ */
+int stream_escape(int in_fd, int out_fd, const EscapeSettings& settings, bool line_buffered, long max_latency_ms,
+                  EscapeStats *stats = nullptr);
+
+#endif
+
+/**
+ * Returns whether read_and_stream would run stream_escape on the file descriptors of the
+ * given streams, which means the input is read just as it is, without going through the
+ * ByteSource (so it can't be decompressed, for one).
+ */
+bool streams_by_descriptor(const StreamPair& streams);
+
+/**
+ * Runs stream_escape on the file descriptors of the given streams. If the input is a
+ * memory-mapped file (which is all there already), or there aren't any descriptors (the
+ * streams are strings, a decompressor, or we're not on Linux), this is just read_and_escape.
+ * @param streams A StreamPair
+ * The other parameters and the return value are the same as stream_escape's.
+ */
+int read_and_stream(StreamPair& streams, const EscapeSettings& settings, bool line_buffered, long max_latency_ms,
+                    EscapeStats *stats = nullptr);
+
+#endif //ESCAPE_UTF8_STREAMING_H
@@ -0,0 +1,112 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_UTF8_DFA_H
+#define ESCAPE_UTF8_UTF8_DFA_H
+
+#include <cstdint> // uint_fast32_t
+
+/*
+ * A table-driven UTF-8 decoder, in the style of Bjoern Hoehrmann's "Flexible and Economical
+ * UTF-8 Decoder": http://bjoern.hoehrmann.de/utf-8/decoder/dfa/
+ *
+ * Decoding is a deterministic finite automaton. Every byte is first mapped to one of 12
+ * byte classes (UTF8_BYTE_CLASS), and then the pair (current state, byte class) is looked
+ * up in UTF8_TRANSITIONS to get the next state. The DFA only accepts well-formed UTF-8 as
+ * defined by the table on page 5 of RFC 3629 (https://tools.ietf.org/html/rfc3629), which
+ * means it rejects everything that the old range checks rejected:
+ *   - bytes that can never appear (C0, C1, F5-FF),
+ *   - continuation bytes where a first byte should be, and vice versa,
+ *   - overlong forms (e.g. E0 80 80),
+ *   - values above U+10FFFF (e.g. F4 90 80 80),
+ * and on top of that it also rejects UTF-16 surrogates (U+D800 through U+DFFF, i.e. ED A0 80
+ * through ED BF BF), which are not valid in UTF-8. Every invalid sequence is caught at the
+ * first byte that makes it invalid, so there's no separate range check at the end.
+ *
+ * The byte classes are:
+ *    0: 00..7F  (US-ASCII)
+ *    1: 80..8F  (continuation)
+ *    2: 90..9F  (continuation)
+ *    3: A0..BF  (continuation)
+ *    4: C0, C1, F5..FF  (never valid)
+ *    5: C2..DF  (first byte of a 2-byte character)
+ *    6: E0      (first byte of a 3-byte character; second byte must be A0..BF)
+ *    7: E1..EC, EE, EF  (first byte of a 3-byte character)
+ *    8: ED      (first byte of a 3-byte character; second byte must be 80..9F, to exclude surrogates)
+ *    9: F0      (first byte of a 4-byte character; second byte must be 90..BF)
+ *   10: F1..F3  (first byte of a 4-byte character)
+ *   11: F4      (first byte of a 4-byte character; second byte must be 80..8F)
+ * Continuation bytes are split three ways because E0, ED, F0, and F4 each restrict the
+ * second byte to a different sub-range.
+ *
+ * The states are stored pre-multiplied by the number of classes, so the next state is
+ * just UTF8_TRANSITIONS[state + byte_class]. The states are:
+ *    0: ACCEPT (at a character boundary)
+ *   12: REJECT (invalid input; this state is a trap)
+ *   24: expecting 1 more continuation byte
+ *   36: expecting 2 more continuation bytes
+ *   48: expecting 3 more continuation bytes
+ *   60: after E0
+ *   72: after ED
+ *   84: after F0
+ *   96: after F4
+ * Every state above REJECT means we're in the middle of a character.
+ */
+
+static const std::uint_fast32_t UTF8_ACCEPT = 0;
+static const std::uint_fast32_t UTF8_REJECT = 12;
+
+static constexpr unsigned char UTF8_BYTE_CLASS[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    4, 4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 7,
+    9, 10, 10, 10, 11, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+};
+
+static constexpr unsigned char UTF8_TRANSITIONS[108] = {
+//  ASCII  80   90   A0   bad  C2   E0   E1   ED   F0   F1   F4
+     0,   12,  12,  12,  12,  24,  60,  36,  72,  84,  48,  96, // ACCEPT
+    12,   12,  12,  12,  12,  12,  12,  12,  12,  12,  12,  12, // REJECT
+    12,    0,   0,   0,  12,  12,  12,  12,  12,  12,  12,  12, // 1 more
+    12,   24,  24,  24,  12,  12,  12,  12,  12,  12,  12,  12, // 2 more
+    12,   36,  36,  36,  12,  12,  12,  12,  12,  12,  12,  12, // 3 more
+    12,   12,  12,  24,  12,  12,  12,  12,  12,  12,  12,  12, // after E0
+    12,   24,  24,  12,  12,  12,  12,  12,  12,  12,  12,  12, // after ED
+    12,   12,  36,  36,  12,  12,  12,  12,  12,  12,  12,  12, // after F0
+    12,   36,  12,  12,  12,  12,  12,  12,  12,  12,  12,  12, // after F4
+};
+
+/*
+ * When a byte starts a character, these are the bits of it that belong to the code point,
+ * indexed by byte class. Classes that can't start a character get 0; the DFA rejects them anyway.
+ */
+static constexpr unsigned char UTF8_LEAD_MASK[12] = {
+    0x7F, 0, 0, 0, 0, 0x1F, 0x0F, 0x0F, 0x0F, 0x07, 0x07, 0x07,
+};
+
+/**
+ * Feeds one byte to the DFA. state is updated to the next state, and codepoint
+ * accumulates the bits of the current character. Once state comes back to UTF8_ACCEPT,
+ * codepoint holds the decoded character.
+ */
+inline void utf8_dfa_step(std::uint_fast32_t& state, std::uint_fast32_t& codepoint, unsigned char byte) {
+    unsigned int byte_class = UTF8_BYTE_CLASS[byte];
+    codepoint = (state == UTF8_ACCEPT) ? (byte & UTF8_LEAD_MASK[byte_class])
+                                       : ((codepoint << 6u) | (byte & 0x3Fu));
+    state = UTF8_TRANSITIONS[state + byte_class];
+}
+
+#endif //ESCAPE_UTF8_UTF8_DFA_H
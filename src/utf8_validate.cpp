@@ -0,0 +1,429 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <cassert>
+#include <cstddef> // std::size_t
+#include <cstdint> // uint_fast32_t
+#include <cstring> // std::memcpy
+
+#include "utf8_validate.h"
+#include "ascii_scan_kernels.h"
+#include "utf8_dfa.h"
+
+/*
+ * IMPLEMENTATION NOTES
+ * Instruction sets:
+ *   Like the scanning code in ascii_scan.cpp, every version of the validator is compiled in
+ *   and the one for the kernel tier in use is picked at runtime (see ScanKernels). The
+ *   vectorized validator needs PSHUFB, which is SSSE3, so the SSE4.2 tier (whose CPUs all
+ *   have SSSE3) gets the 16-byte version, and the AVX2 and AVX-512 tiers get the 32-byte one.
+ *   Below that, the SSE2 tier skips over runs of ASCII 16 bytes at a time, the SWAR tier 8 at
+ *   a time, and the scalar tier one at a time, and all three run the DFA on everything else.
+ *
+ * The vectorized validator:
+ *   This is the "lookup" algorithm from John Keiser and Daniel Lemire, "Validating UTF-8 In
+ *   Less Than One Instruction Per Byte" (https://arxiv.org/abs/2010.03090), which is what
+ *   simdjson uses. Almost every error in UTF-8 can be recognized by looking at just two
+ *   adjacent bytes, and more precisely at the high nibble of the first byte, the low nibble
+ *   of the first byte, and the high nibble of the second byte. Each of those nibbles is
+ *   looked up in a 16-entry table (one PSHUFB each) that gives a bitmask of the errors that
+ *   nibble could be part of, and ANDing the three bitmasks gives the errors that are
+ *   actually there. The error bits are listed below.
+ *
+ *   The only errors that take more than two bytes to see are a character that's too short
+ *   (e.g. E2 82 followed by ASCII) and a continuation byte where a new character should
+ *   start. For those, we separately work out which bytes must be the 3rd or 4th byte of a
+ *   character, i.e. the bytes 2 after an E0..FF or 3 after an F0..FF, and check that those
+ *   are exactly the continuation bytes that the two-byte lookup flagged as TWO_CONTS.
+ *
+ *   Finally, the input mustn't end in the middle of a character, so we check whether any of
+ *   the last 3 bytes starts a character that would need more bytes than are left.
+ *
+ *   Blocks of 64 bytes that are all ASCII are skipped with a single check, so mostly-ASCII
+ *   text goes through at about the speed of memory.
+ */
+#ifdef ESCAPE_UTF8_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/**
+ * Feeds one byte to the DFA from utf8_dfa.h. This is utf8_dfa_step without the code point,
+ * which we don't need just to validate.
+ */
+static inline std::uint_fast32_t dfa_next(std::uint_fast32_t state, unsigned char byte) {
+    return UTF8_TRANSITIONS[state + UTF8_BYTE_CLASS[byte]];
+}
+
+#ifdef ESCAPE_UTF8_X86_KERNELS
+
+// The error bits. A lead byte is the first byte of a multi-byte character, and "1000____"
+// means a byte with the high nibble 1000.
+static const unsigned char TOO_SHORT = 1u << 0u;      // A lead byte followed by a lead byte or ASCII
+static const unsigned char TOO_LONG = 1u << 1u;       // ASCII followed by a continuation byte
+static const unsigned char OVERLONG_3 = 1u << 2u;     // E0 followed by 80..9F
+static const unsigned char TOO_LARGE = 1u << 3u;      // F4 followed by 90..BF, or F5..FF followed by 90..BF
+static const unsigned char SURROGATE = 1u << 4u;      // ED followed by A0..BF
+static const unsigned char OVERLONG_2 = 1u << 5u;     // C0 or C1 followed by a continuation byte
+static const unsigned char TOO_LARGE_1000 = 1u << 6u; // F5..FF followed by 80..8F
+static const unsigned char OVERLONG_4 = 1u << 6u;     // F0 followed by 80..8F
+static const unsigned char TWO_CONTS = 1u << 7u;      // A continuation byte followed by a continuation byte
+// These errors don't depend on the low nibble of the first byte.
+static const unsigned char CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+// Indexed by the high nibble of the first byte.
+static const unsigned char BYTE_1_HIGH[16] = {
+    // 0_______: ASCII
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    // 10______: continuation
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    // 1100____: 2-byte lead (C0 and C1 are overlong)
+    TOO_SHORT | OVERLONG_2,
+    // 1101____: 2-byte lead
+    TOO_SHORT,
+    // 1110____: 3-byte lead
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    // 1111____: 4-byte lead, or F5..FF
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+// Indexed by the low nibble of the first byte.
+static const unsigned char BYTE_1_LOW[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, // ____0000
+    CARRY | OVERLONG_2,                           // ____0001
+    CARRY,                                        // ____0010
+    CARRY,                                        // ____0011
+    CARRY | TOO_LARGE,                            // ____0100
+    CARRY | TOO_LARGE | TOO_LARGE_1000,           // ____0101
+    CARRY | TOO_LARGE | TOO_LARGE_1000,           // ____0110
+    CARRY | TOO_LARGE | TOO_LARGE_1000,           // ____0111
+    CARRY | TOO_LARGE | TOO_LARGE_1000,           // ____1000
+    CARRY | TOO_LARGE | TOO_LARGE_1000,           // ____1001
+    CARRY | TOO_LARGE | TOO_LARGE_1000,           // ____1010
+    CARRY | TOO_LARGE | TOO_LARGE_1000,           // ____1011
+    CARRY | TOO_LARGE | TOO_LARGE_1000,           // ____1100
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, // ____1101
+    CARRY | TOO_LARGE | TOO_LARGE_1000,           // ____1110
+    CARRY | TOO_LARGE | TOO_LARGE_1000,           // ____1111
+};
+
+// Indexed by the high nibble of the second byte.
+static const unsigned char BYTE_2_HIGH[16] = {
+    // 0_______: ASCII
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    // 1000____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    // 1001____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    // 101_____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    // 11______: lead byte
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+// A byte in the last 3 positions is the start of an unfinished character if it's larger than
+// the value here: the last byte can't be a lead byte at all, the second-to-last byte can't
+// start a 3- or 4-byte character, and the third-to-last byte can't start a 4-byte character.
+static const unsigned char MAX_LAST_BYTES[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF,
+};
+
+#endif // ESCAPE_UTF8_X86_KERNELS
+
+/**
+ * Runs the DFA over the character that starts at data[i], and moves i past it.
+ * @return False if the character is invalid, or the buffer ends before it does.
+ */
+static inline bool dfa_skip_char(const unsigned char *data, std::size_t len, std::size_t& i) {
+    std::uint_fast32_t state = UTF8_ACCEPT;
+    while (i < len) {
+        state = dfa_next(state, data[i++]);
+        if (state <= UTF8_REJECT) {
+            break; // Either the end of the character or an error
+        }
+    }
+    return state == UTF8_ACCEPT;
+}
+
+bool scalar_utf8_valid(const unsigned char *data, std::size_t len) {
+    std::size_t i = 0;
+    while (i < len) {
+        // Skip the ASCII...
+        while (i < len && data[i] < 0x80) {
+            ++i;
+        }
+        // ...and run the DFA over the next non-ASCII character.
+        if (i < len && !dfa_skip_char(data, len, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool swar_utf8_valid(const unsigned char *data, std::size_t len) {
+    std::size_t i = 0;
+    while (i < len) {
+        for (; i + 8 <= len; i += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            if ((word & 0x8080808080808080u) != 0) {
+                break;
+            }
+        }
+        while (i < len && data[i] < 0x80) {
+            ++i;
+        }
+        if (i < len && !dfa_skip_char(data, len, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef ESCAPE_UTF8_X86_KERNELS
+
+ESCAPE_UTF8_TARGET("sse2")
+bool sse2_utf8_valid(const unsigned char *data, std::size_t len) {
+    std::size_t i = 0;
+    while (i < len) {
+        for (; i + 16 <= len; i += 16) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            if (_mm_movemask_epi8(x) != 0) {
+                break;
+            }
+        }
+        while (i < len && data[i] < 0x80) {
+            ++i;
+        }
+        if (i < len && !dfa_skip_char(data, len, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * The validator state for 16-byte vectors. This is the same as Avx2Validator (below),
+ * except that getting the bytes just before the input is a single PALIGNR.
+ */
+struct Ssse3Validator {
+    __m128i error;
+    __m128i prev_input;
+    __m128i prev_incomplete;
+    __m128i byte_1_high;
+    __m128i byte_1_low;
+    __m128i byte_2_high;
+    __m128i max_last_bytes;
+
+    ESCAPE_UTF8_TARGET("ssse3")
+    Ssse3Validator()
+        : error(_mm_setzero_si128()), prev_input(_mm_setzero_si128()), prev_incomplete(_mm_setzero_si128()),
+          byte_1_high(_mm_loadu_si128(reinterpret_cast<const __m128i *>(BYTE_1_HIGH))),
+          byte_1_low(_mm_loadu_si128(reinterpret_cast<const __m128i *>(BYTE_1_LOW))),
+          byte_2_high(_mm_loadu_si128(reinterpret_cast<const __m128i *>(BYTE_2_HIGH))),
+          max_last_bytes(_mm_loadu_si128(reinterpret_cast<const __m128i *>(MAX_LAST_BYTES + 16))) {}
+
+    ESCAPE_UTF8_TARGET("ssse3")
+    void check(__m128i input) {
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+        __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+        __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+
+        __m128i sc = _mm_shuffle_epi8(byte_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+        sc = _mm_and_si128(sc, _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, nibble)));
+        sc = _mm_and_si128(sc, _mm_shuffle_epi8(byte_2_high, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+        __m128i must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80))),
+                                      _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80))));
+        __m128i must23_80 = _mm_and_si128(must23, _mm_set1_epi8(static_cast<char>(0x80)));
+        error = _mm_or_si128(error, _mm_xor_si128(must23_80, sc));
+
+        prev_incomplete = _mm_subs_epu8(input, max_last_bytes);
+        prev_input = input;
+    }
+
+    ESCAPE_UTF8_TARGET("ssse3")
+    void check_ascii(__m128i input) {
+        error = _mm_or_si128(error, prev_incomplete);
+        prev_incomplete = _mm_setzero_si128();
+        prev_input = input;
+    }
+
+    ESCAPE_UTF8_TARGET("ssse3")
+    bool valid() const {
+        __m128i all = _mm_or_si128(error, prev_incomplete);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(all, _mm_setzero_si128())) == 0xFFFF;
+    }
+};
+
+ESCAPE_UTF8_TARGET("ssse3")
+bool ssse3_utf8_valid(const unsigned char *data, std::size_t len) {
+    Ssse3Validator validator;
+    std::size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 48));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) == 0) {
+            validator.check_ascii(d);
+        } else {
+            validator.check(a);
+            validator.check(b);
+            validator.check(c);
+            validator.check(d);
+        }
+    }
+    if (i < len) {
+        alignas(16) unsigned char tail[64] = {0};
+        std::memcpy(tail, data + i, len - i);
+        for (std::size_t j = 0; j < 64; j += 16) {
+            validator.check(_mm_load_si128(reinterpret_cast<const __m128i *>(tail + j)));
+        }
+    }
+    return validator.valid();
+}
+
+/**
+ * The validator state for 32-byte vectors. check() is called on every vector of input in
+ * order, and error ends up nonzero if the input so far is invalid.
+ */
+struct Avx2Validator {
+    __m256i error;
+    __m256i prev_input;
+    __m256i prev_incomplete;
+    __m256i byte_1_high;
+    __m256i byte_1_low;
+    __m256i byte_2_high;
+    __m256i max_last_bytes;
+
+    ESCAPE_UTF8_TARGET("avx2")
+    Avx2Validator()
+        : error(_mm256_setzero_si256()), prev_input(_mm256_setzero_si256()), prev_incomplete(_mm256_setzero_si256()),
+          byte_1_high(_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(BYTE_1_HIGH)))),
+          byte_1_low(_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(BYTE_1_LOW)))),
+          byte_2_high(_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(BYTE_2_HIGH)))),
+          max_last_bytes(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(MAX_LAST_BYTES))) {}
+
+    ESCAPE_UTF8_TARGET("avx2")
+    void check(__m256i input) {
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        // AVX2 shifts only work within each 128-bit lane, so to get the bytes just before
+        // input we first line up the top half of prev_input with the bottom half of input.
+        __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+        __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+        __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+        __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+        __m256i sc = _mm256_shuffle_epi8(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+        sc = _mm256_and_si256(sc, _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, nibble)));
+        sc = _mm256_and_si256(sc, _mm256_shuffle_epi8(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+
+        // A byte must be a 3rd or 4th byte if the byte 2 before it is >= E0 or the byte 3
+        // before it is >= F0. The saturating subtraction leaves the high bit set exactly then.
+        __m256i must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80))),
+                                         _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80))));
+        __m256i must23_80 = _mm256_and_si256(must23, _mm256_set1_epi8(static_cast<char>(0x80)));
+        error = _mm256_or_si256(error, _mm256_xor_si256(must23_80, sc));
+
+        prev_incomplete = _mm256_subs_epu8(input, max_last_bytes);
+        prev_input = input;
+    }
+
+    ESCAPE_UTF8_TARGET("avx2")
+    void check_ascii(__m256i input) {
+        // The input is ASCII, so it's valid as long as the previous input didn't end in
+        // the middle of a character.
+        error = _mm256_or_si256(error, prev_incomplete);
+        prev_incomplete = _mm256_setzero_si256();
+        prev_input = input;
+    }
+
+    ESCAPE_UTF8_TARGET("avx2")
+    bool valid() const {
+        __m256i all = _mm256_or_si256(error, prev_incomplete);
+        return _mm256_testz_si256(all, all) != 0;
+    }
+};
+
+ESCAPE_UTF8_TARGET("avx2")
+bool avx2_utf8_valid(const unsigned char *data, std::size_t len) {
+    Avx2Validator validator;
+    std::size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 32));
+        if (_mm256_movemask_epi8(_mm256_or_si256(a, b)) == 0) {
+            validator.check_ascii(b);
+        } else {
+            validator.check(a);
+            validator.check(b);
+        }
+    }
+    if (i < len) {
+        // The tail is padded with zeros, which are ASCII, so they can't hide an error.
+        alignas(32) unsigned char tail[64] = {0};
+        std::memcpy(tail, data + i, len - i);
+        validator.check(_mm256_load_si256(reinterpret_cast<const __m256i *>(tail)));
+        validator.check(_mm256_load_si256(reinterpret_cast<const __m256i *>(tail + 32)));
+    }
+    return validator.valid();
+}
+
+#endif // ESCAPE_UTF8_X86_KERNELS
+
+bool utf8_valid(const unsigned char *data, std::size_t len) {
+    return active_scan_kernels()->utf8_valid(data, len);
+}
+
+/**
+ * Returns the length of the longest prefix of the buffer that doesn't end in the middle of
+ * a character, assuming the buffer starts at a character boundary. Only the last 3 bytes
+ * are looked at, so this doesn't check anything else about the buffer.
+ */
+static std::size_t complete_prefix_len(const unsigned char *data, std::size_t len) {
+    for (std::size_t k = 1; k <= 3 && k <= len; ++k) {
+        unsigned char byte = data[len - k];
+        if (byte < 0x80) {
+            return len; // ASCII
+        } else if (byte >= 0xC0) {
+            std::size_t char_len = (byte >= 0xF0) ? 4 : (byte >= 0xE0) ? 3 : 2;
+            return (char_len > k) ? len - k : len;
+        }
+        // Otherwise it's a continuation byte, so keep looking for the start of the character.
+    }
+    return len;
+}
+
+void validate_block(EscapeState& state, const unsigned char *in, std::size_t len) {
+    assert(!state.invalid);
+    std::uint_fast32_t dfa_state = state.dfa_state;
+    std::size_t i = 0;
+    // Finish off a character that started in the previous block.
+    while (dfa_state > UTF8_REJECT && i < len) {
+        dfa_state = dfa_next(dfa_state, in[i++]);
+    }
+    // Then check everything up to the last whole character at once. If that fails, we
+    // don't skip anything, and the DFA below finds the bad byte.
+    if (dfa_state == UTF8_ACCEPT) {
+        std::size_t end = i + complete_prefix_len(in + i, len - i);
+        if (utf8_valid(in + i, end - i)) {
+            i = end;
+        }
+    }
+    // What's left is either the start of a character that continues in the next block, or
+    // an invalid block.
+    for (; i < len && dfa_state != UTF8_REJECT; ++i) {
+        dfa_state = dfa_next(dfa_state, in[i]);
+    }
+    if (dfa_state == UTF8_REJECT) {
+        state.invalid = true;
+        state.num_bytes_read += i;
+        return;
+    }
+    state.dfa_state = dfa_state;
+    state.num_bytes_read += len;
+}
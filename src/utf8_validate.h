@@ -0,0 +1,43 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_UTF8_VALIDATE_H
+#define ESCAPE_UTF8_UTF8_VALIDATE_H
+
+#include <cstddef> // std::size_t
+
+#include "escape_kernel.h" // EscapeState
+
+/**
+ * Returns whether the given buffer is valid UTF-8 on its own, i.e. it's made up of whole,
+ * well-formed characters. This accepts exactly what the DFA in utf8_dfa.h accepts, so it
+ * rejects overlong forms, surrogates and values above U+10FFFF, and it rejects a buffer that
+ * ends in the middle of a character.
+ *
+ * This looks at 16 (SSSE3) or 32 (AVX2) bytes at a time if the CPU has those instruction
+ * sets. Like passthrough_prefix_len, the version is the one for the kernel tier in use (see
+ * active_kernel_tier in ascii_scan.h); see utf8_validate.cpp. It doesn't say where the input
+ * is invalid.
+ * @param data Pointer to the first byte of the buffer. May be null if len is 0.
+ * @param len Number of bytes in the buffer.
+ */
+bool utf8_valid(const unsigned char *data, std::size_t len);
+
+/**
+ * This is escape_block for --check: it validates one block of input and produces no output.
+ * Like escape_block, a character may be split between blocks, and the state says where the
+ * first invalid byte is: once state.invalid is set, state.num_bytes_read is the 1-based
+ * position of that byte. state.codepoint isn't used, so a state that has been passed to this
+ * function must not be passed to escape_block afterwards, or vice versa.
+ *
+ * Most of the block is checked with utf8_valid, and the DFA is only run on the bytes that
+ * utf8_valid can't handle: the ends of characters that are split between blocks, and, if the
+ * block is invalid, the whole block again to find the bad byte.
+ * @param state The state from the previous block. state.invalid must be false.
+ * @param in The input block. May be null if len is 0.
+ * @param len The number of bytes in the input block.
+ */
+void validate_block(EscapeState& state, const unsigned char *in, std::size_t len);
+
+#endif //ESCAPE_UTF8_UTF8_VALIDATE_H
@@ -0,0 +1,285 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include "zero_copy.h"
+
+#ifdef __linux__
+
+#include <algorithm> // std::min
+#include <cerrno>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h> // splice
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "ascii_scan.h"
+#include "escape_kernel.h"
+#include "measure.h"
+
+/*
+ * Which system call we use depends on what the output is:
+ *   - A regular file: copy_file_range, which can share the data blocks with the input on
+ *     file systems that support it (Btrfs, XFS) and otherwise copies inside the kernel.
+ *     It needs Linux 4.5, or 5.3 to work across file systems, so if it fails we try
+ *     sendfile instead.
+ *   - A pipe: splice, which moves references to the page-cache pages into the pipe.
+ *   - Anything else, like a socket or a terminal: sendfile.
+ * If the kernel refuses (for example, an output opened with O_APPEND makes copy_file_range
+ * and sendfile fail with EINVAL or EBADF), we fall back to an ordinary write() straight out
+ * of the mapping, which is still one copy fewer than going through the streams.
+ *
+ * With --preallocate, when the output is a regular file, we also reserve the disk space for
+ * the output before writing it, with fallocate. Otherwise the file system has to find more
+ * space every time the file grows, and for big outputs that can leave it in lots of small
+ * pieces. We don't know how big the output will be until we've escaped the input, but
+ * escaped_length (see measure.h) can count it for a window of the input much faster than we
+ * can escape it, so we do that for each window before escaping it. FALLOC_FL_KEEP_SIZE means
+ * the file doesn't look any bigger until we actually write to it, so if we stop early
+ * (because the input is invalid, say), the file still ends where the output ends.
+ *
+ * This isn't the default because the counting pass has to read the whole input, while long
+ * runs that don't need escaping would otherwise go straight from the page cache to the
+ * output in the kernel. On mostly-ASCII text that makes escaping about half again as slow,
+ * and ext4 and XFS already keep a file that's written in one go in a few big pieces.
+ *
+ * References:
+ * https://man7.org/linux/man-pages/man2/fallocate.2.html
+ * https://man7.org/linux/man-pages/man2/copy_file_range.2.html
+ * https://man7.org/linux/man-pages/man2/splice.2.html
+ * https://man7.org/linux/man-pages/man2/sendfile.2.html
+ */
+
+namespace {
+
+/**
+ * Writes all of data to fd, retrying after short writes and interrupted calls.
+ * @return False if there was a write error.
+ */
+bool write_all(int fd, const unsigned char *data, std::size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * Returns whether errno (after one of the zero-copy system calls failed) means that the
+ * kernel can't do it for this pair of files, as opposed to a real write error.
+ */
+bool unsupported_errno() {
+    return errno == EINVAL || errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP || errno == EBADF;
+}
+
+enum class OutputKind { File, Pipe, Other, None };
+
+/**
+ * Copies pieces of the input file to the output, using the best system call available.
+ */
+class Forwarder {
+public:
+    Forwarder(int in_fd, int out_fd) : in_fd(in_fd), out_fd(out_fd), kind(OutputKind::Other) {
+        struct stat info;
+        if (fstat(out_fd, &info) == 0) {
+            if (S_ISREG(info.st_mode)) {
+                kind = OutputKind::File;
+            } else if (S_ISFIFO(info.st_mode)) {
+                kind = OutputKind::Pipe;
+            }
+        }
+    }
+
+    /**
+     * Copies len bytes of the input, starting at offset, to the output.
+     * @param data The same bytes in the mapping, for when we have to fall back to write().
+     * @return False if there was a write error.
+     */
+    bool forward(std::uint_fast64_t offset, const unsigned char *data, std::size_t len) {
+        std::size_t done = 0;
+        while (done < len && kind != OutputKind::None) {
+            loff_t in_off = static_cast<loff_t>(offset + done);
+            ssize_t n;
+            switch (kind) {
+                case OutputKind::File:
+#ifdef __NR_copy_file_range
+                    // There's only a glibc wrapper since glibc 2.27, so we make the system call directly.
+                    n = syscall(__NR_copy_file_range, in_fd, &in_off, out_fd, nullptr, len - done, 0u);
+#else
+                    n = -1;
+                    errno = ENOSYS;
+#endif
+                    break;
+                case OutputKind::Pipe:
+                    n = splice(in_fd, &in_off, out_fd, nullptr, len - done, SPLICE_F_MORE);
+                    break;
+                default: {
+                    off_t off = static_cast<off_t>(offset + done);
+                    n = sendfile(out_fd, in_fd, &off, len - done);
+                    break;
+                }
+            }
+            if (n > 0) {
+                done += static_cast<std::size_t>(n);
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n == 0 || unsupported_errno()) {
+                // 0 means the file got shorter, which write() from the mapping will notice.
+                // Otherwise copy_file_range gets a second chance as sendfile, and after that
+                // we stick to write() for the rest of the file.
+                kind = (kind == OutputKind::File && n != 0) ? OutputKind::Other : OutputKind::None;
+            } else {
+                return false;
+            }
+        }
+        return write_all(out_fd, data + done, len - done);
+    }
+
+private:
+    int in_fd;
+    int out_fd;
+    OutputKind kind;
+};
+
+/**
+ * Reserves space in the output file ahead of the writes (see the top of this file).
+ */
+class Preallocator {
+public:
+    Preallocator(int out_fd, const EscapeSettings& settings, bool enabled) : out_fd(out_fd), settings(settings), next(-1) {
+        struct stat info;
+        if (enabled && fstat(out_fd, &info) == 0 && S_ISREG(info.st_mode)) {
+            next = lseek(out_fd, 0, SEEK_CUR);
+        }
+    }
+
+    /**
+     * Reserves the space for the escaped output of the given window of the input, following
+     * on from the space for the previous windows.
+     */
+    void reserve(const unsigned char *window, std::size_t len) {
+        if (next < 0 || len < MIN_PREALLOCATE_WINDOW) {
+            return;
+        }
+        off_t needed = static_cast<off_t>(escaped_length(window, len, settings));
+        if (fallocate(out_fd, FALLOC_FL_KEEP_SIZE, next, needed) != 0) {
+            // Most likely the file system doesn't support it (EOPNOTSUPP), or the disk is
+            // full, in which case the writes will report it. Either way, we stop trying.
+            next = -1;
+            return;
+        }
+        next += needed;
+    }
+
+    /**
+     * Gives back the space we reserved beyond the end of the output, if we stopped before
+     * using all of it.
+     */
+    void release() {
+        if (next >= 0) {
+            off_t end = lseek(out_fd, 0, SEEK_CUR);
+            if (end >= 0 && end < next) {
+                // Truncating to the current size frees the blocks past the end of the file.
+                // If it fails, there's nothing we can do about it; the output itself is fine.
+                if (ftruncate(out_fd, end) != 0) {
+                    return;
+                }
+            }
+        }
+    }
+
+private:
+    // The smallest window that's worth a pass of escaped_length and a system call.
+    static const std::size_t MIN_PREALLOCATE_WINDOW = 1024 * 1024;
+    int out_fd;
+    const EscapeSettings& settings;
+    // Where the space we've reserved so far ends, or -1 if we're not reserving space.
+    off_t next;
+};
+
+} // namespace
+
+int escape_mapped_zero_copy(MappedFile& file, int out_fd, const EscapeSettings& settings, bool preallocate, EscapeStats *stats) {
+    Forwarder forwarder(file.descriptor(), out_fd);
+    Preallocator preallocator(out_fd, settings, preallocate);
+    EscapeState state;
+    StatsScope stats_scope(stats, state);
+    std::vector<unsigned char> outbuf(escape_output_bound(MIN_ZERO_COPY_RUN, settings.format));
+    bool write_error = false;
+
+    const unsigned char *window;
+    std::size_t window_len;
+    std::uint_fast64_t window_start = 0;
+    while (!write_error && file.next_window(window, window_len) && window_len > 0) {
+        stats_lap(stats, Phase::Read);
+        preallocator.reserve(window, window_len);
+        stats_lap(stats, Phase::Write);
+        std::size_t pos = 0;
+        while (pos < window_len) {
+            std::size_t piece = std::min(MIN_ZERO_COPY_RUN, window_len - pos);
+            // We only look for a long run at the start of each piece. A run that starts in
+            // the middle of a piece gets escaped up to the end of the piece, and the rest of
+            // it is found at the start of the next one.
+            if (state.at_boundary() && piece == MIN_ZERO_COPY_RUN &&
+                passthrough_prefix_len(window + pos, piece, settings.preserve) == piece) {
+                std::size_t run = piece + passthrough_prefix_len(window + pos + piece, window_len - pos - piece, settings.preserve);
+                stats_lap(stats, Phase::Escape);
+                if (!forwarder.forward(window_start + pos, window + pos, run)) {
+                    write_error = true;
+                    break;
+                }
+                stats_output(stats, run);
+                stats_lap(stats, Phase::Write);
+                state.num_bytes_read += run;
+                pos += run;
+                continue;
+            }
+            std::size_t outlen = escape_block(state, window + pos, piece, outbuf.data(), settings);
+            stats_lap(stats, Phase::Escape);
+            if (!write_all(out_fd, outbuf.data(), outlen)) {
+                write_error = true;
+                break;
+            }
+            stats_output(stats, outlen);
+            stats_lap(stats, Phase::Write);
+            if (state.invalid) {
+                preallocator.release();
+                std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+                return 2;
+            }
+            pos += piece;
+        }
+        window_start += window_len;
+    }
+
+    if (write_error || state.num_bytes_read != file.size() || !state.at_boundary()) {
+        preallocator.release();
+    }
+    // These are the same checks as at the end of escape_mapped in business_logic.cpp.
+    if (write_error) {
+        std::cerr << "There was a fatal error when trying to write to the output. Exiting now." << std::endl;
+        return 4;
+    }
+    if (state.num_bytes_read != file.size()) {
+        std::cerr << "Failed when trying to read byte " << (state.num_bytes_read + 1) << " due to unknown error." << std::endl;
+        return 3;
+    }
+    if (!state.at_boundary()) {
+        std::cerr << "The given text is not valid UTF-8 text. Exiting now." << std::endl;
+        return 2;
+    }
+    return 0;
+}
+
+#endif
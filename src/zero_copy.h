@@ -0,0 +1,46 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_ZERO_COPY_H
+#define ESCAPE_UTF8_ZERO_COPY_H
+
+#include <cstddef> // std::size_t
+
+#include "MappedFile.h"
+#include "escape_kernel.h" // EscapeSettings
+#include "stats.h"
+
+/*
+ * This is a faster version of read_and_escape for Linux, for when the input is a
+ * memory-mapped file and we have a file descriptor for the output. Long runs of bytes that
+ * don't need escaping are handed to the kernel with copy_file_range, splice or sendfile,
+ * so they go from the page cache to the output without passing through user space. Only
+ * the parts of the input that do need escaping go through escape_block.
+ *
+ * Everything else (the output, the error messages and the return values) is the same as
+ * read_and_escape.
+ */
+
+#ifdef __linux__
+
+// The shortest run of pass-through bytes that is worth a system call of its own. Shorter
+// runs are escaped (that is, copied) along with the bytes around them.
+static const std::size_t MIN_ZERO_COPY_RUN = 64 * 1024;
+
+/**
+ * @param file The input.
+ * @param out_fd The output. Nothing else may have written to it yet without flushing.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * @param preallocate Whether to reserve the disk space for the output before writing it, if
+ * the output is a regular file. See zero_copy.cpp.
+ * @param stats Where to count things for --stats, or null. The runs that the kernel copies
+ * count as written, not escaped.
+ * @return The same exit codes as read_and_escape.
+ */
+int escape_mapped_zero_copy(MappedFile& file, int out_fd, const EscapeSettings& settings = EscapeSettings(), bool preallocate = false,
+                            EscapeStats *stats = nullptr);
+
+#endif
+
+#endif //ESCAPE_UTF8_ZERO_COPY_H
@@ -0,0 +1,826 @@
+"""
+NOTE: this program will create new files in the current directory, potentially overwriting
+existing files. Be careful!
+
+This file contains integration tests for the command-line options that only the C++ version
+of the program has. The tests in integration_tests.py are shared with the Java version, so
+they only use the options that both versions understand.
+
+Usage: python3 cpp_integration_tests.py path/to/escape
+"""
+
+import sys
+if (sys.version_info[0] < 3) or (sys.version_info[0] == 3 and sys.version_info[1] < 5):
+    sys.exit("This script requires Python 3.5 or above.")
+
+import gzip
+import json
+import os
+import random
+import re
+import select
+import shutil
+import signal
+import socket
+import struct
+import time
+from subprocess import Popen, PIPE
+
+INVALID_CMD = b"The given input is not a valid usage of this program.\nUse 'escape --help' for usage information.\n"
+INVALID_UTF8 = b"The given text is not valid UTF-8 text. Exiting now.\n"
+
+
+def run(args, input_bytes=None, env=None):
+    """
+    Runs the executable with the given args (a list, not including the executable itself)
+    and returns (returncode, stdout, stderr). On Windows, stderr has CRLF line endings, so
+    we normalize it to LF. env is a dict of environment variables to set on top of ours.
+    """
+    full_env = None
+    if env is not None:
+        full_env = dict(os.environ)
+        full_env.update(env)
+    with Popen([absolute_path_to_executable] + args, stdin=PIPE, stdout=PIPE, stderr=PIPE, universal_newlines=False,
+               env=full_env) as proc:
+        (stdout_data, stderr_data) = proc.communicate(input_bytes)
+        return (proc.returncode, stdout_data, stderr_data.replace(b"\r\n", b"\n"))
+
+
+def make_mixed_text(size, seed):
+    """
+    Returns about size bytes of valid UTF-8 text with characters of every length.
+    """
+    rng = random.Random(seed)
+    pieces = ["a", "Hola mundo! ", "\t", "\n", "é", "€", "\U0001F602", "\u0001", "中"]
+    chunks = []
+    total = 0
+    while total < size:
+        piece = rng.choice(pieces).encode("utf8")
+        chunks.append(piece)
+        total += len(piece)
+    return b"".join(chunks)
+
+
+def test_threads():
+    # The input has to be a few MB to be split across threads at all.
+    text = make_mixed_text(5 * 1024 * 1024, 1)
+    with open("threads_input", mode="wb") as f:
+        f.write(text)
+    (code, expected, err) = run(["threads_input"])
+    assert code == 0
+    assert err == b""
+
+    for n in ["0", "1", "2", "3", "8"]:
+        (code, out, err) = run(["--threads", n, "threads_input"])
+        assert code == 0
+        assert out == expected
+        assert err == b""
+    # The other spelling, together with the output options, and reading from stdin.
+    (code, out, err) = run(["--threads=4", "-o", "threads_output", "threads_input"])
+    assert code == 0
+    assert out == b""
+    assert err == b""
+    with open("threads_output", mode="rb") as f:
+        assert f.read() == expected
+    (code, out, err) = run(["--threads", "4"], text)
+    assert (code, out, err) == (0, expected, b"")
+
+    # Invalid input must give the same output (up to the bad character) and exit code.
+    for pos in [0, 100000, len(text) // 2, len(text) - 1]:
+        bad = bytearray(text)
+        bad[pos] = 0xFF
+        single = run([], bytes(bad))
+        assert single[0] == 2
+        assert single[2] == INVALID_UTF8
+        assert run(["--threads", "4"], bytes(bad)) == single
+    truncated = text + b"\xF0\x9F\x98"
+    assert run(["--threads", "4"], truncated) == (2, expected, INVALID_UTF8)
+
+    # Malformed values for --threads
+    for args in [["--threads"], ["--threads="], ["--threads", "abc"], ["--threads=-1"],
+                 ["--threads", "2x"], ["--threads", "100000"], ["--threads", "2", "a", "b"]]:
+        assert run(args) == (5, b"", INVALID_CMD)
+    # --threads doesn't get in the way of --help
+    (code, out, err) = run(["--threads", "2", "--help"])
+    assert code == 0
+    assert b"--threads" in out
+    assert err == b""
+
+
+def test_zero_copy():
+    # Long runs of ASCII with some escapes in between. Read from a file, long runs are
+    # copied by the kernel on Linux (with splice to a pipe, or copy_file_range to a file),
+    # so we compare against the same input read from stdin, which always uses the streams.
+    rng = random.Random(2)
+    parts = []
+    for i in range(40):
+        parts.append(b"x" * rng.randrange(1, 300000))
+        parts.append(rng.choice([b"\x01", "\u00e9".encode("utf8"), "\U0001F602".encode("utf8"), b"\n"]))
+    text = b"".join(parts)
+    with open("zero_copy_input", mode="wb") as f:
+        f.write(text)
+    (code, expected, err) = run([], text)
+    assert (code, err) == (0, b"")
+
+    assert run(["zero_copy_input"]) == (0, expected, b"")
+    assert run(["zero_copy_input", "-o", "zero_copy_output"]) == (0, b"", b"")
+    with open("zero_copy_output", mode="rb") as f:
+        assert f.read() == expected
+    # The output file is truncated first, even if it was longer.
+    with open("zero_copy_output", mode="wb") as f:
+        f.write(b"y" * (len(expected) + 100000))
+    assert run(["zero_copy_input", "-o", "zero_copy_output"]) == (0, b"", b"")
+    with open("zero_copy_output", mode="rb") as f:
+        assert f.read() == expected
+
+    # An invalid byte after a long run
+    bad = text[:500000] + b"\xFF" + text[500000:]
+    with open("zero_copy_input", mode="wb") as f:
+        f.write(bad)
+    single = run([], bad)
+    assert single[0] == 2
+    assert run(["zero_copy_input"]) == single
+
+
+def test_check():
+    text = make_mixed_text(3 * 1024 * 1024, 3)
+    with open("check_input", mode="wb") as f:
+        f.write(text)
+    assert run(["--check", "check_input"]) == (0, b"", b"")
+    assert run(["--check"], text) == (0, b"", b"")
+    assert run(["--check"], b"") == (0, b"", b"")
+
+    # The position of the first invalid byte is 1-based, and counts the whole bad sequence
+    # up to the byte where it went wrong.
+    cases = [
+        (b"\xFF", 1),
+        (b"abc\xC0\x80", 4),           # Overlong
+        (b"abc\xE0\x80\x80", 5),       # Overlong
+        (b"ab\xED\xA0\x80", 4),        # Surrogate
+        (b"\xF4\x90\x80\x80", 2),       # Above U+10FFFF
+        (b"a\xE2\x82a", 4),            # Too short
+    ]
+    for (bad, pos) in cases:
+        expected_err = INVALID_UTF8 + b"Byte " + str(pos).encode() + b" is invalid.\n"
+        assert run(["--check"], bad) == (2, b"", expected_err)
+        # The same thing after a few MB of valid text, read from a file.
+        with open("check_input", mode="wb") as f:
+            f.write(text + bad)
+        expected_err = INVALID_UTF8 + b"Byte " + str(len(text) + pos).encode() + b" is invalid.\n"
+        assert run(["--check", "check_input"]) == (2, b"", expected_err)
+    (code, out, err) = run(["--check"], text + b"\xF0\x9F\x98")
+    assert (code, out) == (2, b"")
+    assert err.startswith(INVALID_UTF8 + b"Reached EOF after reading " + str(len(text) + 3).encode() + b" byte(s).")
+
+    # --check doesn't write output, so an output file is rejected.
+    assert run(["--check", "-o", "check_output", "check_input"]) == (5, b"", INVALID_CMD)
+    assert not os.path.exists("check_output")
+
+
+def test_decode():
+    # Round trip: every test case that escapes successfully must decode back to itself.
+    test_dir = os.path.dirname(os.path.realpath(__file__))
+    vcs_testcases = os.path.join(test_dir, "vcs_testcases")
+    paths = [os.path.join(vcs_testcases, name) for name in os.listdir(vcs_testcases)]
+    paths += [os.path.join(vcs_testcases, "gen", name) for name in os.listdir(os.path.join(vcs_testcases, "gen"))]
+    num_round_trips = 0
+    for path in sorted(paths):
+        if not os.path.isfile(path) or path.endswith(".md") or path.endswith(".py"):
+            continue
+        with open(path, mode="rb") as f:
+            original = f.read()
+        (code, escaped, err) = run([path])
+        if code != 0:
+            continue  # Not valid UTF-8, so there's nothing to round-trip.
+        assert run(["--decode"], escaped) == (0, original, b"")
+        with open("decode_input", mode="wb") as f:
+            f.write(escaped)
+        assert run(["--decode", "decode_input", "-o", "decode_output"]) == (0, b"", b"")
+        with open("decode_output", mode="rb") as f:
+            assert f.read() == original
+        num_round_trips += 1
+    assert num_round_trips >= 10
+
+    # A big input, so that escape strings get split between blocks.
+    text = make_mixed_text(3 * 1024 * 1024, 4)
+    (code, escaped, err) = run([], text)
+    assert code == 0
+    assert run(["--decode"], escaped) == (0, text, b"")
+
+    # Malformed or out-of-range escape strings
+    bad_escape = b"The given text contains an invalid escape sequence. Exiting now.\n"
+    for (bad, pos) in [(b"ab\\u'12G4'", 8), (b"ab\\u'110000'", 12), (b"ab\\u'D800'", 10), (b"ab\\u''", 6)]:
+        assert run(["--decode"], bad) == (2, b"ab", bad_escape + b"Byte " + str(pos).encode() + b" is invalid.\n")
+    assert run(["--decode"], b"ab\\u'0041") == (2, b"ab", bad_escape)
+    assert run(["--decode"], b"ab\xFF") == (2, b"ab", INVALID_UTF8 + b"Byte 3 is invalid.\n")
+    # A backslash that doesn't start an escape string stands for itself.
+    assert run(["--decode"], b"C:\\dir\\u\\") == (0, b"C:\\dir\\u\\", b"")
+    assert run(["--decode", "--check"]) == (5, b"", INVALID_CMD)
+
+
+def test_batch():
+    # A small tree of inputs, one of which isn't valid UTF-8.
+    shutil.rmtree("batch_in", ignore_errors=True)
+    shutil.rmtree("batch_out", ignore_errors=True)
+    os.makedirs(os.path.join("batch_in", "sub"))
+    contents = {
+        os.path.join("batch_in", "a.txt"): "caf\u00e9\n".encode("utf8"),
+        os.path.join("batch_in", "big.txt"): make_mixed_text(1024 * 1024, 13),
+        os.path.join("batch_in", "sub", "c.txt"): b"",
+        os.path.join("batch_in", "sub", "d.txt"): "\U0001F602".encode("utf8"),
+    }
+    for (path, data) in contents.items():
+        with open(path, mode="wb") as f:
+            f.write(data)
+    names = sorted(contents)
+    expected_out = b"".join(b"0\t" + name.encode() + b"\n" for name in names)
+
+    def check_outputs(output_name):
+        for name in names:
+            with open(output_name(name), mode="rb") as f:
+                assert f.read() == run([], contents[name])[1]
+
+    # --suffix, with the files on the command line
+    for threads in ["1", "3"]:
+        assert run(["--batch", "--threads", threads, "--suffix", ".esc"] + names) == (0, expected_out, b"")
+        check_outputs(lambda name: name + ".esc")
+    # --recursive skips the .esc files from the last run, and lists files in sorted order.
+    assert run(["--batch", "--suffix", ".esc", "-r", "batch_in"]) == (0, expected_out, b"")
+
+    # --output-dir, with the list of files on stdin
+    file_list = "\n".join(names).encode() + b"\n"
+    assert run(["--batch", "--output-dir", "batch_out", "--files-from", "-"], file_list) == (0, expected_out, b"")
+    check_outputs(lambda name: os.path.join("batch_out", name))
+
+    # A file that fails doesn't stop the others, and the exit status is the first failure's.
+    bad = os.path.join("batch_in", "sub", "bad.txt")
+    with open(bad, mode="wb") as f:
+        f.write(b"ab\xFF")
+    missing = os.path.join("batch_in", "missing.txt")
+    (code, out, err) = run(["--batch", "--output-dir", "batch_out", missing, bad] + names)
+    assert (code, err) == (1, b"")
+    assert out == b"1\t" + missing.encode() + b"\n2\t" + bad.encode() + b"\n" + expected_out
+    check_outputs(lambda name: os.path.join("batch_out", name))
+
+    # Bad usages: no inputs, no output location, both output locations, and options that
+    # only make sense for batch mode.
+    assert run(["--batch", "--suffix", ".esc"]) == (5, b"", INVALID_CMD)
+    assert run(["--batch", names[0]]) == (5, b"", INVALID_CMD)
+    assert run(["--batch", "--suffix", ".esc", "--output-dir", "batch_out", names[0]]) == (5, b"", INVALID_CMD)
+    assert run(["--batch", "--check", "--suffix", ".esc", names[0]]) == (5, b"", INVALID_CMD)
+    assert run(["--suffix", ".esc", names[0]]) == (5, b"", INVALID_CMD)
+    shutil.rmtree("batch_in")
+    shutil.rmtree("batch_out")
+
+
+def test_measure():
+    text = make_mixed_text(3 * 1024 * 1024, 14)
+    with open("measure_input", mode="wb") as f:
+        f.write(text)
+    (code, escaped, err) = run(["measure_input"])
+    assert (code, err) == (0, b"")
+    expected = str(len(escaped)).encode() + b"\n"
+    assert run(["--measure", "measure_input"]) == (0, expected, b"")
+    assert run(["--measure"], text) == (0, expected, b"")
+    assert run(["--measure"], b"") == (0, b"0\n", b"")
+    assert run(["--measure", "-o", "measure_output", "measure_input"]) == (0, b"", b"")
+    with open("measure_output", mode="rb") as f:
+        assert f.read() == expected
+    # Invalid input gets the same messages as --check.
+    assert run(["--measure"], b"abc\xC0\x80") == (2, b"", INVALID_UTF8 + b"Byte 4 is invalid.\n")
+
+    # --preallocate doesn't change the output, even when the input is invalid and the output
+    # stops early.
+    for data in [text, text + b"\xFF" + text]:
+        with open("measure_input", mode="wb") as f:
+            f.write(data)
+        (code, out, err) = run(["measure_input"])
+        assert run(["--preallocate", "measure_input", "-o", "measure_output"]) == (code, b"", err)
+        with open("measure_output", mode="rb") as f:
+            assert f.read() == out
+    assert run(["--measure", "--check"]) == (5, b"", INVALID_CMD)
+    assert run(["--measure", "--preallocate"]) == (5, b"", INVALID_CMD)
+
+
+def test_format():
+    text = make_mixed_text(2 * 1024 * 1024, 15)
+    with open("format_input", mode="wb") as f:
+        f.write(text)
+    original = text.decode("utf8")
+    # How to undo each format, so we can check that the output stands for the original text.
+    # The input has no backslashes or ampersands of its own.
+    decoders = {
+        "rfc5137": lambda out: run(["--decode"], out)[1].decode("utf8"),
+        "json": lambda out: json.loads('"' + out.decode("ascii") + '"', strict=False),
+        "braces": lambda out: re.sub(r"\\U\{([0-9A-F]+)\}", lambda m: chr(int(m.group(1), 16)), out.decode("ascii")),
+        # Not html.unescape, which turns some control characters into other characters, as browsers do.
+        "html": lambda out: re.sub(r"&#x([0-9A-F]+);", lambda m: chr(int(m.group(1), 16)), out.decode("ascii")),
+    }
+    for (name, decode) in decoders.items():
+        (code, out, err) = run(["--format", name, "format_input"])
+        assert (code, err) == (0, b"")
+        assert decode(out) == original
+        # The other ways of escaping give the same output.
+        assert run(["--format=" + name], text) == (0, out, b"")
+        assert run(["--format", name, "--threads", "3", "format_input"]) == (0, out, b"")
+        assert run(["--format", name, "--measure", "format_input"]) == (0, str(len(out)).encode() + b"\n", b"")
+
+    assert run(["--format", "json"], "\U0001F602\u00e9\u0001".encode("utf8")) == (0, b"\\uD83D\\uDE02\\u00E9\\u0001", b"")
+    assert run(["--format", "html"], b"a\xC3\xA9") == (0, b"a&#x00E9;", b"")
+    assert run(["--format", "xml"]) == (5, b"", INVALID_CMD)
+    assert run(["--format", "json", "--decode"]) == (5, b"", INVALID_CMD)
+    assert run(["--format", "json", "--check"]) == (5, b"", INVALID_CMD)
+
+
+def test_preserve():
+    # Text with backslashes and quotes, so that it can't be decoded unless those are escaped too.
+    text = make_mixed_text(2 * 1024 * 1024, 16).replace(b"o", b"\\u'0041'").replace(b"l", b"\x0B\x0C")
+    with open("preserve_input", mode="wb") as f:
+        f.write(text)
+    (code, out, err) = run(["--preserve", "default,-\\,-'", "preserve_input"])
+    assert (code, err) == (0, b"")
+    assert b"\\u'005C'u\\u'0027'0041\\u'0027'" in out
+    assert run(["--decode"], out) == (0, text, b"")
+    # The other ways of escaping give the same output.
+    assert run(["--preserve=default,-\\,-'"], text) == (0, out, b"")
+    assert run(["--preserve", "default,-\\,-'", "--threads", "3", "preserve_input"]) == (0, out, b"")
+    assert run(["--preserve", "default,-\\,-'", "--measure", "preserve_input"]) == (0, str(len(out)).encode() + b"\n", b"")
+
+    (code, out, err) = run(["--preserve", "default,0x0B,0x0C", "--format", "json", "preserve_input"])
+    assert (code, err) == (0, b"")
+    assert b"\x0B\x0C" in out and b"\\u000B" not in out
+
+    assert run(["--preserve", "ascii"], b"\x00\x01\x7F\xC3\xA9") == (0, b"\x00\x01\x7F\\u'00E9'", b"")
+    assert run(["--preserve", "none"], b"ab") == (0, b"\\u'0061'\\u'0062'", b"")
+    assert run(["--preserve", "default,-0x61-0x62"], b"abc\n") == (0, b"\\u'0061'\\u'0062'c\n", b"")
+    assert run(["--preserve", "0x80"]) == (5, b"", INVALID_CMD)
+    assert run(["--preserve", ""]) == (5, b"", INVALID_CMD)
+    assert run(["--preserve", "ascii", "--decode"]) == (5, b"", INVALID_CMD)
+    assert run(["--preserve", "ascii", "--check"]) == (5, b"", INVALID_CMD)
+
+
+def read_until(fd, expected, timeout):
+    """
+    Reads from the file descriptor until the data read so far is at least as long as expected,
+    or until nothing has come for timeout seconds. Returns the data.
+    """
+    data = b""
+    while len(data) < len(expected):
+        (ready, _, _) = select.select([fd], [], [], timeout)
+        if not ready:
+            break
+        chunk = os.read(fd, 65536)
+        if not chunk:
+            break
+        data += chunk
+    return data
+
+
+def test_latency():
+    if os.name == "nt":
+        return  # The streaming mode is Linux-only, and select() doesn't work on pipes on Windows.
+    lines = ["line {} h\u00e9llo \U0001F602\n".format(i).encode("utf8") for i in range(20)]
+    escaped = [line.replace("\u00e9".encode("utf8"), b"\\u'00E9'").replace("\U0001F602".encode("utf8"), b"\\u'1F602'")
+               for line in lines]
+    # The time from writing each line to reading its escaped version, for a quiet stream
+    # (one line every 20ms).
+    with Popen([absolute_path_to_executable, "--line-buffered"], stdin=PIPE, stdout=PIPE, stderr=PIPE) as proc:
+        latencies = []
+        for (line, expected) in zip(lines, escaped):
+            start = time.perf_counter()
+            proc.stdin.write(line)
+            proc.stdin.flush()
+            assert read_until(proc.stdout.fileno(), expected, 5) == expected
+            latencies.append(time.perf_counter() - start)
+            time.sleep(0.02)
+        proc.stdin.close()
+        assert proc.stdout.read() == b""
+        assert proc.wait() == 0
+    latencies.sort()
+    # This should really be well under a millisecond, but slow test machines get some slack.
+    assert latencies[len(latencies) // 2] < 0.1, latencies
+    assert latencies[-1] < 1, latencies
+
+    # Without a line feed, the output only comes out at the deadline.
+    with Popen([absolute_path_to_executable, "--line-buffered", "--max-latency-ms", "50"], stdin=PIPE, stdout=PIPE, stderr=PIPE) as proc:
+        start = time.perf_counter()
+        proc.stdin.write(b"no line feed")
+        proc.stdin.flush()
+        assert read_until(proc.stdout.fileno(), b"no line feed", 5) == b"no line feed"
+        assert time.perf_counter() - start >= 0.04
+        proc.stdin.close()
+        assert proc.wait() == 0
+
+    # The streaming mode gives the same output as the normal mode.
+    text = make_mixed_text(2 * 1024 * 1024, 17)
+    (code, out, err) = run([], text)
+    assert run(["--line-buffered"], text) == (code, out, err)
+    assert run(["--max-latency-ms=0", "--format", "json"], text) == run(["--format", "json"], text)
+    assert run(["--line-buffered"], b"ok\n\xC3") == (2, b"ok\n", INVALID_UTF8)
+    assert run(["--line-buffered", "--threads", "2"]) == (5, b"", INVALID_CMD)
+    assert run(["--max-latency-ms", "10", "--check"]) == (5, b"", INVALID_CMD)
+    assert run(["--max-latency-ms", "-1"]) == (5, b"", INVALID_CMD)
+
+
+def test_stats():
+    text = make_mixed_text(2 * 1024 * 1024, 18)
+    with open("stats_input", mode="wb") as f:
+        f.write(text)
+    chars = text.decode("utf8")
+    passed = sum(1 for c in chars if c in "\t\n\r" or " " <= c <= "~")
+    by_length = [0, 0, 0, 0]
+    for c in chars:
+        by_length[len(c.encode("utf8")) - 1] += 1
+    by_length[0] -= passed
+    (code, expected, err) = run([], text)
+    assert (code, err) == (0, b"")
+
+    # Each way of escaping: a pipe, a mapped file to a pipe (zero-copy), a mapped file to a
+    # file, threads, and the streaming mode.
+    for (args, stdin) in [([], text), (["stats_input"], None), (["stats_input", "-o", "stats_output"], None),
+                          (["--threads", "3"], text), (["--line-buffered"], text)]:
+        (code, out, err) = run(["--stats", "--stats-file", "stats.json"] + args, stdin)
+        assert code == 0
+        if "-o" in args:
+            with open("stats_output", mode="rb") as f:
+                out = f.read()
+        assert out == expected
+        assert re.search(b"^Bytes in: +%d\n" % len(text), err, re.MULTILINE)
+        assert re.search(b"^Throughput: +[0-9.]+ MB/s\n", err, re.MULTILINE)
+        with open("stats.json") as f:
+            stats = json.load(f)
+        assert stats["bytes_in"] == len(text) and stats["bytes_out"] == len(expected)
+        assert stats["ascii_passed_through"] == passed
+        assert [stats["ascii_escaped"], stats["two_byte_chars"], stats["three_byte_chars"], stats["four_byte_chars"]] == by_length
+        assert 0 <= stats["read_seconds"] + stats["escape_seconds"] + stats["write_seconds"] <= stats["total_seconds"] + 1e-6
+
+    # --stats-file on its own doesn't print anything, and the stats are there even if the input is invalid.
+    assert run(["--stats-file", "stats.json"], text) == (0, expected, b"")
+    (code, out, err) = run(["--stats"], b"ab\x01\xFF")
+    assert (code, out) == (2, b"ab\\u'0001'")
+    assert err.startswith(INVALID_UTF8) and b"\nBytes in:              4\n" in err
+    (code, out, err) = run(["--stats-file", os.path.join("no_such_dir", "stats.json")], text)
+    assert (code, out) == (1, b"")
+    assert run(["--stats", "--check"]) == (5, b"", INVALID_CMD)
+    assert run(["--stats-file", "stats.json", "--measure"]) == (5, b"", INVALID_CMD)
+    assert run(["--stats-file"]) == (5, b"", INVALID_CMD)
+    assert run(["--batch", "--suffix", ".esc", "--stats", "stats_input"]) == (5, b"", INVALID_CMD)
+
+
+def test_kernel():
+    text = make_mixed_text(2 * 1024 * 1024, 19)
+    with open("kernel_input", mode="wb") as f:
+        f.write(text)
+    (code, expected, err) = run(["kernel_input"])
+    assert (code, err) == (0, b"")
+    custom = ["--preserve", "default,-\\,0x0B"]
+    (code, expected_custom, err) = run(custom + ["kernel_input"])
+    assert (code, err) == (0, b"")
+
+    # Every tier that this CPU has gives the same output, whether it's chosen with the flag or
+    # with the environment variable. The portable ones are always there.
+    tiers = ["scalar", "swar", "sse2", "sse4.2", "avx2", "avx512"]
+    supported = []
+    for tier in tiers:
+        (code, out, err) = run(["--kernel", tier, "--stats-file", "kernel.json", "kernel_input"])
+        if code == 5:
+            assert (out, err) == (b"", b"The %s kernel can't be used on this CPU. Exiting now.\n" % tier.encode())
+            continue
+        supported.append(tier)
+        assert (code, out, err) == (0, expected, b"")
+        with open("kernel.json") as f:
+            assert json.load(f)["kernel"] == tier
+        assert run(["--kernel=" + tier], text) == (0, expected, b"")
+        assert run(custom + ["--kernel", tier, "kernel_input"]) == (0, expected_custom, b"")
+        assert run(["--kernel", tier, "--threads", "3", "kernel_input"]) == (0, expected, b"")
+        assert run(["--stats-file", "kernel.json", "kernel_input"], env={"ESCAPE_UTF8_KERNEL": tier}) == (0, expected, b"")
+        with open("kernel.json") as f:
+            assert json.load(f)["kernel"] == tier
+    assert supported[:2] == ["scalar", "swar"]
+    # A CPU that has a tier has every tier below it.
+    assert supported == tiers[:len(supported)]
+
+    # The best tier is the default, and the environment variable is ignored if it isn't usable.
+    assert run(["--stats-file", "kernel.json", "kernel_input"], env={"ESCAPE_UTF8_KERNEL": "avx9000"}) == (0, expected, b"")
+    with open("kernel.json") as f:
+        assert json.load(f)["kernel"] == supported[-1]
+    # --kernel wins over the environment variable.
+    assert run(["--kernel", "swar", "--stats-file", "kernel.json", "kernel_input"], env={"ESCAPE_UTF8_KERNEL": "scalar"}) == (0, expected, b"")
+    with open("kernel.json") as f:
+        assert json.load(f)["kernel"] == "swar"
+    assert run(["--kernel", "scalar", "--check", "kernel_input"]) == (0, b"", b"")
+    assert run(["--kernel", "avx9000"]) == (5, b"", INVALID_CMD)
+    assert run(["--kernel"]) == (5, b"", INVALID_CMD)
+
+
+def serve_request(sock, data):
+    """
+    Sends one --serve request on sock and returns (status, output).
+    """
+    sock.sendall(struct.pack(">I", len(data)) + data)
+    header = b""
+    while len(header) < 5:
+        chunk = sock.recv(5 - len(header))
+        assert chunk, "the server closed the connection"
+        header += chunk
+    (status, length) = struct.unpack(">BI", header)
+    output = b""
+    while len(output) < length:
+        chunk = sock.recv(length - len(output))
+        assert chunk, "the server closed the connection"
+        output += chunk
+    return (status, output)
+
+
+def connect_when_ready(path, proc):
+    """
+    Connects to the server at path, waiting for it to start listening.
+    """
+    for _ in range(500):
+        assert proc.poll() is None, proc.stderr.read()
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            sock.connect(path)
+            return sock
+        except OSError:
+            sock.close()
+            time.sleep(0.01)
+    raise AssertionError("the server never started listening")
+
+
+def test_serve():
+    if not sys.platform.startswith("linux"):
+        assert run(["--serve", "escape.sock"]) == (5, b"", b"--serve is only available on Linux. Exiting now.\n")
+        return
+    path = os.path.abspath("escape.sock")
+    if os.path.exists(path):
+        os.remove(path)
+    with Popen([absolute_path_to_executable, "--serve", path], stdin=PIPE, stdout=PIPE, stderr=PIPE) as proc:
+        sock = connect_when_ready(path, proc)
+        assert serve_request(sock, "h\u00e9llo \U0001F602\n".encode("utf8")) == (0, b"h\\u'00E9'llo \\u'1F602'\n")
+        assert serve_request(sock, b"") == (0, b"")
+        assert serve_request(sock, b"ok\xC3") == (2, b"ok")
+        # The same output as the normal mode, for a big input.
+        text = make_mixed_text(1024 * 1024, 21)
+        assert serve_request(sock, text) == (0, run([], text)[1])
+        # A second client, at the same time.
+        other = connect_when_ready(path, proc)
+        assert serve_request(other, "\u20ac".encode("utf8")) == (0, b"\\u'20AC'")
+        other.close()
+        assert serve_request(sock, b"still here") == (0, b"still here")
+        sock.close()
+        proc.send_signal(signal.SIGTERM)
+        assert proc.wait(10) == 0
+        assert proc.stdout.read() == b""
+        assert proc.stderr.read() == b""
+    # The socket file is removed when the server stops.
+    assert not os.path.exists(path)
+
+    # --format and --preserve apply to every request.
+    with Popen([absolute_path_to_executable, "--serve", path, "--format", "json", "--preserve", "default,-\\"],
+               stdin=PIPE, stdout=PIPE, stderr=PIPE) as proc:
+        sock = connect_when_ready(path, proc)
+        assert serve_request(sock, "a\\\u00e9".encode("utf8")) == (0, b"a\\u005C\\u00E9")
+        sock.close()
+        proc.send_signal(signal.SIGINT)
+        assert proc.wait(10) == 0
+
+    # A socket file left behind by a server that was killed gets replaced.
+    stale = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    stale.bind(path)
+    stale.close()
+    assert os.path.exists(path)
+    with Popen([absolute_path_to_executable, "--serve", path], stdin=PIPE, stdout=PIPE, stderr=PIPE) as proc:
+        sock = connect_when_ready(path, proc)
+        assert serve_request(sock, b"x") == (0, b"x")
+        # But not while a server is using it.
+        assert run(["--serve", path]) == (1, b"", b"Something is already using \"%s\". Exiting now.\n" % path.encode())
+        assert serve_request(sock, b"y") == (0, b"y")
+        sock.close()
+        proc.send_signal(signal.SIGTERM)
+        assert proc.wait(10) == 0
+    assert not os.path.exists(path)
+
+    # --serve doesn't go with the options for files and modes.
+    for args in (["in.txt"], ["-o", "out.txt"], ["--check"], ["--decode"], ["--measure"], ["--threads", "2"],
+                 ["--line-buffered"], ["--stats"], ["--files-from", "list.txt"]):
+        assert run(["--serve", path] + args) == (5, b"", INVALID_CMD), args
+    assert run(["--serve"]) == (5, b"", INVALID_CMD)
+    assert run(["--serve", ""]) == (5, b"", INVALID_CMD)
+    assert not os.path.exists(path)
+
+
+def test_compression():
+    # Each format is only there if escape was built with its library. A build without it
+    # says so when asked to compress, and refuses to read input in that format.
+    text = make_mixed_text(3 * 1024 * 1024, 12)
+    (code, expected, err) = run([], text)
+    assert (code, err) == (0, b"")
+    available = {}
+    for name in ["gzip", "zstd"]:
+        (code, out, err) = run(["--compress", name], b"")
+        if code == 0:
+            available[name] = True
+        else:
+            assert (code, out, err) == (5, b"", b"This build of escape can't compress with " + name.encode() + b". Exiting now.\n")
+            available[name] = False
+    if not available["zstd"]:
+        zstd_data = b"\x28\xB5\x2F\xFD" + b"\x00" * 10
+        assert run([], zstd_data) == (1, b"", b"The input is compressed with zstd, which this build of escape can't read. Exiting now.\n")
+
+    if available["gzip"]:
+        compressed = gzip.compress(text)
+        with open("compression_input.gz", mode="wb") as f:
+            f.write(compressed)
+        # From a file and from stdin, with each engine.
+        assert run(["compression_input.gz"]) == (0, expected, b"")
+        assert run([], compressed) == (0, expected, b"")
+        assert run(["--threads", "3", "compression_input.gz"]) == (0, expected, b"")
+        assert run(["--check", "compression_input.gz"]) == (0, b"", b"")
+        # The streaming mode reads an input file like the normal mode, so it's decompressed too.
+        assert run(["--line-buffered", "compression_input.gz"]) == (0, expected, b"")
+        assert run(["--max-latency-ms", "5", "compression_input.gz"]) == (0, expected, b"")
+        assert run(["--measure"], compressed) == (0, str(len(expected)).encode() + b"\n", b"")
+        # Several gzip files one after another, like "cat a.gz b.gz", are read as one.
+        assert run([], compressed + compressed) == (0, expected + expected, b"")
+
+        # Compressed output, to stdout and to a file.
+        (code, out, err) = run(["--compress", "gzip"], text)
+        assert (code, err) == (0, b"")
+        assert gzip.decompress(out) == expected
+        assert run(["--compress=gzip", "compression_input.gz", "-o", "compression_output.gz"]) == (0, b"", b"")
+        with open("compression_output.gz", mode="rb") as f:
+            assert gzip.decompress(f.read()) == expected
+        # --decode both ways round.
+        (code, out, err) = run(["--decode", "--compress", "gzip"], gzip.compress(expected))
+        assert (code, err) == (0, b"")
+        assert gzip.decompress(out) == text
+
+        # Invalid text inside the compressed data: the output still has everything before it,
+        # and it's still a complete gzip file.
+        bad = text[:1000000] + b"\xFF" + text[1000000:]
+        (code, out, err) = run(["--compress", "gzip"], gzip.compress(bad))
+        assert (code, err) == (2, INVALID_UTF8)
+        assert expected.startswith(gzip.decompress(out))
+        # Corrupt or cut-off compressed data is a read error.
+        (code, out, err) = run([], compressed[:len(compressed) // 2])
+        assert code == 3
+        assert expected.startswith(out)
+        assert err.startswith(b"The input is not valid gzip data. Either it's corrupt or it's cut off.\n")
+
+        # Batch mode decompresses each file, and compresses each output with --compress.
+        if os.path.exists("compression_batch"):
+            shutil.rmtree("compression_batch")
+        os.mkdir("compression_batch")
+        assert run(["--batch", "--output-dir", "compression_batch", "--compress", "gzip", "compression_input.gz"]) == \
+            (0, b"0\tcompression_input.gz\n", b"")
+        with open(os.path.join("compression_batch", "compression_input.gz"), mode="rb") as f:
+            assert gzip.decompress(f.read()) == expected
+
+    # Text that only starts like a magic number isn't mistaken for compressed data.
+    for start in [b"\x1F", b"\x1Fa", b"\x28\xB5\x2F"]:
+        assert run([], start)[0] == (0 if start[-1:] in (b"\x1F", b"a") else 2)
+
+    # --compress needs output to compress, in one piece.
+    for args in (["--check"], ["--measure"], ["--preallocate"], ["--line-buffered"], ["--max-latency-ms", "10"],
+                 ["--serve", "compression.sock"]):
+        assert run(["--compress", "gzip"] + args, b"") == (5, b"", INVALID_CMD), args
+    for args in (["--compress"], ["--compress", "zip"], ["--compress="], ["--compress", "none"]):
+        assert run(args, b"") == (5, b"", INVALID_CMD), args
+
+
+def test_in_place():
+    shutil.rmtree("in_place", ignore_errors=True)
+    os.makedirs(os.path.join("in_place", "sub"))
+    mixed = make_mixed_text(1024 * 1024, 15)
+    contents = {
+        os.path.join("in_place", "ascii.txt"): b"Nothing to escape here.\n" * 1000,
+        os.path.join("in_place", "empty.txt"): b"",
+        os.path.join("in_place", "mixed.txt"): mixed,
+        os.path.join("in_place", "sub", "bad.txt"): b"ab\xFF",
+        os.path.join("in_place", "sub", "cafe.txt"): "caf\u00e9\n".encode("utf8"),
+    }
+    for (path, data) in contents.items():
+        with open(path, mode="wb") as f:
+            f.write(data)
+    names = sorted(contents)
+    before = {name: os.stat(name) for name in names}
+    statuses = {name: b"2" if name.endswith("bad.txt") else b"0" for name in names}
+    expected_out = b"".join(statuses[name] + b"\t" + name.encode() + b"\n" for name in names)
+    assert run(["--batch", "--in-place", "--threads", "2", "-r", "in_place"]) == (2, expected_out, b"")
+    for name in names:
+        after = os.stat(name)
+        with open(name, mode="rb") as f:
+            result = f.read()
+        if name.endswith("cafe.txt") or name.endswith("mixed.txt"):
+            assert result == run([], contents[name])[1]
+            assert after.st_ino != before[name].st_ino
+        else:
+            # Files that wouldn't change, or can't be escaped, aren't written at all.
+            assert result == contents[name]
+            assert (after.st_ino, after.st_mtime_ns) == (before[name].st_ino, before[name].st_mtime_ns)
+    # Nothing else was left in the directories.
+    assert sorted(os.listdir("in_place")) == ["ascii.txt", "empty.txt", "mixed.txt", "sub"]
+    assert sorted(os.listdir(os.path.join("in_place", "sub"))) == ["bad.txt", "cafe.txt"]
+    # Running it again changes nothing, since escaped text only needs escaping again if
+    # backslashes are escaped.
+    assert run(["--batch", "--in-place", "-r", "in_place"]) == (2, expected_out, b"")
+
+    assert run(["--batch", "--in-place", "--suffix", ".esc", names[0]]) == (5, b"", INVALID_CMD)
+    assert run(["--batch", "--in-place", "--compress", "gzip", names[0]]) == (5, b"", INVALID_CMD)
+    assert run(["--in-place", names[0]]) == (5, b"", INVALID_CMD)
+    shutil.rmtree("in_place")
+
+
+def wait_for_file(path, expected, timeout=10):
+    """
+    Waits until the file at path has the contents expected, for up to timeout seconds.
+    Returns the contents it ended up with.
+    """
+    deadline = time.time() + timeout
+    while True:
+        try:
+            with open(path, mode="rb") as f:
+                data = f.read()
+        except FileNotFoundError:
+            data = None
+        if data == expected or time.time() > deadline:
+            return data
+        time.sleep(0.01)
+
+
+def test_follow():
+    if not sys.platform.startswith("linux"):
+        assert run(["--follow", "in.log"]) == (5, b"", b"--follow is only available on Linux. Exiting now.\n")
+        return
+    shutil.rmtree("follow", ignore_errors=True)
+    os.makedirs("follow")
+    log = os.path.join("follow", "app.log")
+    out = os.path.join("follow", "out.txt")
+    checkpoint = os.path.join("follow", "checkpoint")
+    with open(log, mode="wb") as f:
+        f.write("caf\u00e9\n".encode("utf8"))
+    args = [absolute_path_to_executable, "--follow", log, "-o", out, "--checkpoint", checkpoint]
+    with Popen(args, stdin=PIPE, stdout=PIPE, stderr=PIPE) as proc:
+        assert wait_for_file(out, b"caf\\u'00E9'\n") == b"caf\\u'00E9'\n"
+        with open(log, mode="ab") as f:
+            f.write("\u20ac\n".encode("utf8"))
+        assert wait_for_file(out, b"caf\\u'00E9'\n\\u'20AC'\n") == b"caf\\u'00E9'\n\\u'20AC'\n"
+        # Rotation: the old file is renamed and a new one takes its place.
+        os.rename(log, log + ".1")
+        with open(log, mode="wb") as f:
+            f.write(b"new file\n")
+        assert wait_for_file(out, b"caf\\u'00E9'\n\\u'20AC'\nnew file\n") == b"caf\\u'00E9'\n\\u'20AC'\nnew file\n"
+        proc.send_signal(signal.SIGTERM)
+        assert proc.wait(10) == 0
+        assert proc.stdout.read() == b""
+        assert proc.stderr.read() == b""
+    info = os.stat(log)
+    with open(checkpoint, mode="rb") as f:
+        assert f.read() == b"%d %d 9\n" % (info.st_dev, info.st_ino)
+
+    # Started again, it carries on from the checkpoint, and appends to the output.
+    with open(log, mode="ab") as f:
+        f.write(b"while stopped\n")
+    with Popen(args, stdin=PIPE, stdout=PIPE, stderr=PIPE) as proc:
+        expected = b"caf\\u'00E9'\n\\u'20AC'\nnew file\nwhile stopped\n"
+        assert wait_for_file(out, expected) == expected
+        proc.send_signal(signal.SIGINT)
+        assert proc.wait(10) == 0
+
+    # Invalid input stops it, like in the normal mode. Without a checkpoint, the whole file is
+    # escaped, to stdout.
+    with open(log, mode="ab") as f:
+        f.write(b"ok\xFF")
+    assert run(["--follow", log]) == (2, b"new file\nwhile stopped\nok", INVALID_UTF8)
+
+    for args in (["--check"], ["--decode"], ["--measure"], ["--threads", "2"], ["--line-buffered"], ["--stats"],
+                 ["--preallocate"], ["--compress", "gzip"], ["--serve", "escape.sock"], ["--batch"]):
+        assert run(["--follow", log] + args) == (5, b"", INVALID_CMD), args
+    assert run(["--follow"]) == (5, b"", INVALID_CMD)
+    assert run(["--checkpoint", checkpoint, log]) == (5, b"", INVALID_CMD)
+    assert run(["--follow", log, "--checkpoint"]) == (5, b"", INVALID_CMD)
+    shutil.rmtree("follow")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) <= 1:
+        sys.exit("You must give the path to the compiled 'escape' executable file as a command-line argument.")
+    absolute_path_to_executable = os.path.realpath(sys.argv[1])
+
+    test_threads()
+    test_zero_copy()
+    test_check()
+    test_decode()
+    test_batch()
+    test_measure()
+    test_format()
+    test_preserve()
+    test_latency()
+    test_stats()
+    test_kernel()
+    test_serve()
+    test_compression()
+    test_in_place()
+    test_follow()
+    print("All C++ integration tests passed!")
@@ -0,0 +1,507 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <algorithm> // std::min
+#include <cstddef> // std::size_t
+#include <cstdint> // uint_fast64_t
+#include <cstdio> // std::remove
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/BlockIO.h"
+#include "../src/Encoder.h"
+#include "../src/MappedFile.h"
+#include "../src/StreamPair.h"
+#include "../src/ascii_scan.h"
+#include "../src/business_logic.h"
+#include "../src/escape_kernel.h"
+#include "../src/libescape.h"
+#include "../src/measure.h"
+#include "../src/parallel_escape.h"
+#include "../src/streaming.h"
+#include "../src/utf8_validate.h"
+#include "../src/zero_copy.h"
+#include "differential.h"
+#include "reference_escape.h"
+#include "test_helpers.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+// Function prototype for a function that isn't exposed through the headers
+int escape_with_block_io(BlockIO& io, const EscapeSettings& settings = EscapeSettings(), EscapeStats *stats = nullptr);
+
+/*
+ * IMPLEMENTATION NOTES
+ * Each engine is run by a function that returns its exit code and output, and compare()
+ * checks them against the reference. "bad byte" positions use the same convention as
+ * reference_escape: the 1-based position of the byte that made the input invalid, or one
+ * past the end if it ended in the middle of a character.
+ *
+ * The engines that cut the input into blocks themselves (read_and_escape with 64 KB blocks,
+ * parallel_read_and_escape with 256 KB chunks) only cut small inputs at all when they're
+ * given a small block size, which only escape_with_block_io can be. The others see a cut
+ * when the input is bigger than their blocks, and differential_test.cpp makes some of its
+ * inputs that big, with characters split across those boundaries.
+ */
+
+static const char *const IN_FILE = "differential_test_in.tmp";
+static const char *const OUT_FILE = "differential_test_out.tmp";
+
+/**
+ * Everything an engine said about one input.
+ */
+struct Result {
+    int retval;
+    std::string output;
+};
+
+/**
+ * Returns a description of the first difference between expected and actual, or an empty
+ * string if there isn't one.
+ */
+static std::string compare(const std::string& engine, const Result& expected, const Result& actual) {
+    std::ostringstream description;
+    if (actual.retval != expected.retval) {
+        description << engine << ": exit code " << actual.retval << ", expected " << expected.retval;
+        return description.str();
+    }
+    if (actual.output != expected.output) {
+        std::size_t i = 0;
+        while (i < actual.output.size() && i < expected.output.size() && actual.output[i] == expected.output[i]) {
+            ++i;
+        }
+        description << engine << ": " << actual.output.size() << " bytes of output, expected "
+                    << expected.output.size() << "; they differ from byte " << i;
+        return description.str();
+    }
+    return "";
+}
+
+/**
+ * Same as above, but for where the input went wrong. 0 means it didn't.
+ */
+static std::string compare_bad_byte(const std::string& engine, std::uint_fast64_t expected, std::uint_fast64_t actual) {
+    if (actual == expected) {
+        return "";
+    }
+    std::ostringstream description;
+    description << engine << ": reported bad byte " << actual << ", expected " << expected;
+    return description.str();
+}
+
+/**
+ * Returns the position of the bad byte, in the above convention, from an EscapeState at the
+ * end of the input.
+ */
+static std::uint_fast64_t bad_byte_of(const EscapeState& state) {
+    if (state.invalid) {
+        return state.num_bytes_read;
+    }
+    return state.at_boundary() ? 0 : state.num_bytes_read + 1;
+}
+
+/**
+ * Cuts [0, len) into pieces: a single piece, or random sizes from 1 to max_piece.
+ */
+static std::vector<std::size_t> random_pieces(std::size_t len, std::size_t max_piece, std::mt19937& rng) {
+    std::vector<std::size_t> pieces;
+    for (std::size_t done = 0; done < len;) {
+        std::size_t piece = std::min<std::size_t>(len - done, 1 + rng() % max_piece);
+        pieces.push_back(piece);
+        done += piece;
+    }
+    return pieces;
+}
+
+/**
+ * Runs escape_block on the given pieces of input, one after another.
+ */
+static Result run_blocks(const std::string& input, const std::vector<std::size_t>& pieces, const EscapeSettings& settings,
+                         std::uint_fast64_t& bad_byte) {
+    Result result;
+    EscapeState state;
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(input.data());
+    for (std::size_t len : pieces) {
+        std::vector<unsigned char> out(escape_output_bound(len, settings.format));
+        std::size_t written = escape_block(state, in, len, out.data(), settings);
+        result.output.append(reinterpret_cast<const char *>(out.data()), written);
+        if (state.invalid) {
+            break;
+        }
+        in += len;
+    }
+    bad_byte = bad_byte_of(state);
+    result.retval = (bad_byte == 0) ? 0 : 2;
+    return result;
+}
+
+/**
+ * Runs validate_block on the given pieces of input, one after another.
+ */
+static std::uint_fast64_t run_validate(const std::string& input, const std::vector<std::size_t>& pieces) {
+    EscapeState state;
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(input.data());
+    for (std::size_t len : pieces) {
+        validate_block(state, in, len);
+        if (state.invalid) {
+            break;
+        }
+        in += len;
+    }
+    return bad_byte_of(state);
+}
+
+/**
+ * Runs the Encoder on the given pieces of input. It only does the default settings.
+ */
+static Result run_encoder(const std::string& input, const std::vector<std::size_t>& pieces, std::uint_fast64_t& bad_byte) {
+    Result result;
+    Encoder encoder;
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(input.data());
+    result.retval = 0;
+    for (std::size_t len : pieces) {
+        result.retval = encoder.feed(in, len, result.output);
+        if (result.retval != 0) {
+            // bytes_read() is the position of the bad byte.
+            bad_byte = encoder.bytes_read();
+            return result;
+        }
+        in += len;
+    }
+    result.retval = encoder.finish();
+    // If the input ended in the middle of a character, bytes_read() is the whole input.
+    bad_byte = (result.retval == 0) ? 0 : encoder.bytes_read() + 1;
+    return result;
+}
+
+/**
+ * Runs the C interface, with an output buffer of out_capacity bytes, so that most calls only
+ * consume part of what they're given.
+ */
+static Result run_c_encoder(const std::string& input, std::size_t out_capacity) {
+    Result result;
+    escape_encoder *enc = escape_encoder_new();
+    std::vector<unsigned char> out(out_capacity);
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(input.data());
+    std::size_t left = input.size();
+    result.retval = ESCAPE_OK;
+    while (left > 0 && result.retval == ESCAPE_OK) {
+        std::size_t consumed;
+        std::size_t written;
+        result.retval = escape_encoder_feed(enc, in, left, out.data(), out.size(), &consumed, &written);
+        result.output.append(reinterpret_cast<const char *>(out.data()), written);
+        in += consumed;
+        left -= consumed;
+    }
+    if (result.retval == ESCAPE_OK) {
+        result.retval = escape_encoder_finish(enc);
+    }
+    escape_encoder_free(enc);
+    return result;
+}
+
+/**
+ * Runs one of the engines that take a StreamPair, on strings.
+ */
+template <typename Engine>
+static Result run_streams(const std::string& input, Engine engine) {
+    Result result;
+    StreamPair streams(ByteSource::from_string(input), ByteSink::to_string());
+    result.retval = engine(streams);
+    result.output = streams.out.contents();
+    return result;
+}
+
+/**
+ * Runs escape_with_block_io with a ThreadIO on strings.
+ */
+static Result run_thread_io(const std::string& input, std::size_t block_size, const EscapeSettings& settings) {
+    return run_streams(input, [block_size, &settings](StreamPair& streams) {
+        std::unique_ptr<BlockIO> io = make_thread_io(streams, block_size);
+        return escape_with_block_io(*io, settings);
+    });
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+/**
+ * Runs read_and_escape on IN_FILE through a one-page MappedFile, writing to a string.
+ * Returns false if the file can't be mapped (an empty file can't be).
+ */
+static bool run_mapped(const EscapeSettings& settings, Result& result) {
+    StreamPair streams(ByteSource::from_string(""), ByteSink::to_string());
+    streams.mapped = MappedFile::open(IN_FILE, 1);
+    if (!streams.mapped) {
+        return false;
+    }
+    result.retval = read_and_escape(streams, settings);
+    result.output = streams.out.contents();
+    return true;
+}
+
+#endif
+
+#ifdef __linux__
+
+/**
+ * Runs escape_mapped_zero_copy on IN_FILE through a one-page MappedFile, writing to OUT_FILE.
+ */
+static bool run_zero_copy(const EscapeSettings& settings, bool preallocate, Result& result) {
+    std::shared_ptr<MappedFile> mapped = MappedFile::open(IN_FILE, 1);
+    if (!mapped) {
+        return false;
+    }
+    int out_fd = open(OUT_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd == -1) {
+        return false;
+    }
+    result.retval = escape_mapped_zero_copy(*mapped, out_fd, settings, preallocate);
+    close(out_fd);
+    result.output = read_file(OUT_FILE);
+    return true;
+}
+
+/**
+ * Runs escape_with_block_io with io_uring, reading IN_FILE and writing OUT_FILE.
+ * Returns false if io_uring isn't available.
+ */
+static bool run_uring(std::size_t block_size, const EscapeSettings& settings, Result& result) {
+    int in_fd = open(IN_FILE, O_RDONLY);
+    int out_fd = open(OUT_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    std::unique_ptr<BlockIO> io;
+    if (in_fd != -1 && out_fd != -1) {
+        io = make_uring_io(in_fd, out_fd, block_size);
+    }
+    const bool available = static_cast<bool>(io);
+    if (available) {
+        result.retval = escape_with_block_io(*io, settings);
+        io.reset();
+    }
+    if (in_fd != -1) {
+        close(in_fd);
+    }
+    if (out_fd != -1) {
+        close(out_fd);
+    }
+    result.output = read_file(OUT_FILE);
+    return available;
+}
+
+/**
+ * Runs stream_escape, reading from a pipe that's fed in pieces of up to max_piece bytes
+ * (so that reads come back short) and writing to OUT_FILE.
+ */
+static bool run_stream(const std::string& input, std::size_t max_piece, const EscapeSettings& settings, bool line_buffered,
+                       long max_latency_ms, std::mt19937& rng, Result& result) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        return false;
+    }
+    int out_fd = open(OUT_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd == -1) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return false;
+    }
+    std::vector<std::size_t> pieces = random_pieces(input.size(), max_piece, rng);
+    std::thread feeder([&input, &pieces, &pipe_fds] {
+        // Once the input is known to be invalid, stream_escape stops reading and the pipe is
+        // closed under us. Blocking SIGPIPE in this thread turns that into an EPIPE error from
+        // write instead of killing the process.
+        sigset_t sigpipe;
+        sigemptyset(&sigpipe);
+        sigaddset(&sigpipe, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &sigpipe, nullptr);
+        const char *data = input.data();
+        for (std::size_t len : pieces) {
+            if (write(pipe_fds[1], data, len) != static_cast<ssize_t>(len)) {
+                break;
+            }
+            data += len;
+        }
+        close(pipe_fds[1]);
+    });
+    result.retval = stream_escape(pipe_fds[0], out_fd, settings, line_buffered, max_latency_ms);
+    close(pipe_fds[0]);
+    feeder.join();
+    close(out_fd);
+    result.output = read_file(OUT_FILE);
+    return true;
+}
+
+#endif
+
+/**
+ * Sends everything written to std::cerr to a string for as long as it exists, so that the
+ * engines' error messages don't get mixed in with the tester's own output.
+ */
+class QuietErrors {
+public:
+    QuietErrors() : saved(std::cerr.rdbuf(sink.rdbuf())) {}
+    ~QuietErrors() { std::cerr.rdbuf(saved); }
+
+private:
+    std::ostringstream sink;
+    std::streambuf *saved;
+};
+
+/**
+ * Chooses the kernel tier for as long as it exists, and then goes back to the one that was
+ * in use before.
+ */
+class TierGuard {
+public:
+    explicit TierGuard(KernelTier tier) : saved(active_kernel_tier()) { set_kernel_tier(tier); }
+    ~TierGuard() { set_kernel_tier(saved); }
+
+private:
+    KernelTier saved;
+};
+
+std::string differential_check(const std::string& input, const EscapeSettings& settings, std::mt19937& rng,
+                               bool with_io) {
+    QuietErrors quiet;
+    Result expected;
+    std::uint_fast64_t expected_bad_byte;
+    expected.retval = reference_escape(input, settings, expected.output, expected_bad_byte);
+    const bool is_default = (settings.format == EscapeFormat::Rfc5137 && settings.preserve.is_default());
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(input.data());
+    std::string mismatch;
+
+    // The checks that don't depend on the tier.
+    if (utf8_valid(data, input.size()) != (expected.retval == 0)) {
+        return "utf8_valid: wrong answer";
+    }
+    std::vector<std::size_t> pieces = random_pieces(input.size(), 1 + rng() % 100, rng);
+    if (!(mismatch = compare_bad_byte("validate_block", expected_bad_byte, run_validate(input, pieces))).empty()) {
+        return mismatch;
+    }
+    if (expected.retval == 0 && escaped_length(data, input.size(), settings) != expected.output.size()) {
+        return "escaped_length: wrong length";
+    }
+
+    std::vector<KernelTier> tiers;
+    for (int k = 0; k < NUM_KERNEL_TIERS; ++k) {
+        if (kernel_tier_available(static_cast<KernelTier>(k))) {
+            tiers.push_back(static_cast<KernelTier>(k));
+        }
+    }
+    for (KernelTier tier : tiers) {
+        TierGuard guard(tier);
+        const std::string suffix = std::string(" (") + kernel_tier_name(tier) + ")";
+        std::uint_fast64_t bad_byte;
+        Result result = run_blocks(input, std::vector<std::size_t>(1, input.size()), settings, bad_byte);
+        if (!(mismatch = compare("escape_block" + suffix, expected, result)).empty() ||
+            !(mismatch = compare_bad_byte("escape_block" + suffix, expected_bad_byte, bad_byte)).empty()) {
+            return mismatch;
+        }
+        pieces = random_pieces(input.size(), 1 + rng() % 100, rng);
+        result = run_blocks(input, pieces, settings, bad_byte);
+        if (!(mismatch = compare("escape_block in pieces" + suffix, expected, result)).empty() ||
+            !(mismatch = compare_bad_byte("escape_block in pieces" + suffix, expected_bad_byte, bad_byte)).empty()) {
+            return mismatch;
+        }
+        if (is_default) {
+            result = run_encoder(input, pieces, bad_byte);
+            if (!(mismatch = compare("Encoder" + suffix, expected, result)).empty() ||
+                !(mismatch = compare_bad_byte("Encoder" + suffix, expected_bad_byte, bad_byte)).empty()) {
+                return mismatch;
+            }
+            result = run_c_encoder(input, escape_output_size(1) + rng() % 64);
+            if (!(mismatch = compare("escape_encoder_feed" + suffix, expected, result)).empty()) {
+                return mismatch;
+            }
+        }
+    }
+    if (!with_io) {
+        return "";
+    }
+
+    // The rest use whichever tier, since they all escape with escape_block anyway.
+    TierGuard guard(tiers[rng() % tiers.size()]);
+    const std::string suffix = std::string(" (") + kernel_tier_name(active_kernel_tier()) + ")";
+    Result result = run_streams(input, [&settings](StreamPair& streams) {
+        return read_and_escape(streams, settings);
+    });
+    if (!(mismatch = compare("read_and_escape" + suffix, expected, result)).empty()) {
+        return mismatch;
+    }
+    const std::size_t block_size = 1 + rng() % 200;
+    result = run_thread_io(input, block_size, settings);
+    if (!(mismatch = compare("escape_with_block_io with threads" + suffix, expected, result)).empty()) {
+        return mismatch;
+    }
+    const unsigned int num_threads = 2 + rng() % 3;
+    result = run_streams(input, [num_threads, &settings](StreamPair& streams) {
+        return parallel_read_and_escape(streams, num_threads, settings);
+    });
+    if (!(mismatch = compare("parallel_read_and_escape" + suffix, expected, result)).empty()) {
+        return mismatch;
+    }
+
+    // --measure and --check write something else, or nothing.
+    Result measured;
+    measured.retval = expected.retval;
+    if (expected.retval == 0) {
+        measured.output = std::to_string(expected.output.size()) + "\n";
+    }
+    result = run_streams(input, [&settings](StreamPair& streams) {
+        return read_and_measure(streams, settings);
+    });
+    if (!(mismatch = compare("read_and_measure", measured, result)).empty()) {
+        return mismatch;
+    }
+    Result checked;
+    checked.retval = expected.retval;
+    result = run_streams(input, read_and_check);
+    if (!(mismatch = compare("read_and_check", checked, result)).empty()) {
+        return mismatch;
+    }
+    // --decode has to turn the output back into the input. It only understands the default
+    // format, and an escape string that was already in the input would be decoded too, so
+    // this only works if backslashes are escaped or there aren't any.
+    if (expected.retval == 0 && settings.format == EscapeFormat::Rfc5137 &&
+        (!settings.preserve.contains('\\') || input.find('\\') == std::string::npos)) {
+        Result original;
+        original.retval = 0;
+        original.output = input;
+        result = run_streams(expected.output, read_and_decode);
+        if (!(mismatch = compare("read_and_decode of the output", original, result)).empty()) {
+            return mismatch;
+        }
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    write_file(IN_FILE, input);
+    if (run_mapped(settings, result)) {
+        mismatch = compare("read_and_escape mapped" + suffix, expected, result);
+    }
+#ifdef __linux__
+    if (mismatch.empty() && run_zero_copy(settings, rng() % 2 == 0, result)) {
+        mismatch = compare("escape_mapped_zero_copy" + suffix, expected, result);
+    }
+    if (mismatch.empty() && run_uring(block_size, settings, result)) {
+        mismatch = compare("escape_with_block_io with io_uring" + suffix, expected, result);
+    }
+    const long latencies[] = {-1, 0, 5};
+    if (mismatch.empty() &&
+        run_stream(input, 1 + rng() % 5000, settings, rng() % 2 == 0, latencies[rng() % 3], rng, result)) {
+        mismatch = compare("stream_escape" + suffix, expected, result);
+    }
+    std::remove(OUT_FILE);
+#endif
+    std::remove(IN_FILE);
+#endif
+    return mismatch;
+}
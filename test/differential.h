@@ -0,0 +1,39 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_DIFFERENTIAL_H
+#define ESCAPE_UTF8_DIFFERENTIAL_H
+
+#include <random>
+#include <string>
+
+#include "../src/escape_kernel.h" // EscapeSettings
+
+/**
+ * Escapes input with every engine in the library, and checks that each one gives exactly the
+ * same output bytes and exit code as reference_escape (see reference_escape.h). Where an
+ * engine also says where invalid input went wrong (--check, the Encoder), that has to match
+ * too. This is the core of the differential tester (differential_test.cpp) and the fuzz
+ * target (fuzz_escape.cpp).
+ *
+ * The engines that only work on blocks in memory are run once with each kernel tier that this
+ * CPU supports (see ascii_scan.h), and are fed the input in one piece and then in randomly
+ * sized pieces, so that characters are split between pieces at every possible place. The
+ * engines that do I/O are run with a randomly chosen tier and block size. Anything that
+ * prints an error message prints it to a string that's thrown away.
+ *
+ * NOTE: with with_io, this creates (and then deletes) files in the current directory.
+ * @param input The input.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * @param rng Chooses the sizes of the pieces, the block sizes, the number of threads and the
+ * tier for the I/O engines.
+ * @param with_io Whether to also run the engines that use streams, threads, files and pipes.
+ * They're much slower than the others.
+ * @return An empty string if every engine agreed with the reference, or else a description
+ * of the first one that didn't.
+ */
+std::string differential_check(const std::string& input, const EscapeSettings& settings, std::mt19937& rng,
+                               bool with_io);
+
+#endif //ESCAPE_UTF8_DIFFERENTIAL_H
@@ -0,0 +1,340 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * The differential tester. It makes up inputs, random and adversarial, and checks that every
+ * engine in the library escapes each one exactly like the reference engine does (see
+ * differential.h and reference_escape.h). Every optimization has to get past this.
+ *
+ * Inputs (chosen at random for each case):
+ *   bytes     Random bytes. Almost all of these are invalid within the first few bytes.
+ *   text      Valid UTF-8: runs of ASCII (with control characters and backslashes) and
+ *             characters of every length, especially the ones at the ends of the ranges,
+ *             like boundary_success in the gen/ test cases.
+ *   defect    Text with one thing wrong with it somewhere: an overlong form, a surrogate,
+ *             a value above U+10FFFF, a stray continuation byte, a byte that can never
+ *             appear, or a character that's cut short (maybe at the very end).
+ *   split     Text with a multi-byte character split across one of the places where the
+ *             engines cut the input: the ends of the 16-, 32- and 64-byte SIMD loads, a page
+ *             (the MappedFile windows), and read_and_escape's blocks and
+ *             parallel_read_and_escape's chunks. Those last two make for big inputs, so only
+ *             1 case in 50 is a split.
+ * Each case gets a random format, and 1 in 4 gets a random --preserve set.
+ *
+ * If an engine disagrees with the reference, the input is written to
+ * differential_test_failure.bin, and the tester prints the seed and stops with exit code 1.
+ * Give a file as an argument to try it again (or to try any other file): files are checked
+ * with every format, and with both the default and the full --preserve set.
+ *
+ * NOTE: this creates (and then deletes) files in the current directory.
+ *
+ * Usage: differential_test [--iterations N] [--seed N] [--max-len N] [--no-io] [FILE...]
+ * --no-io leaves out the engines that use threads, files and pipes, which is about 10 times
+ * as fast. The default is 10000 iterations of inputs up to 1000 bytes, from a random seed.
+ */
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/escape_kernel.h"
+#include "../src/preserve_set.h"
+#include "differential.h"
+
+static const char *const FAILURE_FILE = "differential_test_failure.bin";
+static const char *const FORMAT_NAMES[] = {"rfc5137", "json", "braces", "html"};
+
+// The places where the engines cut the input (see split, above). These are the sizes from
+// ascii_scan_x86.cpp, MappedFile (with a one-page window), business_logic.cpp and
+// parallel_escape.cpp; if those change, change these too.
+static const std::size_t CUT_SIZES[] = {16, 32, 64, 4096, 65536, 256 * 1024};
+
+/**
+ * Appends the UTF-8 encoding of codepoint to out.
+ */
+static void append_utf8(std::string& out, std::uint_fast32_t codepoint) {
+    if (codepoint < 0x80) {
+        out += static_cast<char>(codepoint);
+    } else if (codepoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codepoint >> 6));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else if (codepoint < 0x10000) {
+        out += static_cast<char>(0xE0 | (codepoint >> 12));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (codepoint >> 18));
+        out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+}
+
+/**
+ * Returns a random character that takes numbytes bytes in UTF-8. Half of the time it's one
+ * at the end of a range: the lowest or highest with that many bytes, or one next to the
+ * surrogates.
+ */
+static std::uint_fast32_t random_char(std::mt19937& rng, int numbytes) {
+    static const std::uint_fast32_t lows[] = {0, 0, 0x80, 0x800, 0x10000};
+    static const std::uint_fast32_t highs[] = {0, 0x7F, 0x7FF, 0xFFFF, 0x10FFFF};
+    if (rng() % 2 == 0) {
+        static const std::uint_fast32_t edges[] = {0xD7FF, 0xE000, 0xFFFD, 0xFFFE};
+        switch (rng() % 3) {
+            case 0:
+                return lows[numbytes];
+            case 1:
+                return highs[numbytes];
+            default:
+                return (numbytes == 3) ? edges[rng() % 4] : lows[numbytes] + 1;
+        }
+    }
+    std::uint_fast32_t codepoint;
+    do {
+        codepoint = lows[numbytes] + rng() % (highs[numbytes] - lows[numbytes] + 1);
+    } while (0xD800 <= codepoint && codepoint <= 0xDFFF);
+    return codepoint;
+}
+
+/**
+ * Appends a run of ASCII: mostly printable, with some control characters, DEL and
+ * backslashes (which matter to --decode).
+ */
+static void append_ascii(std::string& out, std::mt19937& rng, std::size_t len) {
+    for (std::size_t i = 0; i < len; ++i) {
+        unsigned r = rng() % 100;
+        if (r < 85) {
+            out += static_cast<char>(32 + rng() % 95);
+        } else if (r < 90) {
+            out += "\t\n\r"[rng() % 3];
+        } else if (r < 95) {
+            out += static_cast<char>(rng() % 32);
+        } else if (r < 97) {
+            out += '\x7F';
+        } else {
+            out += "\\u'"[rng() % 3];
+        }
+    }
+}
+
+/**
+ * Appends something valid: a run of ASCII or a multi-byte character.
+ */
+static void append_valid(std::string& out, std::mt19937& rng) {
+    if (rng() % 3 == 0) {
+        // Long runs matter to the SIMD code, so the lengths go up to well past 64.
+        append_ascii(out, rng, rng() % 4 == 0 ? rng() % 300 : rng() % 8);
+    } else {
+        append_utf8(out, random_char(rng, 2 + static_cast<int>(rng() % 3)));
+    }
+}
+
+/**
+ * Appends something invalid. See defect, above.
+ */
+static void append_defect(std::string& out, std::mt19937& rng) {
+    static const char *const overlongs[] = {"\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF",
+                                            "\xF0\x80\x80\x80", "\xF0\x8F\xBF\xBF"};
+    static const char *const surrogates[] = {"\xED\xA0\x80", "\xED\xAF\xBF", "\xED\xB0\x80", "\xED\xBF\xBF"};
+    static const char *const too_big[] = {"\xF4\x90\x80\x80", "\xF4\xBF\xBF\xBF", "\xF5\x80\x80\x80", "\xF7\xBF\xBF\xBF"};
+    switch (rng() % 6) {
+        case 0:
+            out += overlongs[rng() % 6];
+            break;
+        case 1:
+            out += surrogates[rng() % 4];
+            break;
+        case 2:
+            out += too_big[rng() % 4];
+            break;
+        case 3:
+            out += static_cast<char>(0x80 + rng() % 0x40); // A continuation byte on its own
+            break;
+        case 4:
+            out += static_cast<char>(0xF8 + rng() % 8); // Can't appear anywhere
+            break;
+        default: {
+            // A character cut short.
+            int numbytes = 2 + static_cast<int>(rng() % 3);
+            std::string full;
+            append_utf8(full, random_char(rng, numbytes));
+            out += full.substr(0, 1 + rng() % (numbytes - 1));
+            break;
+        }
+    }
+}
+
+/**
+ * Makes up one input of about max_len bytes or less (except for split, which goes past a cut).
+ */
+static std::string make_case(std::mt19937& rng, std::size_t max_len) {
+    std::string out;
+    const std::size_t len = (max_len == 0) ? 0 : rng() % (max_len + 1);
+    const unsigned kind = rng() % 50;
+    if (kind < 10) {
+        // bytes
+        for (std::size_t i = 0; i < len; ++i) {
+            out += static_cast<char>(rng() % 256);
+        }
+    } else if (kind < 30) {
+        // text
+        while (out.size() < len) {
+            append_valid(out, rng);
+        }
+    } else if (kind < 49) {
+        // defect. The defect is anywhere from the start to the very end.
+        const std::size_t defect_at = (len == 0) ? 0 : rng() % len;
+        while (out.size() < defect_at) {
+            append_valid(out, rng);
+        }
+        append_defect(out, rng);
+        while (out.size() < len) {
+            append_valid(out, rng);
+        }
+    } else {
+        // split. A character ends k bytes past a multiple of the cut size, where 0 < k < its length.
+        const std::size_t cut = CUT_SIZES[rng() % (sizeof(CUT_SIZES) / sizeof(CUT_SIZES[0]))];
+        const std::size_t end = cut * (1 + rng() % 3);
+        const int numbytes = 2 + static_cast<int>(rng() % 3);
+        const std::size_t k = 1 + rng() % (numbytes - 1);
+        const std::size_t start = end + k - numbytes;
+        while (out.size() < start) {
+            // Mostly ASCII, so it's quick to reach the cut, but with a character now and then.
+            if (rng() % 8 == 0 && out.size() + 4 <= start) {
+                append_utf8(out, random_char(rng, 2 + static_cast<int>(rng() % 3)));
+            } else {
+                append_ascii(out, rng, 1);
+            }
+        }
+        append_utf8(out, random_char(rng, numbytes));
+        if (rng() % 4 == 0) {
+            append_defect(out, rng);
+        }
+        append_ascii(out, rng, rng() % 100);
+    }
+    return out;
+}
+
+/**
+ * Returns random settings: any format, and 1 time in 4 a random --preserve set.
+ */
+static EscapeSettings make_settings(std::mt19937& rng) {
+    EscapeFormat format = static_cast<EscapeFormat>(rng() % 4);
+    if (rng() % 4 != 0) {
+        return EscapeSettings(format);
+    }
+    bool preserved[128];
+    const unsigned percent = rng() % 101;
+    for (bool& p : preserved) {
+        p = (rng() % 100 < percent);
+    }
+    return EscapeSettings(format, PreserveSet(preserved));
+}
+
+/**
+ * Prints a description of settings, in terms of the escape program's options.
+ */
+static std::string describe(const EscapeSettings& settings) {
+    std::string description = std::string("--format ") + FORMAT_NAMES[static_cast<int>(settings.format)];
+    if (!settings.preserve.is_default()) {
+        description += " --preserve none";
+        for (int b = 0; b < 128; ++b) {
+            if (settings.preserve.contains(static_cast<unsigned char>(b))) {
+                const char *const digits = "0123456789ABCDEF";
+                description += std::string(",0x") + digits[b / 16] + digits[b % 16];
+            }
+        }
+    }
+    return description;
+}
+
+static int usage() {
+    std::cerr << "Usage: differential_test [--iterations N] [--seed N] [--max-len N] [--no-io] [FILE...]" << std::endl;
+    return 5;
+}
+
+/**
+ * Checks one input, and reports it if it fails.
+ * @return True if every engine agreed with the reference.
+ */
+static bool check(const std::string& input, const EscapeSettings& settings, std::mt19937& rng, bool with_io,
+                  const std::string& name) {
+    std::string mismatch = differential_check(input, settings, rng, with_io);
+    if (mismatch.empty()) {
+        return true;
+    }
+    std::ofstream file(FAILURE_FILE, std::ios_base::binary);
+    file.write(input.data(), static_cast<std::streamsize>(input.size()));
+    std::cout << "FAILED: " << name << " (" << input.size() << " bytes, written to " << FAILURE_FILE << ")\n"
+              << "  settings: " << describe(settings) << "\n"
+              << "  " << mismatch << std::endl;
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long iterations = 10000;
+    std::uint_fast32_t seed = std::random_device()();
+    std::size_t max_len = 1000;
+    bool with_io = true;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool has_value = (i + 1 < argc);
+        if (arg == "--iterations" && has_value) {
+            iterations = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && has_value) {
+            seed = static_cast<std::uint_fast32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--max-len" && has_value) {
+            max_len = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--no-io") {
+            with_io = false;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            return usage();
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    std::mt19937 rng(seed);
+    if (!files.empty()) {
+        bool all_preserved[128];
+        for (bool& p : all_preserved) {
+            p = true;
+        }
+        for (const std::string& name : files) {
+            std::ifstream file(name, std::ios_base::binary);
+            if (!file) {
+                std::cerr << "Can't open " << name << std::endl;
+                return 5;
+            }
+            std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            for (int format = 0; format < 4; ++format) {
+                const EscapeSettings settings[] = {EscapeSettings(static_cast<EscapeFormat>(format)),
+                                                   EscapeSettings(static_cast<EscapeFormat>(format), PreserveSet(all_preserved))};
+                for (const EscapeSettings& s : settings) {
+                    if (!check(input, s, rng, with_io, name)) {
+                        return 1;
+                    }
+                }
+            }
+        }
+        std::cout << "All " << files.size() << " file(s) passed." << std::endl;
+        return 0;
+    }
+
+    std::cout << "Seed: " << seed << std::endl;
+    for (unsigned long n = 0; n < iterations; ++n) {
+        std::string input = make_case(rng, max_len);
+        EscapeSettings settings = make_settings(rng);
+        if (!check(input, settings, rng, with_io, "case " + std::to_string(n) + " with seed " + std::to_string(seed))) {
+            return 1;
+        }
+    }
+    std::cout << "All " << iterations << " cases passed." << std::endl;
+    return 0;
+}
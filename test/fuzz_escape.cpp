@@ -0,0 +1,55 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * A libFuzzer target for the differential tests (see differential.h). libFuzzer comes with
+ * Clang, so CMake only builds this (as fuzz_escape) when the compiler is Clang. Run it with
+ * some seed inputs, for example the test cases:
+ *     ./fuzz_escape -max_len=4096 path/to/test/vcs_testcases/gen path/to/test/vcs_testcases
+ * It adds the inputs it finds interesting to the first directory, so copy that somewhere
+ * first if you don't want it changed.
+ *
+ * The first byte of the fuzzer's input picks the settings, and the rest is the input to
+ * escape: the low 2 bits are the format, and if bit 2 is set the --preserve set is made up
+ * from the next 16 bytes (one bit per ASCII character). Only the engines that work in memory
+ * are run, since the others (threads, files and pipes) are too slow to fuzz; run
+ * differential_test for those.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "../src/escape_kernel.h"
+#include "../src/preserve_set.h"
+#include "differential.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    const EscapeFormat format = static_cast<EscapeFormat>(data[0] & 3);
+    EscapeSettings settings(format);
+    std::size_t start = 1;
+    if ((data[0] & 4) && size >= 17) {
+        bool preserved[128];
+        for (int b = 0; b < 128; ++b) {
+            preserved[b] = (data[1 + b / 8] >> (b % 8)) & 1;
+        }
+        settings = EscapeSettings(format, PreserveSet(preserved));
+        start = 17;
+    }
+    const std::string input(reinterpret_cast<const char *>(data + start), size - start);
+    // The pieces that the input is cut into are random too, but they have to be the same
+    // every time for the same input, or libFuzzer couldn't reproduce a crash.
+    std::mt19937 rng(static_cast<std::uint_fast32_t>(size));
+    std::string mismatch = differential_check(input, settings, rng, false);
+    if (!mismatch.empty()) {
+        std::cerr << mismatch << std::endl;
+        std::abort();
+    }
+    return 0;
+}
@@ -380,6 +380,22 @@ if __name__ == "__main__":
         assert stdout_data == "foo"
         assert stderr_data == "The given text is not valid UTF-8 text. Exiting now.\n"
 
+    # surrogate: UTF-16 surrogates are not valid in UTF-8
+    surrogate = os.path.join(absolute_path_to_gen, "surrogate")
+    with Popen([absolute_path_to_executable, surrogate], stdout=PIPE, stderr=PIPE, universal_newlines=True) as proc:
+        (stdout_data, stderr_data) = proc.communicate()
+        assert proc.returncode != 0
+        assert stdout_data == "foo"
+        assert stderr_data == "The given text is not valid UTF-8 text. Exiting now.\n"
+    # Similar test, for the last surrogate (U+DFFF) right after the last code point before the surrogates (U+D7FF)
+    with Popen([absolute_path_to_executable], stdin=PIPE, stdout=PIPE, stderr=PIPE, universal_newlines=False) as proc:
+        input_bytes = b"\xED\x9F\xBF\xED\xBF\xBF"
+        (stdout_data, stderr_data) = proc.communicate(input_bytes)
+        assert proc.returncode != 0
+        assert stdout_data == b"\\u'D7FF'"
+        assert stderr_data[:52] == b"The given text is not valid UTF-8 text. Exiting now."
+        assert (len(stderr_data) == 53) or (len(stderr_data) == 54)
+
     # Malformed command line 1
     with Popen([absolute_path_to_executable, "foo", "bar"], stdout=PIPE, stderr=PIPE, universal_newlines=False) as proc:
         (stdout_data, stderr_data) = proc.communicate()
@@ -0,0 +1,49 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_KERNEL_TIERS_H
+#define ESCAPE_UTF8_KERNEL_TIERS_H
+
+/*
+ * Helpers for the unit tests that run the same checks with every kernel tier (see
+ * ascii_scan.h). Include this after catch.hpp.
+ */
+
+#include <vector>
+
+#include "../src/ascii_scan.h"
+#include "../src/cpu_features.h"
+
+/**
+ * Returns the kernel tiers that this program and CPU can run.
+ */
+static inline std::vector<KernelTier> available_tiers() {
+    std::vector<KernelTier> tiers;
+    for (int k = 0; k < NUM_KERNEL_TIERS; ++k) {
+        if (kernel_tier_available(static_cast<KernelTier>(k))) {
+            tiers.push_back(static_cast<KernelTier>(k));
+        }
+    }
+    return tiers;
+}
+
+/**
+ * Switches to the given kernel tier for as long as it's in scope, and then back to the
+ * one from before.
+ */
+class TierGuard {
+public:
+    explicit TierGuard(KernelTier tier) : previous(active_kernel_tier()) {
+        REQUIRE(set_kernel_tier(tier));
+    }
+
+    ~TierGuard() {
+        set_kernel_tier(previous);
+    }
+
+private:
+    KernelTier previous;
+};
+
+#endif //ESCAPE_UTF8_KERNEL_TIERS_H
@@ -0,0 +1,149 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <cstdint> // uint_fast32_t, uint_fast64_t
+#include <string>
+
+#include "reference_escape.h"
+
+/*
+ * IMPLEMENTATION NOTES
+ * This is deliberately the slow, obvious way of doing things: one byte at a time, with the
+ * ranges written out as in the RFC, and no tables, SIMD or cleverness of any kind. Don't
+ * share code with src/ here (other than EscapeSettings, which is just data), because then a
+ * bug in the shared code would be in both engines and the differential tests couldn't see it.
+ *
+ * The grammar from RFC 3629, section 4:
+ *   UTF8-1      = %x00-7F
+ *   UTF8-2      = %xC2-DF UTF8-tail
+ *   UTF8-3      = %xE0 %xA0-BF UTF8-tail / %xE1-EC 2( UTF8-tail ) /
+ *                 %xED %x80-9F UTF8-tail / %xEE-EF 2( UTF8-tail )
+ *   UTF8-4      = %xF0 %x90-BF 2( UTF8-tail ) / %xF1-F3 3( UTF8-tail ) /
+ *                 %xF4 %x80-8F 2( UTF8-tail )
+ *   UTF8-tail   = %x80-BF
+ * The special cases for the second byte are what rule out overlong forms (E0, F0),
+ * surrogates (ED) and values above U+10FFFF (F4). C0, C1 and F5 to FF can't start anything.
+ * Reference: https://tools.ietf.org/html/rfc3629#section-4
+ */
+
+/**
+ * Appends codepoint in uppercase hex to output, padded with zeros to at least 4 digits.
+ */
+static void append_hex(std::string& output, std::uint_fast32_t codepoint) {
+    const char *const digits = "0123456789ABCDEF";
+    std::string hex;
+    do {
+        hex.insert(hex.begin(), digits[codepoint % 16]);
+        codepoint /= 16;
+    } while (codepoint != 0);
+    while (hex.size() < 4) {
+        hex.insert(hex.begin(), '0');
+    }
+    output += hex;
+}
+
+/**
+ * Appends the escape string for codepoint, in the given format, to output.
+ */
+static void append_escape(std::string& output, std::uint_fast32_t codepoint, EscapeFormat format) {
+    switch (format) {
+        case EscapeFormat::Rfc5137:
+            output += "\\u'";
+            append_hex(output, codepoint);
+            output += "'";
+            break;
+        case EscapeFormat::Json:
+            if (codepoint >= 0x10000u) {
+                // A UTF-16 surrogate pair.
+                std::uint_fast32_t offset = codepoint - 0x10000u;
+                output += "\\u";
+                append_hex(output, 0xD800u + (offset >> 10));
+                output += "\\u";
+                append_hex(output, 0xDC00u + (offset & 0x3FFu));
+            } else {
+                output += "\\u";
+                append_hex(output, codepoint);
+            }
+            break;
+        case EscapeFormat::Braces:
+            output += "\\U{";
+            append_hex(output, codepoint);
+            output += "}";
+            break;
+        case EscapeFormat::Html:
+            output += "&#x";
+            append_hex(output, codepoint);
+            output += ";";
+            break;
+    }
+}
+
+int reference_escape(const std::string& input, const EscapeSettings& settings, std::string& output,
+                     std::uint_fast64_t& bad_byte) {
+    output.clear();
+    bad_byte = 0;
+    std::size_t i = 0;
+    while (i < input.size()) {
+        unsigned char byte = static_cast<unsigned char>(input[i]);
+        ++i;
+        if (byte <= 127) {
+            if (settings.preserve.contains(byte)) {
+                output += static_cast<char>(byte);
+            } else {
+                append_escape(output, byte, settings.format);
+            }
+            continue;
+        }
+
+        // The number of bytes in the character, the bits of the first byte that are part of
+        // the code point, and the range that the second byte has to be in.
+        int numbytes;
+        std::uint_fast32_t codepoint;
+        unsigned char second_low = 0x80;
+        unsigned char second_high = 0xBF;
+        if (0xC2 <= byte && byte <= 0xDF) {
+            numbytes = 2;
+            codepoint = byte & 0x1Fu;
+        } else if (0xE0 <= byte && byte <= 0xEF) {
+            numbytes = 3;
+            codepoint = byte & 0x0Fu;
+            if (byte == 0xE0) {
+                second_low = 0xA0; // Anything lower is an overlong form.
+            } else if (byte == 0xED) {
+                second_high = 0x9F; // Anything higher is a surrogate.
+            }
+        } else if (0xF0 <= byte && byte <= 0xF4) {
+            numbytes = 4;
+            codepoint = byte & 0x07u;
+            if (byte == 0xF0) {
+                second_low = 0x90; // Anything lower is an overlong form.
+            } else if (byte == 0xF4) {
+                second_high = 0x8F; // Anything higher is above U+10FFFF.
+            }
+        } else {
+            // A continuation byte, C0 or C1 (which could only start overlong forms), or F5 to FF.
+            bad_byte = i;
+            return 2;
+        }
+
+        for (int k = 1; k < numbytes; ++k) {
+            if (i == input.size()) {
+                // The input ended in the middle of the character.
+                bad_byte = i + 1;
+                return 2;
+            }
+            byte = static_cast<unsigned char>(input[i]);
+            ++i;
+            const unsigned char low = (k == 1) ? second_low : 0x80;
+            const unsigned char high = (k == 1) ? second_high : 0xBF;
+            if (byte < low || byte > high) {
+                bad_byte = i;
+                return 2;
+            }
+            codepoint = (codepoint << 6) | (byte & 0x3Fu);
+        }
+        append_escape(output, codepoint, settings.format);
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_REFERENCE_ESCAPE_H
+#define ESCAPE_UTF8_REFERENCE_ESCAPE_H
+
+#include <cstdint> // uint_fast64_t
+#include <string>
+
+#include "../src/escape_kernel.h" // EscapeSettings
+
+/**
+ * This is the reference engine for the differential tests (see differential.h). It's a separate,
+ * byte-at-a-time escaper written from scratch for the tests, working on a string instead of a
+ * stream. It isn't the program's original read_and_escape: that one accepted surrogates, so it
+ * can't be the reference for what the program does now. Every engine in the library has to give
+ * exactly the same output and exit code as this for every input, so it's kept as simple as
+ * possible and should never be optimized: if it's wrong, everything will agree with it and be
+ * wrong too.
+ *
+ * It follows the grammar in RFC 3629, section 4 literally, so it rejects surrogates (U+D800 to
+ * U+DFFF) and notices a bad byte as soon as it's read, like the optimized engines do. It also
+ * knows about --format and --preserve.
+ * @param input The whole input.
+ * @param settings The format of the escape strings and the bytes that are passed through.
+ * @param output This is a return value: the escaped text. If the input is invalid, this is
+ * everything before the character that made it invalid.
+ * @param bad_byte This is a return value: if the input is invalid, the 1-based position of the
+ * byte that made it invalid (which is input.size() + 1 if the input ended in the middle of a
+ * character). Otherwise it's 0.
+ * @return 0 if the input is valid UTF-8, or 2 if it isn't, like read_and_escape.
+ */
+int reference_escape(const std::string& input, const EscapeSettings& settings, std::string& output,
+                     std::uint_fast64_t& bad_byte);
+
+#endif //ESCAPE_UTF8_REFERENCE_ESCAPE_H
@@ -0,0 +1,45 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#ifndef ESCAPE_UTF8_TEST_HELPERS_H
+#define ESCAPE_UTF8_TEST_HELPERS_H
+
+/*
+ * Small helpers that the tests share, for turning strings into byte buffers and for
+ * writing and reading the files they work on. Files are read and written in binary mode,
+ * so the bytes are exactly the ones in the string, on Windows too.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+/**
+ * Returns the bytes of str, as the unsigned chars that the escaping functions take.
+ */
+static inline const unsigned char *bytes(const std::string& str) {
+    return reinterpret_cast<const unsigned char *>(str.data());
+}
+
+/**
+ * Replaces the file at path with contents, or adds contents to the end of it if mode is
+ * std::ios_base::app.
+ */
+static inline void write_file(const std::string& path, const std::string& contents,
+                              std::ios_base::openmode mode = std::ios_base::trunc) {
+    std::ofstream file(path, std::ios_base::binary | std::ios_base::out | mode);
+    file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+}
+
+/**
+ * Returns the contents of the file at path, or an empty string if it can't be read.
+ */
+static inline std::string read_file(const std::string& path) {
+    std::ifstream file(path, std::ios_base::binary);
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+#endif //ESCAPE_UTF8_TEST_HELPERS_H
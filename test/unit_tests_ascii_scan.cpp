@@ -0,0 +1,215 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+#include <cstddef> // std::size_t
+#include <cstring> // std::memcmp
+#include <random>
+#include <vector>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/ascii_scan.h"
+#include "../src/cpu_features.h"
+#include "kernel_tiers.h"
+
+TEST_CASE("Test is_passthrough", "[is_passthrough]") {
+    for (unsigned int byte = 0; byte < 256; ++byte) {
+        bool expected = (32 <= byte && byte <= 126) || byte == '\t' || byte == '\n' || byte == '\r';
+        REQUIRE(is_passthrough(static_cast<unsigned char>(byte)) == expected);
+    }
+}
+
+TEST_CASE("Test passthrough_prefix_len", "[passthrough_prefix_len]") {
+    for (KernelTier tier : available_tiers()) {
+        SECTION(kernel_tier_name(tier)) {
+            TierGuard guard(tier);
+            SECTION("Empty buffer") {
+                REQUIRE(passthrough_prefix_len(nullptr, 0) == 0);
+            }
+            SECTION("Short buffers") {
+                const unsigned char *str = reinterpret_cast<const unsigned char *>("foo\x0B" "bar");
+                REQUIRE(passthrough_prefix_len(str, 7) == 3);
+                REQUIRE(passthrough_prefix_len(str, 3) == 3);
+                REQUIRE(passthrough_prefix_len(str + 3, 4) == 0);
+                REQUIRE(passthrough_prefix_len(str + 4, 3) == 3);
+            }
+            SECTION("Every stopping byte at every position") {
+                // The buffer is long enough to go through the 64-, 32-, 16- and 8-byte loops
+                // as well as the scalar tail, so this checks that they all agree.
+                const std::size_t len = 139;
+                const unsigned char stoppers[] = {0x00, 0x08, 0x0B, 0x0C, 0x1F, 0x7F, 0x80, 0x89, 0xA0, 0xC3, 0xFF};
+                for (unsigned char stopper : stoppers) {
+                    for (std::size_t idx = 0; idx < len; ++idx) {
+                        std::vector<unsigned char> buf(len, 'a');
+                        buf[len / 2] = '\t'; // sprinkle in some whitespace that should be passed through
+                        buf[len / 3] = '\r';
+                        buf[len / 5] = '\n';
+                        buf[len / 7] = ' ';
+                        buf[len / 11] = '~';
+                        buf[idx] = stopper;
+                        REQUIRE(passthrough_prefix_len(buf.data(), len) == idx);
+                    }
+                }
+            }
+            SECTION("All pass-through") {
+                std::vector<unsigned char> buf;
+                for (unsigned char byte = 32; byte <= 126; ++byte) {
+                    buf.push_back(byte);
+                }
+                REQUIRE(passthrough_prefix_len(buf.data(), buf.size()) == buf.size());
+            }
+        }
+    }
+}
+
+TEST_CASE("Test PreserveSet", "[PreserveSet]") {
+    SECTION("The default set") {
+        PreserveSet set;
+        REQUIRE(set.is_default());
+        for (unsigned int byte = 0; byte < 256; ++byte) {
+            REQUIRE(set.contains(static_cast<unsigned char>(byte)) == is_passthrough(static_cast<unsigned char>(byte)));
+        }
+        // [9, 10], [13, 13] and [32, 126]
+        REQUIRE(set.fits_in_ranges());
+        REQUIRE(set.num_ranges() == 3);
+        REQUIRE(set.range_lows()[2] == 32);
+        REQUIRE(set.range_highs()[2] == 126);
+        const unsigned char pairs[16] = {9, 10, 13, 13, 32, 126};
+        REQUIRE(std::memcmp(set.range_pairs(), pairs, 16) == 0);
+    }
+    SECTION("Custom sets") {
+        bool preserved[128] = {};
+        REQUIRE(PreserveSet(preserved).num_ranges() == 0);
+        REQUIRE_FALSE(PreserveSet(preserved).contains('a'));
+        for (unsigned int byte = 0; byte < 128; ++byte) {
+            preserved[byte] = is_passthrough(static_cast<unsigned char>(byte));
+        }
+        REQUIRE(PreserveSet(preserved).is_default());
+        preserved[0x0B] = true;
+        preserved[0x0C] = true;
+        PreserveSet set(preserved);
+        REQUIRE_FALSE(set.is_default());
+        REQUIRE(set.contains(0x0B));
+        REQUIRE_FALSE(set.contains(0x80));
+        REQUIRE(set.num_ranges() == 2); // [9, 13] and [32, 126]
+        // Every other byte is its own range.
+        for (unsigned int byte = 0; byte < 128; ++byte) {
+            preserved[byte] = (byte % 2 == 0);
+        }
+        REQUIRE_FALSE(PreserveSet(preserved).fits_in_ranges());
+    }
+}
+
+TEST_CASE("Test passthrough_prefix_len with a PreserveSet", "[passthrough_prefix_len]") {
+    for (KernelTier tier : available_tiers()) {
+        SECTION(kernel_tier_name(tier)) {
+            TierGuard guard(tier);
+            // Random sets, including some with few ranges (for the range checks) and some
+            // with many, checked against a byte-at-a-time scan.
+            std::mt19937 rng(16);
+            for (int iteration = 0; iteration < 200; ++iteration) {
+                bool preserved[128] = {};
+                unsigned int density = rng() % 4;
+                for (unsigned int byte = 0; byte < 128; ++byte) {
+                    preserved[byte] = (iteration % 2 == 0) ? (rng() % 4 != 0) : (32 <= byte && byte <= 126 && byte != 'a' + density);
+                }
+                PreserveSet set(preserved);
+                std::vector<unsigned char> buf(1 + rng() % 200);
+                std::size_t expected = buf.size();
+                for (std::size_t i = 0; i < buf.size(); ++i) {
+                    // Mostly bytes in the set, so that the scan gets a fair way in.
+                    do {
+                        buf[i] = static_cast<unsigned char>(rng() % 256);
+                    } while (rng() % 16 != 0 && !set.contains(buf[i]));
+                    if (expected == buf.size() && !set.contains(buf[i])) {
+                        expected = i;
+                    }
+                }
+                REQUIRE(passthrough_prefix_len(buf.data(), buf.size(), set) == expected);
+            }
+            SECTION("Every ASCII byte") {
+                bool preserved[128];
+                for (bool& p : preserved) {
+                    p = true;
+                }
+                PreserveSet set(preserved);
+                std::vector<unsigned char> buf;
+                for (unsigned int byte = 0; byte < 128; ++byte) {
+                    buf.push_back(static_cast<unsigned char>(byte));
+                }
+                REQUIRE(passthrough_prefix_len(buf.data(), buf.size(), set) == buf.size());
+                buf[100] = 0xC3;
+                REQUIRE(passthrough_prefix_len(buf.data(), buf.size(), set) == 100);
+            }
+            SECTION("No bytes at all") {
+                bool preserved[128] = {};
+                PreserveSet set(preserved);
+                std::vector<unsigned char> buf(100, 'a');
+                REQUIRE(passthrough_prefix_len(buf.data(), buf.size(), set) == 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("Test that every kernel tier agrees", "[passthrough_prefix_len]") {
+    // Random text that's mostly pass-through, scanned from every offset with every tier, and
+    // compared with the scalar tier.
+    std::mt19937 rng(19);
+    bool preserved[128];
+    for (unsigned int byte = 0; byte < 128; ++byte) {
+        preserved[byte] = is_passthrough(static_cast<unsigned char>(byte)) && byte != '\\';
+    }
+    const PreserveSet sets[] = {PreserveSet(), PreserveSet(preserved)};
+    for (int iteration = 0; iteration < 20; ++iteration) {
+        std::vector<unsigned char> buf(1000);
+        for (unsigned char& byte : buf) {
+            byte = (rng() % 64 == 0) ? static_cast<unsigned char>(rng() % 256) : static_cast<unsigned char>(32 + rng() % 95);
+        }
+        for (const PreserveSet& set : sets) {
+            std::vector<std::size_t> expected;
+            {
+                TierGuard guard(KernelTier::Scalar);
+                for (std::size_t start = 0; start < buf.size(); ++start) {
+                    expected.push_back(passthrough_prefix_len(buf.data() + start, buf.size() - start, set));
+                }
+            }
+            for (KernelTier tier : available_tiers()) {
+                TierGuard guard(tier);
+                INFO(kernel_tier_name(tier));
+                for (std::size_t start = 0; start < buf.size(); ++start) {
+                    REQUIRE(passthrough_prefix_len(buf.data() + start, buf.size() - start, set) == expected[start]);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Test choosing the kernel tier", "[KernelTier]") {
+    for (int k = 0; k < NUM_KERNEL_TIERS; ++k) {
+        KernelTier tier = KernelTier::Scalar;
+        REQUIRE(parse_kernel_tier(kernel_tier_name(static_cast<KernelTier>(k)), tier));
+        REQUIRE(tier == static_cast<KernelTier>(k));
+    }
+    KernelTier tier = KernelTier::Avx2;
+    REQUIRE_FALSE(parse_kernel_tier("sse4", tier));
+    REQUIRE_FALSE(parse_kernel_tier("", tier));
+    REQUIRE(tier == KernelTier::Avx2);
+
+    REQUIRE(kernel_tier_available(KernelTier::Scalar));
+    REQUIRE(kernel_tier_available(KernelTier::Swar));
+    // A tier that's available means every tier below it is too.
+    for (int k = 1; k < NUM_KERNEL_TIERS; ++k) {
+        if (kernel_tier_available(static_cast<KernelTier>(k))) {
+            REQUIRE(kernel_tier_available(static_cast<KernelTier>(k - 1)));
+        }
+    }
+    {
+        TierGuard guard(KernelTier::Swar);
+        REQUIRE(active_kernel_tier() == KernelTier::Swar);
+    }
+    if (!kernel_tier_available(KernelTier::Avx512)) {
+        KernelTier before = active_kernel_tier();
+        REQUIRE_FALSE(set_kernel_tier(KernelTier::Avx512));
+        REQUIRE(active_kernel_tier() == before);
+    }
+}
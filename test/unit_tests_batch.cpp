@@ -0,0 +1,110 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for escape_file and collect_batch_files in batch.cpp.
+ *
+ * NOTE: these tests create (and then delete) files in the current directory.
+ */
+#include <cstdio> // std::remove
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/batch.h"
+#include "test_helpers.h"
+
+static const char *const TEMP_INPUT = "unit_tests_batch.in.tmp";
+static const char *const TEMP_OUTPUT = "unit_tests_batch.out.tmp";
+
+TEST_CASE("Test escape_file", "[batch]") {
+    BatchFile file;
+    file.input = TEMP_INPUT;
+    file.output = TEMP_OUTPUT;
+    BatchBuffers buffers;
+
+    // The buffers are reused from one file to the next, and some files are more than one block.
+    std::string big_ascii(200000, 'a');
+    std::string big_unicode;
+    for (int i = 0; i < 50000; ++i) {
+        big_unicode += "\xE2\x82\xAC"; // Euro sign, so characters get split between blocks
+    }
+    std::string big_unicode_escaped;
+    for (int i = 0; i < 50000; ++i) {
+        big_unicode_escaped += "\\u'20AC'";
+    }
+    struct Case {
+        std::string input;
+        int retval;
+        std::string output; // Only checked if retval is 0
+    };
+    const Case cases[] = {
+        {"", 0, ""},
+        {"Hi \xC3\xA9\n", 0, "Hi \\u'00E9'\n"},
+        {big_ascii, 0, big_ascii},
+        {big_unicode, 0, big_unicode_escaped},
+        {"ab\xFF", 2, ""},
+        {"ab\xE2\x82", 2, ""}, // Stops in the middle of a character
+    };
+    for (const Case& c : cases) {
+        write_file(TEMP_INPUT, c.input);
+        REQUIRE(escape_file(file, buffers) == c.retval);
+        if (c.retval == 0) {
+            REQUIRE(read_file(TEMP_OUTPUT) == c.output);
+        }
+    }
+    // The source and sink of the next file get the same buffers back, instead of new ones.
+    const unsigned char *in_data = buffers.in.data();
+    const unsigned char *out_data = buffers.out.data();
+    REQUIRE(in_data != nullptr);
+    REQUIRE(out_data != nullptr);
+    write_file(TEMP_INPUT, "again");
+    REQUIRE(escape_file(file, buffers) == 0);
+    REQUIRE(buffers.in.data() == in_data);
+    REQUIRE(buffers.out.data() == out_data);
+
+    std::remove(TEMP_INPUT);
+    REQUIRE(escape_file(file, buffers) == 1); // The input doesn't exist
+    std::remove(TEMP_OUTPUT);
+}
+
+TEST_CASE("Test collect_batch_files", "[batch]") {
+    Options options;
+    options.batch = true;
+    options.inputs = {"a.txt", "/abs/b.txt", "../c.txt", "./d/e.txt"};
+
+    options.suffix = ".esc";
+    std::vector<BatchFile> files;
+    std::istringstream empty;
+    REQUIRE(collect_batch_files(options, empty, files) == 0);
+    REQUIRE(files.size() == 4);
+    REQUIRE(files[0].output == "a.txt.esc");
+    REQUIRE(files[1].output == "/abs/b.txt.esc");
+
+    // Under --output-dir, the outputs can't end up outside the output directory.
+    options.suffix.clear();
+    options.output_dir = "out";
+    files.clear();
+    REQUIRE(collect_batch_files(options, empty, files) == 0);
+    REQUIRE(files.size() == 4);
+    REQUIRE(files[0].output == "out/a.txt");
+    REQUIRE(files[1].output == "out/abs/b.txt");
+    REQUIRE(files[2].output == "out/c.txt");
+    REQUIRE(files[3].output == "out/d/e.txt");
+
+    // The list is read after the command-line inputs, and a file that would have the same
+    // output as an earlier one is left out.
+    options.files_from = "-";
+    std::istringstream list("f.txt\r\n\nc.txt\ng.txt");
+    files.clear();
+    REQUIRE(collect_batch_files(options, list, files) == 0);
+    REQUIRE(files.size() == 6);
+    REQUIRE(files[4].input == "f.txt");
+    REQUIRE(files[5].input == "g.txt");
+
+    options.files_from = "unit_tests_batch.does_not_exist";
+    files.clear();
+    REQUIRE(collect_batch_files(options, empty, files) == 1);
+}
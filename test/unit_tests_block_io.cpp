@@ -0,0 +1,145 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for the BlockIO implementations (BlockIO.h) and the pipelined
+ * loop in read_and_escape that uses them. Small block sizes are used so that the input is
+ * split into many blocks, with characters split between them.
+ *
+ * NOTE: the io_uring tests create (and then delete) files in the current directory.
+ */
+#include <algorithm> // std::min
+#include <cstdio> // std::remove
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/BlockIO.h"
+#include "../src/StreamPair.h"
+#include "../src/escape_kernel.h"
+#include "../src/stats.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Function prototype for a function that isn't exposed through the headers
+int escape_with_block_io(BlockIO& io, const EscapeSettings& settings = EscapeSettings(), EscapeStats *stats = nullptr);
+
+// The test input is this piece (13 bytes, with characters of every length) repeated 400
+// times, and the expected output is the escaped piece (36 bytes) repeated 400 times.
+static const char PIECE[] = "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x82\x01 \n";
+static const char ESCAPED_PIECE[] = "a\\u'00E9'\\u'20AC'\\u'1F602'\\u'0001' \n";
+
+static std::string repeat(const char *piece, int times) {
+    std::string result;
+    for (int i = 0; i < times; ++i) {
+        result += piece;
+    }
+    return result;
+}
+
+/**
+ * Runs escape_with_block_io with a ThreadIO on strings.
+ */
+static int run_threads(const std::string& input, std::size_t block_size, std::string& output) {
+    StreamPair streams(ByteSource::from_string(input), ByteSink::to_string());
+    std::unique_ptr<BlockIO> io = make_thread_io(streams, block_size);
+    int retval = escape_with_block_io(*io);
+    io.reset();
+    output = streams.out.contents();
+    return retval;
+}
+
+TEST_CASE("Test escape_with_block_io with threads", "[BlockIO]") {
+    const std::string input = repeat(PIECE, 400);
+    const std::string expected = repeat(ESCAPED_PIECE, 400);
+    std::string output;
+    std::size_t block_sizes[] = {1, 3, 7, 4096, 65536};
+    for (std::size_t block_size : block_sizes) {
+        REQUIRE(run_threads(input, block_size, output) == 0);
+        REQUIRE(output == expected);
+
+        REQUIRE(run_threads(input + "\xF0\x9F", block_size, output) == 2);
+        REQUIRE(output == expected);
+
+        // The bad byte replaces the "a" at the start of piece 100.
+        std::string bad = input;
+        bad[1300] = '\xFF';
+        REQUIRE(run_threads(bad, block_size, output) == 2);
+        REQUIRE(output == expected.substr(0, 100 * 36));
+    }
+    REQUIRE(run_threads("", 16, output) == 0);
+    REQUIRE(output.empty());
+}
+
+#ifdef __linux__
+
+/**
+ * Runs escape_with_block_io with io_uring, reading from a pipe that is fed in small pieces
+ * (so that reads come back short) and writing to a file. Returns -1 if io_uring isn't available.
+ */
+static int run_uring(const std::string& input, std::size_t block_size, std::string& output) {
+    const char *out_name = "unit_tests_block_io.tmp";
+    int pipe_fds[2];
+    REQUIRE(pipe(pipe_fds) == 0);
+    int out_fd = open(out_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    REQUIRE(out_fd != -1);
+    std::unique_ptr<BlockIO> io = make_uring_io(pipe_fds[0], out_fd, block_size);
+    if (!io) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        close(out_fd);
+        std::remove(out_name);
+        return -1;
+    }
+    std::thread feeder([&input, &pipe_fds] {
+        for (std::size_t i = 0; i < input.size(); i += 1000) {
+            std::size_t len = std::min<std::size_t>(1000, input.size() - i);
+            if (write(pipe_fds[1], input.data() + i, len) != static_cast<ssize_t>(len)) {
+                break; // The reader has gone away, after invalid input.
+            }
+        }
+        close(pipe_fds[1]);
+    });
+    int retval = escape_with_block_io(*io);
+    io.reset();
+    close(pipe_fds[0]);
+    feeder.join();
+    close(out_fd);
+    std::ifstream file(out_name, std::ios_base::binary);
+    output.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    file.close();
+    std::remove(out_name);
+    return retval;
+}
+
+TEST_CASE("Test escape_with_block_io with io_uring", "[BlockIO]") {
+    const std::string input = repeat(PIECE, 400);
+    const std::string expected = repeat(ESCAPED_PIECE, 400);
+    std::string output;
+    if (run_uring(input, 4096, output) == -1) {
+        WARN("io_uring isn't available here, so it wasn't tested.");
+        return;
+    }
+    std::size_t block_sizes[] = {1, 7, 4096};
+    for (std::size_t block_size : block_sizes) {
+        REQUIRE(run_uring(input, block_size, output) == 0);
+        REQUIRE(output == expected);
+
+        REQUIRE(run_uring(input + "\xF0\x9F", block_size, output) == 2);
+        REQUIRE(output == expected);
+
+        std::string bad = input;
+        bad[1300] = '\xFF';
+        REQUIRE(run_uring(bad, block_size, output) == 2);
+        REQUIRE(output == expected.substr(0, 100 * 36));
+    }
+}
+
+#endif
@@ -0,0 +1,201 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for ByteSource and ByteSink (ByteStream.cpp).
+ */
+#include <algorithm> // std::min
+#include <cstdio> // std::remove
+#include <cstring> // std::memcpy
+#include <string>
+#include <vector>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/ByteStream.h"
+#include "test_helpers.h"
+
+static const char *const TEMP_FILE = "unit_tests_byte_stream.tmp";
+
+/**
+ * Returns len bytes that aren't all the same, so that a piece in the wrong place shows up.
+ */
+static std::string pattern(std::size_t len) {
+    std::string result(len, '\0');
+    for (std::size_t i = 0; i < len; ++i) {
+        result[i] = static_cast<char>('a' + (i * 7 + i / 251) % 26);
+    }
+    return result;
+}
+
+/**
+ * Reads all of source with pull(), max_len bytes at a time at most.
+ */
+static std::string pull_all(ByteSource& source, std::size_t max_len) {
+    std::string result;
+    const unsigned char *data;
+    std::size_t len;
+    while ((len = source.pull(data, max_len)) > 0) {
+        REQUIRE(len <= max_len);
+        result.append(reinterpret_cast<const char *>(data), len);
+    }
+    return result;
+}
+
+TEST_CASE("Test ByteSource on a string", "[ByteStream]") {
+    const std::string input = pattern(1000);
+    ByteSource source = ByteSource::from_string(input);
+    REQUIRE(source.is_open());
+    REQUIRE(source.fd() == -1);
+
+    SECTION("pull") {
+        REQUIRE(pull_all(source, 7) == input);
+        REQUIRE(source.eof());
+        REQUIRE(!source.error());
+    }
+    SECTION("read") {
+        unsigned char buf[600];
+        REQUIRE(source.read(buf, 600) == 600);
+        REQUIRE(std::string(reinterpret_cast<char *>(buf), 600) == input.substr(0, 600));
+        REQUIRE(!source.eof());
+        REQUIRE(source.read(buf, 600) == 400);
+        REQUIRE(std::string(reinterpret_cast<char *>(buf), 400) == input.substr(600));
+        REQUIRE(source.eof());
+        REQUIRE(source.read(buf, 600) == 0);
+    }
+    SECTION("Both") {
+        unsigned char buf[10];
+        REQUIRE(source.read(buf, 10) == 10);
+        REQUIRE(pull_all(source, 1000) == input.substr(10));
+    }
+    SECTION("Move") {
+        ByteSource other = std::move(source);
+        REQUIRE(!source.is_open());
+        REQUIRE(source.error());
+        REQUIRE(pull_all(other, 1000) == input);
+    }
+}
+
+TEST_CASE("Test ByteSink on a string", "[ByteStream]") {
+    ByteSink sink = ByteSink::to_string();
+    REQUIRE(sink.is_open());
+    REQUIRE(sink.fd() == -1);
+    const std::string big = pattern(BYTE_STREAM_BUFFER_SIZE + 123);
+
+    REQUIRE(sink.write(bytes("abc"), 3));
+    // Nothing shows up until it's flushed.
+    REQUIRE(sink.contents().empty());
+    unsigned char *room = sink.reserve(10);
+    REQUIRE(room != nullptr);
+    std::memcpy(room, "defghijklm", 10);
+    sink.commit(3);
+    REQUIRE(sink.write_unbuffered(bytes("xyz"), 3));
+    REQUIRE(sink.contents() == "abcdefxyz");
+    REQUIRE(sink.write(bytes(big), big.size()));
+    REQUIRE(sink.write(bytes("!"), 1));
+    REQUIRE(sink.flush());
+    REQUIRE(sink.contents() == "abcdefxyz" + big + "!");
+
+    // reserve() makes the buffer bigger if it has to.
+    room = sink.reserve(2 * BYTE_STREAM_BUFFER_SIZE);
+    REQUIRE(room != nullptr);
+    std::memcpy(room + 2 * BYTE_STREAM_BUFFER_SIZE - 1, "?", 1);
+    sink.commit(2 * BYTE_STREAM_BUFFER_SIZE);
+    REQUIRE(sink.flush());
+    REQUIRE(sink.contents().size() == 9 + big.size() + 1 + 2 * BYTE_STREAM_BUFFER_SIZE);
+    REQUIRE(sink.contents().back() == '?');
+
+    ByteSink other = std::move(sink);
+    REQUIRE(!sink.is_open());
+    REQUIRE(!sink.write(bytes("a"), 1));
+    REQUIRE(other.contents().back() == '?');
+}
+
+TEST_CASE("Test ByteSource and ByteSink on a file", "[ByteStream]") {
+    // Several times the size of the buffers, so that every path gets used.
+    const std::string contents = pattern(3 * BYTE_STREAM_BUFFER_SIZE + 5000);
+    {
+        ByteSink sink = ByteSink::open_file(TEMP_FILE);
+        REQUIRE(sink.is_open());
+        REQUIRE(sink.fd() != -1);
+        std::size_t pos = 0;
+        std::size_t sizes[] = {1, 100, 70000, BYTE_STREAM_BUFFER_SIZE - 3, 5, BYTE_STREAM_BUFFER_SIZE + 1};
+        for (std::size_t i = 0; pos < contents.size(); ++i) {
+            std::size_t len = std::min(sizes[i % 6], contents.size() - pos);
+            if (i % 3 == 0) {
+                REQUIRE(sink.write(bytes(contents) + pos, len));
+            } else if (i % 3 == 1) {
+                unsigned char *room = sink.reserve(len);
+                REQUIRE(room != nullptr);
+                std::memcpy(room, contents.data() + pos, len);
+                sink.commit(len);
+            } else {
+                REQUIRE(sink.write_unbuffered(bytes(contents) + pos, len));
+            }
+            pos += len;
+        }
+        REQUIRE(sink.flush());
+    }
+
+    SECTION("pull") {
+        ByteSource source = ByteSource::open_file(TEMP_FILE);
+        REQUIRE(source.is_open());
+        REQUIRE(source.fd() != -1);
+        REQUIRE(pull_all(source, 65536) == contents);
+        REQUIRE(source.eof());
+        REQUIRE(!source.error());
+    }
+    SECTION("read") {
+        ByteSource source = ByteSource::open_file(TEMP_FILE);
+        std::vector<unsigned char> buf(contents.size() + 10);
+        // A small read goes through the buffer, and a big one doesn't.
+        REQUIRE(source.read(buf.data(), 10) == 10);
+        REQUIRE(source.read(buf.data() + 10, 2 * BYTE_STREAM_BUFFER_SIZE) == 2 * BYTE_STREAM_BUFFER_SIZE);
+        std::size_t rest = contents.size() - 10 - 2 * BYTE_STREAM_BUFFER_SIZE;
+        REQUIRE(source.read(buf.data() + 10 + 2 * BYTE_STREAM_BUFFER_SIZE, rest + 10) == rest);
+        REQUIRE(source.eof());
+        REQUIRE(std::string(reinterpret_cast<char *>(buf.data()), contents.size()) == contents);
+    }
+    SECTION("Truncating") {
+        {
+            ByteSink sink = ByteSink::open_file(TEMP_FILE);
+            REQUIRE(sink.write(bytes("short"), 5));
+            // The destructor flushes.
+        }
+        ByteSource source = ByteSource::open_file(TEMP_FILE);
+        REQUIRE(pull_all(source, 100) == "short");
+    }
+    std::remove(TEMP_FILE);
+}
+
+TEST_CASE("Test ByteStream errors", "[ByteStream]") {
+    ByteSource source = ByteSource::open_file("this file doesn't exist");
+    REQUIRE(!source.is_open());
+    REQUIRE(source.error());
+    const unsigned char *data;
+    REQUIRE(source.pull(data, 10) == 0);
+
+    ByteSink sink = ByteSink::open_file("this directory doesn't exist/file");
+    REQUIRE(!sink.is_open());
+    REQUIRE(sink.error());
+    REQUIRE(!sink.write(bytes("a"), 1));
+    REQUIRE(sink.reserve(1) == nullptr);
+    REQUIRE(!sink.flush());
+
+#ifdef __linux__
+    // Every write to /dev/full fails with ENOSPC.
+    ByteSink full = ByteSink::open_file("/dev/full");
+    REQUIRE(full.is_open());
+    REQUIRE(full.write(bytes("a"), 1)); // Only buffered so far
+    REQUIRE(!full.flush());
+    REQUIRE(full.error());
+    REQUIRE(!full.write(bytes("a"), 1));
+
+    // Reading a directory fails after it's opened.
+    ByteSource dir = ByteSource::open_file("/");
+    REQUIRE(dir.is_open());
+    REQUIRE(dir.pull(data, 10) == 0);
+    REQUIRE(dir.error());
+    REQUIRE(!dir.eof());
+#endif
+}
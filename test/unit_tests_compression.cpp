@@ -0,0 +1,174 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for compressed input and output (compression.cpp).
+ *
+ * NOTE: these tests create (and then delete) files in the current directory. The tests of
+ * each format only run if this build has it.
+ */
+#include <algorithm> // std::copy
+#include <cstdio> // std::remove
+#include <string>
+#include <vector>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/batch.h"
+#include "../src/business_logic.h"
+#include "../src/compression.h"
+#include "test_helpers.h"
+
+static const char *const TEMP_FILE = "unit_tests_compression.tmp";
+static const char *const TEMP_OUTPUT = "unit_tests_compression.out.tmp";
+
+/**
+ * Returns len bytes of text, with a non-ASCII character now and then.
+ */
+static std::string some_text(std::size_t len) {
+    std::string result;
+    for (std::size_t i = 0; result.size() < len; ++i) {
+        result += (i % 97 == 0) ? "\xC3\xA9" : std::string(1, static_cast<char>('a' + i % 26));
+    }
+    return result;
+}
+
+static std::string read_all(ByteSource& source) {
+    std::string result;
+    const unsigned char *data;
+    std::size_t len;
+    while ((len = source.pull(data, BYTE_STREAM_BUFFER_SIZE)) > 0) {
+        result.append(reinterpret_cast<const char *>(data), len);
+    }
+    return result;
+}
+
+/**
+ * Compresses text into the file at path with compress_sink.
+ */
+static void compress_to_file(const std::string& text, const char *path, Compression format) {
+    ByteSink sink = compress_sink(ByteSink::open_file(path), format);
+    // Through every kind of write, so that all of them get to the stage.
+    std::size_t half = text.size() / 2;
+    REQUIRE(sink.write(bytes(text), half / 2));
+    REQUIRE(sink.write_unbuffered(bytes(text) + half / 2, half - half / 2));
+    unsigned char *room = sink.reserve(text.size() - half);
+    REQUIRE(room != nullptr);
+    std::copy(text.begin() + half, text.end(), room);
+    sink.commit(text.size() - half);
+    REQUIRE(sink.close());
+}
+
+TEST_CASE("Test detect_compression", "[compression]") {
+    struct Case {
+        std::string input;
+        Compression format;
+    };
+    const Case cases[] = {
+        {"", Compression::None},
+        {"Hello", Compression::None},
+        {"\x1F", Compression::None}, // Only the start of a magic number
+        {"\x1F\x8B", Compression::Gzip},
+        {std::string("\x1F\x8B\x08\x00", 4), Compression::Gzip},
+        {"\x28\xB5\x2F", Compression::None},
+        {"\x28\xB5\x2F\xFD", Compression::Zstd},
+        {"\x28\xB5\x2F\xFD" "abc", Compression::Zstd},
+    };
+    for (const Case& c : cases) {
+        ByteSource source = ByteSource::from_string(c.input);
+        REQUIRE(detect_compression(source) == c.format);
+        // Nothing has been used up.
+        REQUIRE(read_all(source) == c.input);
+    }
+
+    Compression format = Compression::None;
+    REQUIRE(parse_compression("gzip", format));
+    REQUIRE(format == Compression::Gzip);
+    REQUIRE(parse_compression("zstd", format));
+    REQUIRE(format == Compression::Zstd);
+    REQUIRE(!parse_compression("none", format));
+    REQUIRE(!parse_compression("GZIP", format));
+    REQUIRE(format == Compression::Zstd);
+    REQUIRE(std::string(compression_name(Compression::Gzip)) == "gzip");
+}
+
+TEST_CASE("Test compressing and decompressing", "[compression]") {
+    for (Compression format : {Compression::Gzip, Compression::Zstd}) {
+        if (!compression_available(format)) {
+            continue;
+        }
+        INFO(compression_name(format));
+        // Several buffers' worth, so that more than one gets handed between the threads.
+        const std::string text = some_text(3 * BYTE_STREAM_BUFFER_SIZE + 12345);
+        compress_to_file(text, TEMP_FILE, format);
+        const std::string compressed = read_file(TEMP_FILE);
+        REQUIRE(compressed.size() < text.size());
+
+        SECTION("Round trip") {
+            ByteSource file = ByteSource::open_file(TEMP_FILE);
+            REQUIRE(detect_compression(file) == format);
+            ByteSource source = decompress_source(std::move(file), format);
+            REQUIRE(source.has_stage());
+            REQUIRE(read_all(source) == text);
+            REQUIRE(source.eof());
+            REQUIRE(!source.error());
+        }
+        SECTION("Empty output") {
+            compress_to_file("", TEMP_FILE, format);
+            ByteSource source = decompress_source(ByteSource::open_file(TEMP_FILE), format);
+            REQUIRE(read_all(source).empty());
+            REQUIRE(source.eof());
+        }
+        SECTION("One after another") {
+            ByteSource source = decompress_source(ByteSource::from_string(compressed + compressed), format);
+            REQUIRE(read_all(source) == text + text);
+            REQUIRE(!source.error());
+        }
+        SECTION("Cut off") {
+            ByteSource source = decompress_source(ByteSource::from_string(compressed.substr(0, compressed.size() / 2)), format);
+            std::string result = read_all(source);
+            REQUIRE(source.error());
+            REQUIRE(!source.eof());
+            REQUIRE(text.compare(0, result.size(), result) == 0);
+        }
+        SECTION("Corrupt") {
+            std::string corrupt = compressed;
+            for (std::size_t i = 20; i < 60; ++i) {
+                corrupt[i] = static_cast<char>(corrupt[i] ^ 0x55);
+            }
+            ByteSource source = decompress_source(ByteSource::from_string(corrupt), format);
+            read_all(source);
+            REQUIRE(source.error());
+        }
+        SECTION("Stopping early") {
+            // The source is destroyed while the thread is still going.
+            ByteSource source = decompress_source(ByteSource::from_string(compressed), format);
+            const unsigned char *data;
+            REQUIRE(source.pull(data, 10) == 10);
+        }
+        SECTION("read_and_escape") {
+            StreamPair streams(decompress_source(ByteSource::from_string(compressed), format), ByteSink::to_string());
+            REQUIRE(read_and_escape(streams) == 0);
+            StreamPair plain(ByteSource::from_string(text), ByteSink::to_string());
+            REQUIRE(read_and_escape(plain) == 0);
+            REQUIRE(streams.out.contents() == plain.out.contents());
+
+            compress_to_file(text + "\xFF", TEMP_FILE, format);
+            StreamPair invalid(decompress_source(ByteSource::open_file(TEMP_FILE), format), ByteSink::to_string());
+            REQUIRE(read_and_escape(invalid) == 2);
+        }
+        SECTION("escape_file") {
+            BatchFile file;
+            file.input = TEMP_FILE;
+            file.output = TEMP_OUTPUT;
+            BatchBuffers buffers;
+            REQUIRE(escape_file(file, buffers, EscapeSettings(), format) == 0);
+            ByteSource source = decompress_source(ByteSource::open_file(TEMP_OUTPUT), format);
+            StreamPair plain(ByteSource::from_string(text), ByteSink::to_string());
+            REQUIRE(read_and_escape(plain) == 0);
+            REQUIRE(read_all(source) == plain.out.contents());
+            std::remove(TEMP_OUTPUT);
+        }
+        std::remove(TEMP_FILE);
+    }
+}
@@ -0,0 +1,133 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for decode_block and decode_finish in decode_kernel.cpp.
+ * Most of them check that decoding undoes escape_block, with the input split into blocks
+ * at every possible position so that escape strings and characters get split between blocks.
+ */
+#include <algorithm> // std::min
+#include <cstddef> // std::size_t
+#include <cstdint> // uint_fast64_t
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/decode_kernel.h"
+#include "../src/escape_kernel.h"
+
+static std::string escape(const std::string& input) {
+    EscapeState state;
+    std::vector<unsigned char> out(escape_output_bound(input.size()));
+    std::size_t outlen = escape_block(state, reinterpret_cast<const unsigned char *>(input.data()), input.size(), out.data());
+    REQUIRE_FALSE(state.invalid);
+    REQUIRE(state.at_boundary());
+    return std::string(reinterpret_cast<const char *>(out.data()), outlen);
+}
+
+/**
+ * Decodes the input in blocks of the given size, then calls decode_finish. Returns the output; the final state is
+ * stored in state.
+ */
+static std::string decode(const std::string& input, std::size_t block_size, DecodeState& state) {
+    std::string output;
+    std::vector<unsigned char> out(decode_output_bound(block_size));
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(input.data());
+    for (std::size_t i = 0; i < input.size(); i += block_size) {
+        std::size_t len = std::min(block_size, input.size() - i);
+        std::size_t outlen = decode_block(state, data + i, len, out.data());
+        REQUIRE(outlen <= decode_output_bound(len));
+        output.append(reinterpret_cast<const char *>(out.data()), outlen);
+        if (state.invalid) {
+            return output;
+        }
+    }
+    std::size_t outlen = decode_finish(state, out.data());
+    output.append(reinterpret_cast<const char *>(out.data()), outlen);
+    return output;
+}
+
+static std::string decode(const std::string& input, std::size_t block_size = 1 << 20) {
+    DecodeState state;
+    std::string output = decode(input, block_size, state);
+    REQUIRE_FALSE(state.invalid);
+    return output;
+}
+
+TEST_CASE("Test decode_block on escape_block's output", "[decode_block]") {
+    // Characters of every length, control characters, and backslashes that don't start
+    // an escape string.
+    const std::string text("\tHi \xC2\x80\xC2\xB1\xE2\x80\xA0\xF0\x9F\x98\x82\xF4\x8F\xBF\xBF\x0B\x7F\x01 a\\b \\u \\");
+    const std::string escaped = escape(text);
+    REQUIRE(decode(escaped) == text);
+    for (std::size_t block_size = 1; block_size <= escaped.size(); ++block_size) {
+        REQUIRE(decode(escaped, block_size) == text);
+    }
+
+    std::mt19937 rng(12);
+    const char *pieces[] = {"a", "the quick brown fox ", "\n", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x82",
+                            "\x01", "\x7F", "\\", "\\u", "\\n"};
+    for (int iteration = 0; iteration < 200; ++iteration) {
+        std::string original;
+        std::size_t target = rng() % 400;
+        while (original.size() < target) {
+            original += pieces[rng() % (sizeof(pieces) / sizeof(pieces[0]))];
+        }
+        std::string encoded = escape(original);
+        REQUIRE(decode(encoded) == original);
+        REQUIRE(decode(encoded, 1 + rng() % 16) == original);
+    }
+}
+
+TEST_CASE("Test decode_block on other escape strings", "[decode_block]") {
+    // Fewer digits, lowercase, and raw UTF-8 between the escape strings are all fine.
+    REQUIRE(decode("\\u'41'\\u'e9'\\u'1f602'") == "A\xC3\xA9\xF0\x9F\x98\x82");
+    REQUIRE(decode("\\u'0'") == std::string(1, '\0'));
+    REQUIRE(decode("\\u'10FFFF'") == "\xF4\x8F\xBF\xBF");
+    REQUIRE(decode("caf\xC3\xA9 \\u'00E9'") == "caf\xC3\xA9 \xC3\xA9");
+    REQUIRE(decode("\\\\u'0041'") == "\\A");
+    REQUIRE(decode("\\x\\uu\\") == "\\x\\uu\\");
+    REQUIRE(decode("") == "");
+}
+
+TEST_CASE("Test decode_block on invalid input", "[decode_block]") {
+    struct Case {
+        const char *input;
+        const char *output; // What's written before the error
+        std::uint_fast64_t position; // The 1-based position of the bad byte, or 0 for "at the end of the input"
+        bool bad_escape;
+    };
+    const Case cases[] = {
+        {"ab\\u''", "ab", 6, true},              // No digits
+        {"ab\\u'1234567'", "ab", 12, true},       // Too many digits
+        {"ab\\u'12G4'", "ab", 8, true},           // Not a hex digit
+        {"ab\\u'110000'", "ab", 12, true},        // Above U+10FFFF
+        {"ab\\u'D800'", "ab", 10, true},          // Surrogate
+        {"ab\\u'dfff'", "ab", 10, true},          // Surrogate
+        {"ab\\u'0041", "ab", 0, true},            // Unfinished escape string
+        {"ab\\u'", "ab", 0, true},
+        {"ab\xC3\xA9\xFF", "ab\xC3\xA9", 5, false}, // Invalid UTF-8 between escape strings
+        {"\\u'41'\xE2\x82\\", "A", 9, false},     // A backslash in the middle of a character
+        {"ab\xE2\x82", "ab\xE2\x82", 0, false},   // Unfinished character at the end
+    };
+    for (const Case& c : cases) {
+        std::string input(c.input);
+        for (std::size_t block_size = 1; block_size <= input.size(); ++block_size) {
+            DecodeState state;
+            std::string output = decode(input, block_size, state);
+            REQUIRE(state.invalid);
+            REQUIRE(state.bad_escape == c.bad_escape);
+            if (c.position != 0) {
+                REQUIRE(state.num_bytes_read == c.position);
+                // Everything before the bad character was written. With small blocks, the start
+                // of a multi-byte character might already have gone out in an earlier block.
+                REQUIRE(output.substr(0, std::string(c.output).size()) == c.output);
+            } else {
+                REQUIRE(state.num_bytes_read == input.size());
+                REQUIRE(output == c.output);
+            }
+        }
+    }
+}
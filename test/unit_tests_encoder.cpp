@@ -0,0 +1,104 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for the library interfaces: the Encoder class and the C ABI.
+ */
+#include <algorithm> // std::min
+#include <cstddef> // std::size_t
+#include <string>
+#include <vector>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/Encoder.h"
+#include "../src/libescape.h"
+#include "test_helpers.h"
+
+TEST_CASE("Test Encoder", "[Encoder]") {
+    Encoder encoder;
+    std::string out;
+
+    SECTION("Valid input in pieces") {
+        const std::string input("\xC2\xA1Hola mundo! \xF0\x9F\x98\x82\n");
+        for (std::size_t i = 0; i < input.size(); i += 3) {
+            REQUIRE(encoder.feed(bytes(input) + i, std::min<std::size_t>(3, input.size() - i), out) == 0);
+        }
+        REQUIRE(encoder.finish() == 0);
+        REQUIRE(out == "\\u'00A1'Hola mundo! \\u'1F602'\n");
+        REQUIRE(encoder.bytes_read() == input.size());
+    }
+    SECTION("Invalid input") {
+        const std::string input("foo\xFF" "bar");
+        REQUIRE(encoder.feed(bytes(input), input.size(), out) == 2);
+        REQUIRE(out == "foo");
+        REQUIRE(encoder.bytes_read() == 4);
+        // It stays invalid until it's reset.
+        REQUIRE(encoder.feed(bytes(input), 3, out) == 2);
+        REQUIRE(out == "foo");
+        REQUIRE(encoder.finish() == 2);
+
+        encoder.reset();
+        REQUIRE(encoder.feed(bytes(input), 3, out) == 0);
+        REQUIRE(encoder.finish() == 0);
+        REQUIRE(out == "foofoo");
+    }
+    SECTION("Truncated input") {
+        const std::string input("\xE2\x80");
+        REQUIRE(encoder.feed(bytes(input), input.size(), out) == 0);
+        REQUIRE(encoder.finish() == 2);
+    }
+    SECTION("Raw buffer") {
+        const std::string input("\x0B");
+        std::vector<unsigned char> buf(escape_output_bound(input.size()));
+        std::size_t written = 0;
+        REQUIRE(encoder.feed(bytes(input), input.size(), buf.data(), written) == 0);
+        REQUIRE(std::string(reinterpret_cast<char *>(buf.data()), written) == "\\u'000B'");
+    }
+}
+
+TEST_CASE("Test the C ABI", "[libescape]") {
+    escape_encoder *enc = escape_encoder_new();
+    REQUIRE(enc != nullptr);
+
+    SECTION("Small output buffer") {
+        // With a 20-byte output buffer, each call can only take 2 bytes of input.
+        const std::string input("a\xF0\x9F\x98\x82" "bc\x7F");
+        std::string out;
+        std::size_t pos = 0;
+        while (pos < input.size()) {
+            unsigned char buf[20];
+            std::size_t consumed = 0;
+            std::size_t written = 0;
+            REQUIRE(escape_encoder_feed(enc, bytes(input) + pos, input.size() - pos, buf, sizeof(buf), &consumed, &written) == ESCAPE_OK);
+            REQUIRE(consumed > 0);
+            REQUIRE(written <= sizeof(buf));
+            out.append(reinterpret_cast<char *>(buf), written);
+            pos += consumed;
+        }
+        REQUIRE(escape_encoder_finish(enc) == ESCAPE_OK);
+        REQUIRE(out == "a\\u'1F602'bc\\u'007F'");
+    }
+    SECTION("Invalid input") {
+        const std::string input("ab\xED\xA0\x80");
+        std::vector<unsigned char> buf(escape_output_size(input.size()));
+        std::size_t consumed = 0;
+        std::size_t written = 0;
+        REQUIRE(escape_encoder_feed(enc, bytes(input), input.size(), buf.data(), buf.size(), &consumed, &written) == ESCAPE_INVALID_UTF8);
+        REQUIRE(written == 2);
+        REQUIRE(consumed == 4);
+        REQUIRE(escape_encoder_finish(enc) == ESCAPE_INVALID_UTF8);
+        escape_encoder_reset(enc);
+        REQUIRE(escape_encoder_finish(enc) == ESCAPE_OK);
+    }
+    SECTION("Bad arguments") {
+        unsigned char buf[9];
+        std::size_t consumed = 0;
+        std::size_t written = 0;
+        REQUIRE(escape_encoder_feed(enc, bytes("a"), 1, buf, sizeof(buf), &consumed, &written) == ESCAPE_BAD_ARGUMENT);
+        REQUIRE(escape_encoder_feed(nullptr, bytes("a"), 1, buf, sizeof(buf), &consumed, &written) == ESCAPE_BAD_ARGUMENT);
+        REQUIRE(escape_encoder_finish(nullptr) == ESCAPE_BAD_ARGUMENT);
+    }
+
+    escape_encoder_free(enc);
+}
@@ -0,0 +1,387 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for escape_block in escape_kernel.cpp.
+ */
+#include <cstddef> // std::size_t
+#include <cstdint> // uint_fast32_t
+#include <string>
+#include <vector>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/escape_kernel.h"
+#include "../src/utf8_dfa.h"
+
+/**
+ * Escapes the given input by splitting it into blocks at the given positions and
+ * feeding each block to escape_block in turn. Returns the concatenated output.
+ * The final state is stored in state.
+ */
+static std::string escape_in_blocks(const std::string& input, const std::vector<std::size_t>& splits, EscapeState& state) {
+    std::string output;
+    std::size_t start = 0;
+    std::vector<std::size_t> ends(splits);
+    ends.push_back(input.size());
+    for (std::size_t end : ends) {
+        const unsigned char *data = reinterpret_cast<const unsigned char *>(input.data()) + start;
+        std::vector<unsigned char> out(escape_output_bound(end - start));
+        std::size_t outlen = escape_block(state, data, end - start, out.data());
+        REQUIRE(outlen <= out.size());
+        output.append(reinterpret_cast<const char *>(out.data()), outlen);
+        if (state.invalid) {
+            break;
+        }
+        start = end;
+    }
+    return output;
+}
+
+static std::string escape_whole(const std::string& input, EscapeState& state) {
+    return escape_in_blocks(input, std::vector<std::size_t>(), state);
+}
+
+TEST_CASE("Test escape_block on valid input", "[escape_block]") {
+    // "\t" U+0080 " " U+00B1 "Hi" U+2020 U+1F602 U+10FFFF U+000B U+007F
+    const std::string input("\t\xC2\x80 \xC2\xB1Hi\xE2\x80\xA0\xF0\x9F\x98\x82\xF4\x8F\xBF\xBF\x0B\x7F");
+    const std::string expected("\t\\u'0080' \\u'00B1'Hi\\u'2020'\\u'1F602'\\u'10FFFF'\\u'000B'\\u'007F'");
+
+    SECTION("One block") {
+        EscapeState state;
+        REQUIRE(escape_whole(input, state) == expected);
+        REQUIRE_FALSE(state.invalid);
+        REQUIRE(state.at_boundary());
+        REQUIRE(state.num_bytes_read == input.size());
+    }
+    SECTION("Split into two blocks at every position") {
+        for (std::size_t split = 0; split <= input.size(); ++split) {
+            EscapeState state;
+            REQUIRE(escape_in_blocks(input, {split}, state) == expected);
+            REQUIRE_FALSE(state.invalid);
+            REQUIRE(state.at_boundary());
+            // Each character is counted once, no matter where it was split.
+            REQUIRE(state.num_escaped[0] == 2);
+            REQUIRE(state.num_escaped[1] == 2);
+            REQUIRE(state.num_escaped[2] == 1);
+            REQUIRE(state.num_escaped[3] == 2);
+        }
+    }
+    SECTION("One byte per block") {
+        std::vector<std::size_t> splits;
+        for (std::size_t split = 1; split < input.size(); ++split) {
+            splits.push_back(split);
+        }
+        EscapeState state;
+        REQUIRE(escape_in_blocks(input, splits, state) == expected);
+        REQUIRE(state.at_boundary());
+    }
+    SECTION("Four-byte character split three ways") {
+        EscapeState state;
+        REQUIRE(escape_in_blocks("a\xF0\x9F\x98\x82z", {2, 3, 4}, state) == "a\\u'1F602'z");
+        REQUIRE(state.at_boundary());
+    }
+}
+
+TEST_CASE("Test escape_block on invalid input", "[escape_block]") {
+    SECTION("Bad first byte") {
+        EscapeState state;
+        REQUIRE(escape_whole("foo\xFF" "bar", state) == "foo");
+        REQUIRE(state.invalid);
+        REQUIRE(state.num_bytes_read == 4);
+    }
+    SECTION("Bad continuation byte, split across blocks") {
+        EscapeState state;
+        REQUIRE(escape_in_blocks("foo\xE2\x80" "bar", {4}, state) == "foo");
+        REQUIRE(state.invalid);
+        REQUIRE(state.num_bytes_read == 6);
+    }
+    SECTION("Overlong 2-byte character") {
+        EscapeState state;
+        REQUIRE(escape_whole("foo\xC1\xBF" "bar", state) == "foo");
+        REQUIRE(state.invalid);
+    }
+    SECTION("4-byte character above U+10FFFF") {
+        EscapeState state;
+        REQUIRE(escape_whole("foo\xF4\x90\x80\x80" "bar", state) == "foo");
+        REQUIRE(state.invalid);
+    }
+    SECTION("UTF-16 surrogates") {
+        // U+D800 and U+DFFF. The first byte of each is fine; the second one isn't.
+        EscapeState state1;
+        REQUIRE(escape_whole("foo\xED\xA0\x80" "bar", state1) == "foo");
+        REQUIRE(state1.invalid);
+        REQUIRE(state1.num_bytes_read == 5);
+        EscapeState state2;
+        REQUIRE(escape_whole("\xED\x9F\xBF\xED\xBF\xBF", state2) == "\\u'D7FF'");
+        REQUIRE(state2.invalid);
+    }
+    SECTION("Truncated character") {
+        // Running out of input isn't an error by itself; the caller has to check
+        // at_boundary() once it knows there's no more input.
+        EscapeState state;
+        REQUIRE(escape_whole("first line\xE2\xB5", state) == "first line");
+        REQUIRE_FALSE(state.invalid);
+        REQUIRE_FALSE(state.at_boundary());
+    }
+}
+
+TEST_CASE("Test escape_block on every ASCII control character", "[escape_block]") {
+    // These come out of a lookup table rather than construct_escape_string,
+    // so check that the two agree.
+    for (unsigned int byte = 0; byte < 128; ++byte) {
+        if ((32 <= byte && byte <= 126) || byte == 9 || byte == 10 || byte == 13) {
+            continue;
+        }
+        unsigned char expected[10] = {'\\', 'u', '\''};
+        std::size_t expected_len = construct_escape_string(expected, byte);
+        REQUIRE(expected_len == 8);
+
+        EscapeState state;
+        std::string input(1, static_cast<char>(byte));
+        REQUIRE(escape_whole(input, state) == std::string(reinterpret_cast<char *>(expected), expected_len));
+    }
+}
+
+TEST_CASE("Test escape_block in each format", "[escape_block]") {
+    // "\t" U+0080 U+000B "Hi" U+2020 U+1F602 U+10FFFF
+    const std::string input("\t\xC2\x80\x0BHi\xE2\x80\xA0\xF0\x9F\x98\x82\xF4\x8F\xBF\xBF");
+    struct Case {
+        EscapeFormat format;
+        const char *expected;
+    };
+    const Case cases[] = {
+        {EscapeFormat::Rfc5137, "\t\\u'0080'\\u'000B'Hi\\u'2020'\\u'1F602'\\u'10FFFF'"},
+        {EscapeFormat::Json, "\t\\u0080\\u000BHi\\u2020\\uD83D\\uDE02\\uDBFF\\uDFFF"},
+        {EscapeFormat::Braces, "\t\\U{0080}\\U{000B}Hi\\U{2020}\\U{1F602}\\U{10FFFF}"},
+        {EscapeFormat::Html, "\t&#x0080;&#x000B;Hi&#x2020;&#x1F602;&#x10FFFF;"},
+    };
+    for (const Case& c : cases) {
+        // Every split, so that each character gets finished off by a block of its own.
+        for (std::size_t split = 0; split <= input.size(); ++split) {
+            EscapeState state;
+            std::string output;
+            std::size_t ends[2] = {split, input.size()};
+            std::size_t start = 0;
+            for (std::size_t end : ends) {
+                std::vector<unsigned char> out(escape_output_bound(end - start, c.format));
+                const unsigned char *data = reinterpret_cast<const unsigned char *>(input.data()) + start;
+                std::size_t outlen = escape_block(state, data, end - start, out.data(), c.format);
+                output.append(reinterpret_cast<const char *>(out.data()), outlen);
+                start = end;
+            }
+            REQUIRE(output == c.expected);
+            REQUIRE(state.at_boundary());
+        }
+    }
+
+    // A single byte that finishes a character is the worst case for the output bound.
+    EscapeState state;
+    std::vector<unsigned char> out(escape_output_bound(3, EscapeFormat::Json));
+    REQUIRE(escape_block(state, reinterpret_cast<const unsigned char *>("\xF0\x9F\x98"), 3, out.data(), EscapeFormat::Json) == 0);
+    out.assign(escape_output_bound(1, EscapeFormat::Json), 0);
+    REQUIRE(escape_block(state, reinterpret_cast<const unsigned char *>("\x82"), 1, out.data(), EscapeFormat::Json) == 12);
+}
+
+TEST_CASE("Test escape_input_bound", "[escape_block]") {
+    // It's the longest input whose escape_output_bound fits, in each format.
+    for (EscapeFormat format : {EscapeFormat::Rfc5137, EscapeFormat::Json, EscapeFormat::Braces}) {
+        for (std::size_t capacity = 0; capacity < 100; ++capacity) {
+            std::size_t len = escape_input_bound(capacity, format);
+            if (len > 0) {
+                REQUIRE(escape_output_bound(len, format) <= capacity);
+            }
+            REQUIRE(escape_output_bound(len + 1, format) > capacity);
+        }
+    }
+    REQUIRE(escape_input_bound(escape_output_bound(1)) == 1);
+    REQUIRE(escape_input_bound(escape_output_bound(1) - 1) == 0);
+    REQUIRE(escape_input_bound(escape_output_bound(1, EscapeFormat::Json) - 1, EscapeFormat::Json) == 0);
+}
+
+/**
+ * A deliberately naive decoder for a single character, written straight from the
+ * table in RFC 3629. Returns true if bytes[0..len) is exactly one valid character.
+ */
+static bool naive_is_valid_char(const unsigned char *bytes, int len) {
+    int expected_len;
+    std::uint_fast32_t codepoint;
+    if (bytes[0] < 0x80) {
+        expected_len = 1;
+        codepoint = bytes[0];
+    } else if ((bytes[0] & 0xE0u) == 0xC0u) {
+        expected_len = 2;
+        codepoint = bytes[0] & 0x1Fu;
+    } else if ((bytes[0] & 0xF0u) == 0xE0u) {
+        expected_len = 3;
+        codepoint = bytes[0] & 0x0Fu;
+    } else if ((bytes[0] & 0xF8u) == 0xF0u) {
+        expected_len = 4;
+        codepoint = bytes[0] & 0x07u;
+    } else {
+        return false;
+    }
+    if (len != expected_len) {
+        return false;
+    }
+    for (int i = 1; i < len; ++i) {
+        if ((bytes[i] & 0xC0u) != 0x80u) {
+            return false;
+        }
+        codepoint = (codepoint << 6u) | (bytes[i] & 0x3Fu);
+    }
+    const std::uint_fast32_t min_value[5] = {0, 0, 0x80, 0x800, 0x10000};
+    if (codepoint < min_value[len] || codepoint > 0x10FFFF) {
+        return false;
+    }
+    return codepoint < 0xD800 || codepoint > 0xDFFF;
+}
+
+/**
+ * Runs the DFA over bytes[0..len) and returns true if it ends in UTF8_ACCEPT
+ * without passing through UTF8_REJECT.
+ */
+static bool dfa_accepts(const unsigned char *bytes, int len) {
+    std::uint_fast32_t state = UTF8_ACCEPT;
+    std::uint_fast32_t codepoint = 0;
+    for (int i = 0; i < len; ++i) {
+        utf8_dfa_step(state, codepoint, bytes[i]);
+        if (state == UTF8_REJECT) {
+            return false;
+        }
+        if (state == UTF8_ACCEPT && i != len - 1) {
+            return false; // Accepted a character before the end, so it's more than one character.
+        }
+    }
+    return state == UTF8_ACCEPT;
+}
+
+TEST_CASE("Test escape_block with a custom preserve set", "[escape_block]") {
+    // "\t" "\v" "\\" "a'b" U+00E9 "\x01"
+    const std::string input("\t\x0B\\a'b\xC3\xA9\x01");
+    bool preserved[128] = {};
+    for (unsigned int byte = 0; byte < 128; ++byte) {
+        preserved[byte] = (32 <= byte && byte <= 126 && byte != '\\' && byte != '\'') || byte == '\t' || byte == 0x0B;
+    }
+    const EscapeSettings settings(EscapeFormat::Rfc5137, PreserveSet(preserved));
+    for (unsigned int byte = 0; byte < 128; ++byte) {
+        preserved[byte] = true;
+    }
+    const EscapeSettings all_ascii(EscapeFormat::Json, PreserveSet(preserved));
+    struct Case {
+        const EscapeSettings& settings;
+        const char *expected;
+    };
+    const Case cases[] = {
+        {settings, "\t\x0B\\u'005C'a\\u'0027'b\\u'00E9'\\u'0001'"},
+        {all_ascii, "\t\x0B\\a'b\\u00E9\x01"},
+    };
+    for (const Case& c : cases) {
+        for (std::size_t split = 0; split <= input.size(); ++split) {
+            EscapeState state;
+            std::string output;
+            std::size_t ends[2] = {split, input.size()};
+            std::size_t start = 0;
+            for (std::size_t end : ends) {
+                std::vector<unsigned char> out(escape_output_bound(end - start, c.settings.format));
+                const unsigned char *data = reinterpret_cast<const unsigned char *>(input.data()) + start;
+                output.append(reinterpret_cast<const char *>(out.data()),
+                              escape_block(state, data, end - start, out.data(), c.settings));
+                start = end;
+            }
+            REQUIRE(output == c.expected);
+            REQUIRE(state.at_boundary());
+        }
+    }
+
+    // A long input, so that the vector loops see every kind of byte too.
+    std::string long_input;
+    std::string expected;
+    for (int i = 0; i < 50; ++i) {
+        long_input += "The quick brown fox's \\ jumps\x0B over the lazy dog.\n";
+        expected += "The quick brown fox\\u'0027's \\u'005C' jumps\x0B over the lazy dog.\\u'000A'";
+    }
+    EscapeState state;
+    std::vector<unsigned char> out(escape_output_bound(long_input.size()));
+    std::size_t outlen = escape_block(state, reinterpret_cast<const unsigned char *>(long_input.data()), long_input.size(),
+                                      out.data(), settings);
+    REQUIRE(std::string(reinterpret_cast<const char *>(out.data()), outlen) == expected);
+}
+
+TEST_CASE("Test the character counts in EscapeState", "[escape_block]") {
+    // The characters on either side of each change in length: U+007F, U+0080, U+07FF, U+0800,
+    // U+FFFF, U+10000 and U+10FFFF.
+    const std::string input("\x7F\xC2\x80\xDF\xBF\xE0\xA0\x80\xEF\xBF\xBF\xF0\x90\x80\x80\xF4\x8F\xBF\xBF");
+    EscapeState state;
+    escape_whole(input, state);
+    REQUIRE(state.num_escaped[0] == 1);
+    REQUIRE(state.num_escaped[1] == 2);
+    REQUIRE(state.num_escaped[2] == 2);
+    REQUIRE(state.num_escaped[3] == 2);
+
+    // ASCII characters that aren't in the preserve set are counted as escaped too.
+    bool preserved[128] = {};
+    preserved['b'] = true;
+    const EscapeSettings settings(EscapeFormat::Json, PreserveSet(preserved));
+    EscapeState custom;
+    const std::string text("abc\xC3\xA9");
+    std::vector<unsigned char> out(escape_output_bound(text.size(), settings.format));
+    escape_block(custom, reinterpret_cast<const unsigned char *>(text.data()), text.size(), out.data(), settings);
+    REQUIRE(custom.num_escaped[0] == 2);
+    REQUIRE(custom.num_escaped[1] == 1);
+}
+
+TEST_CASE("Test the UTF-8 DFA against a naive decoder", "[utf8_dfa]") {
+    unsigned char bytes[4];
+    SECTION("All 1- and 2-byte sequences") {
+        for (unsigned int a = 0; a < 256; ++a) {
+            bytes[0] = static_cast<unsigned char>(a);
+            REQUIRE(dfa_accepts(bytes, 1) == naive_is_valid_char(bytes, 1));
+            for (unsigned int b = 0; b < 256; ++b) {
+                bytes[1] = static_cast<unsigned char>(b);
+                REQUIRE(dfa_accepts(bytes, 2) == naive_is_valid_char(bytes, 2));
+            }
+        }
+    }
+    SECTION("All 3-byte sequences starting with E0..EF") {
+        for (unsigned int a = 0xE0; a <= 0xEF; ++a) {
+            for (unsigned int b = 0x70; b < 0xD0; ++b) {
+                for (unsigned int c = 0x70; c < 0xD0; ++c) {
+                    bytes[0] = static_cast<unsigned char>(a);
+                    bytes[1] = static_cast<unsigned char>(b);
+                    bytes[2] = static_cast<unsigned char>(c);
+                    // Only reporting failures keeps the assertion count sane.
+                    if (dfa_accepts(bytes, 3) != naive_is_valid_char(bytes, 3)) {
+                        FAIL("Mismatch for " << a << " " << b << " " << c);
+                    }
+                }
+            }
+        }
+    }
+    SECTION("4-byte sequences around the boundaries") {
+        const unsigned int seconds[] = {0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0};
+        for (unsigned int a = 0xF0; a <= 0xFF; ++a) {
+            for (unsigned int b : seconds) {
+                for (unsigned int c : seconds) {
+                    for (unsigned int d : seconds) {
+                        bytes[0] = static_cast<unsigned char>(a);
+                        bytes[1] = static_cast<unsigned char>(b);
+                        bytes[2] = static_cast<unsigned char>(c);
+                        bytes[3] = static_cast<unsigned char>(d);
+                        REQUIRE(dfa_accepts(bytes, 4) == naive_is_valid_char(bytes, 4));
+                    }
+                }
+            }
+        }
+    }
+    SECTION("Decoded values") {
+        std::uint_fast32_t state = UTF8_ACCEPT;
+        std::uint_fast32_t codepoint = 0;
+        const unsigned char joy[] = {0xF0, 0x9F, 0x98, 0x82};
+        for (unsigned char byte : joy) {
+            utf8_dfa_step(state, codepoint, byte);
+        }
+        REQUIRE(state == UTF8_ACCEPT);
+        REQUIRE(codepoint == 0x1F602);
+    }
+}
@@ -0,0 +1,211 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for --follow (follow.cpp). follow() runs in a thread of its own,
+ * and the tests write to its input and wait for the output to catch up.
+ *
+ * NOTE: these tests create (and then delete) files and a directory in the current directory.
+ */
+#ifdef __linux__
+
+#include <atomic>
+#include <chrono>
+#include <cstdio> // std::remove, std::rename
+#include <string>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/follow.h"
+#include "test_helpers.h"
+
+static const char *const TEMP_DIR = "unit_tests_follow.tmp";
+static const std::string INPUT_FILE = std::string(TEMP_DIR) + "/input.log";
+static const std::string ROTATED_FILE = std::string(TEMP_DIR) + "/input.log.1";
+static const std::string OUTPUT_FILE = std::string(TEMP_DIR) + "/output.txt";
+static const std::string CHECKPOINT_FILE = std::string(TEMP_DIR) + "/checkpoint";
+
+static void append_file(const std::string& path, const std::string& contents) {
+    write_file(path, contents, std::ios_base::app);
+}
+
+/**
+ * Waits (for up to 10 seconds) until the file at path has the given contents.
+ * @return The contents it ended up with, so that a failure shows them.
+ */
+static std::string wait_for(const std::string& path, const std::string& expected) {
+    std::string contents;
+    for (int i = 0; i < 1000; ++i) {
+        contents = read_file(path);
+        if (contents == expected) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return contents;
+}
+
+/**
+ * Runs follow() on INPUT_FILE, with OUTPUT_FILE as the output, in a thread of its own.
+ */
+class FollowRunner {
+public:
+    explicit FollowRunner(const std::string& checkpoint = std::string(), const EscapeSettings& settings = EscapeSettings())
+            : retval(-1), done(false) {
+        REQUIRE(pipe(stop_pipe) == 0);
+        thread = std::thread([this, checkpoint, settings] {
+            ByteSink out = ByteSink::open_file(OUTPUT_FILE);
+            retval = follow(INPUT_FILE, out, settings, checkpoint, stop_pipe[0]);
+            done = true;
+        });
+    }
+
+    ~FollowRunner() {
+        if (thread.joinable()) {
+            stop();
+        }
+    }
+
+    /**
+     * Tells follow() to stop (if it hasn't already), and returns what it returned.
+     */
+    int stop() {
+        close(stop_pipe[1]);
+        thread.join();
+        close(stop_pipe[0]);
+        return retval;
+    }
+
+    /**
+     * Waits (for up to 10 seconds) for follow() to stop by itself, which it does after an
+     * error, and returns what it returned.
+     */
+    int finish() {
+        for (int i = 0; i < 1000 && !done; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return stop();
+    }
+
+private:
+    int stop_pipe[2];
+    std::thread thread;
+    int retval;
+    std::atomic<bool> done;
+};
+
+TEST_CASE("Test follow", "[follow]") {
+    mkdir(TEMP_DIR, 0777);
+
+    SECTION("Appending") {
+        write_file(INPUT_FILE, "caf\xC3\xA9\n");
+        FollowRunner runner;
+        REQUIRE(wait_for(OUTPUT_FILE, "caf\\u'00E9'\n") == "caf\\u'00E9'\n");
+        append_file(INPUT_FILE, "more\n");
+        REQUIRE(wait_for(OUTPUT_FILE, "caf\\u'00E9'\nmore\n") == "caf\\u'00E9'\nmore\n");
+        // Half of a character is held back until the rest of it is written.
+        append_file(INPUT_FILE, "x\xF0\x9F");
+        REQUIRE(wait_for(OUTPUT_FILE, "caf\\u'00E9'\nmore\nx") == "caf\\u'00E9'\nmore\nx");
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        REQUIRE(read_file(OUTPUT_FILE) == "caf\\u'00E9'\nmore\nx");
+        append_file(INPUT_FILE, "\x98\x82\n");
+        REQUIRE(wait_for(OUTPUT_FILE, "caf\\u'00E9'\nmore\nx\\u'1F602'\n") == "caf\\u'00E9'\nmore\nx\\u'1F602'\n");
+        REQUIRE(runner.stop() == 0);
+    }
+    SECTION("Settings") {
+        write_file(INPUT_FILE, "a\xC3\xA9");
+        FollowRunner runner(std::string(), EscapeSettings(EscapeFormat::Json));
+        REQUIRE(wait_for(OUTPUT_FILE, "a\\u00E9") == "a\\u00E9");
+        REQUIRE(runner.stop() == 0);
+    }
+    SECTION("Rotation by renaming") {
+        write_file(INPUT_FILE, "one\n");
+        FollowRunner runner;
+        REQUIRE(wait_for(OUTPUT_FILE, "one\n") == "one\n");
+        // What's written to the old file after it's renamed still comes before the new file.
+        REQUIRE(std::rename(INPUT_FILE.c_str(), ROTATED_FILE.c_str()) == 0);
+        append_file(ROTATED_FILE, "late\n");
+        write_file(INPUT_FILE, "two\n");
+        REQUIRE(wait_for(OUTPUT_FILE, "one\nlate\ntwo\n") == "one\nlate\ntwo\n");
+        append_file(INPUT_FILE, "three\n");
+        REQUIRE(wait_for(OUTPUT_FILE, "one\nlate\ntwo\nthree\n") == "one\nlate\ntwo\nthree\n");
+        REQUIRE(runner.stop() == 0);
+    }
+    SECTION("Rotation by truncating") {
+        write_file(INPUT_FILE, "first line\n");
+        FollowRunner runner;
+        REQUIRE(wait_for(OUTPUT_FILE, "first line\n") == "first line\n");
+        write_file(INPUT_FILE, "2nd\n");
+        REQUIRE(wait_for(OUTPUT_FILE, "first line\n2nd\n") == "first line\n2nd\n");
+        REQUIRE(runner.stop() == 0);
+    }
+    SECTION("Checkpoint") {
+        write_file(INPUT_FILE, "one\n");
+        struct stat info;
+        REQUIRE(stat(INPUT_FILE.c_str(), &info) == 0);
+        const std::string id = std::to_string(info.st_dev) + " " + std::to_string(info.st_ino) + " ";
+        {
+            FollowRunner runner(CHECKPOINT_FILE);
+            REQUIRE(wait_for(OUTPUT_FILE, "one\n") == "one\n");
+            REQUIRE(runner.stop() == 0);
+        }
+        REQUIRE(read_file(CHECKPOINT_FILE) == id + "4\n");
+
+        // Only what was added while we were stopped is escaped the next time.
+        append_file(INPUT_FILE, "two\xC3\xA9\n");
+        {
+            FollowRunner runner(CHECKPOINT_FILE);
+            REQUIRE(wait_for(OUTPUT_FILE, "two\\u'00E9'\n") == "two\\u'00E9'\n");
+            REQUIRE(runner.stop() == 0);
+        }
+        REQUIRE(read_file(CHECKPOINT_FILE) == id + "10\n");
+
+        // A checkpoint for another file, or past the end of this one, doesn't count.
+        for (const std::string& saved : {std::to_string(info.st_dev) + " " + std::to_string(info.st_ino + 1) + " 4\n", id + "1000\n"}) {
+            write_file(CHECKPOINT_FILE, saved);
+            FollowRunner runner(CHECKPOINT_FILE);
+            REQUIRE(wait_for(OUTPUT_FILE, "one\ntwo\\u'00E9'\n") == "one\ntwo\\u'00E9'\n");
+            REQUIRE(runner.stop() == 0);
+            REQUIRE(read_file(CHECKPOINT_FILE) == id + "10\n");
+        }
+        std::remove(CHECKPOINT_FILE.c_str());
+    }
+    SECTION("Errors") {
+        // follow() stops by itself at an invalid byte, after writing everything before it.
+        write_file(INPUT_FILE, "ab\xFF" "cd");
+        {
+            FollowRunner runner;
+            REQUIRE(runner.finish() == 2);
+            REQUIRE(read_file(OUTPUT_FILE) == "ab");
+        }
+        write_file(INPUT_FILE, "ab");
+        {
+            FollowRunner runner;
+            REQUIRE(wait_for(OUTPUT_FILE, "ab") == "ab");
+            append_file(INPUT_FILE, "\xC0\x80");
+            REQUIRE(runner.finish() == 2);
+        }
+        // A checkpoint file that isn't one.
+        write_file(CHECKPOINT_FILE, "not a checkpoint\n");
+        {
+            FollowRunner runner(CHECKPOINT_FILE);
+            REQUIRE(runner.finish() == 1);
+        }
+        std::remove(CHECKPOINT_FILE.c_str());
+        std::remove(INPUT_FILE.c_str());
+        {
+            FollowRunner runner;
+            REQUIRE(runner.finish() == 1);
+        }
+    }
+    std::remove(INPUT_FILE.c_str());
+    std::remove(ROTATED_FILE.c_str());
+    std::remove(OUTPUT_FILE.c_str());
+    rmdir(TEMP_DIR);
+}
+
+#endif
@@ -0,0 +1,138 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for escape_in_place (in_place.cpp).
+ *
+ * NOTE: these tests create (and then delete) files and a directory in the current directory.
+ */
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <cstdio> // std::remove
+#include <string>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/in_place.h"
+#include "test_helpers.h"
+
+static const char *const TEMP_DIR = "unit_tests_in_place.tmp";
+static const std::string TEMP_FILE = std::string(TEMP_DIR) + "/file.txt";
+
+/**
+ * Returns the number of entries in TEMP_DIR, so that we can tell if a temporary file was
+ * left behind.
+ */
+static int count_files() {
+    int count = 0;
+    DIR *dir = opendir(TEMP_DIR);
+    REQUIRE(dir != nullptr);
+    while (struct dirent *entry = readdir(dir)) {
+        std::string name(entry->d_name);
+        if (name != "." && name != "..") {
+            ++count;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+TEST_CASE("Test escape_in_place", "[in_place]") {
+    mkdir(TEMP_DIR, 0777);
+
+    SECTION("Nothing to escape") {
+        // The file isn't touched at all, so it's still the same file with the same times.
+        std::string contents(3 * 65536 + 5, 'a');
+        contents += "\tprintable ASCII\r\n";
+        for (const std::string& text : {std::string(), contents}) {
+            write_file(TEMP_FILE, text);
+            chmod(TEMP_FILE.c_str(), 0640);
+            struct stat before;
+            REQUIRE(stat(TEMP_FILE.c_str(), &before) == 0);
+            REQUIRE(escape_in_place(TEMP_FILE) == 0);
+            struct stat after;
+            REQUIRE(stat(TEMP_FILE.c_str(), &after) == 0);
+            REQUIRE(after.st_ino == before.st_ino);
+            REQUIRE(after.st_mtime == before.st_mtime);
+            REQUIRE(read_file(TEMP_FILE) == text);
+        }
+    }
+    SECTION("Escaping") {
+        struct Case {
+            std::string input;
+            std::string output;
+        };
+        std::string ascii(200000, 'x');
+        const Case cases[] = {
+            {"\xC3\xA9", "\\u'00E9'"},
+            {"caf\xC3\xA9\n", "caf\\u'00E9'\n"},
+            // The first byte to escape is far in, so there's a long part that's copied as it is.
+            {ascii + "\x01" + ascii, ascii + "\\u'0001'" + ascii},
+            {"\xF0\x9F\x98\x82" + ascii, "\\u'1F602'" + ascii},
+        };
+        for (const Case& c : cases) {
+            write_file(TEMP_FILE, c.input);
+            chmod(TEMP_FILE.c_str(), 0640);
+            struct stat before;
+            REQUIRE(stat(TEMP_FILE.c_str(), &before) == 0);
+            REQUIRE(escape_in_place(TEMP_FILE) == 0);
+            REQUIRE(read_file(TEMP_FILE) == c.output);
+            // It's a new file, with the same permissions.
+            struct stat after;
+            REQUIRE(stat(TEMP_FILE.c_str(), &after) == 0);
+            REQUIRE(after.st_ino != before.st_ino);
+            REQUIRE((after.st_mode & 07777) == 0640);
+            REQUIRE(count_files() == 1);
+        }
+    }
+    SECTION("Settings") {
+        write_file(TEMP_FILE, "a\\b\xC3\xA9");
+        REQUIRE(escape_in_place(TEMP_FILE, EscapeSettings(EscapeFormat::Json)) == 0);
+        REQUIRE(read_file(TEMP_FILE) == "a\\b\\u00E9");
+        // With backslashes escaped, a file that's all printable ASCII can still change.
+        bool preserved[128] = {};
+        for (unsigned char byte = 32; byte <= 126; ++byte) {
+            preserved[byte] = byte != '\\';
+        }
+        REQUIRE(escape_in_place(TEMP_FILE, EscapeSettings(EscapeFormat::Rfc5137, PreserveSet(preserved))) == 0);
+        REQUIRE(read_file(TEMP_FILE) == "a\\u'005C'b\\u'005C'u00E9");
+    }
+    SECTION("Errors") {
+        // A file that can't be escaped is left as it is, and so is its directory.
+        for (const std::string& text : {std::string("ab\xFF"), std::string("ab\xE2\x82"), std::string(100000, 'a') + "\xC0\x80"}) {
+            write_file(TEMP_FILE, text);
+            REQUIRE(escape_in_place(TEMP_FILE) == 2);
+            REQUIRE(read_file(TEMP_FILE) == text);
+            REQUIRE(count_files() == 1);
+        }
+        REQUIRE(escape_in_place(std::string(TEMP_DIR) + "/missing.txt") == 1);
+        REQUIRE(escape_in_place(TEMP_DIR) == 1);
+        if (geteuid() != 0) { // root can write anywhere
+            write_file(TEMP_FILE, "\xC3\xA9");
+            chmod(TEMP_DIR, 0555);
+            REQUIRE(escape_in_place(TEMP_FILE) == 4);
+            chmod(TEMP_DIR, 0777);
+            REQUIRE(read_file(TEMP_FILE) == "\xC3\xA9");
+        }
+    }
+    SECTION("Symbolic link") {
+        // The file the link points to is replaced, and the link stays a link.
+        write_file(TEMP_FILE, "\xC3\xA9");
+        const std::string link = std::string(TEMP_DIR) + "/link.txt";
+        REQUIRE(symlink("file.txt", link.c_str()) == 0);
+        REQUIRE(escape_in_place(link) == 0);
+        REQUIRE(read_file(TEMP_FILE) == "\\u'00E9'");
+        struct stat info;
+        REQUIRE(lstat(link.c_str(), &info) == 0);
+        REQUIRE(S_ISLNK(info.st_mode));
+        std::remove(link.c_str());
+    }
+    std::remove(TEMP_FILE.c_str());
+    rmdir(TEMP_DIR);
+}
+
+#endif
@@ -0,0 +1,121 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for MappedFile and for the memory-mapped path of read_and_escape.
+ * The tests use windows of a single page, so that a small file is split into many windows
+ * and characters end up split between them.
+ *
+ * NOTE: these tests create (and then delete) a file in the current directory.
+ */
+#include <cstdio> // std::remove
+#include <memory>
+#include <string>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/MappedFile.h"
+#include "../src/StreamPair.h"
+#include "../src/business_logic.h"
+#include "test_helpers.h"
+
+// MappedFile is only implemented for POSIX systems; see MappedFile.h.
+#if defined(__unix__) || defined(__APPLE__)
+
+static const char *const TEMP_FILE = "unit_tests_mapped_file.tmp";
+
+/**
+ * Runs read_and_escape on contents, either through a one-page MappedFile or (if mapped is
+ * false) through a string source.
+ */
+static int run(const std::string& contents, bool mapped, std::string& output) {
+    StreamPair streams(ByteSource::from_string(mapped ? "" : contents), ByteSink::to_string());
+    if (mapped) {
+        write_file(TEMP_FILE, contents);
+        streams.mapped = MappedFile::open(TEMP_FILE, 1);
+        REQUIRE(streams.mapped);
+    }
+    int retval = read_and_escape(streams);
+    output = streams.out.contents();
+    streams.mapped.reset();
+    std::remove(TEMP_FILE);
+    return retval;
+}
+
+TEST_CASE("Test MappedFile windows", "[MappedFile]") {
+    std::string contents;
+    for (int i = 0; i < 10000; ++i) {
+        contents += static_cast<char>('a' + i % 26);
+    }
+    write_file(TEMP_FILE, contents);
+    {
+        std::shared_ptr<MappedFile> file = MappedFile::open(TEMP_FILE, 1000);
+        REQUIRE(file);
+        REQUIRE(file->size() == contents.size());
+        std::string joined;
+        const unsigned char *data;
+        std::size_t len;
+        int windows = 0;
+        while (true) {
+            REQUIRE(file->next_window(data, len));
+            if (len == 0) {
+                break;
+            }
+            joined.append(reinterpret_cast<const char *>(data), len);
+            ++windows;
+        }
+        REQUIRE(joined == contents);
+        REQUIRE(windows > 1); // 1000 is rounded up to a page, which is still less than 10000.
+    }
+    std::remove(TEMP_FILE);
+
+    SECTION("Empty file") {
+        write_file(TEMP_FILE, "");
+        std::shared_ptr<MappedFile> file = MappedFile::open(TEMP_FILE);
+        REQUIRE(file);
+        const unsigned char *data;
+        std::size_t len = 1;
+        REQUIRE(file->next_window(data, len));
+        REQUIRE(len == 0);
+        file.reset();
+        std::remove(TEMP_FILE);
+    }
+    SECTION("Things that can't be mapped") {
+        REQUIRE_FALSE(MappedFile::open("this file does not exist"));
+        REQUIRE_FALSE(MappedFile::open("."));
+    }
+}
+
+TEST_CASE("Test read_and_escape with a mapped file", "[read_and_escape]") {
+    // Characters of every length, repeated so that some of them straddle window boundaries.
+    std::string contents;
+    while (contents.size() < 20000) {
+        contents += "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x82\x01 \n";
+    }
+    std::string expected;
+    REQUIRE(run(contents, false, expected) == 0);
+
+    std::string output;
+    SECTION("valid") {
+        REQUIRE(run(contents, true, output) == 0);
+        REQUIRE(output == expected);
+    }
+    SECTION("invalid") {
+        std::string bad = contents;
+        bad[9000] = '\xFF';
+        std::string streamed;
+        REQUIRE(run(bad, false, streamed) == 2);
+        REQUIRE(run(bad, true, output) == 2);
+        REQUIRE(output == streamed);
+    }
+    SECTION("truncated") {
+        REQUIRE(run(contents + "\xF0\x9F", true, output) == 2);
+        REQUIRE(output == expected);
+    }
+    SECTION("empty") {
+        REQUIRE(run("", true, output) == 0);
+        REQUIRE(output.empty());
+    }
+}
+
+#endif
@@ -0,0 +1,114 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for escaped_length in measure.cpp. The expected length always
+ * comes from actually escaping the input with escape_block, and each test is run with every
+ * kernel tier this CPU has.
+ */
+#include <cstddef> // std::size_t
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/escape_kernel.h"
+#include "../src/measure.h"
+#include "kernel_tiers.h"
+
+static std::size_t escape_length(const std::string& input, EscapeFormat format = EscapeFormat::Rfc5137) {
+    EscapeState state;
+    std::vector<unsigned char> out(escape_output_bound(input.size(), format));
+    std::size_t outlen = escape_block(state, reinterpret_cast<const unsigned char *>(input.data()), input.size(), out.data(), format);
+    REQUIRE_FALSE(state.invalid);
+    REQUIRE(state.at_boundary());
+    return outlen;
+}
+
+static std::uint_fast64_t measure(const std::string& input, std::size_t offset, std::size_t len,
+                                  EscapeFormat format = EscapeFormat::Rfc5137) {
+    return escaped_length(reinterpret_cast<const unsigned char *>(input.data()) + offset, len, format);
+}
+
+static const EscapeFormat FORMATS[] = {EscapeFormat::Rfc5137, EscapeFormat::Json, EscapeFormat::Braces, EscapeFormat::Html};
+
+TEST_CASE("Test escaped_length on each kind of character", "[escaped_length]") {
+    for (KernelTier tier : available_tiers()) {
+        SECTION(kernel_tier_name(tier)) {
+            TierGuard guard(tier);
+            REQUIRE(measure("", 0, 0) == 0);
+            const char *chars[] = {"a", " ", "~", "\t", "\n", "\r", "\x01", "\x7F", "\x0B", "\xC2\x80", "\xDF\xBF",
+                                   "\xE0\xA0\x80", "\xEF\xBF\xBF", "\xF0\x90\x80\x80", "\xF3\xBF\xBF\xBF", "\xF4\x8F\xBF\xBF"};
+            for (const char *c : chars) {
+                // Enough copies to go through the vector loops and the scalar loop.
+                std::string input;
+                for (int i = 0; i < 300; ++i) {
+                    input += c;
+                }
+                for (EscapeFormat format : FORMATS) {
+                    REQUIRE(measure(input, 0, input.size(), format) == escape_length(input, format));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Test escaped_length on mixed text", "[escaped_length]") {
+    for (KernelTier tier : available_tiers()) {
+        SECTION(kernel_tier_name(tier)) {
+            TierGuard guard(tier);
+            std::mt19937 rng(14);
+            const char *pieces[] = {"a", "Hola mundo! ", "\t", "\n", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x82",
+                                    "\xF4\x80\x80\x80", "\x01", "\x7F", "\xE4\xB8\xAD"};
+            for (int iteration = 0; iteration < 100; ++iteration) {
+                std::string input;
+                // Some of these are long enough that the byte counters have to be summed several times.
+                std::size_t target = (iteration % 10 == 0) ? 20000 : rng() % 300;
+                while (input.size() < target) {
+                    input += pieces[rng() % (sizeof(pieces) / sizeof(pieces[0]))];
+                }
+                for (EscapeFormat format : FORMATS) {
+                    REQUIRE(measure(input, 0, input.size(), format) == escape_length(input, format));
+                    // A character can be split anywhere, and the two halves still add up.
+                    std::size_t split = input.empty() ? 0 : rng() % input.size();
+                    REQUIRE(measure(input, 0, split, format) + measure(input, split, input.size() - split, format) ==
+                            escape_length(input, format));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Test escaped_length with a custom preserve set", "[escaped_length]") {
+    for (KernelTier tier : available_tiers()) {
+        SECTION(kernel_tier_name(tier)) {
+            TierGuard guard(tier);
+            std::mt19937 rng(16);
+            const char *pieces[] = {"a", "\\", "'", " ", "\t", "\n", "\x0B", "\x0C", "\x01", "\x7F", "\xC3\xA9",
+                                    "\xE2\x82\xAC", "\xF0\x9F\x98\x82", "\xF4\x80\x80\x80"};
+            for (int iteration = 0; iteration < 100; ++iteration) {
+                // Alternately a random set (usually too many ranges for SSE2) and a small change to the default.
+                bool preserved[128] = {};
+                for (unsigned int byte = 0; byte < 128; ++byte) {
+                    preserved[byte] = (iteration % 2 == 0) ? (rng() % 2 == 0)
+                                                           : (32 <= byte && byte <= 126 && byte != '\\') || byte == 0x0B;
+                }
+                std::string input;
+                std::size_t target = (iteration % 10 == 0) ? 20000 : rng() % 300;
+                while (input.size() < target) {
+                    input += pieces[rng() % (sizeof(pieces) / sizeof(pieces[0]))];
+                }
+                for (EscapeFormat format : FORMATS) {
+                    const EscapeSettings settings(format, PreserveSet(preserved));
+                    EscapeState state;
+                    std::vector<unsigned char> out(escape_output_bound(input.size(), format));
+                    std::size_t outlen = escape_block(state, reinterpret_cast<const unsigned char *>(input.data()), input.size(),
+                                                      out.data(), settings);
+                    REQUIRE(escaped_length(reinterpret_cast<const unsigned char *>(input.data()), input.size(), settings) ==
+                            outlen);
+                }
+            }
+        }
+    }
+}
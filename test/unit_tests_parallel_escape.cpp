@@ -0,0 +1,112 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for parallel_escape.cpp. The main thing to check is that
+ * parallel_read_and_escape behaves exactly like read_and_escape: same output, same
+ * return value. The inputs have to be bigger than a chunk (256 KB) to exercise the
+ * splitting, so they're built in code rather than stored in vcs_testcases.
+ */
+#include <cstddef> // std::size_t
+#include <memory>
+#include <random>
+#include <string>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/StreamPair.h"
+#include "../src/business_logic.h"
+#include "../src/parallel_escape.h"
+
+// Function prototype for a function that isn't exposed through the headers
+std::size_t find_chunk_boundary(const unsigned char *data, std::size_t pos, std::size_t len, std::size_t min);
+
+/**
+ * Runs either read_and_escape (if num_threads is 1) or parallel_read_and_escape on input,
+ * with strings in place of the files.
+ */
+static int run(const std::string& input, unsigned int num_threads, std::string& output) {
+    StreamPair streams(ByteSource::from_string(input), ByteSink::to_string());
+    int retval = (num_threads == 1) ? read_and_escape(streams) : parallel_read_and_escape(streams, num_threads);
+    output = streams.out.contents();
+    return retval;
+}
+
+TEST_CASE("Test find_chunk_boundary", "[find_chunk_boundary]") {
+    // "a", U+00E9 (2 bytes), U+20AC (3 bytes), U+1F602 (4 bytes), "b"
+    const unsigned char text[] = {'a', 0xC3, 0xA9, 0xE2, 0x82, 0xAC, 0xF0, 0x9F, 0x98, 0x82, 'b'};
+    const std::size_t len = sizeof(text);
+    const std::size_t expected[] = {0, 1, 1, 3, 3, 3, 6, 6, 6, 6, 10, 11};
+    for (std::size_t pos = 0; pos <= len; ++pos) {
+        REQUIRE(find_chunk_boundary(text, pos, len, 0) == expected[pos]);
+    }
+    // It doesn't go below min, or back more than 3 bytes.
+    REQUIRE(find_chunk_boundary(text, 9, len, 8) == 8);
+    const unsigned char junk[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x80};
+    REQUIRE(find_chunk_boundary(junk, 5, sizeof(junk), 0) == 2);
+    REQUIRE(find_chunk_boundary(junk, 2, sizeof(junk), 0) == 0);
+}
+
+TEST_CASE("Test parallel_read_and_escape matches read_and_escape", "[parallel_read_and_escape]") {
+    // The same characters as above, plus a control character, in random order.
+    const char *pieces[] = {"a", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x82", "\x01", "hello world "};
+    std::mt19937 rng(2026);
+    std::string input;
+    while (input.size() < 3 * 1024 * 1024) {
+        input += pieces[rng() % 6];
+    }
+    std::string expected;
+    REQUIRE(run(input, 1, expected) == 0);
+
+    unsigned int thread_counts[] = {2, 3, 7};
+    for (unsigned int n : thread_counts) {
+        std::string output;
+        SECTION("valid, " + std::to_string(n) + " threads") {
+            REQUIRE(run(input, n, output) == 0);
+            REQUIRE(output == expected);
+        }
+        SECTION("bad byte in the middle, " + std::to_string(n) + " threads") {
+            // Put the bad byte at a few different positions, including right next to where
+            // the chunks are likely to be cut.
+            std::size_t positions[] = {0, 12345, 256 * 1024 - 1, 256 * 1024, input.size() / 2, input.size() - 1};
+            for (std::size_t pos : positions) {
+                std::string bad = input;
+                bad[pos] = '\xFF'; // 0xFF never appears in UTF-8
+                std::string single_output;
+                REQUIRE(run(bad, 1, single_output) == 2);
+                REQUIRE(run(bad, n, output) == 2);
+                REQUIRE(output == single_output);
+            }
+        }
+        SECTION("truncated, " + std::to_string(n) + " threads") {
+            std::string truncated = input + "\xF0\x9F\x98";
+            REQUIRE(run(truncated, n, output) == 2);
+            REQUIRE(output == expected);
+        }
+        SECTION("runs of continuation bytes, " + std::to_string(n) + " threads") {
+            // A long run of continuation bytes, so that the cuts can't find a boundary.
+            std::string bad = input.substr(0, 300 * 1024) + std::string(600 * 1024, '\x80');
+            std::string single_output;
+            REQUIRE(run(bad, 1, single_output) == 2);
+            REQUIRE(run(bad, n, output) == 2);
+            REQUIRE(output == single_output);
+        }
+    }
+#ifdef __linux__
+    SECTION("write error before a bad byte") {
+        // The output fails in the first chunk, so like read_and_escape we stop there with a
+        // write error and never report the bad byte in a later chunk of the same superblock.
+        std::string bad = std::string(600000, 'a') + "\xFF" + std::string(100, 'b');
+        for (unsigned int n : {1u, 4u}) {
+            StreamPair streams(ByteSource::from_string(bad), ByteSink::open_file("/dev/full"));
+            int retval = (n == 1) ? read_and_escape(streams) : parallel_read_and_escape(streams, n);
+            REQUIRE(retval == 4);
+        }
+    }
+#endif
+    SECTION("empty input") {
+        std::string output;
+        REQUIRE(run("", 4, output) == 0);
+        REQUIRE(output.empty());
+    }
+}
@@ -8,10 +8,13 @@
 #include <cstring> // std::size_t
 
 #include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/preserve_set.h"
 
 // Function prototypes for functions that aren't exposed through the headers
 bool strlen_atleast(const char *str, std::size_t len);
 int check_output_option(const char *arg);
+bool parse_count(const char *str, unsigned int max, unsigned int& count);
+bool parse_preserve(const char *str, PreserveSet& set);
 
 TEST_CASE("Test strlen_atleast", "[strlen_atleast]") {
     REQUIRE(strlen_atleast("foo", 0));
@@ -41,3 +44,70 @@ TEST_CASE("Test check_output_option", "[check_output_option]") {
     REQUIRE(check_output_option("-\no") == -1);
     REQUIRE(check_output_option("foo") == -1);
 }
+
+TEST_CASE("Test parse_count", "[parse_count]") {
+    unsigned int count = 42;
+    REQUIRE(parse_count("0", 10, count));
+    REQUIRE(count == 0);
+    REQUIRE(parse_count("10", 10, count));
+    REQUIRE(count == 10);
+    REQUIRE(parse_count("007", 10, count));
+    REQUIRE(count == 7);
+    count = 42;
+    REQUIRE_FALSE(parse_count("11", 10, count));
+    REQUIRE_FALSE(parse_count("", 10, count));
+    REQUIRE_FALSE(parse_count("-1", 10, count));
+    REQUIRE_FALSE(parse_count("+1", 10, count));
+    REQUIRE_FALSE(parse_count(" 1", 10, count));
+    REQUIRE_FALSE(parse_count("1 ", 10, count));
+    REQUIRE_FALSE(parse_count("99999999999999999999999", 10, count));
+    REQUIRE(count == 42);
+}
+
+TEST_CASE("Test parse_preserve", "[parse_preserve]") {
+    PreserveSet set;
+    REQUIRE(parse_preserve("default", set));
+    REQUIRE(set.is_default());
+    REQUIRE(parse_preserve("default,0x0B,0x0c", set));
+    REQUIRE_FALSE(set.is_default());
+    REQUIRE(set.contains(0x0B));
+    REQUIRE(set.contains(0x0C));
+    REQUIRE(set.contains('a'));
+    REQUIRE_FALSE(set.contains(0x01));
+    REQUIRE(parse_preserve("ascii", set));
+    REQUIRE(set.contains(0x00));
+    REQUIRE(set.contains(0x7F));
+    REQUIRE_FALSE(set.contains(0x80));
+    REQUIRE(parse_preserve("default,-\\,-'", set));
+    REQUIRE_FALSE(set.contains('\\'));
+    REQUIRE_FALSE(set.contains('\''));
+    REQUIRE(set.contains('a'));
+    REQUIRE(parse_preserve("0x61-0x7A,-,--,-0x6A-0x6B,0x2C", set));
+    REQUIRE(set.contains('a'));
+    REQUIRE(set.contains('z'));
+    REQUIRE_FALSE(set.contains('j'));
+    REQUIRE_FALSE(set.contains('k'));
+    REQUIRE_FALSE(set.contains('-')); // Added and then taken out again
+    REQUIRE(set.contains(','));
+    REQUIRE_FALSE(set.contains('A'));
+    REQUIRE(parse_preserve("ascii,-ascii,a", set));
+    REQUIRE(set.contains('a'));
+    REQUIRE_FALSE(set.contains('b'));
+    REQUIRE(parse_preserve("none", set));
+    REQUIRE_FALSE(set.contains('a'));
+
+    // None of these should change the set.
+    REQUIRE_FALSE(parse_preserve("", set));
+    REQUIRE_FALSE(parse_preserve("default,", set));
+    REQUIRE_FALSE(parse_preserve("defaults", set));
+    REQUIRE_FALSE(parse_preserve("0x80", set));
+    REQUIRE_FALSE(parse_preserve("0x", set));
+    REQUIRE_FALSE(parse_preserve("0x123", set));
+    REQUIRE_FALSE(parse_preserve("0xG1", set));
+    REQUIRE_FALSE(parse_preserve("0x7A-0x61", set));
+    REQUIRE_FALSE(parse_preserve("0x61-", set));
+    REQUIRE_FALSE(parse_preserve("\x01", set));
+    REQUIRE_FALSE(parse_preserve("\xC3\xA9", set));
+    REQUIRE_FALSE(set.contains('b'));
+    REQUIRE_FALSE(set.contains('a'));
+}
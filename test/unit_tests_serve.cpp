@@ -0,0 +1,234 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for --serve (serve.cpp) and its client (serve_client.cpp). The
+ * server runs in a thread of its own, on a socket in the temp directory.
+ */
+#ifdef __linux__
+
+#include <cstdio> // std::remove
+#include <cstring> // std::memcpy, std::memset
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/serve.h"
+#include "../src/serve_client.h"
+#include "test_helpers.h"
+
+/**
+ * Runs serve() in a thread of its own until it's destroyed.
+ */
+class ServerRunner {
+public:
+    explicit ServerRunner(const EscapeSettings& settings = EscapeSettings())
+            : path("/tmp/escape_unit_test_" + std::to_string(getpid()) + ".sock"), retval(-1) {
+        int listen_fd = open_serve_socket(path);
+        REQUIRE(listen_fd != -1);
+        REQUIRE(pipe(stop_pipe) == 0);
+        thread = std::thread([this, listen_fd, settings] {
+            retval = serve(listen_fd, settings, stop_pipe[0]);
+        });
+    }
+
+    ~ServerRunner() {
+        close(stop_pipe[1]);
+        thread.join();
+        close(stop_pipe[0]);
+        std::remove(path.c_str());
+        CHECK(retval == 0);
+    }
+
+    std::unique_ptr<ServeClient> connect() {
+        std::unique_ptr<ServeClient> client = ServeClient::connect(path);
+        REQUIRE(client);
+        return client;
+    }
+
+    const std::string path;
+
+private:
+    int stop_pipe[2];
+    std::thread thread;
+    int retval;
+};
+
+/**
+ * Connects to the server without a ServeClient, to send it things that ServeClient won't.
+ */
+static int raw_connect(const std::string& path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(fd != -1);
+    REQUIRE(connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0);
+    return fd;
+}
+
+/**
+ * Reads from fd until len bytes have been read or the connection is closed.
+ * @return The number of bytes read.
+ */
+static std::size_t read_fully(int fd, unsigned char *buf, std::size_t len) {
+    std::size_t total = 0;
+    while (total < len) {
+        ssize_t n = read(fd, buf + total, len - total);
+        if (n <= 0) {
+            break;
+        }
+        total += static_cast<std::size_t>(n);
+    }
+    return total;
+}
+
+TEST_CASE("Test serve", "[serve]") {
+    ServerRunner server;
+    std::unique_ptr<ServeClient> client = server.connect();
+    int status = -1;
+    std::string output;
+
+    SECTION("Valid input") {
+        REQUIRE(client->escape("\xC2\xA1Hola mundo! \xF0\x9F\x98\x82\n", status, output));
+        REQUIRE(status == SERVE_OK);
+        REQUIRE(output == "\\u'00A1'Hola mundo! \\u'1F602'\n");
+        // The connection can be used again.
+        REQUIRE(client->escape("caf\xC3\xA9", status, output));
+        REQUIRE(status == SERVE_OK);
+        REQUIRE(output == "caf\\u'00E9'");
+    }
+    SECTION("Empty input") {
+        REQUIRE(client->escape("", status, output));
+        REQUIRE(status == SERVE_OK);
+        REQUIRE(output.empty());
+    }
+    SECTION("Invalid input") {
+        REQUIRE(client->escape("\xC3\xA9t\xC3" "foo", status, output));
+        REQUIRE(status == SERVE_INVALID_UTF8);
+        REQUIRE(output == "\\u'00E9't");
+        // An invalid input doesn't affect the next one.
+        REQUIRE(client->escape("\xC3\xA9", status, output));
+        REQUIRE(status == SERVE_OK);
+        REQUIRE(output == "\\u'00E9'");
+        // Neither does one that ends in the middle of a character.
+        REQUIRE(client->escape("ab\xE2\x82", status, output));
+        REQUIRE(status == SERVE_INVALID_UTF8);
+        REQUIRE(output == "ab");
+        REQUIRE(client->escape("\xAC", status, output));
+        REQUIRE(status == SERVE_INVALID_UTF8);
+        REQUIRE(output.empty());
+    }
+    SECTION("Pipelined requests") {
+        std::vector<std::string> inputs;
+        for (int i = 0; i < 100; ++i) {
+            inputs.push_back(std::to_string(i) + "\xE2\x82\xAC");
+            REQUIRE(client->send_request(bytes(inputs.back()), inputs.back().size()));
+        }
+        for (int i = 0; i < 100; ++i) {
+            REQUIRE(client->receive_response(status, output));
+            REQUIRE(status == SERVE_OK);
+            REQUIRE(output == std::to_string(i) + "\\u'20AC'");
+        }
+    }
+    SECTION("Large input") {
+        // Much more than the server reads at once, and much more output than a socket buffers,
+        // so the server has to wait for the client to read some of it.
+        std::string input;
+        std::string expected;
+        for (int i = 0; i < 200000; ++i) {
+            input += "a\xE6\x97\xA5";
+            expected += "a\\u'65E5'";
+        }
+        REQUIRE(client->escape(input, status, output));
+        REQUIRE(status == SERVE_OK);
+        REQUIRE(output == expected);
+    }
+    SECTION("Several clients at once") {
+        std::vector<std::unique_ptr<ServeClient>> clients;
+        for (int c = 0; c < 8; ++c) {
+            clients.push_back(server.connect());
+            const std::string input = std::to_string(c) + "\xC3\xB1";
+            REQUIRE(clients.back()->send_request(bytes(input), input.size()));
+        }
+        // Answer them in the opposite order; none of them waits for another.
+        for (int c = 7; c >= 0; --c) {
+            REQUIRE(clients[c]->receive_response(status, output));
+            REQUIRE(status == SERVE_OK);
+            REQUIRE(output == std::to_string(c) + "\\u'00F1'");
+        }
+        // The first client still works too.
+        REQUIRE(client->escape("x", status, output));
+        REQUIRE(output == "x");
+    }
+    SECTION("Clients on threads") {
+        std::vector<std::thread> threads;
+        std::vector<int> failures(4, 0);
+        for (int c = 0; c < 4; ++c) {
+            threads.emplace_back([&server, &failures, c] {
+                std::unique_ptr<ServeClient> own = ServeClient::connect(server.path);
+                int own_status;
+                std::string own_output;
+                for (int i = 0; i < 200; ++i) {
+                    const std::string input = std::to_string(c * 1000 + i) + "\xCE\xA9";
+                    if (!own || !own->escape(input, own_status, own_output) || own_status != SERVE_OK ||
+                        own_output != std::to_string(c * 1000 + i) + "\\u'03A9'") {
+                        ++failures[c];
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(failures == std::vector<int>(4, 0));
+    }
+    SECTION("Request too long") {
+        // ServeClient won't send this, so it's done by hand. Only the header is sent; the
+        // server shouldn't wait for the input.
+        int fd = raw_connect(server.path);
+        const unsigned char header[4] = {0x01, 0x00, 0x00, 0x01};
+        REQUIRE(SERVE_MAX_REQUEST + 1 == 0x01000001);
+        REQUIRE(write(fd, header, sizeof(header)) == 4);
+        unsigned char response[6];
+        REQUIRE(read_fully(fd, response, sizeof(response)) == 5);
+        REQUIRE(response[0] == SERVE_TOO_LONG);
+        REQUIRE(response[1] == 0);
+        REQUIRE(response[2] == 0);
+        REQUIRE(response[3] == 0);
+        REQUIRE(response[4] == 0);
+        close(fd);
+        // The other connections aren't affected.
+        REQUIRE(client->escape("ok", status, output));
+        REQUIRE(status == SERVE_OK);
+        REQUIRE(output == "ok");
+    }
+    SECTION("Client goes away in the middle of a request") {
+        int fd = raw_connect(server.path);
+        const unsigned char partial[6] = {0x00, 0x00, 0x00, 0x10, 'a', 'b'};
+        REQUIRE(write(fd, partial, sizeof(partial)) == 6);
+        close(fd);
+        REQUIRE(client->escape("ok", status, output));
+        REQUIRE(output == "ok");
+    }
+}
+
+TEST_CASE("Test serve with other settings", "[serve]") {
+    ServerRunner server(EscapeSettings(EscapeFormat::Json));
+    std::unique_ptr<ServeClient> client = server.connect();
+    int status = -1;
+    std::string output;
+    REQUIRE(client->escape("\xC2\xA1" "a\xF0\x9F\x98\x82", status, output));
+    REQUIRE(status == SERVE_OK);
+    REQUIRE(output == "\\u00A1a\\uD83D\\uDE02");
+}
+
+#endif
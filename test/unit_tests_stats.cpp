@@ -0,0 +1,107 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for EscapeStats in stats.cpp, and for the counting that each way
+ * of escaping does for it.
+ */
+#include <cstdint> // uint_fast64_t
+#include <cstring> // std::size_t
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/StreamPair.h"
+#include "../src/ascii_scan.h" // active_kernel_tier
+#include "../src/business_logic.h"
+#include "../src/parallel_escape.h"
+#include "../src/stats.h"
+
+/**
+ * Runs either read_and_escape (if num_threads is 1) or parallel_read_and_escape on input,
+ * with strings in place of the files, and counts into stats.
+ */
+static int run(const std::string& input, unsigned int num_threads, std::string& output, EscapeStats& stats) {
+    StreamPair streams(ByteSource::from_string(input), ByteSink::to_string());
+    int retval = (num_threads == 1) ? read_and_escape(streams, EscapeSettings(), false, &stats)
+                                    : parallel_read_and_escape(streams, num_threads, EscapeSettings(), &stats);
+    output = streams.out.contents();
+    return retval;
+}
+
+TEST_CASE("Test the counts in EscapeStats", "[EscapeStats]") {
+    // "a", U+00E9 (2 bytes), U+20AC (3 bytes), U+1F602 (4 bytes), a control character, and some
+    // ASCII, in random order. The input is several blocks (and several chunks) long.
+    const char *pieces[] = {"a", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x82", "\x01", "hello world "};
+    std::uint_fast64_t counts[6] = {};
+    std::mt19937 rng(2026);
+    std::string input;
+    while (input.size() < 3 * 1024 * 1024) {
+        unsigned int k = rng() % 6;
+        input += pieces[k];
+        ++counts[k];
+    }
+
+    unsigned int thread_counts[] = {1, 3};
+    for (unsigned int n : thread_counts) {
+        SECTION(std::to_string(n) + " threads") {
+            EscapeStats stats;
+            std::string output;
+            REQUIRE(run(input, n, output, stats) == 0);
+            REQUIRE(stats.bytes_in == input.size());
+            REQUIRE(stats.bytes_out == output.size());
+            REQUIRE(stats.passed_through == counts[0] + 12 * counts[5]);
+            REQUIRE(stats.escaped[0] == counts[4]);
+            REQUIRE(stats.escaped[1] == counts[1]);
+            REQUIRE(stats.escaped[2] == counts[2]);
+            REQUIRE(stats.escaped[3] == counts[3]);
+            double phases = stats.phase_seconds[0] + stats.phase_seconds[1] + stats.phase_seconds[2];
+            REQUIRE(stats.phase_seconds[1] > 0);
+            REQUIRE(phases <= stats.total_seconds + 1e-9);
+        }
+    }
+    SECTION("invalid input") {
+        // The stats are still finished, with the counts up to the bad byte.
+        EscapeStats stats;
+        std::string output;
+        REQUIRE(run("ab\xC3\xA9\x01\xFF" "cd", 1, output, stats) == 2);
+        REQUIRE(stats.bytes_in == 6);
+        REQUIRE(stats.bytes_out == output.size());
+        REQUIRE(stats.escaped[0] == 1);
+        REQUIRE(stats.escaped[1] == 1);
+    }
+}
+
+TEST_CASE("Test the EscapeStats reports", "[EscapeStats]") {
+    EscapeState state;
+    state.num_bytes_read = 100;
+    state.num_escaped[0] = 5;
+    state.num_escaped[1] = 4;
+    state.num_escaped[2] = 3;
+    state.num_escaped[3] = 2;
+    EscapeStats stats;
+    stats.add_output(250);
+    stats.lap(Phase::Escape);
+    stats.finish(state);
+    // 100 bytes, less 5 + 2 * 4 + 3 * 3 + 4 * 2 = 30 bytes of escaped characters.
+    REQUIRE(stats.passed_through == 70);
+
+    std::ostringstream text;
+    stats.print(text);
+    REQUIRE(text.str().find("Bytes in:              100\n") != std::string::npos);
+    REQUIRE(text.str().find("Bytes out:             250\n") != std::string::npos);
+    REQUIRE(text.str().find("ASCII passed through:  70\n") != std::string::npos);
+    REQUIRE(text.str().find("4-byte characters:     2\n") != std::string::npos);
+    REQUIRE(text.str().find("MB/s\n") != std::string::npos);
+    REQUIRE(text.str().find(std::string("Kernel:                ") + kernel_tier_name(active_kernel_tier()) + "\n") != std::string::npos);
+
+    std::ostringstream json;
+    stats.write_json(json);
+    REQUIRE(json.str().find("{\"bytes_in\": 100, \"bytes_out\": 250, \"ascii_passed_through\": 70, ") == 0);
+    REQUIRE(json.str().find("\"ascii_escaped\": 5, \"two_byte_chars\": 4, \"three_byte_chars\": 3, \"four_byte_chars\": 2, ") != std::string::npos);
+    REQUIRE(json.str().find(std::string(", \"kernel\": \"") + kernel_tier_name(active_kernel_tier()) + "\"}\n") != std::string::npos);
+    REQUIRE(json.str().back() == '\n');
+}
@@ -0,0 +1,180 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for stream_escape in streaming.cpp. The input and the output are
+ * pipes, like in "tail -f app.log | escape --line-buffered | shipper".
+ */
+#ifdef __linux__
+
+#include <cstring> // std::size_t
+#include <string>
+#include <thread>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/streaming.h"
+
+/**
+ * Runs stream_escape in a thread of its own, reading from one pipe and writing to another.
+ */
+class StreamRunner {
+public:
+    StreamRunner(bool line_buffered, long max_latency_ms) : retval(-1) {
+        REQUIRE(pipe(in_pipe) == 0);
+        REQUIRE(pipe(out_pipe) == 0);
+        thread = std::thread([this, line_buffered, max_latency_ms] {
+            retval = stream_escape(in_pipe[0], out_pipe[1], EscapeSettings(), line_buffered, max_latency_ms);
+            close(out_pipe[1]);
+        });
+    }
+
+    ~StreamRunner() {
+        finish_input();
+        read_all();
+        close(in_pipe[0]);
+        close(out_pipe[0]);
+    }
+
+    /**
+     * Writes to the input. This doesn't use REQUIRE, so that it can be called from another thread.
+     */
+    bool write_input(const std::string& data) {
+        return write(in_pipe[1], data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    }
+
+    void finish_input() {
+        if (in_pipe[1] != -1) {
+            close(in_pipe[1]);
+            in_pipe[1] = -1;
+        }
+    }
+
+    /**
+     * Returns the output that shows up within timeout_ms milliseconds. Stops early if the
+     * output is closed, or once it's at least min_len bytes long.
+     */
+    std::string read_output(int timeout_ms, std::size_t min_len) {
+        std::string output;
+        while (output.size() < min_len) {
+            pollfd fds;
+            fds.fd = out_pipe[0];
+            fds.events = POLLIN;
+            fds.revents = 0;
+            if (poll(&fds, 1, timeout_ms) <= 0) {
+                break;
+            }
+            char buf[4096];
+            ssize_t len = read(out_pipe[0], buf, sizeof(buf));
+            if (len <= 0) {
+                break;
+            }
+            output.append(buf, static_cast<std::size_t>(len));
+        }
+        return output;
+    }
+
+    /**
+     * Returns the rest of the output, up to the end, and waits for stream_escape to return.
+     */
+    std::string read_all() {
+        std::string output = read_output(-1, static_cast<std::size_t>(-1));
+        if (thread.joinable()) {
+            thread.join();
+        }
+        return output;
+    }
+
+    int result() const { return retval; }
+
+private:
+    int in_pipe[2];
+    int out_pipe[2];
+    std::thread thread;
+    int retval;
+};
+
+static const std::string PIECE("H\xC3\xA9llo, w\xF0\x9F\x98\x82rld!\n\x01");
+static const std::string ESCAPED_PIECE("H\\u'00E9'llo, w\\u'1F602'rld!\n\\u'0001'");
+
+TEST_CASE("Test stream_escape output", "[stream_escape]") {
+    std::string input;
+    std::string expected;
+    for (int i = 0; i < 20000; ++i) {
+        input += PIECE;
+        expected += ESCAPED_PIECE;
+    }
+    const bool line_modes[] = {false, true};
+    const long latencies[] = {-1, 0, 5};
+    for (bool line_buffered : line_modes) {
+        for (long max_latency_ms : latencies) {
+            {
+                StreamRunner runner(line_buffered, max_latency_ms);
+                // The input is much bigger than a pipe holds, so it's fed from another thread.
+                // The writes are odd-sized, so that characters get split between reads.
+                std::thread feeder([&runner, &input] {
+                    for (std::size_t i = 0; i < input.size(); i += 997) {
+                        runner.write_input(input.substr(i, 997));
+                    }
+                    runner.finish_input();
+                });
+                std::string output = runner.read_all();
+                feeder.join();
+                REQUIRE(output == expected);
+                REQUIRE(runner.result() == 0);
+            }
+            {
+                StreamRunner runner(line_buffered, max_latency_ms);
+                REQUIRE(runner.write_input(PIECE + "ab\xFF" "cd\n"));
+                REQUIRE(runner.read_all() == ESCAPED_PIECE + "ab");
+                REQUIRE(runner.result() == 2);
+            }
+            {
+                // The input ends in the middle of a character.
+                StreamRunner runner(line_buffered, max_latency_ms);
+                REQUIRE(runner.write_input(PIECE + "\xF0\x9F"));
+                runner.finish_input();
+                REQUIRE(runner.read_all() == ESCAPED_PIECE);
+                REQUIRE(runner.result() == 2);
+            }
+        }
+    }
+}
+
+TEST_CASE("Test that stream_escape writes before the input ends", "[stream_escape]") {
+    SECTION("--line-buffered") {
+        StreamRunner runner(true, -1);
+        REQUIRE(runner.write_input("first\xC3\xA9\nsecond"));
+        // The timeouts are long so that a slow machine doesn't fail the test; the output should
+        // really show up within a millisecond or so.
+        REQUIRE(runner.read_output(5000, 16) == "first\\u'00E9'\n");
+        // The rest of the line waits for its line feed.
+        REQUIRE(runner.read_output(200, 1).empty());
+        REQUIRE(runner.write_input(" line\nthird"));
+        REQUIRE(runner.read_output(5000, 12) == "second line\n");
+        runner.finish_input();
+        REQUIRE(runner.read_all() == "third");
+        REQUIRE(runner.result() == 0);
+    }
+    SECTION("--max-latency-ms") {
+        StreamRunner runner(false, 20);
+        REQUIRE(runner.write_input("no line feed \xC3\xA9"));
+        REQUIRE(runner.read_output(5000, 21) == "no line feed \\u'00E9'");
+        runner.finish_input();
+        REQUIRE(runner.read_all().empty());
+        REQUIRE(runner.result() == 0);
+    }
+    SECTION("Neither") {
+        // This is the normal behavior: the output waits for a full buffer or the end of the input.
+        StreamRunner runner(false, -1);
+        REQUIRE(runner.write_input("a line\n"));
+        REQUIRE(runner.read_output(200, 1).empty());
+        runner.finish_input();
+        REQUIRE(runner.read_all() == "a line\n");
+    }
+}
+
+#endif
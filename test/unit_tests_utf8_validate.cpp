@@ -0,0 +1,141 @@
+//
+// Created by Vicram on 10/17/2026.
+//
+
+/*
+ * This file contains tests for utf8_valid and validate_block in utf8_validate.cpp. The DFA
+ * behind escape_block is the reference: both functions have to agree with it about whether
+ * the input is valid and (for validate_block) about where the first invalid byte is. Every
+ * kernel tier that this CPU supports gets the same inputs.
+ */
+#include <algorithm> // std::min
+#include <cstddef> // std::size_t
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../Catch2/single_include/catch2/catch.hpp"
+#include "../src/escape_kernel.h"
+#include "../src/utf8_validate.h"
+#include "kernel_tiers.h"
+#include "test_helpers.h"
+
+/**
+ * Runs escape_block on the whole input and returns its final state.
+ */
+static EscapeState reference(const std::string& input) {
+    EscapeState state;
+    std::vector<unsigned char> out(escape_output_bound(input.size()));
+    escape_block(state, bytes(input), input.size(), out.data());
+    return state;
+}
+
+/**
+ * Runs validate_block on the input, split into blocks of the given size, and returns the final state.
+ */
+static EscapeState validate_in_blocks(const std::string& input, std::size_t block_size) {
+    EscapeState state;
+    for (std::size_t i = 0; i < input.size() && !state.invalid; i += block_size) {
+        validate_block(state, bytes(input) + i, std::min(block_size, input.size() - i));
+    }
+    return state;
+}
+
+/**
+ * Checks that utf8_valid and validate_block (with several block sizes) agree with the reference.
+ */
+static void check_against_reference(const std::string& input) {
+    EscapeState expected = reference(input);
+    bool expected_valid = !expected.invalid && expected.at_boundary();
+    REQUIRE(utf8_valid(bytes(input), input.size()) == expected_valid);
+    std::size_t block_sizes[] = {1, 2, 3, 5, 64, 100, input.size() + 1};
+    for (std::size_t block_size : block_sizes) {
+        EscapeState state = validate_in_blocks(input, block_size);
+        REQUIRE(state.invalid == expected.invalid);
+        REQUIRE(state.num_bytes_read == expected.num_bytes_read);
+        if (!expected.invalid) {
+            REQUIRE(state.at_boundary() == expected.at_boundary());
+        }
+    }
+}
+
+TEST_CASE("Test utf8_valid on known inputs", "[utf8_validate]") {
+    for (KernelTier tier : available_tiers()) {
+        SECTION(kernel_tier_name(tier)) {
+            TierGuard guard(tier);
+            std::string padding(70, 'x'); // So the interesting bytes also end up past the first vector.
+            const char *valid[] = {
+                "", "a", "\xC2\x80", "\xDF\xBF", "\xE0\xA0\x80", "\xED\x9F\xBF", "\xEE\x80\x80", "\xEF\xBF\xBF",
+                "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF", "Hi \xE2\x82\xAC \xF0\x9F\x98\x82\x01\x7F",
+            };
+            const char *invalid[] = {
+                "\x80", "\xBF", "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF", // Stray continuation bytes and overlong forms
+                "\xED\xA0\x80", "\xED\xBF\xBF",                                         // Surrogates
+                "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xF7\xBF\xBF\xBF", "\xF8", "\xFF", // Above U+10FFFF, and bytes that never appear
+                "\xF0\x80\x80\x80", "\xF0\x8F\xBF\xBF",                                 // Overlong 4-byte forms
+                "\xC2", "\xE2\x82", "\xF0\x9F\x98", "\xC2" "a", "\xE2\x82" "a",         // Too short
+                "\xC2\x80\x80", "\xF0\x9F\x98\x82\x82",                                 // Too long
+            };
+            for (const char *text : valid) {
+                std::string str(text);
+                REQUIRE(utf8_valid(bytes(str), str.size()));
+                REQUIRE(utf8_valid(bytes(padding + str), padding.size() + str.size()));
+                REQUIRE(utf8_valid(bytes(padding + str + padding), 2 * padding.size() + str.size()));
+                check_against_reference(padding + str);
+            }
+            for (const char *text : invalid) {
+                std::string str(text);
+                REQUIRE_FALSE(utf8_valid(bytes(str), str.size()));
+                REQUIRE_FALSE(utf8_valid(bytes(padding + str), padding.size() + str.size()));
+                REQUIRE_FALSE(utf8_valid(bytes(padding + str + padding), 2 * padding.size() + str.size()));
+                check_against_reference(str);
+                check_against_reference(padding + str + padding);
+            }
+            // A character at every position in and around the 64-byte blocks, some of which
+            // are all ASCII, and the rest of which aren't.
+            const std::string ascii(200, 'y');
+            for (std::size_t pos = 0; pos <= 140; ++pos) {
+                for (const char *text : {"\xE2\x82\xAC", "\xF0\x9F\x98\x82"}) {
+                    REQUIRE(utf8_valid(bytes(ascii.substr(0, pos) + text + ascii), pos + std::string(text).size() + ascii.size()));
+                }
+                for (const char *text : {"\xC0\x80", "\xED\xA0\x80", "\x80", "\xE2\x82"}) {
+                    check_against_reference(ascii.substr(0, pos) + text + ascii);
+                    check_against_reference(ascii.substr(0, pos) + text);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Test validate_block against the reference on random inputs", "[utf8_validate]") {
+    for (KernelTier tier : available_tiers()) {
+        SECTION(kernel_tier_name(tier)) {
+            TierGuard guard(tier);
+            // Random valid text with characters of every length, and then a few random bytes changed,
+            // which makes for a lot of different kinds of invalid input.
+            std::mt19937 rng(11);
+            const char *pieces[] = {"a", "abcdefghijklmnopqrstuvwxyz ", "\n", "\xC3\xA9", "\xE2\x82\xAC", "\xED\x9F\xBF",
+                                    "\xF0\x9F\x98\x82", "\xF4\x8F\xBF\xBF", "\x01"};
+            const unsigned char interesting[] = {0x00, 0x41, 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xC1, 0xC2,
+                                                 0xDF, 0xE0, 0xED, 0xEF, 0xF0, 0xF4, 0xF5, 0xFF};
+            for (int iteration = 0; iteration < 300; ++iteration) {
+                std::string input;
+                std::size_t target = rng() % 500;
+                while (input.size() < target) {
+                    input += pieces[rng() % (sizeof(pieces) / sizeof(pieces[0]))];
+                }
+                check_against_reference(input);
+                if (input.empty()) {
+                    continue;
+                }
+                int changes = static_cast<int>(rng() % 3) + 1;
+                for (int c = 0; c < changes; ++c) {
+                    input[rng() % input.size()] = static_cast<char>(interesting[rng() % sizeof(interesting)]);
+                }
+                check_against_reference(input);
+                // And the same with the input cut off at a random point, which is often mid-character.
+                check_against_reference(input.substr(0, rng() % input.size()));
+            }
+        }
+    }
+}